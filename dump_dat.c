@@ -1,74 +1,295 @@
 /* dump_dat.c */
+// 讀取任何版本的 server.dat (格式見 src/common/include/snapshot_format.h)：
+//   版本 2 起：只讀檔頭與區段表，各區段以固定大小的區塊串流讀取並同時計算 CRC，檔案再大也只用固定記憶體
+//   版本 1：第一版程式寫出的 SharedState 原始傾印 (依凍結的 SnapshotV1State 解碼)
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
-#include "src/common/include/shared_data.h" 
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "src/common/include/shared_data.h"
+#include "src/common/include/snapshot_format.h"
 
 #define DATA_FILE "server.dat"
+#define STREAM_CHUNK (64 * 1024)    // 串流讀取的區塊大小
 
-int main() {
-    int fd = open(DATA_FILE, O_RDONLY);
-    if (fd == -1) {
-        printf("Error: Could not open %s. Please ensure the server has run and shut down gracefully.\n", DATA_FILE);
-        return 1;
-    }
+// 司機狀態統計 (邊讀邊累加)
+typedef struct {
+    uint64_t index;
+    int available;
+    int busy;
+    int refueling;
+} DriverTally;
 
-    SharedState state;
-    // read
-    if (read(fd, &state, sizeof(SharedState)) != sizeof(SharedState)) {
-        printf("Error: File size mismatch. The save file might be corrupted or created by an incompatible version.\n");
-        close(fd);
-        return 1;
-    }
-    close(fd);
+typedef void (*RecordVisitor)(const uint8_t *rec, uint32_t record_size, void *ctx);
 
+static void print_summary(int version, uint64_t journal_lsn, int64_t created_at,
+                          const SnapshotCounters *c, const SnapshotStatsRecord *s) {
     printf("======================================\n");
     printf("        Server State Dump Report      \n");
     printf("======================================\n");
-    printf("Total Requests Handled : %ld\n", state.total_requests_handled);
-    printf("Total Success Requests : %ld\n", state.total_success_requests);
-    printf("Total Revenue          : \033[1;32m$%ld\033[0m\n", state.total_revenue); 
-    printf("Active Driver Count    : %d\n", state.driver_count);
+    if (version >= 2) {
+        time_t t = (time_t)created_at;
+        char when[64];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        printf("Snapshot Format        : v%d (written %s)\n", version, when);
+    } else {
+        printf("Snapshot Format        : v%d (raw SharedState dump)\n", version);
+    }
+    printf("Total Requests Handled : %lu\n", c->total_requests_handled);
+    printf("Total Success Requests : %lu\n", c->total_success_requests);
+    printf("Total Revenue          : \033[1;32m$%ld\033[0m\n", c->total_revenue);
+    printf("Active Driver Count    : %u\n", c->driver_count);
+    printf("Journal LSN            : %lu (records after this are replayed from server.wal)\n", journal_lsn);
+    printf("Connections Admitted   : %lu\n", c->total_connections_accepted);
+    if (s != NULL) {
+        printf("Background Snapshots   : %lu taken, %lu failed (every %u s); stall last %.3f / max %.3f ms, last write %.1f ms\n",
+               s->snapshots_taken, s->snapshots_failed, s->snapshot_interval_secs,
+               s->snapshot_last_stall_ms, s->snapshot_max_stall_ms, s->snapshot_last_write_ms);
+        printf("Connections Rejected   : %lu (before handshake)\n", s->peer_blocked);
+        printf("Rate Limit Blocked     : %lu\n", s->rate_limit_blocked);
+        printf("Location Updates       : %lu received, %lu applied, %lu stale, %lu rejected (%lu batches)\n",
+               s->loc_received, s->loc_applied, s->loc_stale, s->loc_rejected, s->loc_batches);
+        printf("Driver Push Channels   : %u connected, %lu attaches, %lu posted (%lu offline), %lu delivered\n",
+               s->push_connected, s->push_attaches, s->push_posted, s->push_offline, s->push_delivered);
+        printf("Tickets Issued/Resumed : %lu / %lu (rejected %lu)\n", s->tickets_issued, s->tickets_resumed, s->tickets_rejected);
+    }
     printf("--------------------------------------\n");
     printf("Driver List (First 5 Details):\n");
-    
-    int available_drivers = 0;
-    int refueling_drivers = 0;
-    int busy_drivers = 0;
-
-    for (int i = 0; i < state.driver_count; i++) {
-        const char *status_str;
-        
-        if (state.drivers[i].is_refueling) {
-            status_str = "\033[1;34mREFUELING\033[0m"; // 藍色
-            refueling_drivers++;
-        } else if (state.drivers[i].is_available) {
-            status_str = "\033[1;32mAVAILABLE\033[0m"; // 綠色
-            available_drivers++;
-        } else {
-            status_str = "\033[1;31mBUSY\033[0m";      // 紅色
-            busy_drivers++;
+}
+
+static void tally_driver(const uint8_t *rec, uint32_t record_size, void *ctx) {
+    (void)record_size;
+    DriverTally *t = ctx;
+    const SnapshotDriver *d = (const SnapshotDriver *)rec;
+    const char *status_str;
+
+    if (d->is_refueling) {
+        status_str = "\033[1;34mREFUELING\033[0m"; // 藍色
+        t->refueling++;
+    } else if (d->is_available) {
+        status_str = "\033[1;32mAVAILABLE\033[0m"; // 綠色
+        t->available++;
+    } else {
+        status_str = "\033[1;31mBUSY\033[0m";      // 紅色
+        t->busy++;
+    }
+
+    if (t->index < 5) {
+        printf("  [%lu] ID: %u, Status: %s, Rides: %d, Fuel: %d/10\n",
+               t->index, d->driver_id, status_str, d->rides_count, d->fuel);
+    }
+    t->index++;
+}
+
+static void print_tally(const DriverTally *t) {
+    if (t->index > 5) printf("  ... (%lu more drivers hidden)\n", t->index - 5);
+    printf("--------------------------------------\n");
+    printf("Summary:\n");
+    printf(" - AVAILABLE : %d\n", t->available);
+    printf(" - BUSY      : %d\n", t->busy);
+    printf(" - REFUELING : %d\n", t->refueling);
+    printf("--------------------------------------\n");
+    printf("Zone Supply / Demand:\n");
+}
+
+static void print_zone(const uint8_t *rec, uint32_t record_size, void *ctx) {
+    (void)record_size;
+    int *z = ctx;
+    const SnapshotZone *zone = (const SnapshotZone *)rec;
+    printf("  Zone %d: Available %d, Busy %d, Demand %.1f\n", (*z)++, zone->available_drivers, zone->busy_drivers, zone->demand);
+}
+
+// 單筆記錄的區段 (計數器 / 統計)：複製認得的前綴，較新版本多出的欄位略過
+typedef struct {
+    void *out;
+    size_t size;
+} PrefixCopy;
+
+static void copy_prefix(const uint8_t *rec, uint32_t record_size, void *ctx) {
+    PrefixCopy *p = ctx;
+    memcpy(p->out, rec, record_size < p->size ? record_size : p->size);
+    p->size = 0; // 只取第一筆
+}
+
+static int read_at(int fd, void *buf, size_t len, off_t offset) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+ * 以固定大小的區塊讀完整個區段，逐筆交給 visit (可為 NULL)，同時計算 CRC。
+ * return 0 = CRC 相符, 1 = CRC 不符, -1 = 讀取失敗
+ */
+static int stream_section(int fd, const SnapshotSection *sec, RecordVisitor visit, void *ctx) {
+    size_t per_chunk = STREAM_CHUNK / sec->record_size;
+    if (per_chunk == 0) per_chunk = 1;
+    size_t chunk = per_chunk * sec->record_size;
+    uint8_t *buf = malloc(chunk);
+    if (buf == NULL) return -1;
+
+    uint32_t crc = 0;
+    uint64_t done = 0;
+    int result = 0;
+    while (done < sec->length) {
+        size_t n = sec->length - done < chunk ? (size_t)(sec->length - done) : chunk;
+        if (read_at(fd, buf, n, (off_t)(sec->offset + done)) < 0) {
+            result = -1;
+            break;
+        }
+        crc = snapshot_crc32(crc, buf, n);
+        if (visit != NULL) {
+            for (size_t off = 0; off < n; off += sec->record_size) visit(buf + off, sec->record_size, ctx);
         }
+        done += n;
+    }
+    free(buf);
+    if (result == 0 && crc != sec->crc) result = 1;
+    return result;
+}
+
+static const char *section_name(uint32_t id) {
+    switch (id) {
+        case SNAPSHOT_SEC_COUNTERS: return "counters";
+        case SNAPSHOT_SEC_DRIVERS:  return "drivers";
+        case SNAPSHOT_SEC_ZONES:    return "zones";
+        case SNAPSHOT_SEC_STATS:    return "stats";
+        default:                    return "(unknown)";
+    }
+}
 
-        if (i < 5) {
-            printf("  [%d] ID: %d, Status: %s, Rides: %d, Fuel: %d/10\n", 
-                   i, 
-                   state.drivers[i].driver_id, 
-                   status_str,
-                   state.drivers[i].rides_count,      
-                   state.drivers[i].fuel
-                   );
+static int dump_sections(int fd, uint64_t file_size) {
+    SnapshotFileHeader hdr;
+    SnapshotSection sections[SNAPSHOT_MAX_SECTIONS];
+    if (read_at(fd, &hdr, sizeof(hdr), 0) < 0) {
+        printf("Error: Truncated snapshot header.\n");
+        return 1;
+    }
+    if (hdr.section_count > SNAPSHOT_MAX_SECTIONS ||
+        read_at(fd, sections, hdr.section_count * sizeof(SnapshotSection), sizeof(hdr)) < 0) {
+        printf("Error: Bad or truncated section table.\n");
+        return 1;
+    }
+    const char *why = snapshot_header_check(&hdr, sections, file_size);
+    if (why != NULL) {
+        printf("Error: Invalid snapshot (%s).\n", why);
+        return 1;
+    }
+
+    int status[SNAPSHOT_MAX_SECTIONS];
+    for (uint32_t i = 0; i < hdr.section_count; i++) status[i] = -2; // 尚未讀取
+
+    // 1. 先讀小的單筆區段，印出摘要
+    SnapshotCounters counters;
+    SnapshotStatsRecord stats;
+    memset(&counters, 0, sizeof(counters));
+    memset(&stats, 0, sizeof(stats));
+    int have_stats = 0;
+    for (uint32_t i = 0; i < hdr.section_count; i++) {
+        PrefixCopy copy;
+        if (sections[i].id == SNAPSHOT_SEC_COUNTERS) {
+            copy.out = &counters;
+            copy.size = sizeof(counters);
+        } else if (sections[i].id == SNAPSHOT_SEC_STATS) {
+            copy.out = &stats;
+            copy.size = sizeof(stats);
+            have_stats = 1;
+        } else {
+            continue;
         }
+        status[i] = stream_section(fd, &sections[i], copy_prefix, &copy);
     }
-    if (state.driver_count > 5) printf("  ... (%d more drivers hidden)\n", state.driver_count - 5);
+    print_summary((int)hdr.version, hdr.journal_lsn, hdr.created_at, &counters, have_stats ? &stats : NULL);
+
+    // 2. 司機表與區域串流輸出
+    DriverTally tally;
+    memset(&tally, 0, sizeof(tally));
+    const SnapshotSection *sec = snapshot_find_section(&hdr, sections, SNAPSHOT_SEC_DRIVERS, sizeof(SnapshotDriver));
+    if (sec != NULL) status[sec - sections] = stream_section(fd, sec, tally_driver, &tally);
+    print_tally(&tally);
+
+    int zone = 0;
+    sec = snapshot_find_section(&hdr, sections, SNAPSHOT_SEC_ZONES, sizeof(SnapshotZone));
+    if (sec != NULL) status[sec - sections] = stream_section(fd, sec, print_zone, &zone);
+
+    // 3. 其餘 (較新版本才有的) 區段只驗證
+    int bad = 0;
     printf("--------------------------------------\n");
-    printf("Summary:\n");
-    printf(" - AVAILABLE : %d\n", available_drivers);
-    printf(" - BUSY      : %d\n", busy_drivers);
-    printf(" - REFUELING : %d\n", refueling_drivers);
+    printf("Sections (%u):\n", hdr.section_count);
+    for (uint32_t i = 0; i < hdr.section_count; i++) {
+        if (status[i] == -2) status[i] = stream_section(fd, &sections[i], NULL, NULL);
+        const char *result = status[i] == 0 ? "\033[1;32mOK\033[0m" :
+                             status[i] == 1 ? "\033[1;31mCRC MISMATCH\033[0m" : "\033[1;31mREAD ERROR\033[0m";
+        if (status[i] != 0) bad = 1;
+        printf("  #%u %-10s @%-8lu %lu x %u bytes, crc %08x %s\n", sections[i].id, section_name(sections[i].id),
+               sections[i].offset, sections[i].record_count, sections[i].record_size, sections[i].crc, result);
+    }
     printf("======================================\n");
+    return bad;
+}
+
+static int dump_raw(int fd, uint64_t file_size) {
+    if (file_size != SNAPSHOT_V1_SIZE) {
+        printf("Error: Unknown format. A raw (v1) dump must be exactly %d bytes, got %lu.\n", SNAPSHOT_V1_SIZE, file_size);
+        return 1;
+    }
+    const void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        printf("Error: mmap failed: %s\n", strerror(errno));
+        return 1;
+    }
+    static SnapshotImage image;
+    const char *why = snapshot_v1_decode(map, file_size, &image);
+    munmap((void *)map, file_size);
+    if (why != NULL) {
+        printf("Error: v1 dump rejected: %s.\n", why);
+        return 1;
+    }
 
+    // 版本 1 沒有區域與統計 (區域在載入時依司機重建)
+    print_summary(SNAPSHOT_VERSION_RAW, 0, 0, &image.counters, NULL);
+    DriverTally tally;
+    memset(&tally, 0, sizeof(tally));
+    for (uint32_t i = 0; i < image.counters.driver_count; i++) {
+        tally_driver((const uint8_t *)&image.drivers[i], sizeof(SnapshotDriver), &tally);
+    }
+    print_tally(&tally);
+    printf("  (not stored in v1; rebuilt from the driver table on load)\n");
+    printf("======================================\n");
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : DATA_FILE;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("Error: Could not open %s. Please ensure the server has run and shut down gracefully.\n", path);
+        return 1;
+    }
+
+    struct stat st;
+    char magic[8];
+    int result;
+    if (fstat(fd, &st) != 0) {
+        printf("Error: stat %s failed: %s\n", path, strerror(errno));
+        result = 1;
+    } else if (read_at(fd, magic, sizeof(magic), 0) == 0 && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0) {
+        result = dump_sections(fd, (uint64_t)st.st_size);
+    } else {
+        result = dump_raw(fd, (uint64_t)st.st_size);
+    }
+    close(fd);
+    return result;
+}
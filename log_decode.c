@@ -0,0 +1,151 @@
+/* log_decode.c */
+// 把 Server 的二進位 log (--log-format=binary 寫出的 server.blog，格式見 src/common/include/log_system.h)
+// 還原成與文字模式相同的 "[時間] [等級] 訊息" 行。
+// 記錄以固定大小的緩衝區串流讀取，檔案再大也只用固定記憶體；被截斷的最後一筆記錄 (例如 Server 被 kill -9) 會被略過。
+// 用法: ./log_decode [--stats] [file]
+//   --stats  不輸出訊息，改為列出每個呼叫點的筆數與佔用的 bytes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "src/common/include/log_system.h"
+
+#define DATA_FILE "server.blog"
+
+static const char *level_names[] = { "INFO", "WARN", "ERROR", "DEBUG" };
+
+// 呼叫點字典 (由 LOG_BIN_SITE 記錄建立；輪替後的新檔案會重新寫入定義)
+typedef struct {
+    int defined;
+    uint16_t line;
+    char file[64];
+    char fmt[LOG_FMT_MAX];
+    uint64_t events;
+    uint64_t bytes;
+} SiteInfo;
+
+static SiteInfo sites[LOG_MAX_SITES + 1];
+
+static void print_line(uint32_t timestamp, uint8_t level, const char *text) {
+    static uint32_t cached_sec = 0;
+    static char cached_time[20] = "";
+    if (timestamp != cached_sec || cached_time[0] == '\0') {
+        time_t t = (time_t)timestamp;
+        strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        cached_sec = timestamp;
+    }
+    printf("[%s] [%s] %s\n", cached_time, level_names[level < 4 ? level : 0], text);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = DATA_FILE;
+    int stats = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [--stats] [file]\n", argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror("Failed to open log file");
+        return 1;
+    }
+    static char iobuf[256 * 1024];
+    setvbuf(fp, iobuf, _IOFBF, sizeof(iobuf));
+
+    LogBinFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, LOG_BIN_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "%s: not a binary log (missing %s header)\n", path, LOG_BIN_MAGIC);
+        fclose(fp);
+        return 1;
+    }
+    if (hdr.version != LOG_BIN_VERSION) {
+        fprintf(stderr, "%s: unsupported version %u\n", path, hdr.version);
+        fclose(fp);
+        return 1;
+    }
+
+    uint64_t records = 0, text_records = 0, text_bytes = 0, unknown = 0, total_bytes = sizeof(hdr);
+    LogBinRecord rec;
+    uint8_t body[LOG_BIN_MAX_LEN];
+    char line[1024];
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        // 長度不合理代表檔案損毀，之後的記錄邊界也不可信
+        if (rec.len > LOG_BIN_MAX_LEN || (rec.kind != LOG_BIN_TEXT && rec.len < 2)) {
+            fprintf(stderr, "%s: corrupt record (kind %u, length %u) after %lu records\n", path, rec.kind, rec.len, records);
+            break;
+        }
+        if (rec.len > 0 && fread(body, rec.len, 1, fp) != 1) {
+            fprintf(stderr, "%s: last record truncated (%lu records read)\n", path, records);
+            break;
+        }
+        records++;
+        total_bytes += sizeof(rec) + rec.len;
+
+        if (rec.kind == LOG_BIN_SITE && rec.len >= 4) {
+            uint16_t id, site_line;
+            memcpy(&id, body, 2);
+            memcpy(&site_line, body + 2, 2);
+            if (id == 0 || id > LOG_MAX_SITES) continue;
+            // 檔名與格式字串各以 '\0' 結尾 (內容不完整時當成空字串)
+            const char *file = (const char *)body + 4;
+            size_t file_len = strnlen(file, rec.len - 4u);
+            const char *fmt = file + file_len + 1;
+            size_t fmt_len = file_len + 5 < rec.len ? strnlen(fmt, rec.len - 5u - file_len) : 0;
+            SiteInfo *s = &sites[id];
+            s->defined = 1;
+            s->line = site_line;
+            snprintf(s->file, sizeof(s->file), "%.*s", (int)file_len, file);
+            snprintf(s->fmt, sizeof(s->fmt), "%.*s", (int)fmt_len, fmt_len > 0 ? fmt : "");
+        } else if (rec.kind == LOG_BIN_EVENT && rec.len >= 2) {
+            uint16_t id;
+            memcpy(&id, body, 2);
+            if (id == 0 || id > LOG_MAX_SITES || !sites[id].defined) {
+                unknown++;
+                continue;
+            }
+            sites[id].events++;
+            sites[id].bytes += sizeof(rec) + rec.len;
+            if (!stats) {
+                log_render(sites[id].fmt, body + 2, rec.len - 2u, rec.flags & LOG_BIN_TRUNCATED, line, sizeof(line));
+                print_line(rec.timestamp, rec.level, line);
+            }
+        } else if (rec.kind == LOG_BIN_TEXT) {
+            text_records++;
+            text_bytes += sizeof(rec) + rec.len;
+            if (!stats) {
+                snprintf(line, sizeof(line), "%.*s%s", (int)rec.len, (const char *)body,
+                         (rec.flags & LOG_BIN_TRUNCATED) ? "..." : "");
+                print_line(rec.timestamp, rec.level, line);
+            }
+        } else {
+            unknown++;
+        }
+    }
+    fclose(fp);
+
+    if (stats) {
+        printf("%s: %lu records, %lu bytes\n", path, records, total_bytes);
+        printf("%-6s %-28s %10s %10s %7s  %s\n", "Site", "Location", "Events", "Bytes", "B/evt", "Format");
+        for (int id = 1; id <= LOG_MAX_SITES; id++) {
+            SiteInfo *s = &sites[id];
+            if (!s->defined || s->events == 0) continue;
+            char where[96];
+            snprintf(where, sizeof(where), "%s:%u", s->file, s->line);
+            printf("%-6d %-28s %10lu %10lu %7.1f  %s\n", id, where, s->events, s->bytes,
+                   (double)s->bytes / s->events, s->fmt);
+        }
+        if (text_records > 0) {
+            printf("%-6s %-28s %10lu %10lu %7.1f  (pre-formatted text)\n", "text", "-", text_records, text_bytes,
+                   (double)text_bytes / text_records);
+        }
+    }
+    if (unknown > 0) fprintf(stderr, "%s: %lu records skipped (unknown kind or undefined site)\n", path, unknown);
+    return 0;
+}
@@ -0,0 +1,283 @@
+/* ride_top.c */
+// 即時監看執行中的 server_app：以唯讀方式附加 SHM_NAME，每個間隔取樣一次並顯示與上一次的差值。
+// 對應頁面是 PROT_READ，不可能去拿 state->mutex；所有欄位都是不上鎖直接讀 (計數器以 relaxed load)，
+// 只用來觀察，偶爾讀到更新到一半的司機表不影響結果。
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "src/common/include/shared_data.h"
+
+static const char *const g_site_names[LOCK_SITE_COUNT] = {
+    "ride_match", "driver_join", "map_tick", "location_batch",
+    "driver_attach", "driver_detach", "ticket_rotate", "snapshot"
+};
+
+// 一次取樣 (只複製要顯示的欄位，不複製整個 SharedState)
+typedef struct {
+    double t;                               // CLOCK_MONOTONIC 秒
+    uint64_t counters[METRIC_COUNT];
+    StageHistogram stages[STAGE_COUNT];
+    uint64_t admitted;
+    long revenue;
+    uint64_t rate_blocked;
+    uint64_t peer_blocked;
+    uint64_t loc_applied;
+    uint64_t push_delivered;
+    uint32_t push_connected;
+    int driver_count;
+    int available;
+    int busy;
+    int refueling;
+    WorkerPool pool;                        // 只複製摘要欄位 (不含各格)
+    uint32_t lock_profiling;
+    LockSiteStats sites[LOCK_SITE_COUNT];   // 只加總計數欄位 (直方圖不用)
+} Sample;
+
+static double mono_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t load_u64(const uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void take_sample(const SharedState *s, Sample *out) {
+    memset(out, 0, sizeof(*out));
+    out->t = mono_sec();
+
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) {
+        const WorkerMetrics *wm = &s->metrics.workers[w];
+        for (int c = 0; c < METRIC_COUNT; c++) out->counters[c] += load_u64(&wm->counters[c]);
+        for (int st = 0; st < STAGE_COUNT; st++) {
+            const StageHistogram *h = &wm->stages[st];
+            if (load_u64(&h->count) == 0) continue;
+            for (int b = 0; b <= METRICS_BUCKETS; b++) out->stages[st].buckets[b] += load_u64(&h->buckets[b]);
+            out->stages[st].count += load_u64(&h->count);
+            out->stages[st].sum_ns += load_u64(&h->sum_ns);
+        }
+    }
+
+    out->admitted = load_u64(&s->total_connections_accepted);
+    out->revenue = __atomic_load_n(&s->total_revenue, __ATOMIC_RELAXED);
+    out->rate_blocked = load_u64(&s->rate_limit.blocked_count);
+    out->peer_blocked = load_u64(&s->peer_admission.blocked_count);
+    out->loc_applied = load_u64(&s->location.applied);
+    out->push_delivered = load_u64(&s->driver_push.delivered);
+    out->push_connected = __atomic_load_n(&s->driver_push.connected, __ATOMIC_RELAXED);
+
+    int count = __atomic_load_n(&s->driver_count, __ATOMIC_RELAXED);
+    if (count > MAX_DRIVERS) count = MAX_DRIVERS;
+    out->driver_count = count;
+    for (int i = 0; i < count; i++) {
+        const Driver *d = &s->drivers[i];
+        if (d->is_refueling) out->refueling++;
+        else if (d->is_available) out->available++;
+        else out->busy++;
+    }
+
+    memcpy(&out->pool, &s->pool, offsetof(WorkerPool, slots));
+
+    out->lock_profiling = __atomic_load_n(&s->lock_profile.enabled, __ATOMIC_RELAXED);
+    for (int slot = 0; slot < LOCKPROF_SLOTS; slot++) {
+        for (int site = 0; site < LOCK_SITE_COUNT; site++) {
+            const LockSiteStats *st = &s->lock_profile.slots[slot].sites[site];
+            if (load_u64(&st->acquisitions) == 0) continue;
+            out->sites[site].acquisitions += load_u64(&st->acquisitions);
+            out->sites[site].contended += load_u64(&st->contended);
+            out->sites[site].wait_ns += load_u64(&st->wait_ns);
+            out->sites[site].hold_ns += load_u64(&st->hold_ns);
+        }
+    }
+}
+
+/**
+ * 兩次取樣之間某個階段的直方圖差值：平均與分位數 (分位數為落點那一格的上界)。
+ */
+typedef struct {
+    uint64_t count;
+    double avg_us;
+    double p50_us;
+    double p99_us;
+} StageDelta;
+
+static double quantile_us(const uint64_t *buckets, uint64_t count, double q) {
+    uint64_t target = (uint64_t)(count * q + 0.5), seen = 0;
+    if (target == 0) target = 1;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= target) return (double)(1ULL << (b + METRICS_MIN_SHIFT)) / 1e3;
+    }
+    return (double)(1ULL << (METRICS_BUCKETS + METRICS_MIN_SHIFT)) / 1e3; // 溢位格：至少這麼長
+}
+
+static StageDelta stage_delta(const Sample *prev, const Sample *cur, MetricsStage stage) {
+    StageDelta d = {0};
+    uint64_t buckets[METRICS_BUCKETS + 1];
+    for (int b = 0; b <= METRICS_BUCKETS; b++) {
+        buckets[b] = cur->stages[stage].buckets[b] - prev->stages[stage].buckets[b];
+        d.count += buckets[b];
+    }
+    if (d.count == 0) return d;
+    d.avg_us = (cur->stages[stage].sum_ns - prev->stages[stage].sum_ns) / 1e3 / d.count;
+    d.p50_us = quantile_us(buckets, d.count, 0.50);
+    d.p99_us = quantile_us(buckets, d.count, 0.99);
+    return d;
+}
+
+static void format_us(double us, char *out, size_t cap) {
+    if (us >= 1000.0) snprintf(out, cap, "%.1f ms", us / 1e3);
+    else snprintf(out, cap, "%.0f us", us);
+}
+
+static void render(const Sample *prev, const Sample *cur, pid_t server_pid, int batch) {
+    double dt = cur->t - prev->t;
+    if (dt <= 0) dt = 1e-9;
+#define RATE(field) ((double)(cur->field - prev->field) / dt)
+
+    if (!batch) printf("\033[H\033[2J");
+    char when[32];
+    time_t now = time(NULL);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    printf("ride_top  %s  (%s, server pid %d, every %.1f s, read-only)\n\n", when, SHM_NAME, (int)server_pid, dt);
+
+    uint64_t requests = cur->counters[METRIC_REQUESTS] - prev->counters[METRIC_REQUESTS];
+    uint64_t confirmed = cur->counters[METRIC_CONFIRMED] - prev->counters[METRIC_CONFIRMED];
+    printf("Requests    : %8.1f/s   confirmed %8.1f/s (%5.1f%%)   no driver %8.1f/s   blocked %6.1f/s\n",
+           requests / dt, confirmed / dt, requests > 0 ? confirmed * 100.0 / requests : 0.0,
+           RATE(counters[METRIC_NO_DRIVER]), RATE(counters[METRIC_BLOCKED]));
+
+    StageDelta req = stage_delta(prev, cur, STAGE_REQUEST);
+    char avg[16], p50[16], p99[16];
+    format_us(req.avg_us, avg, sizeof(avg));
+    format_us(req.p50_us, p50, sizeof(p50));
+    format_us(req.p99_us, p99, sizeof(p99));
+    printf("Service time: avg %-9s p50 <= %-9s p99 <= %-9s (server side, decrypted -> reply queued)\n", avg, p50, p99);
+
+    printf("Revenue     : %8.0f $/s   total $%ld\n", RATE(revenue), cur->revenue);
+    printf("Connections : %8.1f/s   handshakes %8.1f/s   resumes %8.1f/s (rejected %.1f/s)\n",
+           RATE(admitted), RATE(counters[METRIC_HANDSHAKES]), RATE(counters[METRIC_RESUMES]),
+           RATE(counters[METRIC_RESUME_REJECTS]));
+    printf("Protection  : rate limit %6.1f/s   admission %6.1f/s   checksum errors %.1f/s   no handshake %.1f/s\n",
+           RATE(rate_blocked), RATE(peer_blocked), RATE(counters[METRIC_CHECKSUM_ERRORS]),
+           RATE(counters[METRIC_NO_HANDSHAKE]));
+    printf("Drivers     : %4d total   %4d available   %4d busy   %4d refueling   %4u push-connected\n",
+           cur->driver_count, cur->available, cur->busy, cur->refueling, cur->push_connected);
+    printf("              location updates %.1f/s   pushes delivered %.1f/s\n",
+           RATE(loc_applied), RATE(push_delivered));
+    printf("Workers     : %4u live (%u ~ %u)   %4u busy   utilization %5.1f%%   accept queue %u / %u\n",
+           cur->pool.live, cur->pool.min_workers, cur->pool.max_workers, cur->pool.busy,
+           cur->pool.utilization * 100.0, cur->pool.accept_queue, cur->pool.accept_backlog);
+    printf("              spawned %lu   respawned %lu   retired %lu (since start)\n",
+           cur->pool.spawned, cur->pool.respawned, cur->pool.retired);
+
+    // 叫車路徑的鎖 (各階段計時一直開著)
+    StageDelta wait = stage_delta(prev, cur, STAGE_LOCK_WAIT);
+    uint64_t hold_ns = cur->stages[STAGE_MATCH].sum_ns - prev->stages[STAGE_MATCH].sum_ns;
+    format_us(wait.avg_us, avg, sizeof(avg));
+    format_us(wait.p99_us, p99, sizeof(p99));
+    printf("Lock (match): wait avg %-9s p99 <= %-9s held %5.1f%% of the time by ride requests\n",
+           avg, p99, hold_ns / 1e9 / dt * 100.0);
+
+    // 各呼叫點 (--lock-profile / SIGUSR1 開啟時)
+    if (!cur->lock_profiling) {
+        printf("Lock sites  : profiling off (server_app --lock-profile, or kill -USR1 %d)\n", (int)server_pid);
+    } else {
+        printf("\n%-15s %10s %9s %12s %12s %9s\n", "lock site", "acquire/s", "contended", "wait ms/s", "hold ms/s", "held");
+        for (int site = 0; site < LOCK_SITE_COUNT; site++) {
+            const LockSiteStats *a = &prev->sites[site], *b = &cur->sites[site];
+            uint64_t acq = b->acquisitions - a->acquisitions;
+            // 重新開始一輪時計數會歸零，這一次差值不可信
+            if (b->acquisitions < a->acquisitions || acq == 0) continue;
+            printf("%-15s %10.1f %8.1f%% %12.2f %12.2f %8.1f%%\n", g_site_names[site], acq / dt,
+                   (b->contended - a->contended) * 100.0 / acq, (b->wait_ns - a->wait_ns) / 1e6 / dt,
+                   (b->hold_ns - a->hold_ns) / 1e6 / dt, (b->hold_ns - a->hold_ns) / 1e9 / dt * 100.0);
+        }
+    }
+    if (batch) printf("\n");
+    fflush(stdout);
+#undef RATE
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--interval=SEC] [--iterations=N] [--batch]\n", prog);
+    fprintf(stderr, "  --interval=SEC   取樣間隔 (預設 1 秒)\n");
+    fprintf(stderr, "  --iterations=N   輸出 N 次後結束 (預設一直執行)\n");
+    fprintf(stderr, "  --batch          不清除畫面，逐次附加輸出 (適合導向檔案)\n");
+}
+
+int main(int argc, char *argv[]) {
+    double interval = 1.0;
+    long iterations = 0;
+    int batch = 0;
+
+    static struct option long_options[] = {
+        {"interval",   required_argument, NULL, 'i'},
+        {"iterations", required_argument, NULL, 'n'},
+        {"batch",      no_argument,       NULL, 'b'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'i': interval = atof(optarg); break;
+            case 'n': iterations = atol(optarg); break;
+            case 'b': batch = 1; break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (interval < 0.1) interval = 0.1;
+
+    int fd = shm_open(SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s (is server_app running?)\n", SHM_NAME, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size != sizeof(SharedState)) {
+        fprintf(stderr, "%s is %ld bytes, expected %zu: ride_top and server_app were built from different versions.\n",
+                SHM_NAME, (long)st.st_size, sizeof(SharedState));
+        close(fd);
+        return 1;
+    }
+    const SharedState *state = mmap(NULL, sizeof(SharedState), PROT_READ, MAP_SHARED, fd, 0);
+    if (state == MAP_FAILED) {
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    Sample samples[2];
+    int cur = 0;
+    take_sample(state, &samples[cur]);
+    struct timespec pause = { (time_t)interval, (long)((interval - (time_t)interval) * 1e9) };
+    for (long n = 0; iterations == 0 || n < iterations; n++) {
+        nanosleep(&pause, NULL);
+
+        // 關機後共享記憶體可能還留著，但數字不會再變
+        pid_t server_pid = __atomic_load_n(&state->server_pid, __ATOMIC_RELAXED);
+        if (server_pid <= 0 || (kill(server_pid, 0) < 0 && errno == ESRCH)) {
+            printf("server_app (pid %d) is not running.\n", (int)server_pid);
+            break;
+        }
+        take_sample(state, &samples[cur ^ 1]);
+        render(&samples[cur], &samples[cur ^ 1], server_pid, batch);
+        cur ^= 1;
+    }
+
+    munmap((void *)state, sizeof(SharedState));
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,177 @@
+/* src/bench/bench_dispatcher.c */
+// Dispatcher I/O 後端比較：對執行中的 server_app 做封閉迴圈壓測
+// 每個請求都是完整的一條短連線：connect → DH 握手 → 加密叫車請求 → 讀回覆 → close
+// 用法：先以 --io-backend=classic 或 --io-backend=uring (建議加 --admit-rate=0) 啟動 server_app，
+//       再執行 ./bench_dispatcher <ip> <port> [threads] [seconds] [bin|text]，兩種後端在同一台機器上各跑一次比較
+//       最後一個參數選擇回覆格式 (預設 bin = OP_REQ_RIDE_BIN；text = 舊版文字回覆)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "../common/include/protocol.h"
+#include "../common/include/net_wrapper.h"
+#include "../common/include/dh_crypto.h"
+
+#define DEFAULT_THREADS 32
+#define DEFAULT_SECONDS 5
+#define MAX_SAMPLES_PER_THREAD (1 << 18)
+
+static uint16_t g_request_opcode = OP_REQ_RIDE_BIN;
+
+typedef struct {
+    int id;
+    const char *ip;
+    int port;
+    double deadline;
+    long completed;
+    long errors;
+    long sample_count;
+    double *latency_us;
+} BenchThread;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * 在已連線的 socket 上完成一次請求 (不使用 Ticket，每條連線都做 DH 握手)。
+ * return 0 = 收到有效回覆, -1 = 失敗
+ */
+static int exchange(int fd, uint32_t client_id) {
+    FrameReader reader;
+    ProtocolHeader h;
+    uint8_t *body;
+    char key[64];
+
+    frame_reader_init(&reader, fd);
+
+    // 1. DH 握手
+    long long priv = generate_private_key();
+    HandshakeData hs = { .public_key = calculate_public_key(priv) };
+    ProtocolHeader hs_h = { .length = sizeof(hs), .type = MSG_TYPE_HANDSHAKE, .opcode = OP_HANDSHAKE, .checksum = 0 };
+
+    if (send_frame(fd, &hs_h, &hs) < 0) return -1;
+    if (frame_reader_next(&reader, &h, &body) <= 0 || h.type != MSG_TYPE_HANDSHAKE_ACK) return -1;
+    derive_session_key(calculate_shared_secret(((HandshakeData *)body)->public_key, priv), key, sizeof(key));
+
+    // 2. 加密叫車請求
+    RideRequestData req = { .client_id = client_id, .type = 0, .lat = 25.0330, .lon = 121.5654 };
+    ProtocolHeader req_h = { .length = sizeof(req), .type = MSG_TYPE_RIDE_REQ, .opcode = g_request_opcode };
+    req_h.checksum = calculate_checksum((uint8_t *)&req, sizeof(req));
+    rc4_crypt((uint8_t *)&req, sizeof(req), key);
+    if (send_frame(fd, &req_h, &req) < 0) return -1;
+
+    // 3. 回覆 (有沒有派到車都算完成一次 I/O 往返，只檢查能否正確解密)
+    if (frame_reader_next(&reader, &h, &body) <= 0 || h.type != MSG_TYPE_RIDE_RESP) return -1;
+    rc4_crypt(body, h.length, key);
+    return (calculate_checksum(body, h.length) == h.checksum) ? 0 : -1;
+}
+
+/**
+ * 一個完整請求：connect → exchange → close。
+ */
+static int one_request(const char *ip, int port, uint32_t client_id) {
+    int fd = connect_to_server(ip, port);
+    if (fd < 0) return -1;
+
+    struct timeval tv = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+
+    int result = exchange(fd, client_id);
+    close(fd);
+    return result;
+}
+
+static void *bench_thread(void *arg) {
+    BenchThread *t = arg;
+    uint32_t seq = 0;
+
+    // 每個請求用不同的 client_id，避免被每位乘客的限流擋下 (這裡量的是 I/O，不是限流)
+    while (now_sec() < t->deadline) {
+        uint32_t client_id = 100000u + (uint32_t)t->id * 1000000u + seq++;
+        double start = now_sec();
+        if (one_request(t->ip, t->port, client_id) == 0) {
+            t->completed++;
+            if (t->sample_count < MAX_SAMPLES_PER_THREAD) {
+                t->latency_us[t->sample_count++] = (now_sec() - start) * 1e6;
+            }
+        } else {
+            t->errors++;
+        }
+    }
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s <Server IP> <Port> [threads=%d] [seconds=%d] [bin|text]\n", argv[0], DEFAULT_THREADS, DEFAULT_SECONDS);
+        return 1;
+    }
+    const char *ip = argv[1];
+    int port = atoi(argv[2]);
+    int nthreads = (argc > 3) ? atoi(argv[3]) : DEFAULT_THREADS;
+    int seconds = (argc > 4) ? atoi(argv[4]) : DEFAULT_SECONDS;
+    if (nthreads < 1) nthreads = 1;
+    if (argc > 5 && strcmp(argv[5], "text") == 0) g_request_opcode = OP_REQ_RIDE;
+
+    srand(time(NULL) ^ getpid());
+    BenchThread *threads = calloc(nthreads, sizeof(BenchThread));
+    pthread_t *tids = calloc(nthreads, sizeof(pthread_t));
+
+    double start = now_sec();
+    for (int i = 0; i < nthreads; i++) {
+        threads[i].id = i;
+        threads[i].ip = ip;
+        threads[i].port = port;
+        threads[i].deadline = start + seconds;
+        threads[i].latency_us = malloc(sizeof(double) * MAX_SAMPLES_PER_THREAD);
+        pthread_create(&tids[i], NULL, bench_thread, &threads[i]);
+    }
+
+    long completed = 0, errors = 0, samples = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+        completed += threads[i].completed;
+        errors += threads[i].errors;
+        samples += threads[i].sample_count;
+    }
+    double elapsed = now_sec() - start;
+
+    // 合併所有延遲樣本計算百分位數
+    double *all = malloc(sizeof(double) * (samples > 0 ? samples : 1));
+    long n = 0;
+    for (int i = 0; i < nthreads; i++) {
+        memcpy(all + n, threads[i].latency_us, sizeof(double) * threads[i].sample_count);
+        n += threads[i].sample_count;
+        free(threads[i].latency_us);
+    }
+    qsort(all, n, sizeof(double), cmp_double);
+
+    printf("Dispatcher benchmark: %d threads, %.1f s, target %s:%d, %s replies\n", nthreads, elapsed, ip, port,
+           g_request_opcode == OP_REQ_RIDE ? "text" : "binary");
+    printf("| %10s | %8s | %10s | %9s | %9s | %9s | %9s |\n",
+           "completed", "errors", "req/s", "p50 (us)", "p90 (us)", "p99 (us)", "max (us)");
+    if (n > 0) {
+        printf("| %10ld | %8ld | %10.0f | %9.0f | %9.0f | %9.0f | %9.0f |\n",
+               completed, errors, completed / elapsed,
+               all[n / 2], all[(long)(n * 0.90)], all[(long)(n * 0.99)], all[n - 1]);
+    } else {
+        printf("| %10ld | %8ld | %10s | %9s | %9s | %9s | %9s |\n", completed, errors, "-", "-", "-", "-", "-");
+    }
+
+    free(all);
+    free(threads);
+    free(tids);
+    return 0;
+}
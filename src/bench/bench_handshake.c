@@ -0,0 +1,140 @@
+/* src/bench/bench_handshake.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/include/dh_crypto.h"
+
+#define HANDSHAKES 2000000
+#define VERIFY_ROUNDS 100000
+
+// 改版前的實作 (64-bit % 的 square-and-multiply)，當作比較基準
+// noinline：和原本一樣以參數傳入 mod，編譯器無法把除法換成乘法
+__attribute__((noinline)) static long long power_mod_legacy(long long base, long long exp, long long mod) {
+    long long res = 1;
+    base = base % mod;
+    while (exp > 0) {
+        if (exp % 2 == 1) res = (res * base) % mod;
+        exp = exp >> 1;
+        base = (base * base) % mod;
+    }
+    return res;
+}
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 預先產生 Client 公鑰，讓計時只包含 Server 端的工作
+static long long *make_client_keys(int n) {
+    long long *keys = malloc(sizeof(long long) * n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = calculate_public_key(generate_private_key());
+    }
+    return keys;
+}
+
+static void report(const char *label, double elapsed, int n, long long checksum) {
+    printf("| %-34s | %9.1f | %12.0f | %016llx |\n",
+           label, elapsed * 1e9 / n, n / elapsed, (unsigned long long)checksum);
+}
+
+int main() {
+    srand(12345);
+    char key[64];
+
+    // 1. 正確性：Mersenne 快速路徑必須和通用版完全一致 (含超出範圍 / 負數的 base)
+    for (int i = 0; i < VERIFY_ROUNDS; i++) {
+        long long base = ((long long)rand() << 16) ^ rand();
+        if (i % 7 == 0) base = -base;
+        long long exp = ((long long)rand() << 1) ^ rand();
+        long long expect = power_mod_legacy(((base % DH_PRIME) + DH_PRIME) % DH_PRIME, exp, DH_PRIME);
+        if (power_mod_mersenne31(base, exp) != expect) {
+            printf("MISMATCH: base=%lld exp=%lld\n", base, exp);
+            return 1;
+        }
+    }
+    printf("Mersenne reduction verified against generic power_mod (%d random cases).\n\n", VERIFY_ROUNDS);
+
+    long long *client_pub = make_client_keys(4096);
+
+    printf("Server-side handshake cost (%d handshakes, private key < 100000):\n", HANDSHAKES);
+    printf("+------------------------------------+-----------+--------------+------------------+\n");
+    printf("| Path                               | ns/hs     | handshakes/s | checksum         |\n");
+    printf("+------------------------------------+-----------+--------------+------------------+\n");
+
+    // A. 改版前：同步產生密鑰對 + 通用 % 運算
+    long long sum = 0;
+    double t0 = now_sec();
+    for (int i = 0; i < HANDSHAKES; i++) {
+        long long priv = generate_private_key();
+        long long pub = power_mod_legacy(DH_GENERATOR, priv, DH_PRIME);
+        long long shared = power_mod_legacy(client_pub[i & 4095], priv, DH_PRIME);
+        derive_session_key(shared, key, sizeof(key));
+        sum += pub ^ shared;
+    }
+    report("sync keygen, generic %", now_sec() - t0, HANDSHAKES, sum);
+
+    // B. 同步產生密鑰對 + Mersenne 快速模運算
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < HANDSHAKES; i++) {
+        long long priv = generate_private_key();
+        long long pub = calculate_public_key(priv);
+        long long shared = calculate_shared_secret(client_pub[i & 4095], priv);
+        derive_session_key(shared, key, sizeof(key));
+        sum += pub ^ shared;
+    }
+    report("sync keygen, mersenne", now_sec() - t0, HANDSHAKES, sum);
+
+    // C. 密鑰池 + Mersenne：請求路徑只剩 Shared Secret (補池時間另外計算)
+    DhKeyPool pool;
+    dh_keypool_init(&pool);
+    double refill_time = 0.0;
+    sum = 0;
+    double request_time = 0.0;
+    for (int done = 0; done < HANDSHAKES; ) {
+        double r0 = now_sec();
+        dh_keypool_refill(&pool, DH_KEYPOOL_SIZE);
+        double r1 = now_sec();
+        refill_time += r1 - r0;
+
+        for (int k = 0; k < DH_KEYPOOL_SIZE && done < HANDSHAKES; k++, done++) {
+            DhKeyPair kp = dh_keypool_take(&pool);
+            long long shared = calculate_shared_secret(client_pub[done & 4095], kp.private_key);
+            derive_session_key(shared, key, sizeof(key));
+            sum += kp.public_key ^ shared;
+        }
+        request_time += now_sec() - r1;
+    }
+    report("keypool (request path only)", request_time, HANDSHAKES, sum);
+    report("keypool refill (idle time)", refill_time, HANDSHAKES, 0);
+    printf("+------------------------------------+-----------+--------------+------------------+\n");
+    printf("Pool hits: %lu, misses: %lu\n", pool.hits, pool.misses);
+
+    // D. 最壞情況：31-bit 指數的單次模數冪
+    printf("\nSingle power_mod with full 31-bit exponents:\n");
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < HANDSHAKES; i++) {
+        sum += power_mod_legacy(client_pub[i & 4095], DH_PRIME - 2 - i, DH_PRIME);
+    }
+    double legacy = now_sec() - t0;
+    long long legacy_sum = sum;
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < HANDSHAKES; i++) {
+        sum += power_mod_mersenne31(client_pub[i & 4095], DH_PRIME - 2 - i);
+    }
+    double fast = now_sec() - t0;
+    long long fast_sum = sum;
+    printf("  generic %%: %.1f ns/op, mersenne: %.1f ns/op (%.2fx) [checksum %s]\n",
+           legacy * 1e9 / HANDSHAKES, fast * 1e9 / HANDSHAKES, legacy / fast,
+           fast_sum == legacy_sum ? "match" : "MISMATCH");
+
+    free(client_pub);
+    return 0;
+}
@@ -0,0 +1,380 @@
+/* src/bench/bench_kernels.c */
+// 請求路徑上各個計算核心的微基準 (不含 I/O)：
+//   Checksum、RC4、DH 各函式、派車搜尋 (不同車隊規模)、A* 尋路 (最壞情況的地圖)、動態定價
+// 每個核心先校準迭代次數 (每次重複至少跑 --min-ms)，跑一次暖身後重複 --reps 次，
+// 回報中位數 ns/op、最小值、離散程度 (max-min)/median 與 bytes/s (有處理資料量的核心)。
+// 用法: ./bench_kernels [名稱篩選字串] [--reps=N] [--min-ms=N] [--list]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/include/shared_data.h"
+#include "../common/include/protocol.h"
+#include "../common/include/net_wrapper.h"
+#include "../common/include/dh_crypto.h"
+#include "../server/include/dispatch_algorithms.h"
+#include "../server/include/pathfinding.h"
+#include "../server/include/pricing_service.h"
+
+#define DEFAULT_REPS   7
+#define DEFAULT_MIN_MS 50
+#define MAX_REPS       64
+#define MAX_KERNELS    64
+#define SESSION_KEY    "KEY_1234567890_SECURE"
+
+// 回傳值累加到這裡，避免編譯器把整個迴圈當成沒有作用而刪掉
+static volatile long g_sink;
+
+typedef long (*KernelFn)(void *ctx, long iters);
+
+typedef struct {
+    char name[48];
+    size_t bytes;       // 每次操作處理的資料量 (0 = 不適用)
+    KernelFn fn;
+    void *ctx;
+} Kernel;
+
+static Kernel g_kernels[MAX_KERNELS];
+static int g_kernel_count = 0;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void add_kernel(const char *name, size_t bytes, KernelFn fn, void *ctx) {
+    if (g_kernel_count == MAX_KERNELS) return;
+    Kernel *k = &g_kernels[g_kernel_count++];
+    snprintf(k->name, sizeof(k->name), "%s", name);
+    k->bytes = bytes;
+    k->fn = fn;
+    k->ctx = ctx;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// xorshift64：固定種子，每次執行的輸入都一樣
+static uint64_t next_rand(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+//  核心
+// 1. Checksum / RC4 (訊息大小：叫車請求 24 B、一般回覆、Frame 上限 1 KB)
+typedef struct {
+    uint8_t buf[FRAME_MAX_BODY];
+    size_t len;
+} BufferCtx;
+
+static long k_checksum(void *ctx, long iters) {
+    BufferCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) {
+        c->buf[0] = (uint8_t)i;
+        sum += calculate_checksum(c->buf, c->len);
+    }
+    return sum;
+}
+
+static long k_rc4(void *ctx, long iters) {
+    BufferCtx *c = ctx;
+    for (long i = 0; i < iters; i++) rc4_crypt(c->buf, c->len, SESSION_KEY); // 每則訊息都含金鑰排程
+    return c->buf[0];
+}
+
+// 2. DH
+#define DH_KEYS 1024
+typedef struct {
+    long long priv[DH_KEYS];
+    long long pub[DH_KEYS];
+    DhKeyPool pool;
+} DhCtx;
+
+static long k_generate_private_key(void *ctx, long iters) {
+    (void)ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) sum += generate_private_key();
+    return sum;
+}
+
+static long k_public_key(void *ctx, long iters) {
+    DhCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) sum += calculate_public_key(c->priv[i & (DH_KEYS - 1)]);
+    return sum;
+}
+
+static long k_shared_secret(void *ctx, long iters) {
+    DhCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) {
+        sum += calculate_shared_secret(c->pub[i & (DH_KEYS - 1)], c->priv[(i + 7) & (DH_KEYS - 1)]);
+    }
+    return sum;
+}
+
+static long k_power_mod_generic(void *ctx, long iters) {
+    DhCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) sum += power_mod(c->pub[i & (DH_KEYS - 1)], c->priv[i & (DH_KEYS - 1)], 1000000007LL);
+    return sum;
+}
+
+static long k_derive_session_key(void *ctx, long iters) {
+    DhCtx *c = ctx;
+    char key[64];
+    long sum = 0;
+    for (long i = 0; i < iters; i++) {
+        derive_session_key(c->pub[i & (DH_KEYS - 1)], key, sizeof(key));
+        sum += key[0];
+    }
+    return sum;
+}
+
+static long k_keypool(void *ctx, long iters) {
+    DhCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) {
+        if (c->pool.count == 0) dh_keypool_refill(&c->pool, DH_KEYPOOL_SIZE); // 閒置時補充的成本也算進來
+        sum += dh_keypool_take(&c->pool).public_key;
+    }
+    return sum;
+}
+
+// 3. 派車搜尋
+typedef struct {
+    SharedState *state;
+    int is_vip;
+} FleetCtx;
+
+static long k_find_basic(void *ctx, long iters) {
+    FleetCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) sum += find_driver_basic(c->state);
+    return sum;
+}
+
+static long k_find_smart(void *ctx, long iters) {
+    FleetCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) sum += find_driver_smart(c->state, c->is_vip);
+    return sum;
+}
+
+/**
+ * 建立一個車隊：位置分散在地圖上，約 80% 空車，評分 3.0 ~ 5.0。
+ */
+static SharedState *make_fleet(int count, uint64_t seed) {
+    SharedState *state = calloc(1, sizeof(SharedState));
+    if (state == NULL) return NULL;
+    state->driver_count = count;
+    for (int i = 0; i < count; i++) {
+        Driver *d = &state->drivers[i];
+        d->driver_id = 1001 + i;
+        d->lat = BASE_LAT + (double)(next_rand(&seed) % (MAP_HEIGHT * 100)) / (100.0 * SCALE_FACTOR);
+        d->lon = BASE_LON + (double)(next_rand(&seed) % (MAP_WIDTH * 100)) / (100.0 * SCALE_FACTOR);
+        d->is_available = (next_rand(&seed) % 10) < 8;
+        d->fuel = 100;
+        d->rating = 3.0 + (double)(next_rand(&seed) % 21) / 10.0;
+    }
+    pricing_rebuild_zones(state);
+    return state;
+}
+
+// 4. A* (起終點以網格座標指定)
+typedef struct {
+    double start_lat, start_lon, target_lat, target_lon;
+} AstarCtx;
+
+static long k_astar(void *ctx, long iters) {
+    AstarCtx *c = ctx;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) {
+        Point p = get_next_step_astar(c->start_lat, c->start_lon, c->target_lat, c->target_lon);
+        sum += p.x + p.y;
+    }
+    return sum;
+}
+
+static void set_astar(AstarCtx *c, int sx, int sy, int tx, int ty) {
+    // 取格子中心，避免浮點誤差落到隔壁格
+    c->start_lat = BASE_LAT + (sy + 0.5) / SCALE_FACTOR;
+    c->start_lon = BASE_LON + (sx + 0.5) / SCALE_FACTOR;
+    c->target_lat = BASE_LAT + (ty + 0.5) / SCALE_FACTOR;
+    c->target_lon = BASE_LON + (tx + 0.5) / SCALE_FACTOR;
+}
+
+// 5. 動態定價
+#define SURGE_POINTS 1024
+typedef struct {
+    SharedState *state;
+    double lat[SURGE_POINTS];
+    double lon[SURGE_POINTS];
+} SurgeCtx;
+
+static long k_surge(void *ctx, long iters) {
+    SurgeCtx *c = ctx;
+    long sum = 0;
+    int is_surge;
+    for (long i = 0; i < iters; i++) {
+        sum += calculate_surge_price(c->state, c->lat[i & (SURGE_POINTS - 1)], c->lon[i & (SURGE_POINTS - 1)], &is_surge);
+        sum += is_surge;
+    }
+    return sum;
+}
+
+//  執行
+/**
+ * 校準迭代次數、暖身，再重複量測。
+ */
+static void run_kernel(const Kernel *k, int reps, double min_ns) {
+    // 校準：找到一次重複至少跑 min_ns 的迭代次數
+    long iters = 1;
+    while (1) {
+        double t0 = now_ns();
+        g_sink += k->fn(k->ctx, iters);
+        double elapsed = now_ns() - t0;
+        if (elapsed >= min_ns) break;
+        double scale = elapsed > 0 ? min_ns / elapsed * 1.2 : 100;
+        if (scale > 100) scale = 100;
+        if (scale < 2) scale = 2;
+        iters = (long)(iters * scale);
+    }
+    g_sink += k->fn(k->ctx, iters); // 暖身 (快取、分支預測)
+
+    double ns_per_op[MAX_REPS];
+    for (int r = 0; r < reps; r++) {
+        double t0 = now_ns();
+        g_sink += k->fn(k->ctx, iters);
+        ns_per_op[r] = (now_ns() - t0) / iters;
+    }
+    qsort(ns_per_op, reps, sizeof(double), cmp_double);
+    double median = ns_per_op[reps / 2];
+    double spread = median > 0 ? (ns_per_op[reps - 1] - ns_per_op[0]) / median * 100.0 : 0;
+
+    printf("| %-34s | %11.1f | %11.1f | %6.1f%% | %12ld |", k->name, median, ns_per_op[0], spread, iters);
+    if (k->bytes > 0) {
+        printf(" %10.1f |\n", k->bytes / median * 1e9 / (1024.0 * 1024.0));
+    } else {
+        printf(" %10s |\n", "-");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    int reps = DEFAULT_REPS, list = 0;
+    double min_ms = DEFAULT_MIN_MS;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--reps=", 7) == 0) {
+            reps = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--min-ms=", 9) == 0) {
+            min_ms = atof(argv[i] + 9);
+        } else if (strcmp(argv[i], "--list") == 0) {
+            list = 1;
+        } else if (argv[i][0] == '-') {
+            printf("Usage: %s [filter] [--reps=N] [--min-ms=N] [--list]\n", argv[0]);
+            return 1;
+        } else {
+            filter = argv[i];
+        }
+    }
+    if (reps < 1) reps = 1;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    if (min_ms <= 0) min_ms = DEFAULT_MIN_MS;
+
+    srand(12345);
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    char name[48];
+
+    // Checksum / RC4
+    static const size_t sizes[] = { sizeof(RideRequestData), 256, FRAME_MAX_BODY };
+    static BufferCtx buffers[3];
+    for (int i = 0; i < 3; i++) {
+        buffers[i].len = sizes[i];
+        for (size_t b = 0; b < sizes[i]; b++) buffers[i].buf[b] = (uint8_t)next_rand(&seed);
+    }
+    for (int i = 0; i < 3; i++) {
+        snprintf(name, sizeof(name), "checksum/%zuB", sizes[i]);
+        add_kernel(name, sizes[i], k_checksum, &buffers[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        snprintf(name, sizeof(name), "rc4_crypt/%zuB", sizes[i]);
+        add_kernel(name, sizes[i], k_rc4, &buffers[i]);
+    }
+
+    // DH
+    static DhCtx dh;
+    for (int i = 0; i < DH_KEYS; i++) {
+        dh.priv[i] = generate_private_key();
+        dh.pub[i] = calculate_public_key(generate_private_key());
+    }
+    dh_keypool_init(&dh.pool);
+    add_kernel("dh/generate_private_key", 0, k_generate_private_key, &dh);
+    add_kernel("dh/calculate_public_key", 0, k_public_key, &dh);
+    add_kernel("dh/calculate_shared_secret", 0, k_shared_secret, &dh);
+    add_kernel("dh/power_mod (generic modulus)", 0, k_power_mod_generic, &dh);
+    add_kernel("dh/derive_session_key", 0, k_derive_session_key, &dh);
+    add_kernel("dh/keypool take (+refill)", 0, k_keypool, &dh);
+
+    // 派車搜尋：車隊規模 16 / 64 / MAX_DRIVERS
+    static const int fleets[] = { 16, 64, MAX_DRIVERS };
+    static FleetCtx fleet_ctx[3][3];
+    for (int i = 0; i < 3; i++) {
+        SharedState *state = make_fleet(fleets[i], seed + i);
+        if (state == NULL) return 1;
+        fleet_ctx[i][0] = (FleetCtx){ state, 0 };
+        fleet_ctx[i][1] = (FleetCtx){ state, 0 };
+        fleet_ctx[i][2] = (FleetCtx){ state, 1 };
+        snprintf(name, sizeof(name), "find_driver_basic/%d", fleets[i]);
+        add_kernel(name, 0, k_find_basic, &fleet_ctx[i][0]);
+        snprintf(name, sizeof(name), "find_driver_smart/%d", fleets[i]);
+        add_kernel(name, 0, k_find_smart, &fleet_ctx[i][1]);
+        snprintf(name, sizeof(name), "find_driver_smart/%d vip", fleets[i]);
+        add_kernel(name, 0, k_find_smart, &fleet_ctx[i][2]);
+    }
+
+    // A*：地圖上有一條河 (x = 20, y 5~14) 與兩棟建築
+    init_map_obstacles();
+    static AstarCtx astar[4];
+    set_astar(&astar[0], 2, 10, 12, 10);    // 空曠路段
+    set_astar(&astar[1], 18, 10, 22, 10);   // 隔著河，必須繞路
+    set_astar(&astar[2], 0, 0, MAP_WIDTH - 1, MAP_HEIGHT - 1); // 對角
+    set_astar(&astar[3], 0, 0, 7, 5);       // 終點在建築內，無法到達 (探索整張地圖)
+    add_kernel("astar/open field", 0, k_astar, &astar[0]);
+    add_kernel("astar/across river", 0, k_astar, &astar[1]);
+    add_kernel("astar/corner to corner", 0, k_astar, &astar[2]);
+    add_kernel("astar/unreachable target", 0, k_astar, &astar[3]);
+
+    // 動態定價：以最大車隊的區域計數器查表
+    static SurgeCtx surge;
+    surge.state = fleet_ctx[2][0].state;
+    for (int i = 0; i < SURGE_POINTS; i++) {
+        surge.lat[i] = BASE_LAT + (double)(next_rand(&seed) % (MAP_HEIGHT * 100)) / (100.0 * SCALE_FACTOR);
+        surge.lon[i] = BASE_LON + (double)(next_rand(&seed) % (MAP_WIDTH * 100)) / (100.0 * SCALE_FACTOR);
+    }
+    for (int z = 0; z < ZONE_COUNT; z += 3) pricing_record_demand(surge.state, z); // 部分區域有近期需求
+    add_kernel("calculate_surge_price", 0, k_surge, &surge);
+
+    if (list) {
+        for (int i = 0; i < g_kernel_count; i++) printf("%s\n", g_kernels[i].name);
+        return 0;
+    }
+
+    printf("Kernel microbenchmarks: %d reps x >= %.0f ms each, after calibration + warmup\n", reps, min_ms);
+    printf("+------------------------------------+-------------+-------------+---------+--------------+------------+\n");
+    printf("| Kernel                             | median ns/op| min ns/op   | spread  | iters/rep    | MB/s       |\n");
+    printf("+------------------------------------+-------------+-------------+---------+--------------+------------+\n");
+    for (int i = 0; i < g_kernel_count; i++) {
+        if (filter != NULL && strstr(g_kernels[i].name, filter) == NULL) continue;
+        run_kernel(&g_kernels[i], reps, min_ms * 1e6);
+    }
+    printf("+------------------------------------+-------------+-------------+---------+--------------+------------+\n");
+    return 0;
+}
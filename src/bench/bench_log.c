@@ -0,0 +1,117 @@
+/* src/bench/bench_log.c */
+// Log 呼叫成本：同步 (localtime + fprintf + fflush) vs 非同步環狀緩衝區 (drop / block 兩種策略)
+// vs 二進位格式 (只複製呼叫點編號與原始參數，離線還原)
+// 與 Server 相同的結構：多個進程同時寫同一個檔案，非同步模式每個進程一個緩衝區，由父進程的寫入執行緒取出
+// 用法: ./bench_log [每個進程的行數] [進程數]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "../common/include/log_system.h"
+
+#define LOG_PATH "/tmp/bench_log.log"
+#define MAX_PROCS 64
+
+typedef struct {
+    volatile int go;            // 所有子進程就緒後一起開始
+    double ns_per_call[MAX_PROCS];
+} BenchShared;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : 0;
+}
+
+static long count_lines(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+    long lines = 0;
+    int c;
+    while ((c = fgetc(fp)) != EOF) {
+        if (c == '\n') lines++;
+    }
+    fclose(fp);
+    return lines;
+}
+
+/**
+ * 執行一種模式。policy < 0 = 同步
+ */
+static void run_mode(const char *label, int policy, int format, int calls, int procs, BenchShared *shared) {
+    unlink(LOG_PATH);
+    memset(shared, 0, sizeof(*shared));
+    log_init(LOG_PATH);
+    if (policy >= 0 && log_async_init(policy, 0, format) < 0) {
+        printf("log_async_init failed\n");
+        exit(1);
+    }
+
+    for (int p = 0; p < procs; p++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            log_attach(p + 1);
+            while (!shared->go) usleep(100);
+            double t0 = now_ns();
+            for (int i = 0; i < calls; i++) {
+                // 與 ride_service 派車成功時的 log 相近
+                log_info("[Dispatcher %d] Ride %d: client %d -> driver %d, fare $%d (surge x%.1f)",
+                         getpid(), i, 1000 + i % 97, 1001 + i % 20, 100 + i % 400, 1.0 + (i % 5) * 0.5);
+            }
+            shared->ns_per_call[p] = (now_ns() - t0) / calls;
+            _exit(0);
+        }
+    }
+
+    if (policy >= 0) log_async_start();
+    double t0 = now_ns();
+    shared->go = 1;
+    while (wait(NULL) > 0);
+    double elapsed = now_ns() - t0;
+
+    uint64_t written = 0, dropped = 0;
+    log_cleanup(); // 非同步模式：寫完剩餘的行
+    log_async_stats(&written, &dropped);
+    // 二進位檔案沒有換行，改用寫入執行緒的計數
+    long lines = format == LOG_FORMAT_BINARY ? (long)written : count_lines(LOG_PATH);
+    long bytes = file_size(LOG_PATH);
+
+    double sum = 0;
+    for (int p = 0; p < procs; p++) sum += shared->ns_per_call[p];
+    printf("| %-16s | %9.0f | %12.0f | %10ld | %10lu | %9.1f |\n", label, sum / procs,
+           (double)calls * procs / (elapsed / 1e9), lines, dropped, lines > 0 ? (double)bytes / lines : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    int calls = argc > 1 ? atoi(argv[1]) : 200000;
+    int procs = argc > 2 ? atoi(argv[2]) : 4;
+    if (calls <= 0) calls = 200000;
+    if (procs <= 0 || procs > MAX_PROCS) procs = 4;
+
+    BenchShared *shared = mmap(NULL, sizeof(BenchShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) return 1;
+
+    printf("%d processes x %d log lines -> %s\n", procs, calls, LOG_PATH);
+    printf("+------------------+-----------+--------------+------------+------------+-----------+\n");
+    printf("| Mode             | ns/call   | lines/s      | in file    | dropped    | bytes/line|\n");
+    printf("+------------------+-----------+--------------+------------+------------+-----------+\n");
+    run_mode("sync (fflush)", -1, LOG_FORMAT_TEXT, calls, procs, shared);
+    run_mode("async drop", LOG_OVERFLOW_DROP, LOG_FORMAT_TEXT, calls, procs, shared);
+    run_mode("async block", LOG_OVERFLOW_BLOCK, LOG_FORMAT_TEXT, calls, procs, shared);
+    run_mode("binary drop", LOG_OVERFLOW_DROP, LOG_FORMAT_BINARY, calls, procs, shared);
+    run_mode("binary block", LOG_OVERFLOW_BLOCK, LOG_FORMAT_BINARY, calls, procs, shared);
+    printf("+------------------+-----------+--------------+------------+------------+-----------+\n");
+    unlink(LOG_PATH);
+    return 0;
+}
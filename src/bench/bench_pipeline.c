@@ -0,0 +1,385 @@
+/* src/bench/bench_pipeline.c */
+// 不經過網路的 Dispatcher 全流程基準：在單一進程內直接把預先編碼好的 Frame 餵給 dispatch_frame
+// (Ticket 驗證 / DH、解密、Checksum、限流、派車、定價、加密回覆)，不需要 TCP、Worker 進程與地圖執行緒，
+// 只量 CPU 成本；再以 socketpair 跑同一批 Frame 經過 handle_client，差值就是 Kernel 收送的成本。
+//   1. request only      Session 已建立，只送叫車請求 (業務路徑)
+//   2. resume + request  每條連線先出示 Ticket 再送請求 (一般 Client 的路徑)
+//   3. DH + request      每條連線做完整 DH 握手 (Client 端的金鑰計算不計時；密鑰池在請求之間補滿)
+//   4. socketpair        與 2 相同的 Frame，經由 socketpair 與 handle_client 收送
+// 每隔 drivers/2 個請求把司機表還原成全部空車 (不計時)，讓大部分請求都走派車成功的路徑。
+// 用法: ./bench_pipeline [seconds per path] [drivers] [bin|text]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "../common/include/protocol.h"
+#include "../common/include/shared_data.h"
+#include "../common/include/net_wrapper.h"
+#include "../common/include/dh_crypto.h"
+#include "../common/include/log_system.h"
+#include "../server/include/dispatcher.h"
+#include "../server/include/resource_service.h"
+#include "../server/include/pricing_service.h"
+#include "../server/include/session_ticket.h"
+
+#define DEFAULT_SECONDS 3
+#define DEFAULT_DRIVERS 64
+#define FRAME_SETS      16384   // 預先編碼的連線數 (循環使用)；每組的 client_id 不同
+#define CLIENT_KEYS     1024    // DH 路徑預先算好的 Client 密鑰對
+#define CHECK_EVERY     256     // 每隔幾個請求檢查一次時間
+#define BENCH_RATE      1000    // 限流照常檢查，但額度設到上限，不會擋下基準的請求
+
+// server_main.c 的全域變數 (Server 核心模組以 extern 引用)
+SharedState *g_shared_state = NULL;
+volatile sig_atomic_t g_running = 1;
+
+// from dispatcher.c (阻塞式後端的單一連線處理)
+extern int handle_client(int client_fd);
+
+static uint16_t g_request_opcode = OP_REQ_RIDE_BIN;
+static Driver g_initial_drivers[MAX_DRIVERS];
+static int g_restore_every = 1;
+
+// 一條預先編碼的連線：RESUME Frame (可省略) + 加密後的叫車請求 Frame
+typedef struct {
+    uint8_t data[sizeof(ProtocolHeader) * 2 + sizeof(ResumeData) + sizeof(RideRequestData)];
+    size_t len;
+    size_t ride_offset;         // 叫車請求 Frame 的起點
+    char session_key[64];       // 這條連線的 Session Key (request only 路徑直接放進 Session)
+} EncodedConn;
+
+typedef struct {
+    const char *name;
+    long requests;
+    double server_secs;         // 計時區段的總和
+    uint64_t confirmed;
+} PathResult;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//  A. 準備
+/**
+ * 與 server_main 相同的初始狀態 (全新啟動)，但放在一般的 heap 上。
+ */
+static int setup_state(int driver_count) {
+    g_shared_state = calloc(1, sizeof(SharedState));
+    if (g_shared_state == NULL) return -1;
+    SharedState *state = g_shared_state;
+
+    srand(12345);
+    state->driver_count = driver_count;
+    state->dispatch_mode = 1;
+    for (int i = 0; i < driver_count; i++) {
+        Driver *d = &state->drivers[i];
+        d->driver_id = 1000 + i + 1;
+        d->is_available = 1;
+        d->lat = 25.0330 + (rand() % 100) * 0.0001;
+        d->lon = 121.5654 + (rand() % 100) * 0.0001;
+        d->fuel = 10;
+        d->rating = i < 2 ? 4.9 + (rand() % 2) / 10.0 : 3.5 + (rand() % 15) / 10.0;
+    }
+    memcpy(g_initial_drivers, state->drivers, sizeof(g_initial_drivers));
+    pricing_rebuild_zones(state);
+
+    rate_limit_table_init(&state->rate_limit, BENCH_RATE, BENCH_RATE);
+    rate_limit_table_init(&state->peer_admission, 0, 0);
+    ticket_keyring_init(&state->tickets);
+    pthread_mutex_init(&state->mutex, NULL);
+    g_restore_every = driver_count / 2 > 0 ? driver_count / 2 : 1;
+    return 0;
+}
+
+/**
+ * 司機表還原成全部空車 (不計時)。
+ */
+static void restore_drivers(void) {
+    memcpy(g_shared_state->drivers, g_initial_drivers, sizeof(g_initial_drivers));
+    pricing_rebuild_zones(g_shared_state);
+}
+
+/**
+ * 把一個 Frame 附加到 buf：Checksum 以明文計算，key 不為 NULL 時加密 Body。
+ */
+static size_t encode_frame(uint8_t *buf, uint8_t type, uint16_t opcode, const void *body, size_t len, const char *key) {
+    ProtocolHeader h;
+    h.length = (uint32_t)len;
+    h.type = type;
+    h.opcode = opcode;
+    h.checksum = key != NULL ? calculate_checksum(body, len) : 0;
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), body, len);
+    if (key != NULL) rc4_crypt(buf + sizeof(h), len, key);
+    return sizeof(h) + len;
+}
+
+static size_t encode_ride(uint8_t *buf, uint32_t client_id, const char *key) {
+    RideRequestData req;
+    req.client_id = client_id;
+    req.type = client_id <= 10 ? 1 : 0;
+    req.lat = 25.0330 + (client_id % 100) * 0.0001;
+    req.lon = 121.5654 + (client_id % 180) * 0.0001;
+    return encode_frame(buf, MSG_TYPE_RIDE_REQ, g_request_opcode, &req, sizeof(req), key);
+}
+
+/**
+ * 以可恢復的 DH 握手向 Dispatcher 取得一張 Ticket (與 Client 的流程相同，只是不經過 socket)。
+ */
+static int obtain_ticket(SessionTicket *ticket, long long *resumption_secret) {
+    ClientSession session;
+    ReplyBuffer out;
+    client_session_init(&session);
+    out.len = 0;
+
+    long long priv = generate_private_key();
+    HandshakeData hs = { .public_key = calculate_public_key(priv) };
+    ProtocolHeader h = { .length = sizeof(hs), .type = MSG_TYPE_HANDSHAKE, .opcode = OP_HANDSHAKE_RESUMABLE, .checksum = 0 };
+    dispatch_frame(&session, &h, (uint8_t *)&hs, &out);
+
+    ProtocolHeader ack, th;
+    HandshakeData srv;
+    SessionTicketData td;
+    size_t pos = 0;
+    if (out.len < sizeof(ack) + sizeof(srv)) return -1;
+    memcpy(&ack, out.data, sizeof(ack));
+    memcpy(&srv, out.data + sizeof(ack), sizeof(srv));
+    pos = sizeof(ack) + ack.length;
+    if (ack.type != MSG_TYPE_HANDSHAKE_ACK || out.len < pos + sizeof(th) + sizeof(td)) return -1;
+    memcpy(&th, out.data + pos, sizeof(th));
+    memcpy(&td, out.data + pos + sizeof(th), sizeof(td));
+    if (th.type != MSG_TYPE_SESSION_TICKET) return -1;
+
+    *ticket = td.ticket;
+    *resumption_secret = derive_resumption_secret(calculate_shared_secret(srv.public_key, priv));
+    return 0;
+}
+
+/**
+ * 預先編碼所有連線：每組用不同的 nonce (不同的 Session Key) 與 client_id。
+ */
+static int encode_conns(EncodedConn *conns) {
+    SessionTicket ticket;
+    long long secret;
+    if (obtain_ticket(&ticket, &secret) < 0) {
+        fprintf(stderr, "Failed to obtain a session ticket from the dispatcher.\n");
+        return -1;
+    }
+    for (int k = 0; k < FRAME_SETS; k++) {
+        EncodedConn *c = &conns[k];
+        ResumeData resume = { .ticket = ticket, .client_nonce = (uint32_t)k * 2654435761U };
+        derive_resumed_session_key(secret, resume.client_nonce, c->session_key, sizeof(c->session_key));
+        c->len = encode_frame(c->data, MSG_TYPE_RESUME, OP_RESUME, &resume, sizeof(resume), NULL);
+        c->ride_offset = c->len;
+        c->len += encode_ride(c->data + c->len, 11 + (uint32_t)k, c->session_key);
+    }
+    return 0;
+}
+
+/**
+ * 把一份 Frame 複製到可寫的緩衝區 (dispatch_frame 會就地解密) 後處理。
+ * return dispatch_frame 的回傳值
+ */
+static int feed(ClientSession *session, const uint8_t *frame, ReplyBuffer *out) {
+    uint8_t scratch[sizeof(ProtocolHeader) + FRAME_MAX_BODY];
+    ProtocolHeader h;
+    memcpy(&h, frame, sizeof(h));
+    memcpy(scratch, frame + sizeof(h), h.length);
+    return dispatch_frame(session, &h, scratch, out);
+}
+
+//  B. 各條路徑
+static void path_request_only(const EncodedConn *conns, double seconds, PathResult *r) {
+    ClientSession session;
+    ReplyBuffer out;
+    uint64_t before = g_shared_state->total_success_requests;
+    double deadline = now_sec() + seconds;
+
+    for (long i = 0; ; i++) {
+        if (i % CHECK_EVERY == 0 && now_sec() >= deadline) break;
+        if (i % g_restore_every == 0) restore_drivers();
+        const EncodedConn *c = &conns[i % FRAME_SETS];
+        client_session_init(&session);
+        memcpy(session.session_key, c->session_key, sizeof(session.session_key));
+        session.is_key_established = 1;
+        out.len = 0;
+
+        double t0 = now_sec();
+        feed(&session, c->data + c->ride_offset, &out);
+        r->server_secs += now_sec() - t0;
+        r->requests++;
+    }
+    r->confirmed = g_shared_state->total_success_requests - before;
+}
+
+static void path_resume(const EncodedConn *conns, double seconds, PathResult *r) {
+    ClientSession session;
+    ReplyBuffer out;
+    uint64_t before = g_shared_state->total_success_requests;
+    double deadline = now_sec() + seconds;
+
+    for (long i = 0; ; i++) {
+        if (i % CHECK_EVERY == 0 && now_sec() >= deadline) break;
+        if (i % g_restore_every == 0) restore_drivers();
+        const EncodedConn *c = &conns[i % FRAME_SETS];
+        client_session_init(&session);
+        out.len = 0;
+
+        double t0 = now_sec();
+        feed(&session, c->data, &out);
+        feed(&session, c->data + c->ride_offset, &out);
+        r->server_secs += now_sec() - t0;
+        r->requests++;
+    }
+    r->confirmed = g_shared_state->total_success_requests - before;
+}
+
+static void path_full_handshake(double seconds, PathResult *r) {
+    static long long priv[CLIENT_KEYS];
+    static HandshakeData pub[CLIENT_KEYS];
+    for (int k = 0; k < CLIENT_KEYS; k++) {
+        priv[k] = generate_private_key();
+        pub[k].public_key = calculate_public_key(priv[k]);
+    }
+
+    ClientSession session;
+    ReplyBuffer out;
+    uint8_t ride[sizeof(ProtocolHeader) + sizeof(RideRequestData)];
+    uint64_t before = g_shared_state->total_success_requests;
+    double deadline = now_sec() + seconds;
+
+    for (long i = 0; ; i++) {
+        if (i % CHECK_EVERY == 0 && now_sec() >= deadline) break;
+        if (i % g_restore_every == 0) restore_drivers();
+        int k = (int)(i % CLIENT_KEYS);
+        client_session_init(&session);
+        out.len = 0;
+
+        // 1. 握手 (計時)
+        HandshakeData hs = pub[k];
+        ProtocolHeader h = { .length = sizeof(hs), .type = MSG_TYPE_HANDSHAKE, .opcode = OP_HANDSHAKE, .checksum = 0 };
+        double t0 = now_sec();
+        dispatch_frame(&session, &h, (uint8_t *)&hs, &out);
+        r->server_secs += now_sec() - t0;
+
+        // 2. Client 端衍生 Session Key 並加密請求 (不計時)
+        HandshakeData srv;
+        char key[64];
+        memcpy(&srv, out.data + sizeof(ProtocolHeader), sizeof(srv));
+        derive_session_key(calculate_shared_secret(srv.public_key, priv[k]), key, sizeof(key));
+        encode_ride(ride, 11 + (uint32_t)(i % FRAME_SETS), key);
+
+        // 3. 叫車請求 (計時)
+        t0 = now_sec();
+        feed(&session, ride, &out);
+        r->server_secs += now_sec() - t0;
+        r->requests++;
+
+        // 閒置時補充密鑰池 (Server 在沒有連線時做的事，不計時)
+        dispatcher_refill_keypool();
+    }
+    r->confirmed = g_shared_state->total_success_requests - before;
+}
+
+static void path_socketpair(const EncodedConn *conns, double seconds, PathResult *r) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return;
+    }
+    uint8_t reply[REPLY_BUFFER_SIZE];
+    uint64_t before = g_shared_state->total_success_requests;
+    double deadline = now_sec() + seconds;
+
+    for (long i = 0; ; i++) {
+        if (i % CHECK_EVERY == 0 && now_sec() >= deadline) break;
+        if (i % g_restore_every == 0) restore_drivers();
+        const EncodedConn *c = &conns[i % FRAME_SETS];
+
+        // Client 一次送出 RESUME + 請求，Server 端 handle_client 讀完、處理、送出回覆後返回
+        double t0 = now_sec();
+        if (send_n(sv[0], c->data, c->len) < 0) break;
+        handle_client(sv[1]);
+        ProtocolHeader h;
+        if (recv_n(sv[0], &h, sizeof(h)) <= 0 || h.length > sizeof(reply)) break;
+        if (h.length > 0 && recv_n(sv[0], reply, h.length) <= 0) break;
+        r->server_secs += now_sec() - t0;
+        r->requests++;
+    }
+    r->confirmed = g_shared_state->total_success_requests - before;
+    close(sv[0]);
+    close(sv[1]);
+}
+
+//  C. 報表
+static void report(const PathResult *r) {
+    double us = r->requests > 0 ? r->server_secs / r->requests * 1e6 : 0;
+    printf("| %-18s | %10ld | %10.0f | %9.2f | %8.1f%% |\n", r->name, r->requests,
+           r->server_secs > 0 ? r->requests / r->server_secs : 0, us,
+           r->requests > 0 ? r->confirmed * 100.0 / r->requests : 0);
+}
+
+static double us_per_req(const PathResult *r) {
+    return r->requests > 0 ? r->server_secs / r->requests * 1e6 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : DEFAULT_SECONDS;
+    int drivers = argc > 2 ? atoi(argv[2]) : DEFAULT_DRIVERS;
+    if (argc > 3 && strcmp(argv[3], "text") == 0) g_request_opcode = OP_REQ_RIDE;
+    if (seconds <= 0) seconds = DEFAULT_SECONDS;
+    if (drivers < 1 || drivers > MAX_DRIVERS) drivers = DEFAULT_DRIVERS;
+
+    // 業務路徑上的 log 照常經過非同步緩衝區 (寫入執行緒輸出到 /dev/null)
+    log_init("/dev/null");
+    log_async_init(LOG_OVERFLOW_DROP, 0, LOG_FORMAT_TEXT);
+    log_async_start();
+
+    if (setup_state(drivers) < 0) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    dispatcher_worker_init();
+
+    EncodedConn *conns = malloc(FRAME_SETS * sizeof(EncodedConn));
+    if (conns == NULL || encode_conns(conns) < 0) return 1;
+
+    printf("In-process dispatcher pipeline: %d drivers (SMART), %s replies, %.1f s per path, %d pre-encoded connections\n",
+           drivers, g_request_opcode == OP_REQ_RIDE ? "text" : "binary", seconds, FRAME_SETS);
+    printf("+--------------------+------------+------------+-----------+-----------+\n");
+    printf("| Path               |   Requests |   Req/s    |  us/req   | Confirmed |\n");
+    printf("+--------------------+------------+------------+-----------+-----------+\n");
+
+    PathResult results[4];
+    memset(results, 0, sizeof(results));
+    results[0].name = "request only";
+    path_request_only(conns, seconds, &results[0]);
+    report(&results[0]);
+    results[1].name = "resume + request";
+    path_resume(conns, seconds, &results[1]);
+    report(&results[1]);
+    results[2].name = "DH + request";
+    path_full_handshake(seconds, &results[2]);
+    report(&results[2]);
+    results[3].name = "resume, socketpair";
+    path_socketpair(conns, seconds, &results[3]);
+    report(&results[3]);
+    printf("+--------------------+------------+------------+-----------+-----------+\n");
+
+    printf("Ticket resume adds %.2f us, a full DH handshake %.2f us; socketpair I/O adds %.2f us per connection.\n",
+           us_per_req(&results[1]) - us_per_req(&results[0]), us_per_req(&results[2]) - us_per_req(&results[0]),
+           us_per_req(&results[3]) - us_per_req(&results[1]));
+    printf("Rate limiting: %lu blocked (quota raised to %d/s so the benchmark is not throttled).\n",
+           g_shared_state->rate_limit.blocked_count, BENCH_RATE);
+
+    free(conns);
+    log_cleanup();
+    return 0;
+}
@@ -0,0 +1,138 @@
+/* src/bench/bench_rate_limit.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../common/include/shared_data.h"
+#include "../server/include/resource_service.h"
+
+// resource_service.c 需要這個全域變數
+SharedState *g_shared_state = NULL;
+
+// 模擬的全體請求速率 (決定 TAT 推進速度與同時活躍的 client 數)
+#define SIM_REQUESTS_PER_SEC 100000
+#define OPS_PER_THREAD 4000000
+
+typedef struct {
+    RateLimitTable *table;
+    uint32_t distinct_clients;
+    int thread_index;
+    uint64_t *op_clock;  // 所有執行緒共用的模擬時鐘 (已送出的請求數)
+    uint64_t blocked;
+} BenchArgs;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift64：每個執行緒各自的亂數，避免 rand() 的鎖
+static uint64_t next_rand(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static void *bench_thread(void *arg) {
+    BenchArgs *a = (BenchArgs *)arg;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (a->thread_index + 1);
+    double us_per_op = 1000000.0 / SIM_REQUESTS_PER_SEC;
+
+    for (long i = 0; i < OPS_PER_THREAD; i++) {
+        // 所有執行緒共用同一條模擬時間軸，就像真實系統共用同一個時鐘
+        uint64_t op = __atomic_fetch_add(a->op_clock, 1, __ATOMIC_RELAXED);
+        uint32_t now = 1000000 + (uint32_t)(op * us_per_op);
+        uint32_t client = (uint32_t)(next_rand(&seed) % a->distinct_clients) * 2654435761u;
+        a->blocked += rate_limit_table_check(a->table, client, now);
+    }
+    return NULL;
+}
+
+static void run_case(RateLimitTable *table, uint32_t distinct_clients, int threads) {
+    rate_limit_table_init(table, RATE_LIMIT_PER_SEC, RATE_LIMIT_BURST);
+
+    pthread_t tids[16];
+    BenchArgs args[16];
+    uint64_t op_clock = 0;
+    double start = now_sec();
+    for (int t = 0; t < threads; t++) {
+        args[t] = (BenchArgs){table, distinct_clients, t, &op_clock, 0};
+        pthread_create(&tids[t], NULL, bench_thread, &args[t]);
+    }
+    uint64_t blocked = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        blocked += args[t].blocked;
+    }
+    double elapsed = now_sec() - start;
+
+    double total_ops = (double)OPS_PER_THREAD * threads;
+    printf("| %10u | %7d | %8.1f | %10.2f | %8.4f%% | %9.4f%% |\n",
+           distinct_clients, threads,
+           elapsed * 1e9 / total_ops,
+           total_ops / elapsed / 1e6,
+           100.0 * blocked / total_ops,
+           100.0 * table->table_full_count / total_ops);
+}
+
+// 單一 client 連發：驗證 burst 之後確實被擋
+static void run_hot_client(RateLimitTable *table) {
+    rate_limit_table_init(table, RATE_LIMIT_PER_SEC, RATE_LIMIT_BURST);
+    int allowed = 0;
+    for (uint32_t us = 0; us < 10000000; us += 10000) {
+        if (!rate_limit_table_check(table, 0xDEADBEEF, 1000000 + us)) allowed++;
+    }
+    printf("Hot client: 1000 requests over 10s at 100 req/s -> %d allowed (expected ~%d)\n",
+           allowed, RATE_LIMIT_BURST + 10 * RATE_LIMIT_PER_SEC);
+}
+
+// 離開超過一次 32-bit 微秒刻度回繞 (約 71.6 分鐘) 後回來的 client：舊 TAT 不能被當成未來的額度負債
+static void run_returning_client(RateLimitTable *table) {
+    rate_limit_table_init(table, RATE_LIMIT_PER_SEC, RATE_LIMIT_BURST);
+    uint32_t t0 = 1000000;
+    for (int i = 0; i < RATE_LIMIT_BURST; i++) rate_limit_table_check(table, 0xC0FFEE, t0);
+
+    // 刻度回繞一圈後再過 0.5 秒回來：舊 TAT (t0 + 約 1 s) 看起來落在 0.5 秒後的未來。期間 Coordinator 每 100 ms 維護一次
+    uint64_t back = (uint64_t)t0 + 0x100000000ULL + 500000u;
+    for (uint64_t t = t0; t < back; t += 100000) {
+        rate_limit_table_maintain(table, (uint32_t)t);
+    }
+    int allowed = 0;
+    for (int i = 0; i < RATE_LIMIT_BURST; i++) {
+        if (!rate_limit_table_check(table, 0xC0FFEE, (uint32_t)back)) allowed++;
+    }
+    printf("Returning client after a tick wrap: %d of %d burst requests allowed (expected %d)\n",
+           allowed, RATE_LIMIT_BURST, RATE_LIMIT_BURST);
+}
+
+int main() {
+    RateLimitTable *table = malloc(sizeof(RateLimitTable));
+    if (!table) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("GCRA rate limiter: %d slots (%zu KB), probe window %d, simulated %d req/s\n",
+           RATE_LIMIT_SLOTS, sizeof(RateLimitTable) / 1024, RATE_LIMIT_PROBE, SIM_REQUESTS_PER_SEC);
+    run_hot_client(table);
+    run_returning_client(table);
+
+    printf("+------------+---------+----------+------------+-----------+------------+\n");
+    printf("| Clients    | Threads | ns/op    | Mops/s     | Blocked   | Table Full |\n");
+    printf("+------------+---------+----------+------------+-----------+------------+\n");
+    uint32_t client_counts[] = {1000, 1000000, 4000000, 16000000};
+    int thread_counts[] = {1, 4};
+    for (size_t c = 0; c < sizeof(client_counts) / sizeof(client_counts[0]); c++) {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            run_case(table, client_counts[c], thread_counts[t]);
+        }
+    }
+    printf("+------------+---------+----------+------------+-----------+------------+\n");
+
+    free(table);
+    return 0;
+}
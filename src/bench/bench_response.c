@@ -0,0 +1,139 @@
+/* src/bench/bench_response.c */
+// 叫車回覆格式比較：文字 (snprintf / strstr + sscanf) vs 二進位 RideResponseData
+// 分別量 Server 端編碼與 Client 端解碼的每筆 CPU 成本，並各自量一次含 Checksum + RC4 的完整路徑
+// (RC4 每則訊息都重做金鑰排程，是固定成本，單看格式差異要看不含加密的那幾列)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/include/protocol.h"
+#include "../common/include/net_wrapper.h"
+
+#define ITERATIONS 2000000
+#define SESSION_KEY "KEY_1234567890_SECURE"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *label, double elapsed, long checksum) {
+    printf("| %-36s | %9.1f | %12.0f | %14ld |\n", label, elapsed * 1e9 / ITERATIONS, ITERATIONS / elapsed, checksum);
+}
+
+// 每次迭代換一組欄位，避免編譯器把格式化結果當常數
+static void make_result(RideResponseData *r, int i) {
+    memset(r, 0, sizeof(*r));
+    r->version = RIDE_RESP_VERSION;
+    r->status = RIDE_STATUS_CONFIRMED;
+    r->flags = (i & 1) ? RIDE_FLAG_SURGE | RIDE_FLAG_SMART : RIDE_FLAG_SMART;
+    r->rating_x10 = 30 + i % 21;
+    r->ride_id = (uint32_t)i;
+    r->driver_id = 1 + i % 5000;
+    r->dist_e7 = (uint32_t)(i * 7919u % 200000u);
+    r->eta_secs = (uint16_t)(i % 900);
+    r->fare = 100 + i % 400;
+}
+
+// Client 端舊版解析 (與 client_core.c 的文字路徑相同)
+static int parse_text(const char *msg, int *driver_id) {
+    if (strstr(msg, "Ride Confirmed!")) {
+        sscanf(msg, "%*[^:]: %d", driver_id);
+        return 0;
+    } else if (strstr(msg, "Blocked.")) {
+        return -2;
+    }
+    return -1;
+}
+
+int main() {
+    char text[256];
+    RideResponseData r, decoded;
+    long sum;
+    double t0;
+
+    // 1. 正確性：兩種格式解出同一位司機
+    make_result(&r, 12345);
+    ride_response_format_text(&r, text, sizeof(text));
+    int parsed_id = 0;
+    if (parse_text(text, &parsed_id) != 0 || (uint32_t)parsed_id != r.driver_id ||
+        ride_response_decode((uint8_t *)&r, sizeof(r), &decoded) != 0 || decoded.driver_id != r.driver_id) {
+        printf("MISMATCH: \"%s\"\n", text);
+        return 1;
+    }
+    printf("Text reply: \"%s\" (%zu bytes) vs binary reply: %zu bytes\n\n", text, strlen(text), sizeof(RideResponseData));
+
+    printf("Per-request cost (%d replies):\n", ITERATIONS);
+    printf("+--------------------------------------+-----------+--------------+----------------+\n");
+    printf("| Path                                 | ns/reply  | replies/s    | checksum       |\n");
+    printf("+--------------------------------------+-----------+--------------+----------------+\n");
+
+    // A. Server 端編碼
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < ITERATIONS; i++) {
+        make_result(&r, i);
+        sum += ride_response_format_text(&r, text, sizeof(text));
+    }
+    report("server encode: text (snprintf)", now_sec() - t0, sum);
+
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < ITERATIONS; i++) {
+        make_result(&r, i);
+        sum += calculate_checksum((uint8_t *)&r, sizeof(r));
+    }
+    report("server encode: binary (+checksum)", now_sec() - t0, sum);
+
+    // B. Client 端解碼
+    make_result(&r, 4242);
+    char wire_text[256];
+    ride_response_format_text(&r, wire_text, sizeof(wire_text));
+
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < ITERATIONS; i++) {
+        int id = 0;
+        wire_text[40] = '0' + (i & 7); // 改動司機 ID 之後的內容，讓每次解析的輸入不同
+        sum += parse_text(wire_text, &id) + id;
+    }
+    report("client decode: text (strstr+sscanf)", now_sec() - t0, sum);
+
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < ITERATIONS; i++) {
+        r.ride_id = (uint32_t)i;
+        if (ride_response_decode((uint8_t *)&r, sizeof(r), &decoded) == 0) sum += decoded.driver_id + decoded.ride_id;
+    }
+    report("client decode: binary", now_sec() - t0, sum);
+
+    // C. 含 Checksum + RC4 的完整路徑 (Server 編碼 + 加密，Client 解密 + 驗證 + 解析)
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < ITERATIONS; i++) {
+        make_result(&r, i);
+        int len = ride_response_format_text(&r, text, sizeof(text));
+        uint16_t ck = calculate_checksum((uint8_t *)text, len);
+        rc4_crypt((uint8_t *)text, len, SESSION_KEY);
+        rc4_crypt((uint8_t *)text, len, SESSION_KEY);
+        int id = 0;
+        if (calculate_checksum((uint8_t *)text, len) == ck) sum += parse_text(text, &id) + id;
+    }
+    report("round trip: text + crypto", now_sec() - t0, sum);
+
+    sum = 0;
+    t0 = now_sec();
+    for (int i = 0; i < ITERATIONS; i++) {
+        make_result(&r, i);
+        uint16_t ck = calculate_checksum((uint8_t *)&r, sizeof(r));
+        rc4_crypt((uint8_t *)&r, sizeof(r), SESSION_KEY);
+        rc4_crypt((uint8_t *)&r, sizeof(r), SESSION_KEY);
+        if (calculate_checksum((uint8_t *)&r, sizeof(r)) == ck &&
+            ride_response_decode((uint8_t *)&r, sizeof(r), &decoded) == 0) sum += decoded.driver_id;
+    }
+    report("round trip: binary + crypto", now_sec() - t0, sum);
+    printf("+--------------------------------------+-----------+--------------+----------------+\n");
+    return 0;
+}
@@ -18,10 +18,8 @@
 // #define SECRET_KEY "..." (已移除)
 
 // 引入 DH 數學函式 (from src/common/dh_crypto.c)
-extern long long generate_private_key();
-extern long long calculate_public_key(long long private_key);
-extern long long calculate_shared_secret(long long other_public, long long my_private);
-extern void derive_session_key(long long secret, char *buf, size_t len);
+#include "../../common/include/dh_crypto.h"
+#include "include/latency_histogram.h"
 
 // 取得當前時間 (ms)
 double get_time_ms() {
@@ -41,6 +39,13 @@ void get_time_str(char *buffer, size_t size) {
     strcat(buffer, ms);
 }
 
+// 安靜模式：不印握手訊息與 Client 1 的加密前後 Hex (大量重播 / 壓測時避免洗版)
+static int g_quiet = 0;
+
+void client_core_set_quiet(int quiet) {
+    g_quiet = quiet;
+}
+
 // 印出 Hex (for debug)
 void print_hex(const char *label, uint8_t *data, size_t len) {
     printf("[DEBUG] %s: ", label);
@@ -50,9 +55,21 @@ void print_hex(const char *label, uint8_t *data, size_t len) {
     printf("\n");
 }
 
+// Session Resumption Ticket 快取
+// 每個執行緒代表一個 Client (stress_client)，所以用 thread-local 保存，不需要上鎖
+typedef struct {
+    int valid;
+    SessionTicket ticket;
+    long long resumption_secret;
+    double expires_at_ms;
+} ClientTicketCache;
+
+static __thread ClientTicketCache t_ticket_cache;
+
 // DH HandShake 邏輯
 // 成功返回 0，失敗返回 -1，並將生成的 Key 填入 session_key_out
-int perform_dh_handshake(int sock_fd, char *session_key_out) {
+// 同時要求 Server 簽發 Ticket，存入快取供下次連線使用
+int perform_dh_handshake(FrameReader *reader, char *session_key_out) {
     // 1. 生成 Client 自己的密鑰對
     long long my_priv = generate_private_key();
     long long my_pub  = calculate_public_key(my_priv);
@@ -65,90 +82,169 @@ int perform_dh_handshake(int sock_fd, char *session_key_out) {
 
     header.length = sizeof(HandshakeData);
     header.type = MSG_TYPE_HANDSHAKE;     // 設定類型為握手
-    header.opcode = OP_HANDSHAKE;         // 設定操作碼
+    header.opcode = OP_HANDSHAKE_RESUMABLE; // 握手並要求 Resumption Ticket
     header.checksum = 0;                  // 握手階段通常不作 checksum 或簡單處理
 
-    // 3. 發送
-    if (send_n(sock_fd, &header, sizeof(ProtocolHeader)) <= 0) return -1;
-    if (send_n(sock_fd, &body, sizeof(HandshakeData)) <= 0) return -1;
+    // 3. 發送 (Header + Body 一次 writev)
+    if (send_frame(reader->fd, &header, &body) < 0) return -1;
 
     // 4. 接收 Server 回應 (Server 公鑰)
     ProtocolHeader resp_header;
-    HandshakeData resp_body;
+    uint8_t *resp_body;
 
-    if (recv_n(sock_fd, &resp_header, sizeof(ProtocolHeader)) <= 0) return -1;
+    if (frame_reader_next(reader, &resp_header, &resp_body) <= 0) return -1;
     
     // 檢查回應類型
-    if (resp_header.type != MSG_TYPE_HANDSHAKE_ACK) return -1;
-
-    if (recv_n(sock_fd, &resp_body, sizeof(HandshakeData)) <= 0) return -1;
+    if (resp_header.type != MSG_TYPE_HANDSHAKE_ACK || resp_header.length != sizeof(HandshakeData)) return -1;
 
     // 5. 計算共享密鑰 (Shared Secret)
-    long long server_pub = (long long)resp_body.public_key;
+    long long server_pub = (long long)((HandshakeData *)resp_body)->public_key;
     long long shared_secret = calculate_shared_secret(server_pub, my_priv);
 
     // 6. 衍生 Session Key (轉成字串)
     derive_session_key(shared_secret, session_key_out, 64);
 
-    printf("[Security] DH Handshake Success. Key Established.\n");
+    // 7. 接收 Server 緊接著送出的 Ticket (和 ACK 同一批到達，通常已在讀取緩衝區內)
+    ProtocolHeader ticket_header;
+    uint8_t *ticket_raw;
+    if (frame_reader_next(reader, &ticket_header, &ticket_raw) <= 0) return -1;
+    if (ticket_header.type != MSG_TYPE_SESSION_TICKET || ticket_header.length != sizeof(SessionTicketData)) return -1;
+
+    SessionTicketData *ticket_body = (SessionTicketData *)ticket_raw;
+    if (calculate_checksum(ticket_raw, sizeof(SessionTicketData)) == ticket_header.checksum) {
+        t_ticket_cache.valid = 1;
+        t_ticket_cache.ticket = ticket_body->ticket;
+        t_ticket_cache.resumption_secret = derive_resumption_secret(shared_secret);
+        // 提早 5 秒視為過期，避免剛好在 Server 端過期
+        t_ticket_cache.expires_at_ms = get_time_ms() + (ticket_body->lifetime_secs - 5) * 1000.0;
+    }
+
+    if (!g_quiet) printf("[Security] DH Handshake Success. Key Established.\n");
     return 0;
 }
 
-// 核心連線邏輯
-
-/**
- * 發送叫車請求的核心邏輯 (包含握手)。
- * return 0 = 成功, -1 = 失敗, -2 = 被 DoS 阻擋
- */
-int perform_ride_request(int sock_fd, int client_id, char *msg_buffer) {
-    char session_key[64]; // 用來存放動態協商的 Key
-    int assigned_driver_id; 
-
-    // 0. 先執行 DH 握手
-    if (perform_dh_handshake(sock_fd, session_key) < 0) {
-        snprintf(msg_buffer, 1024, "Handshake Failed");
+// Ticket 恢復邏輯：排入 RESUME 封包，與業務請求一起送出，不等待回覆
+// 成功返回 0 (session_key_out 已填入)，沒有可用 Ticket 返回 -1
+// body 由呼叫端提供，必須保持有效直到 writer flush
+static int queue_resume(FrameWriter *writer, ResumeData *body, char *session_key_out) {
+    if (!t_ticket_cache.valid || get_time_ms() >= t_ticket_cache.expires_at_ms) {
+        t_ticket_cache.valid = 0;
         return -1;
     }
 
-    // 握手成功，以下通訊都使用 session_key 加密
+    ProtocolHeader header;
+
+    body->ticket = t_ticket_cache.ticket;
+    body->client_nonce = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+
+    header.length = sizeof(ResumeData);
+    header.type = MSG_TYPE_RESUME;
+    header.opcode = OP_RESUME;
+    header.checksum = 0;
+
+    frame_writer_add(writer, &header, body);
+
+    derive_resumed_session_key(t_ticket_cache.resumption_secret, body->client_nonce, session_key_out, 64);
+    if (!g_quiet) printf("[Security] Session Resumed (Ticket).\n");
+    return 0;
+}
 
+// 加密並排入叫車請求 (req_body 由呼叫端提供，必須保持有效直到 writer flush)
+static int queue_ride_request(FrameWriter *writer, RideRequestData *req_body, const RideRequestData *req,
+                              uint16_t opcode, const char *session_key) {
     ProtocolHeader req_header;
-    RideRequestData req_body;
+    int client_id = (int)req->client_id;
 
-    // 1. 準備 Body
-    req_body.client_id = client_id;
-    // 設定 VIP 邏輯：ID <= 10 為 VIP
-    req_body.type = (client_id <= 10) ? 1 : 0; 
-    req_body.lat = 25.0330;
-    req_body.lon = 121.5654;
+    // 1. 準備 Body (就地加密，所以每次都從 req 複製)
+    *req_body = *req;
 
     // 2. 準備 Header
     req_header.type = MSG_TYPE_RIDE_REQ; // 設定訊息類型
-    req_header.opcode = OP_REQ_RIDE;     // 設定操作碼
+    req_header.opcode = opcode;          // OP_REQ_RIDE_BIN 要求二進位回覆，OP_REQ_RIDE 為文字回覆
     req_header.length = sizeof(RideRequestData);
     
     // 計算 Checksum (加密前計算)
-    req_header.checksum = calculate_checksum((uint8_t*)&req_body, req_header.length);
+    req_header.checksum = calculate_checksum((uint8_t*)req_body, req_header.length);
 
     // 輸出 DEBUG Log (只針對 Client 1)
-    if (client_id == 1) print_hex("Before Encrypt", (uint8_t*)&req_body, req_header.length);
+    if (client_id == 1 && !g_quiet) print_hex("Before Encrypt", (uint8_t*)req_body, req_header.length);
 
     // 使用動態 Session Key 加密
-    rc4_crypt((uint8_t*)&req_body, req_header.length, session_key);
+    rc4_crypt((uint8_t*)req_body, req_header.length, session_key);
 
-    if (client_id == 1) print_hex("After  Encrypt", (uint8_t*)&req_body, req_header.length);
+    if (client_id == 1 && !g_quiet) print_hex("After  Encrypt", (uint8_t*)req_body, req_header.length);
 
-    // 3. 發送
-    if (send_n(sock_fd, &req_header, sizeof(ProtocolHeader)) <= 0) return -1;
-    if (send_n(sock_fd, &req_body, req_header.length) <= 0) return -1;
+    // 3. 排入 (由呼叫端 flush)
+    return frame_writer_add(writer, &req_header, req_body);
+}
+
+// 核心連線邏輯
 
-    // 4. 接收 Header
+/**
+ * 發送叫車請求的核心邏輯 (包含握手)，請求內容與操作碼由呼叫端指定 (trace_replay 重播擷取的請求)。
+ * 有 Ticket 時先嘗試恢復 Session (省掉 DH 來回)，被拒絕再改走完整握手。
+ * phase_ms 可為 NULL；否則填入 LAT_PHASE_HANDSHAKE / LAT_PHASE_REQUEST 的耗時 (ms)，
+ *          沒有做 DH 握手時 LAT_PHASE_HANDSHAKE 為 -1
+ * return 0 = 成功, -1 = 失敗, -2 = 被 DoS 阻擋, -3 = 無車可用 (只有二進位回覆分得出來)
+ */
+int perform_ride_request_as(int sock_fd, const RideRequestData *req, uint16_t opcode, char *msg_buffer, double *phase_ms) {
+    char session_key[64]; // 用來存放動態協商的 Key
+    int assigned_driver_id; 
+    int resumed = 0;
+    FrameReader reader;         // 回應的 Header 與 Body 一次 read() 讀進來
+    FrameWriter writer;         // RESUME 與叫車請求合併成一次 writev
+    ResumeData resume_body;
+    RideRequestData req_body;
+
+    double handshake_ms = -1;
+    double t0 = get_time_ms();
+
+    frame_reader_init(&reader, sock_fd);
+    frame_writer_init(&writer, sock_fd);
+
+    // 0. 有 Ticket 就直接恢復 Session，並緊接著送出請求；否則先執行 DH 握手
+    if (queue_resume(&writer, &resume_body, session_key) == 0) {
+        resumed = 1;
+    } else if (perform_dh_handshake(&reader, session_key) < 0) {
+        snprintf(msg_buffer, 1024, "Handshake Failed");
+        return -1;
+    } else {
+        handshake_ms = get_time_ms() - t0;
+        t0 += handshake_ms;
+    }
+
+    // 以下通訊都使用 session_key 加密
+    if (queue_ride_request(&writer, &req_body, req, opcode, session_key) < 0) return -1;
+    if (frame_writer_flush(&writer) < 0) return -1;
+
+    // 4. 接收回應 Frame
     ProtocolHeader resp_header;
-    if (recv_n(sock_fd, &resp_header, sizeof(ProtocolHeader)) <= 0) return -1;
+    uint8_t *resp_body;
+    if (frame_reader_next(&reader, &resp_header, &resp_body) <= 0) return -1;
+
+    // Ticket 被拒絕 (過期 / Server 重啟)：同一條連線上改走完整握手並重送請求
+    if (resumed && resp_header.type == MSG_TYPE_RESUME_REJECT) {
+        t_ticket_cache.valid = 0;
+        if (perform_dh_handshake(&reader, session_key) < 0) {
+            snprintf(msg_buffer, 1024, "Handshake Failed");
+            return -1;
+        }
+        // 被拒絕的 RESUME 來回也算在握手裡
+        handshake_ms = get_time_ms() - t0;
+        t0 += handshake_ms;
+        if (queue_ride_request(&writer, &req_body, req, opcode, session_key) < 0) return -1;
+        if (frame_writer_flush(&writer) < 0) return -1;
+        if (frame_reader_next(&reader, &resp_header, &resp_body) <= 0) return -1;
+    }
+
+    if (phase_ms != NULL) {
+        phase_ms[LAT_PHASE_HANDSHAKE] = handshake_ms;
+        phase_ms[LAT_PHASE_REQUEST] = get_time_ms() - t0;
+    }
 
-    // 5. 接收 Body
+    // 5. 取出 Body
     if (resp_header.length > 0 && resp_header.length < 1024) {
-        if (recv_n(sock_fd, msg_buffer, resp_header.length) <= 0) return -1;
+        memcpy(msg_buffer, resp_body, resp_header.length);
         msg_buffer[resp_header.length] = '\0'; 
         
         // 使用動態 Session Key 解密
@@ -161,7 +257,20 @@ int perform_ride_request(int sock_fd, int client_id, char *msg_buffer) {
              return -1; 
         }
 
-        // 解析回覆
+        // 解析回覆：二進位結構直接讀欄位；文字回覆 (OP_RESPONSE) 仍照舊解析
+        if (resp_header.opcode == OP_RESPONSE_BIN) {
+            RideResponseData resp;
+            if (ride_response_decode((uint8_t*)msg_buffer, resp_header.length, &resp) < 0) {
+                snprintf(msg_buffer, 1024, "Unsupported Response Version");
+                return -1;
+            }
+            ride_response_format_text(&resp, msg_buffer, 1024); // 只供顯示
+            if (resp.status == RIDE_STATUS_CONFIRMED) return 0;
+            if (resp.status == RIDE_STATUS_BLOCKED) return -2;
+            if (resp.status == RIDE_STATUS_NO_DRIVER) return -3;
+            return -1;
+        }
+
         if (strstr(msg_buffer, "Ride Confirmed!")) {
             sscanf(msg_buffer, "%*[^:]: %d", &assigned_driver_id);
             return 0; // 成功
@@ -170,4 +279,23 @@ int perform_ride_request(int sock_fd, int client_id, char *msg_buffer) {
         }
     }
     return -1; // 失敗
-}
\ No newline at end of file
+}
+
+/**
+ * 以固定的上車點發送叫車請求 (ID <= 10 為 VIP)。
+ * return 0 = 成功, -1 = 失敗 / 無車可用, -2 = 被 DoS 阻擋
+ */
+int perform_ride_request_timed(int sock_fd, int client_id, char *msg_buffer, double *phase_ms) {
+    RideRequestData req;
+    req.client_id = client_id;
+    // 設定 VIP 邏輯：ID <= 10 為 VIP
+    req.type = (client_id <= 10) ? 1 : 0;
+    req.lat = 25.0330;
+    req.lon = 121.5654;
+    int result = perform_ride_request_as(sock_fd, &req, OP_REQ_RIDE_BIN, msg_buffer, phase_ms);
+    return result == -3 ? -1 : result;
+}
+
+int perform_ride_request(int sock_fd, int client_id, char *msg_buffer) {
+    return perform_ride_request_timed(sock_fd, client_id, msg_buffer, NULL);
+}
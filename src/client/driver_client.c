@@ -0,0 +1,313 @@
+/* src/client/driver_client.c */
+// 模擬車隊的 GPS 定位回報：每位司機以固定頻率送出 UDP 定位 Datagram (OP_UPDATE_LOC)
+// 同一輪所有司機的回報用 sendmmsg 一次送出
+// 加上 --tcp-port 時，每位司機另外維持一條加密的 TCP 長連線，接收 Server 推播的派單
+#define _GNU_SOURCE // sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../../common/include/protocol.h"
+#include "../../common/include/net_wrapper.h"
+#include "../../common/include/dh_crypto.h"
+
+#define BASE_LAT 25.0330
+#define BASE_LON 121.5654
+#define FIRST_DRIVER_ID 1001    // 與 server_app 初始化的司機 ID 一致
+#define SEND_BATCH 64
+
+typedef struct {
+    uint32_t driver_id;
+    uint64_t key;
+    uint32_t seq;
+    double lat;
+    double lon;
+
+    // TCP 長連線 (--tcp-port)
+    int fd;                 // -1 = 沒有長連線
+    char session_key[64];
+    FrameReader *reader;
+    long assignments;       // 收到的派單數
+} SimDriver;
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <Server IP> <UDP Port> <Num Drivers> [hz=1] [seconds=10]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --fleet-key=K   車隊金鑰 (必填，需與 server_app 的 --fleet-key 相同)\n");
+    fprintf(stderr, "  --duplicate     每個 Datagram 送兩次 (模擬網路重送，Server 應丟棄第二份)\n");
+    fprintf(stderr, "  --tcp-port=N    每位司機維持一條 TCP 長連線並印出 Server 推播的派單\n");
+}
+
+/**
+ * 建立司機長連線：DH 握手後送出身分證明 (MSG_TYPE_DRIVER_ATTACH)，等待確認。
+ * return 0 = 成功, -1 = 失敗
+ */
+static int driver_attach(SimDriver *d, const char *ip, int tcp_port) {
+    ProtocolHeader h;
+    uint8_t *body;
+
+    d->fd = connect_to_server(ip, tcp_port);
+    if (d->fd < 0) return -1;
+    d->reader = malloc(sizeof(FrameReader));
+    frame_reader_init(d->reader, d->fd);
+
+    // 1. DH 握手
+    long long priv = generate_private_key();
+    HandshakeData hs = { .public_key = calculate_public_key(priv) };
+    ProtocolHeader hs_h = { .length = sizeof(hs), .type = MSG_TYPE_HANDSHAKE, .opcode = OP_HANDSHAKE, .checksum = 0 };
+    if (send_frame(d->fd, &hs_h, &hs) < 0) return -1;
+    if (frame_reader_next(d->reader, &h, &body) <= 0 || h.type != MSG_TYPE_HANDSHAKE_ACK) return -1;
+    derive_session_key(calculate_shared_secret(((HandshakeData *)body)->public_key, priv), d->session_key, sizeof(d->session_key));
+
+    // 2. 身分證明 (綁定這條連線的 Session Key)
+    DriverAttachData attach = { .driver_id = d->driver_id, .proof = driver_attach_proof(d->key, d->session_key) };
+    ProtocolHeader attach_h = { .length = sizeof(attach), .type = MSG_TYPE_DRIVER_ATTACH, .opcode = OP_DRIVER_JOIN };
+    attach_h.checksum = calculate_checksum((uint8_t *)&attach, sizeof(attach));
+    rc4_crypt((uint8_t *)&attach, sizeof(attach), d->session_key);
+    if (send_frame(d->fd, &attach_h, &attach) < 0) return -1;
+
+    // 3. 確認 (連線被關閉代表證明錯誤)
+    if (frame_reader_next(d->reader, &h, &body) <= 0 || h.opcode != OP_DRIVER_JOIN) return -1;
+
+    fcntl(d->fd, F_SETFL, fcntl(d->fd, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+/**
+ * 讀出長連線上所有已到達的派單。
+ * return 0 = 連線正常, -1 = 連線關閉
+ */
+static int driver_read_assignments(SimDriver *d) {
+    ProtocolHeader h;
+    uint8_t *body;
+
+    while (1) {
+        int r = frame_reader_next(d->reader, &h, &body);
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (r <= 0) return -1;
+        if (h.type != MSG_TYPE_RIDE_ASSIGN || h.length != sizeof(RideAssignmentData)) continue;
+
+        rc4_crypt(body, h.length, d->session_key);
+        if (calculate_checksum(body, h.length) != h.checksum) {
+            printf("[Driver %u] Assignment checksum mismatch.\n", d->driver_id);
+            continue;
+        }
+        RideAssignmentData *a = (RideAssignmentData *)body;
+        d->assignments++;
+        printf("[Driver %u] Ride #%u assigned: client %u, pickup (%.4f, %.4f) -> (%.4f, %.4f), fare $%d\n",
+               d->driver_id, a->ride_id, a->client_id, a->pickup_lat, a->pickup_lon,
+               a->dest_lat, a->dest_lon, a->fare);
+    }
+}
+
+/**
+ * 送出一批 Datagram (sendmmsg 可能只送出一部分，剩下的繼續送)。
+ * return 實際送出的數量
+ */
+static int send_batch(int fd, const struct sockaddr_in *dest, LocationUpdateDatagram *dgrams, int count) {
+    struct mmsghdr msgs[SEND_BATCH];
+    struct iovec iovs[SEND_BATCH];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < count; i++) {
+        iovs[i].iov_base = &dgrams[i];
+        iovs[i].iov_len = sizeof(LocationUpdateDatagram);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = (void *)dest;
+        msgs[i].msg_hdr.msg_namelen = sizeof(*dest);
+    }
+
+    int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(fd, msgs + sent, count - sent, 0);
+        if (n <= 0) break;
+        sent += n;
+    }
+    return sent;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t fleet_key = DRIVER_FLEET_KEY_NONE;
+    int duplicate = 0;
+    int tcp_port = 0;
+
+    static struct option long_options[] = {
+        {"fleet-key", required_argument, NULL, 'k'},
+        {"duplicate", no_argument,       NULL, 'd'},
+        {"tcp-port",  required_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'k': fleet_key = strtoull(optarg, NULL, 0); break;
+            case 'd': duplicate = 1; break;
+            case 't': tcp_port = atoi(optarg); break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind < 3 || fleet_key == DRIVER_FLEET_KEY_NONE) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const char *server_ip = argv[optind];
+    int port = atoi(argv[optind + 1]);
+    int num_drivers = atoi(argv[optind + 2]);
+    double hz = (argc - optind > 3) ? atof(argv[optind + 3]) : 1.0;
+    int seconds = (argc - optind > 4) ? atoi(argv[optind + 4]) : 10;
+    if (num_drivers < 1 || hz <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &dest.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid address: %s\n", server_ip);
+        return 1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    srand(time(NULL) ^ getpid());
+
+    // 序號從目前的毫秒時間開始：程式重啟後的序號仍比上次送出的大，不會被 Server 當成舊資料
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint32_t seq_base = (uint32_t)(now.tv_sec * 1000ULL + now.tv_nsec / 1000000);
+
+    SimDriver *drivers = calloc(num_drivers, sizeof(SimDriver));
+    for (int i = 0; i < num_drivers; i++) {
+        drivers[i].driver_id = FIRST_DRIVER_ID + i;
+        drivers[i].key = driver_location_key(fleet_key, drivers[i].driver_id);
+        drivers[i].seq = seq_base;
+        drivers[i].lat = BASE_LAT + (rand() % 100) * 0.0001;
+        drivers[i].lon = BASE_LON + (rand() % 100) * 0.0001;
+        drivers[i].fd = -1;
+    }
+
+    // 司機長連線：全部掛在同一個 epoll 上，在兩輪定位回報之間等待派單
+    int epfd = -1;
+    int attached = 0;
+    if (tcp_port > 0) {
+        epfd = epoll_create1(0);
+        for (int i = 0; i < num_drivers; i++) {
+            SimDriver *d = &drivers[i];
+            if (driver_attach(d, server_ip, tcp_port) < 0) {
+                fprintf(stderr, "Driver %u: attach failed.\n", d->driver_id);
+                if (d->fd >= 0) close(d->fd);
+                d->fd = -1;
+                continue;
+            }
+            struct epoll_event ev = { .events = EPOLLIN, .data.ptr = d };
+            epoll_ctl(epfd, EPOLL_CTL_ADD, d->fd, &ev);
+            driver_read_assignments(d); // 斷線期間的派單會跟確認一起到
+            attached++;
+        }
+        printf("%d / %d drivers holding push connections on TCP port %d.\n", attached, num_drivers, tcp_port);
+    }
+
+    printf("Simulating %d drivers at %.1f Hz for %d s -> %s:%d (UDP)%s\n",
+           num_drivers, hz, seconds, server_ip, port, duplicate ? " [duplicate]" : "");
+
+    LocationUpdateDatagram batch[SEND_BATCH];
+    long sent_total = 0, attempted = 0;
+    long ticks = (long)(seconds * hz);
+    long interval_ns = (long)(1e9 / hz);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (long t = 0; t < ticks; t++) {
+        int count = 0;
+        for (int i = 0; i < num_drivers; i++) {
+            SimDriver *d = &drivers[i];
+            // 小幅隨機移動 (約 50 公尺)
+            d->lat += ((rand() % 3) - 1) * 0.0005;
+            d->lon += ((rand() % 3) - 1) * 0.0005;
+
+            LocationUpdateDatagram *dgram = &batch[count++];
+            dgram->opcode = OP_UPDATE_LOC;
+            dgram->reserved = 0;
+            dgram->driver_id = d->driver_id;
+            dgram->seq = ++d->seq;
+            dgram->lat_e7 = (int32_t)(d->lat * LOC_COORD_SCALE);
+            dgram->lon_e7 = (int32_t)(d->lon * LOC_COORD_SCALE);
+            location_datagram_seal(dgram, d->key);
+
+            if (duplicate && count < SEND_BATCH) {
+                batch[count] = batch[count - 1];
+                count++;
+            }
+            if (count >= SEND_BATCH - 1 || i == num_drivers - 1) {
+                attempted += count;
+                sent_total += send_batch(fd, &dest, batch, count);
+                count = 0;
+            }
+        }
+
+        // 以絕對時間排程，避免誤差累積
+        next.tv_nsec += interval_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        if (epfd < 0) {
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+            continue;
+        }
+
+        // 等到下一輪之前處理推播
+        while (1) {
+            struct timespec now_ts;
+            clock_gettime(CLOCK_MONOTONIC, &now_ts);
+            long wait_ms = (next.tv_sec - now_ts.tv_sec) * 1000 + (next.tv_nsec - now_ts.tv_nsec) / 1000000;
+            if (wait_ms <= 0) break;
+
+            struct epoll_event events[64];
+            int n = epoll_wait(epfd, events, 64, (int)wait_ms);
+            for (int i = 0; i < n; i++) {
+                SimDriver *d = events[i].data.ptr;
+                if (driver_read_assignments(d) < 0) {
+                    printf("[Driver %u] Push connection closed by server.\n", d->driver_id);
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, d->fd, NULL);
+                    close(d->fd);
+                    d->fd = -1;
+                }
+            }
+        }
+    }
+
+    printf("Sent %ld / %ld datagrams.\n", sent_total, attempted);
+    if (epfd >= 0) {
+        long total = 0;
+        for (int i = 0; i < num_drivers; i++) {
+            total += drivers[i].assignments;
+            if (drivers[i].fd >= 0) close(drivers[i].fd);
+            free(drivers[i].reader);
+        }
+        printf("Received %ld pushed ride assignments.\n", total);
+        close(epfd);
+    }
+    free(drivers);
+    close(fd);
+    return 0;
+}
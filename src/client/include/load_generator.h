@@ -0,0 +1,57 @@
+/* src/client/include/load_generator.h */
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <stdint.h>
+#include "latency_histogram.h"
+
+// 開放迴圈 (open-loop) 負載產生器
+// 封閉迴圈壓測 (每個執行緒等回覆才送下一個) 在 Server 變慢時會自動降低送出速度，
+// 慢的那段時間本來該送出的請求根本沒送，延遲統計因此嚴重偏低 (coordinated omission)。
+// 這裡依到達過程 (Poisson 或固定間隔) 預先排定每個請求的「預定送出時間」，不管前面的請求有沒有完成都照表送出，
+// 延遲一律從預定時間算起；少數幾個 epoll 執行緒以非阻塞 socket 同時推進所有連線。
+
+#define LOADGEN_ARRIVAL_POISSON  0  // 指數分布的到達間隔
+#define LOADGEN_ARRIVAL_CONSTANT 1  // 固定間隔
+
+#define LOADGEN_DEFAULT_THREADS      4
+#define LOADGEN_DEFAULT_MAX_INFLIGHT 2048  // 每個執行緒同時進行中的連線上限 (超過時請求排隊，延遲照樣從預定時間算)
+#define LOADGEN_DEFAULT_TIMEOUT_MS   2000
+
+typedef struct {
+    const char *ip;
+    int port;
+    double rate;                // 目標請求數 / 秒 (所有執行緒合計)
+    double duration_secs;
+    int arrival;                // LOADGEN_ARRIVAL_*
+    int threads;
+    int max_inflight;           // 每個執行緒
+    int timeout_ms;             // 單一請求從預定時間起的逾時
+    uint16_t request_opcode;    // OP_REQ_RIDE_BIN 或 OP_REQ_RIDE (文字回覆)
+} LoadGenConfig;
+
+typedef struct {
+    double offered_rate;        // 設定的目標速率
+    double elapsed_secs;        // 排程時間 (不含結束後等待回覆)
+    uint64_t scheduled;         // 排定的請求數
+    uint64_t completed;         // 收到有效回覆
+    uint64_t confirmed;         // 其中派車成功
+    uint64_t blocked;           // 其中被限流阻擋
+    uint64_t errors;            // 連線 / 協定錯誤
+    uint64_t timeouts;          // 逾時
+    uint64_t unsent;            // 排程結束時還在排隊、沒有送出的請求
+    // 各階段延遲 (合併所有執行緒)；LAT_PHASE_TOTAL 從預定送出時間算起
+    LatencyHistogram phases[LAT_PHASE_COUNT];
+    // 從實際開始連線算起的總延遲 (封閉迴圈工具看到的數字，與 TOTAL 比較可以看出排隊造成的差距)
+    LatencyHistogram service;
+    // 實際開始連線比預定時間晚多少 (負載產生器本身跟不上時會變大)
+    LatencyHistogram send_lag;
+} LoadGenResult;
+
+/**
+ * 以固定的目標速率執行一段時間，回傳統計。
+ * return 0 = 成功, -1 = 無法建立執行緒 / epoll
+ */
+int loadgen_run(const LoadGenConfig *cfg, LoadGenResult *result);
+
+#endif // LOAD_GENERATOR_H
@@ -0,0 +1,80 @@
+/* src/client/latency_histogram.c */
+#include <string.h>
+#include <stdint.h>
+
+#include "include/latency_histogram.h"
+
+const char *const latency_phase_names[LAT_PHASE_COUNT] = { "connect", "handshake", "request", "total" };
+
+/**
+ * 值對應的計數器位置：值的最高位元決定區間 b，區間內再取最高 8 個位元當作格子。
+ * 0..255 落在區間 0 (每格 1 µs)，之後每個區間的格寬加倍。
+ */
+static int hist_index(uint64_t value) {
+    int msb = 63 - __builtin_clzll(value | 1);
+    int bucket = msb - (HIST_SUB_BUCKET_BITS - 1);
+    if (bucket < 0) bucket = 0;
+    return bucket * HIST_HALF_BUCKETS + (int)(value >> bucket);
+}
+
+/**
+ * 計數器位置可代表的最大值。
+ */
+static uint64_t hist_highest_equivalent(int index) {
+    int bucket = index < HIST_SUB_BUCKETS ? 0 : index / HIST_HALF_BUCKETS - 1;
+    uint64_t sub = (uint64_t)(index - bucket * HIST_HALF_BUCKETS);
+    return (sub << bucket) + ((1ULL << bucket) - 1);
+}
+
+void hist_init(LatencyHistogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void hist_record(LatencyHistogram *h, uint64_t value_us) {
+    if (value_us >= (1ULL << HIST_MAX_VALUE_BITS)) value_us = (1ULL << HIST_MAX_VALUE_BITS) - 1;
+    h->counts[hist_index(value_us)]++;
+    if (h->total == 0 || value_us < h->min) h->min = value_us;
+    if (value_us > h->max) h->max = value_us;
+    h->total++;
+    h->sum += (double)value_us;
+}
+
+void hist_record_ms(LatencyHistogram *h, double value_ms) {
+    hist_record(h, value_ms > 0 ? (uint64_t)(value_ms * 1000.0 + 0.5) : 0);
+}
+
+void hist_merge(LatencyHistogram *dst, const LatencyHistogram *src) {
+    if (src->total == 0) return;
+    for (int i = 0; i < HIST_COUNTS; i++) dst->counts[i] += src->counts[i];
+    if (dst->total == 0 || src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->total += src->total;
+    dst->sum += src->sum;
+}
+
+uint64_t hist_percentile(const LatencyHistogram *h, double percentile) {
+    if (h->total == 0) return 0;
+    if (percentile > 100.0) percentile = 100.0;
+    // 第 rank 個值 (至少 1) 所在的格子
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->total + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_COUNTS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t value = hist_highest_equivalent(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+void hist_summarize(const LatencyHistogram *h, LatencySummary *out) {
+    out->count = h->total;
+    out->mean = h->total > 0 ? h->sum / (double)h->total : 0;
+    out->p50 = hist_percentile(h, 50.0);
+    out->p90 = hist_percentile(h, 90.0);
+    out->p99 = hist_percentile(h, 99.0);
+    out->p999 = hist_percentile(h, 99.9);
+    out->max = h->max;
+}
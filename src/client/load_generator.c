@@ -0,0 +1,392 @@
+/* src/client/load_generator.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "include/load_generator.h"
+#include "../../common/include/protocol.h"
+#include "../../common/include/net_wrapper.h"
+#include "../../common/include/dh_crypto.h"
+
+#define LOADGEN_EPOLL_EVENTS   256
+#define LOADGEN_MAX_WAIT_MS    10   // 沒有到期的請求時 epoll_wait 最多等這麼久 (順便檢查逾時)
+#define LOADGEN_SCAN_INTERVAL  0.02 // 逾時檢查間隔 (秒)
+
+// 單一請求的狀態：connect → 送出 DH 公鑰 → 收 ACK、送出加密請求 → 收回覆
+typedef enum {
+    CONN_FREE,
+    CONN_CONNECTING,
+    CONN_HANDSHAKE,     // 等待 HANDSHAKE_ACK
+    CONN_REQUEST        // 等待 RIDE_RESP
+} ConnState;
+
+typedef struct {
+    int fd;
+    ConnState state;
+    int next_free;              // 空閒串列
+    double intended;            // 預定送出時間
+    double started;             // 實際開始連線的時間
+    double connected;           // 連線建立
+    double acked;               // 收到 HANDSHAKE_ACK
+    long long priv;
+    uint32_t client_id;
+    char key[64];
+    size_t out_len, out_off;
+    uint8_t out[64];            // 待送出的 Frame (握手 / 請求都小於 64 bytes)
+    size_t in_len;
+    uint8_t in[sizeof(ProtocolHeader) + FRAME_MAX_BODY];
+} LoadConn;
+
+typedef struct {
+    int id;
+    const LoadGenConfig *cfg;
+    struct sockaddr_in addr;
+    double start, end;
+    int epfd;
+    LoadConn *conns;
+    int free_head;
+    int inflight;
+    unsigned int seed;
+    uint32_t seq;
+    // 結果
+    uint64_t scheduled, completed, confirmed, blocked, errors, timeouts, unsent;
+    LatencyHistogram phases[LAT_PHASE_COUNT];
+    LatencyHistogram service;
+    LatencyHistogram send_lag;
+} LoadThread;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * 下一個到達間隔 (秒)。每個執行緒負責 rate / threads。
+ */
+static double next_gap(LoadThread *t, double rate) {
+    if (t->cfg->arrival == LOADGEN_ARRIVAL_CONSTANT) return 1.0 / rate;
+    double u = (rand_r(&t->seed) + 1.0) / ((double)RAND_MAX + 2.0); // (0, 1)
+    return -log(u) / rate;
+}
+
+static void conn_release(LoadThread *t, LoadConn *c) {
+    close(c->fd); // close 也會自動移出 epoll
+    c->fd = -1;
+    c->state = CONN_FREE;
+    c->next_free = t->free_head;
+    t->free_head = (int)(c - t->conns);
+    t->inflight--;
+}
+
+static void conn_fail(LoadThread *t, LoadConn *c) {
+    t->errors++;
+    conn_release(t, c);
+}
+
+/**
+ * 把一個 Frame 放進送出緩衝區。
+ */
+static void conn_queue_frame(LoadConn *c, const ProtocolHeader *h, const void *body) {
+    memcpy(c->out, h, sizeof(*h));
+    memcpy(c->out + sizeof(*h), body, h->length);
+    c->out_len = sizeof(*h) + h->length;
+    c->out_off = 0;
+}
+
+/**
+ * 送出緩衝區剩餘的資料；送完後只等讀取事件，送不完就繼續等可寫。
+ * return 0 = 正常, -1 = 連線錯誤
+ */
+static int conn_flush(LoadThread *t, LoadConn *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return -1;
+        c->out_off += (size_t)n;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    if (c->out_off < c->out_len) ev.events |= EPOLLOUT;
+    return epoll_ctl(t->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/**
+ * 在預定時間 intended 開始一個請求 (非阻塞 connect)。
+ */
+static void conn_start(LoadThread *t, double intended, double now) {
+    int idx = t->free_head;
+    LoadConn *c = &t->conns[idx];
+    t->free_head = c->next_free;
+    t->inflight++;
+
+    c->intended = intended;
+    c->started = now;
+    c->in_len = 0;
+    c->out_len = 0;
+    c->out_off = 0;
+    // 每個請求用不同的 client_id，避免被每位乘客的限流擋下
+    c->client_id = 100000u + (uint32_t)t->id * 10000000u + t->seq++;
+    hist_record_ms(&t->send_lag, (now - intended) * 1000.0);
+
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) {
+        c->state = CONN_FREE;
+        c->next_free = t->free_head;
+        t->free_head = idx;
+        t->inflight--;
+        t->errors++;
+        return;
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->state = CONN_CONNECTING;
+
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+    if ((connect(c->fd, (struct sockaddr *)&t->addr, sizeof(t->addr)) < 0 && errno != EINPROGRESS) ||
+        epoll_ctl(t->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        conn_fail(t, c);
+    }
+}
+
+/**
+ * 連線建立：送出 DH 公鑰 (不要求 Ticket，每個請求都是完整的新連線)。
+ */
+static int conn_on_connected(LoadThread *t, LoadConn *c) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) return -1;
+    c->connected = now_sec();
+
+    c->priv = (rand_r(&t->seed) % 100000) + 1;
+    HandshakeData hs = { .public_key = calculate_public_key(c->priv) };
+    ProtocolHeader h = { .length = sizeof(hs), .type = MSG_TYPE_HANDSHAKE, .opcode = OP_HANDSHAKE, .checksum = 0 };
+    conn_queue_frame(c, &h, &hs);
+    c->state = CONN_HANDSHAKE;
+    return conn_flush(t, c);
+}
+
+/**
+ * 處理一個完整的 Frame。
+ * return 0 = 繼續, 1 = 請求完成 (已釋放連線), -1 = 錯誤
+ */
+static int conn_on_frame(LoadThread *t, LoadConn *c, ProtocolHeader *h, uint8_t *body) {
+    if (c->state == CONN_HANDSHAKE) {
+        if (h->type != MSG_TYPE_HANDSHAKE_ACK || h->length != sizeof(HandshakeData)) return -1;
+        c->acked = now_sec();
+        long long server_pub = ((HandshakeData *)body)->public_key;
+        derive_session_key(calculate_shared_secret(server_pub, c->priv), c->key, sizeof(c->key));
+
+        RideRequestData req = { .client_id = c->client_id, .type = 0, .lat = 25.0330, .lon = 121.5654 };
+        ProtocolHeader req_h = { .length = sizeof(req), .type = MSG_TYPE_RIDE_REQ, .opcode = t->cfg->request_opcode };
+        req_h.checksum = calculate_checksum((uint8_t *)&req, sizeof(req));
+        rc4_crypt((uint8_t *)&req, sizeof(req), c->key);
+        conn_queue_frame(c, &req_h, &req);
+        c->state = CONN_REQUEST;
+        return conn_flush(t, c);
+    }
+
+    if (c->state != CONN_REQUEST || h->type != MSG_TYPE_RIDE_RESP) return -1;
+    rc4_crypt(body, h->length, c->key);
+    if (calculate_checksum(body, h->length) != h->checksum) return -1;
+
+    double done = now_sec();
+    t->completed++;
+    hist_record_ms(&t->phases[LAT_PHASE_CONNECT], (c->connected - c->started) * 1000.0);
+    hist_record_ms(&t->phases[LAT_PHASE_HANDSHAKE], (c->acked - c->connected) * 1000.0);
+    hist_record_ms(&t->phases[LAT_PHASE_REQUEST], (done - c->acked) * 1000.0);
+    hist_record_ms(&t->phases[LAT_PHASE_TOTAL], (done - c->intended) * 1000.0);
+    hist_record_ms(&t->service, (done - c->started) * 1000.0);
+    if (h->opcode == OP_RESPONSE_BIN) {
+        RideResponseData resp;
+        if (ride_response_decode(body, h->length, &resp) == 0) {
+            if (resp.status == RIDE_STATUS_CONFIRMED) t->confirmed++;
+            if (resp.status == RIDE_STATUS_BLOCKED) t->blocked++;
+        }
+    } else {
+        char text[FRAME_MAX_BODY + 1];
+        memcpy(text, body, h->length);
+        text[h->length] = '\0';
+        if (strstr(text, "Ride Confirmed!")) t->confirmed++;
+        if (strstr(text, "Blocked.")) t->blocked++;
+    }
+    conn_release(t, c);
+    return 1;
+}
+
+/**
+ * 讀取並處理所有已到達的 Frame。
+ * return 0 = 繼續, 1 = 請求完成, -1 = 錯誤 / 連線關閉
+ */
+static int conn_on_readable(LoadThread *t, LoadConn *c) {
+    while (1) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+        c->in_len += (size_t)n;
+
+        ProtocolHeader h;
+        ssize_t frame_len;
+        while ((frame_len = frame_parse(c->in, c->in_len, &h)) > 0) {
+            int rc = conn_on_frame(t, c, &h, c->in + sizeof(ProtocolHeader));
+            if (rc != 0) return rc;
+            memmove(c->in, c->in + frame_len, c->in_len - (size_t)frame_len);
+            c->in_len -= (size_t)frame_len;
+        }
+        if (frame_len < 0) return -1;
+    }
+}
+
+static void conn_on_event(LoadThread *t, LoadConn *c, uint32_t events) {
+    int rc = 0;
+    if (c->state == CONN_CONNECTING) {
+        rc = conn_on_connected(t, c);
+    } else {
+        if (events & EPOLLOUT) rc = conn_flush(t, c);
+        if (rc == 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) rc = conn_on_readable(t, c);
+    }
+    if (rc < 0) conn_fail(t, c);
+}
+
+/**
+ * 逾時的請求 (從預定時間算起) 視為失敗。
+ */
+static void expire_conns(LoadThread *t, double now) {
+    double limit = t->cfg->timeout_ms / 1000.0;
+    for (int i = 0; i < t->cfg->max_inflight; i++) {
+        LoadConn *c = &t->conns[i];
+        if (c->state != CONN_FREE && now - c->intended > limit) {
+            t->timeouts++;
+            conn_release(t, c);
+        }
+    }
+}
+
+static void *load_thread(void *arg) {
+    LoadThread *t = arg;
+    const LoadGenConfig *cfg = t->cfg;
+    double rate = cfg->rate / cfg->threads;
+    struct epoll_event events[LOADGEN_EPOLL_EVENTS];
+
+    // 各執行緒的第一個到達時間錯開，避免固定間隔時同時送出
+    double next = t->start + next_gap(t, rate) * ((cfg->arrival == LOADGEN_ARRIVAL_CONSTANT) ? (double)t->id / cfg->threads : 1.0);
+    double last_scan = t->start;
+    double drain_deadline = t->end + cfg->timeout_ms / 1000.0;
+
+    while (1) {
+        double now = now_sec();
+        // 到期的請求全部送出；連線數已滿時留在排程上 (next 不前進)，延遲照樣從預定時間算
+        while (next <= now && next < t->end && t->inflight < cfg->max_inflight) {
+            conn_start(t, next, now);
+            t->scheduled++;
+            next += next_gap(t, rate);
+        }
+        if (now >= t->end && (t->inflight == 0 || now >= drain_deadline)) break;
+        if (now - last_scan >= LOADGEN_SCAN_INTERVAL) {
+            expire_conns(t, now);
+            last_scan = now;
+        }
+
+        int wait_ms = LOADGEN_MAX_WAIT_MS;
+        if (next < t->end && t->inflight < cfg->max_inflight) {
+            double until = (next - now) * 1000.0;
+            wait_ms = until <= 0 ? 0 : (until < LOADGEN_MAX_WAIT_MS ? (int)ceil(until) : LOADGEN_MAX_WAIT_MS);
+        }
+        int n = epoll_wait(t->epfd, events, LOADGEN_EPOLL_EVENTS, wait_ms);
+        for (int i = 0; i < n; i++) {
+            LoadConn *c = events[i].data.ptr;
+            if (c->state != CONN_FREE) conn_on_event(t, c, events[i].events);
+        }
+    }
+
+    // 排程結束時還沒送出的請求 (連線數一直是滿的)
+    while (next < t->end) {
+        t->unsent++;
+        t->scheduled++;
+        next += next_gap(t, rate);
+    }
+    expire_conns(t, now_sec() + cfg->timeout_ms / 1000.0); // 剩下的都算逾時
+    return NULL;
+}
+
+int loadgen_run(const LoadGenConfig *cfg, LoadGenResult *result) {
+    memset(result, 0, sizeof(*result));
+    result->offered_rate = cfg->rate;
+    if (cfg->threads <= 0 || cfg->max_inflight <= 0 || cfg->rate <= 0) return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(cfg->port);
+    if (inet_pton(AF_INET, cfg->ip, &addr.sin_addr) <= 0) return -1;
+
+    LoadThread *threads = calloc(cfg->threads, sizeof(LoadThread)); // 直方圖計數器從 0 開始
+    pthread_t *tids = calloc(cfg->threads, sizeof(pthread_t));
+    if (threads == NULL || tids == NULL) {
+        free(threads);
+        free(tids);
+        return -1;
+    }
+
+    double start = now_sec() + 0.05; // 讓所有執行緒就緒後一起開始
+    int started = 0, rc = 0;
+    for (int i = 0; i < cfg->threads; i++) {
+        LoadThread *t = &threads[i];
+        t->id = i;
+        t->cfg = cfg;
+        t->addr = addr;
+        t->start = start;
+        t->end = start + cfg->duration_secs;
+        t->seed = (unsigned int)(time(NULL) ^ (getpid() << 8) ^ (i * 2654435761u));
+        t->epfd = epoll_create1(0);
+        t->conns = calloc(cfg->max_inflight, sizeof(LoadConn));
+        if (t->epfd < 0 || t->conns == NULL) {
+            rc = -1;
+            break;
+        }
+        for (int k = 0; k < cfg->max_inflight; k++) {
+            t->conns[k].fd = -1;
+            t->conns[k].next_free = k + 1 < cfg->max_inflight ? k + 1 : -1;
+        }
+        t->free_head = 0;
+        if (pthread_create(&tids[i], NULL, load_thread, t) != 0) {
+            rc = -1;
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    result->elapsed_secs = now_sec() - start;
+    if (result->elapsed_secs > cfg->duration_secs) result->elapsed_secs = cfg->duration_secs;
+
+    for (int i = 0; i < cfg->threads; i++) {
+        LoadThread *t = &threads[i];
+        result->scheduled += t->scheduled;
+        result->completed += t->completed;
+        result->confirmed += t->confirmed;
+        result->blocked += t->blocked;
+        result->errors += t->errors;
+        result->timeouts += t->timeouts;
+        result->unsent += t->unsent;
+        for (int p = 0; p < LAT_PHASE_COUNT; p++) hist_merge(&result->phases[p], &t->phases[p]);
+        hist_merge(&result->service, &t->service);
+        hist_merge(&result->send_lag, &t->send_lag);
+        if (t->epfd > 0) close(t->epfd);
+        free(t->conns);
+    }
+
+    free(threads);
+    free(tids);
+    return rc;
+}
@@ -5,12 +5,16 @@
 #include <unistd.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include <pthread.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
-#include <signal.h> 
+#include <signal.h>
+#include <getopt.h>
 
+#include "include/load_generator.h"
+#include "include/latency_histogram.h"
 #include "../../common/include/protocol.h"
 #include "../../common/include/net_wrapper.h"
 #include "../../common/include/log_system.h"
@@ -18,7 +22,7 @@
 #define SECRET_KEY "RIDE_HAILING_2025_SECURE_KEY"
 
 // 宣告在 client_core.c 中定義的核心函式 (外部引用)
-extern int perform_ride_request(int sock_fd, int client_id, char *msg_buffer);
+extern int perform_ride_request_timed(int sock_fd, int client_id, char *msg_buffer, double *phase_ms);
 extern double get_time_ms();
 extern void get_time_str(char *buffer, size_t size);
 
@@ -39,26 +43,160 @@ typedef struct {
 } ClientStatusEntry;
 
 
-// 統計結構
+// 每個執行緒自己的統計 (不需要鎖)，全部結束後再合併
 
 typedef struct {
-    pthread_mutex_t lock;
     long total_requests;
     long success_count;
     long fail_count;
-    double total_latency_ms;
+    LatencyHistogram phases[LAT_PHASE_COUNT];   // 只記錄成功的請求
 } ClientStats;
 
 typedef struct {
     int client_id;
     char *server_ip;
     int server_port;
-    ClientStats *stats;
+    ClientStats stats;
     ClientStatusEntry *status_list; // 指向 Client 狀態陣列的指針
-    int requests_per_thread; 
+    int requests_per_thread;
 } ThreadArgs;
 
 
+// 報表輸出 (--csv / --json)
+// CSV 以附加方式寫入 (檔案是新的才寫欄位名稱)，每次執行、每一階、每個階段一行，方便長期比較；
+// JSON 每次執行覆寫成一份完整文件。
+
+typedef struct {
+    FILE *csv;
+    FILE *json;
+    int json_steps;
+    char run_at[32];
+    const char *label;
+    const char *mode;
+} Report;
+
+// 一階的計數 (封閉迴圈只有一階，offered 為 0)
+typedef struct {
+    double offered_rps;
+    double achieved_rps;
+    uint64_t completed;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint64_t unsent;
+} StepCounts;
+
+static void json_write_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', fp);
+        if ((unsigned char)*s >= 0x20) fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/**
+ * 開啟報表檔案並寫入開頭。路徑為 NULL 的格式不輸出。
+ * return 0 = 成功, -1 = 無法開檔
+ */
+static int report_open(Report *r, const char *csv_path, const char *json_path, const char *label,
+                       const char *mode, const char *target, const char *detail) {
+    memset(r, 0, sizeof(*r));
+    r->label = label ? label : "";
+    r->mode = mode;
+    time_t now = time(NULL);
+    strftime(r->run_at, sizeof(r->run_at), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    if (csv_path != NULL) {
+        struct stat st;
+        int fresh = stat(csv_path, &st) != 0 || st.st_size == 0;
+        r->csv = fopen(csv_path, "a");
+        if (r->csv == NULL) {
+            perror("open csv");
+            return -1;
+        }
+        if (fresh) {
+            fprintf(r->csv, "run_at,label,mode,offered_rps,achieved_rps,completed,errors,timeouts,unsent,"
+                            "phase,count,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+        }
+    }
+    if (json_path != NULL) {
+        r->json = fopen(json_path, "w");
+        if (r->json == NULL) {
+            perror("open json");
+            return -1;
+        }
+        fprintf(r->json, "{\n  \"run_at\": \"%s\",\n  \"label\": ", r->run_at);
+        json_write_string(r->json, r->label);
+        fprintf(r->json, ",\n  \"mode\": \"%s\",\n  \"target\": \"%s\",\n  \"config\": \"%s\",\n  \"steps\": [",
+                mode, target, detail);
+    }
+    return 0;
+}
+
+static void report_step(Report *r, const StepCounts *c, const LatencyHistogram phases[LAT_PHASE_COUNT]) {
+    LatencySummary s[LAT_PHASE_COUNT];
+    for (int p = 0; p < LAT_PHASE_COUNT; p++) hist_summarize(&phases[p], &s[p]);
+
+    if (r->csv != NULL) {
+        for (int p = 0; p < LAT_PHASE_COUNT; p++) {
+            fprintf(r->csv, "%s,", r->run_at);
+            // CSV 欄位內的逗號 / 引號以雙引號包住
+            if (strpbrk(r->label, ",\"") != NULL) {
+                fputc('"', r->csv);
+                for (const char *q = r->label; *q; q++) {
+                    if (*q == '"') fputc('"', r->csv);
+                    fputc(*q, r->csv);
+                }
+                fputc('"', r->csv);
+            } else {
+                fputs(r->label, r->csv);
+            }
+            fprintf(r->csv, ",%s,%.0f,%.1f,%lu,%lu,%lu,%lu,%s,%lu,%.1f,%lu,%lu,%lu,%lu,%lu\n",
+                    r->mode, c->offered_rps, c->achieved_rps, c->completed, c->errors, c->timeouts, c->unsent,
+                    latency_phase_names[p], s[p].count, s[p].mean, s[p].p50, s[p].p90, s[p].p99, s[p].p999, s[p].max);
+        }
+        fflush(r->csv);
+    }
+    if (r->json != NULL) {
+        fprintf(r->json, "%s\n    {\"offered_rps\": %.0f, \"achieved_rps\": %.1f, \"completed\": %lu, \"errors\": %lu, "
+                         "\"timeouts\": %lu, \"unsent\": %lu, \"phases\": {",
+                r->json_steps++ > 0 ? "," : "", c->offered_rps, c->achieved_rps, c->completed, c->errors,
+                c->timeouts, c->unsent);
+        for (int p = 0; p < LAT_PHASE_COUNT; p++) {
+            fprintf(r->json, "%s\n      \"%s\": {\"count\": %lu, \"mean_us\": %.1f, \"p50_us\": %lu, \"p90_us\": %lu, "
+                             "\"p99_us\": %lu, \"p999_us\": %lu, \"max_us\": %lu}",
+                    p > 0 ? "," : "", latency_phase_names[p], s[p].count, s[p].mean,
+                    s[p].p50, s[p].p90, s[p].p99, s[p].p999, s[p].max);
+        }
+        fprintf(r->json, "\n    }}");
+    }
+}
+
+static void report_close(Report *r) {
+    if (r->csv != NULL) fclose(r->csv);
+    if (r->json != NULL) {
+        fprintf(r->json, "\n  ]\n}\n");
+        fclose(r->json);
+    }
+}
+
+/**
+ * 各階段延遲表 (ms)。
+ */
+static void print_phase_table(const LatencyHistogram phases[LAT_PHASE_COUNT]) {
+    printf("+-----------+----------+----------+----------+----------+----------+----------+----------+\n");
+    printf("| Phase     | count    | mean ms  | p50 ms   | p90 ms   | p99 ms   | p99.9 ms | max ms   |\n");
+    printf("+-----------+----------+----------+----------+----------+----------+----------+----------+\n");
+    for (int p = 0; p < LAT_PHASE_COUNT; p++) {
+        LatencySummary s;
+        hist_summarize(&phases[p], &s);
+        printf("| %-9s | %8lu | %8.2f | %8.2f | %8.2f | %8.2f | %8.2f | %8.2f |\n", latency_phase_names[p], s.count,
+               s.mean / 1000.0, s.p50 / 1000.0, s.p90 / 1000.0, s.p99 / 1000.0, s.p999 / 1000.0, s.max / 1000.0);
+    }
+    printf("+-----------+----------+----------+----------+----------+----------+----------+----------+\n");
+}
+
+
 // 輔助函式：輸出狀態表格
 
 void print_client_status_table(ClientStatusEntry *status_list, int count) {
@@ -93,56 +231,60 @@ void print_client_status_table(ClientStatusEntry *status_list, int count) {
 
 void *stress_client_thread_func(void *arg) {
     ThreadArgs *args = (ThreadArgs *)arg;
-    int sock_fd; 
+    ClientStats *stats = &args->stats;
+    int sock_fd;
     char time_buf[32];
-    char msg_buffer[1024]; 
+    char msg_buffer[1024];
+    double phase_ms[LAT_PHASE_COUNT];
     int success_local_count = 0; // 追蹤該執行緒是否有成功
-    
+
     // 使用 rand() 初始化
-    srand(time(NULL) ^ args->client_id); 
+    srand(time(NULL) ^ args->client_id);
 
     for (int i = 0; i < args->requests_per_thread; i++) {
+        double start = get_time_ms();
+
         sock_fd = connect_to_server(args->server_ip, args->server_port);
         if (sock_fd < 0) {
             // ... (連線失敗邏輯不變) ...
-            usleep(100 * 1000); 
-            continue; 
+            usleep(100 * 1000);
+            continue;
         }
+        phase_ms[LAT_PHASE_CONNECT] = get_time_ms() - start;
 
         // 設定 Timeout
         struct timeval tv = {2, 0};
         setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
 
-        double start = get_time_ms(); 
-        
-        int result = perform_ride_request(sock_fd, args->client_id, msg_buffer); 
-        
-        close(sock_fd); 
+        int result = perform_ride_request_timed(sock_fd, args->client_id, msg_buffer, phase_ms);
+
+        close(sock_fd);
 
-        double end = get_time_ms(); 
+        double end = get_time_ms();
 
-        pthread_mutex_lock(&args->stats->lock);
-        args->stats->total_requests++;
+        stats->total_requests++;
         if (result == 0) {
-            args->stats->success_count++;
-            args->stats->total_latency_ms += (end - start);
+            stats->success_count++;
+            phase_ms[LAT_PHASE_TOTAL] = end - start;
+            for (int p = 0; p < LAT_PHASE_COUNT; p++) {
+                if (phase_ms[p] >= 0) hist_record_ms(&stats->phases[p], phase_ms[p]); // Ticket 恢復時沒有握手
+            }
             success_local_count++; // 該執行緒成功計數
         } else {
-            args->stats->fail_count++;
+            stats->fail_count++;
         }
-        pthread_mutex_unlock(&args->stats->lock);
 
         if (result == 0) {
             // Log 輸出 (前 30 人)
             if (args->client_id <= 30) {
-                get_time_str(time_buf, sizeof(time_buf)); 
+                get_time_str(time_buf, sizeof(time_buf));
                 printf("[%s] Client %3d: %s\n", time_buf, args->client_id, msg_buffer);
             }
-            usleep(200 * 1000); 
+            usleep(200 * 1000);
         } else if (result == -2) {
             // DoS 阻擋 Log (前 30 人)
             if (args->client_id <= 30) {
-                 printf("\033[1;33m[Client %d] Blocked! Retrying.\033[0m\n", args->client_id); 
+                 printf("\033[1;33m[Client %d] Blocked! Retrying.\033[0m\n", args->client_id);
             }
             // 更新最終狀態為 DoS 阻擋 (如果這是第一個失敗)
             if (args->status_list[args->client_id - 1].final_status == STATUS_INIT) {
@@ -152,43 +294,134 @@ void *stress_client_thread_func(void *arg) {
         } else {
             // 失敗重試 Log (前 30 人)
             if (args->client_id <= 30) {
-                 printf("[Client %d] Request failed/no driver. Retrying.\n", args->client_id); 
+                 printf("[Client %d] Request failed/no driver. Retrying.\n", args->client_id);
             }
             // 更新最終狀態為 No Driver
             if (args->status_list[args->client_id - 1].final_status == STATUS_INIT) {
                 args->status_list[args->client_id - 1].final_status = STATUS_FAIL_NO_DRIVER;
             }
-            usleep((rand() % 300 + 200) * 1000); 
+            usleep((rand() % 300 + 200) * 1000);
         }
     }
-    
-    // 執行緒結束時，設定最終狀態
-    pthread_mutex_lock(&args->stats->lock); 
-    if (success_local_count > 0) { 
+
+    // 執行緒結束時，設定最終狀態 (每個執行緒只寫自己的那一格)
+    if (success_local_count > 0) {
         args->status_list[args->client_id - 1].final_status = STATUS_SUCCESS;
     } else if (args->status_list[args->client_id - 1].final_status == STATUS_INIT) {
         // 如果狀態仍然是 INIT，表示所有請求都失敗了，最終設為 No Driver
         args->status_list[args->client_id - 1].final_status = STATUS_FAIL_NO_DRIVER;
     }
-    pthread_mutex_unlock(&args->stats->lock);
-
-    free(args);
     return NULL;
 }
 
 
-int main(int argc, char *argv[]) {
-    // 忽略 SIGPIPE 訊號
-    signal(SIGPIPE, SIG_IGN); 
+// 開放迴圈模式 (--rate)
+
+#define KNEE_MIN_THROUGHPUT 0.95    // 實際完成率低於目標的 95%
+#define KNEE_MAX_ERROR_RATE 0.01    // 或錯誤 / 逾時超過 1%
+#define KNEE_P99_FACTOR     5.0     // 或 p99 超過第一階的 5 倍，視為超過飽和點
+#define LOADGEN_LAG_WARN_MS 2.0     // epoll_wait 以 ms 為單位，1 ms 內的送出延遲是正常的
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s <Server IP> <Port> <Num Clients> [--csv=F] [--json=F] [--label=L]   (closed-loop)\n", prog);
+    printf("       %s <Server IP> <Port> --rate=R [options]                            (open-loop)\n", prog);
+    printf("  --rate=R          目標請求數 / 秒 (開放迴圈：照排程送出，不等前一個請求完成)\n");
+    printf("  --rate-max=M      從 R 開始逐階提高到 M，找出飽和點 (預設只跑 R)\n");
+    printf("  --rate-step=S     每階增加的速率 (預設 = R)\n");
+    printf("  --duration=N      每階秒數 (預設 10)\n");
+    printf("  --arrival=A       poisson (預設) 或 constant\n");
+    printf("  --threads=N       epoll 執行緒數 (預設 %d)\n", LOADGEN_DEFAULT_THREADS);
+    printf("  --max-inflight=N  每個執行緒同時進行的請求上限 (預設 %d)\n", LOADGEN_DEFAULT_MAX_INFLIGHT);
+    printf("  --timeout-ms=N    從預定送出時間起的逾時 (預設 %d)\n", LOADGEN_DEFAULT_TIMEOUT_MS);
+    printf("  --text            要求文字回覆 (預設二進位)\n");
+    printf("  --csv=F           把各階段延遲附加到 CSV 檔 (每階、每個階段一行)\n");
+    printf("  --json=F          把這次執行的結果寫成 JSON 檔\n");
+    printf("  --label=L         報表中標示這次執行的名稱 (例如 commit 或設定)\n");
+    printf("建議 Server 以 --admit-rate=0 啟動，否則同一個 IP 的連線會被准入控制擋下。\n");
+}
 
-    if (argc < 4) {
-        printf("Usage: %s <Server IP> <Port> <Num Clients>\n", argv[0]);
+/**
+ * 逐階提高目標速率，每階輸出一行，最後指出飽和點 (knee) 與該階的各階段延遲。
+ */
+static int run_open_loop(LoadGenConfig *cfg, double rate_max, double rate_step, Report *report) {
+    if (rate_step <= 0) rate_step = cfg->rate;
+    if (rate_max < cfg->rate) rate_max = cfg->rate;
+
+    printf("Open-loop load: %s:%d, %s arrivals, %d epoll threads, %.0f s per step, %s replies\n",
+           cfg->ip, cfg->port, cfg->arrival == LOADGEN_ARRIVAL_POISSON ? "Poisson" : "constant", cfg->threads,
+           cfg->duration_secs, cfg->request_opcode == OP_REQ_RIDE ? "text" : "binary");
+    printf("Latency is measured from each request's intended send time (no coordinated omission).\n");
+    printf("+----------+----------+----------+---------+---------+---------+---------+---------+---------+---------+----------+\n");
+    printf("| offered  | achieved | complete | err+t/o | unsent  | p50 ms  | p90 ms  | p99 ms  | p99.9ms | max ms  | svc p99  |\n");
+    printf("+----------+----------+----------+---------+---------+---------+---------+---------+---------+---------+----------+\n");
+
+    // 結果含 6 個直方圖 (約 80 KB)，放在 heap
+    LoadGenResult *r = malloc(sizeof(LoadGenResult));
+    LoadGenResult *knee_result = malloc(sizeof(LoadGenResult));
+    if (r == NULL || knee_result == NULL) {
+        free(r);
+        free(knee_result);
         return 1;
     }
+    double base_p99 = 0, knee = 0;
+    int saturated = 0;
+    for (double rate = cfg->rate; rate <= rate_max + 1e-9 && !saturated; rate += rate_step) {
+        cfg->rate = rate;
+        if (loadgen_run(cfg, r) < 0) {
+            printf("load generator failed to start\n");
+            free(r);
+            free(knee_result);
+            return 1;
+        }
+        LatencySummary total;
+        hist_summarize(&r->phases[LAT_PHASE_TOTAL], &total);
+        double achieved = r->completed / r->elapsed_secs;
+        double failed = (double)(r->errors + r->timeouts + r->unsent) / (r->scheduled > 0 ? r->scheduled : 1);
+        double p99_ms = total.p99 / 1000.0;
+        printf("| %8.0f | %8.0f | %8lu | %7lu | %7lu | %7.2f | %7.2f | %7.2f | %7.2f | %7.1f | %8.2f |\n",
+               rate, achieved, r->completed, r->errors + r->timeouts, r->unsent,
+               total.p50 / 1000.0, total.p90 / 1000.0, p99_ms, total.p999 / 1000.0, total.max / 1000.0,
+               hist_percentile(&r->service, 99.0) / 1000.0);
+        double lag_ms = hist_percentile(&r->send_lag, 99.0) / 1000.0;
+        if (lag_ms > LOADGEN_LAG_WARN_MS) {
+            printf("  ^ generator start lag p99 %.2f ms (load generator is CPU bound; add --threads or another machine)\n",
+                   lag_ms);
+        }
 
-    char *server_ip = argv[1];
-    int server_port = atoi(argv[2]);
-    int num_clients = atoi(argv[3]); 
+        StepCounts counts = { rate, achieved, r->completed, r->errors, r->timeouts, r->unsent };
+        report_step(report, &counts, r->phases);
+
+        if (base_p99 == 0) base_p99 = p99_ms > 0.1 ? p99_ms : 0.1;
+        if (achieved < rate * KNEE_MIN_THROUGHPUT || failed > KNEE_MAX_ERROR_RATE || p99_ms > base_p99 * KNEE_P99_FACTOR) {
+            saturated = 1;
+        } else {
+            knee = rate;
+            memcpy(knee_result, r, sizeof(*r));
+        }
+        if (!saturated && rate + rate_step <= rate_max + 1e-9) sleep(1); // 讓上一階的連線收尾 (TIME_WAIT、Server 佇列)
+    }
+    printf("+----------+----------+----------+---------+---------+---------+---------+---------+---------+---------+----------+\n");
+    if (saturated && knee > 0) {
+        printf("Saturation knee: ~%.0f req/s (last step that kept up; the next step fell behind or p99 > %.0fx)\n",
+               knee, KNEE_P99_FACTOR);
+    } else if (saturated) {
+        printf("Saturated at the first step (%.0f req/s); lower --rate.\n", cfg->rate);
+    } else {
+        printf("No saturation up to %.0f req/s; raise --rate-max.\n", rate_max);
+    }
+    if (knee > 0) {
+        printf("\nPer-phase latency at %.0f req/s (total = from intended send time):\n", knee);
+        print_phase_table(knee_result->phases);
+    }
+    free(r);
+    free(knee_result);
+    return 0;
+}
+
+/**
+ * 原本的封閉迴圈壓測：每個 Client 一個執行緒，連線 → 請求 → 休息，重複 requests_per_client 次。
+ */
+static int run_closed_loop(char *server_ip, int server_port, int num_clients, Report *report) {
     int requests_per_client = 10; // 每個客戶嘗試 10 次 (可調)
 
     if (num_clients <= 0) num_clients = 1;
@@ -198,54 +431,164 @@ int main(int argc, char *argv[]) {
     log_info("Starting stress test: %d clients, %d requests each...", num_clients, requests_per_client);
 
     pthread_t *threads = malloc(sizeof(pthread_t) * num_clients);
-    ClientStats stats = {PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0.0};
-    
+    // 每個執行緒的統計含直方圖；calloc 的大區塊由 mmap 提供，只有真正用到的分頁才佔記憶體
+    ThreadArgs *args = calloc(num_clients, sizeof(ThreadArgs));
+
     // 創建 Client 狀態追蹤陣列
     ClientStatusEntry *status_list = malloc(sizeof(ClientStatusEntry) * num_clients);
-    if (!status_list) {
+    if (!status_list || !args || !threads) {
         perror("malloc status_list failed");
         return 1;
     }
-    
-    double start_time = get_time_ms(); 
+
+    double start_time = get_time_ms();
 
     for (int i = 0; i < num_clients; i++) {
-        ThreadArgs *args = malloc(sizeof(ThreadArgs));
-        args->client_id = i + 1;
-        args->server_ip = server_ip;
-        args->server_port = server_port;
-        args->stats = &stats;
-        args->requests_per_thread = requests_per_client;
-        
+        args[i].client_id = i + 1;
+        args[i].server_ip = server_ip;
+        args[i].server_port = server_port;
+        args[i].requests_per_thread = requests_per_client;
+
         // 初始化 Client 狀態並傳遞指針
         status_list[i].client_id = i + 1;
         status_list[i].final_status = STATUS_INIT;
-        args->status_list = status_list;
+        args[i].status_list = status_list;
 
-        pthread_create(&threads[i], NULL, stress_client_thread_func, args);
+        pthread_create(&threads[i], NULL, stress_client_thread_func, &args[i]);
     }
 
+    // 合併每個執行緒的統計
+    ClientStats *stats = calloc(1, sizeof(ClientStats));
     for (int i = 0; i < num_clients; i++) {
         pthread_join(threads[i], NULL);
+        stats->total_requests += args[i].stats.total_requests;
+        stats->success_count += args[i].stats.success_count;
+        stats->fail_count += args[i].stats.fail_count;
+        for (int p = 0; p < LAT_PHASE_COUNT; p++) hist_merge(&stats->phases[p], &args[i].stats.phases[p]);
     }
 
-    double end_time = get_time_ms(); 
-    
+    double end_time = get_time_ms();
+
     // 輸出詳細狀態表格
     print_client_status_table(status_list, num_clients);
 
     printf("\n=== Stress Test Summary ===\n");
-    printf("Total Duration   : %.2f ms\n", end_time - start_time);
-    printf("Total Requests   : %ld\n", stats.total_requests);
-    printf("Successful Rides : %ld\n", stats.success_count);
-    printf("Failed Requests  : %ld\n", stats.fail_count);
-    if (stats.success_count > 0) {
-        printf("Avg Latency      : %.2f ms\n", stats.total_latency_ms / stats.success_count);
+    printf("Total Duration   : %.2f ms\n", end_time - start_time);
+    printf("Total Requests   : %ld\n", stats->total_requests);
+    printf("Successful Rides : %ld\n", stats->success_count);
+    printf("Failed Requests  : %ld\n", stats->fail_count);
+    if (stats->success_count > 0) {
+        printf("Avg Latency      : %.2f ms\n", stats->phases[LAT_PHASE_TOTAL].sum / stats->success_count / 1000.0);
     }
     printf("===========================\n");
+    if (stats->success_count > 0) {
+        printf("\nPer-phase latency of successful requests (handshake only when a full DH handshake ran):\n");
+        print_phase_table(stats->phases);
+    }
 
+    double seconds = (end_time - start_time) / 1000.0;
+    StepCounts counts = { 0, seconds > 0 ? stats->success_count / seconds : 0, (uint64_t)stats->success_count,
+                          (uint64_t)stats->fail_count, 0, 0 };
+    report_step(report, &counts, stats->phases);
+
+    free(stats);
     free(status_list); // 釋放狀態陣列
+    free(args);
     free(threads);
     log_cleanup();
     return 0;
-}
\ No newline at end of file
+}
+
+
+int main(int argc, char *argv[]) {
+    // 忽略 SIGPIPE 訊號
+    signal(SIGPIPE, SIG_IGN);
+
+    LoadGenConfig cfg = {
+        .rate = 0, .duration_secs = 10, .arrival = LOADGEN_ARRIVAL_POISSON,
+        .threads = LOADGEN_DEFAULT_THREADS, .max_inflight = LOADGEN_DEFAULT_MAX_INFLIGHT,
+        .timeout_ms = LOADGEN_DEFAULT_TIMEOUT_MS, .request_opcode = OP_REQ_RIDE_BIN
+    };
+    double rate_max = 0, rate_step = 0;
+    const char *csv_path = NULL, *json_path = NULL, *label = NULL;
+
+    static struct option long_options[] = {
+        {"rate",         required_argument, NULL, 'r'},
+        {"rate-max",     required_argument, NULL, 'm'},
+        {"rate-step",    required_argument, NULL, 's'},
+        {"duration",     required_argument, NULL, 'd'},
+        {"arrival",      required_argument, NULL, 'a'},
+        {"threads",      required_argument, NULL, 't'},
+        {"max-inflight", required_argument, NULL, 'i'},
+        {"timeout-ms",   required_argument, NULL, 'o'},
+        {"text",         no_argument,       NULL, 'x'},
+        {"csv",          required_argument, NULL, 'c'},
+        {"json",         required_argument, NULL, 'j'},
+        {"label",        required_argument, NULL, 'l'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r': cfg.rate = atof(optarg); break;
+            case 'm': rate_max = atof(optarg); break;
+            case 's': rate_step = atof(optarg); break;
+            case 'd': cfg.duration_secs = atof(optarg); break;
+            case 't': cfg.threads = atoi(optarg); break;
+            case 'i': cfg.max_inflight = atoi(optarg); break;
+            case 'o': cfg.timeout_ms = atoi(optarg); break;
+            case 'x': cfg.request_opcode = OP_REQ_RIDE; break;
+            case 'c': csv_path = optarg; break;
+            case 'j': json_path = optarg; break;
+            case 'l': label = optarg; break;
+            case 'a':
+                if (strcmp(optarg, "poisson") == 0) {
+                    cfg.arrival = LOADGEN_ARRIVAL_POISSON;
+                } else if (strcmp(optarg, "constant") == 0) {
+                    cfg.arrival = LOADGEN_ARRIVAL_CONSTANT;
+                } else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    // 有 --rate 就是開放迴圈模式；否則維持原本的封閉迴圈壓測 (第三個位置參數 = Client 數)
+    int open_loop = cfg.rate > 0;
+    if (argc - optind < (open_loop ? 2 : 3) || cfg.duration_secs <= 0 || cfg.threads <= 0 || cfg.max_inflight <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    char *server_ip = argv[optind];
+    int server_port = atoi(argv[optind + 1]);
+
+    char target[64], detail[160];
+    snprintf(target, sizeof(target), "%s:%d", server_ip, server_port);
+    if (open_loop) {
+        snprintf(detail, sizeof(detail), "rate=%.0f rate_max=%.0f rate_step=%.0f duration=%.0f arrival=%s threads=%d%s",
+                 cfg.rate, rate_max, rate_step, cfg.duration_secs,
+                 cfg.arrival == LOADGEN_ARRIVAL_POISSON ? "poisson" : "constant", cfg.threads,
+                 cfg.request_opcode == OP_REQ_RIDE ? " text" : "");
+    } else {
+        snprintf(detail, sizeof(detail), "clients=%s", argv[optind + 2]);
+    }
+
+    Report report;
+    if (report_open(&report, csv_path, json_path, label, open_loop ? "open-loop" : "closed-loop", target, detail) < 0) {
+        return 1;
+    }
+    int rc;
+    if (open_loop) {
+        cfg.ip = server_ip;
+        cfg.port = server_port;
+        rc = run_open_loop(&cfg, rate_max, rate_step, &report);
+    } else {
+        rc = run_closed_loop(server_ip, server_port, atoi(argv[optind + 2]), &report);
+    }
+    report_close(&report);
+    return rc;
+}
@@ -0,0 +1,442 @@
+/* src/client/trace_replay.c */
+// 重播 server_app --trace 擷取的叫車請求
+// 依擷取時的到達時間排序，以原速 (1x)、N 倍速或不等待 (max) 重新送出，保留請求間隔：
+// 每個請求的「預定送出時間」= 重播起點 + 原本的到達時間 / 速度，延遲從預定時間算起 (重播端跟不上時不會低估)。
+// 同一位 Client 的請求永遠由同一個執行緒依序送出 (client_id % threads)，所以每位 Client 的順序與原本相同。
+// 用法: ./trace_replay [--speed=N|max] [--threads=N] [--limit=N] <trace file> <server_ip> <port>
+//       ./trace_replay --info <trace file>      只顯示擷取檔的摘要
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "../../common/include/protocol.h"
+#include "../../common/include/net_wrapper.h"
+#include "../../common/include/trace_format.h"
+#include "include/latency_histogram.h"
+
+// from client_core.c
+extern int perform_ride_request_as(int sock_fd, const RideRequestData *req, uint16_t opcode, char *msg_buffer, double *phase_ms);
+extern void client_core_set_quiet(int quiet);
+
+#define DEFAULT_THREADS      32
+#define MAX_THREADS          1024
+#define REQUEST_TIMEOUT_SEC  2
+#define LAG_WARN_MS          10.0   // p99 送出延遲超過這個值時提醒加大 --threads
+
+typedef struct {
+    TraceFileHeader header;
+    TraceRecord *recs;      // 依 t_us 排序 (同一時間保留檔案中的順序)
+    size_t count;
+} Trace;
+
+// 一個結果分類的計數
+typedef struct {
+    uint64_t confirmed;
+    uint64_t no_driver;
+    uint64_t blocked;
+    uint64_t failed;        // 連線 / 握手 / 協定錯誤 (擷取檔中沒有這一類)
+} StatusCounts;
+
+typedef struct {
+    int id;
+    const char *ip;
+    int port;
+    double speed;           // 0 = 不等待
+    double start_ms;        // 所有執行緒共用的重播起點
+    const Trace *trace;
+    size_t *list;           // 這個執行緒負責的請求 (trace->recs 的索引，依時間排序)
+    size_t list_len;
+
+    StatusCounts counts;
+    LatencyHistogram latency;   // 從預定送出時間到收到回覆
+    LatencyHistogram service;   // 從實際開始連線到收到回覆
+    LatencyHistogram lag;       // 實際開始連線比預定時間晚多少
+} ReplayThread;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_until_ms(double when_ms) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(when_ms / 1000.0);
+    ts.tv_nsec = (long)((when_ms - ts.tv_sec * 1000.0) * 1e6);
+    if (ts.tv_nsec >= 1000000000L) ts.tv_nsec = 999999999L;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+//  擷取檔
+static const TraceRecord *g_sort_base;
+
+static int cmp_by_time(const void *a, const void *b) {
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    uint64_t tx = g_sort_base[x].t_us, ty = g_sort_base[y].t_us;
+    if (tx != ty) return tx < ty ? -1 : 1;
+    return (x > y) - (x < y); // 同一時間維持檔案順序
+}
+
+/**
+ * 讀入擷取檔並依到達時間排序。
+ * return 0 = 成功, -1 = 檔案不存在 / 格式錯誤
+ */
+static int load_trace(const char *path, Trace *trace) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fread(&trace->header, sizeof(TraceFileHeader), 1, fp) != 1 ||
+        memcmp(trace->header.magic, TRACE_MAGIC, sizeof(trace->header.magic)) != 0) {
+        fprintf(stderr, "%s is not a request trace.\n", path);
+        fclose(fp);
+        return -1;
+    }
+    size_t record_size = trace->header.record_size;
+    if (trace->header.version < 1 || record_size < sizeof(TraceRecord)) {
+        fprintf(stderr, "%s: unsupported trace version %u (record size %zu).\n", path, trace->header.version, record_size);
+        fclose(fp);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    fseek(fp, sizeof(TraceFileHeader), SEEK_SET);
+    size_t count = file_size > (long)sizeof(TraceFileHeader) ? (file_size - sizeof(TraceFileHeader)) / record_size : 0;
+
+    TraceRecord *raw = malloc((count > 0 ? count : 1) * sizeof(TraceRecord));
+    uint8_t *buf = malloc(record_size);
+    size_t *order = malloc((count > 0 ? count : 1) * sizeof(size_t));
+    trace->recs = malloc((count > 0 ? count : 1) * sizeof(TraceRecord));
+    if (raw == NULL || buf == NULL || order == NULL || trace->recs == NULL) {
+        fprintf(stderr, "Out of memory loading %zu records.\n", count);
+        fclose(fp);
+        return -1;
+    }
+    // 新版本的記錄比較長：只取前面認得的欄位 (寫到一半的尾端記錄不算)
+    size_t n = 0;
+    while (n < count && fread(buf, record_size, 1, fp) == 1) {
+        memcpy(&raw[n], buf, sizeof(TraceRecord));
+        order[n] = n;
+        n++;
+    }
+    fclose(fp);
+    free(buf);
+
+    g_sort_base = raw;
+    qsort(order, n, sizeof(size_t), cmp_by_time);
+    for (size_t i = 0; i < n; i++) trace->recs[i] = raw[order[i]];
+    trace->count = n;
+    free(order);
+    free(raw);
+    return 0;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static size_t count_clients(const Trace *trace) {
+    if (trace->count == 0) return 0;
+    uint32_t *ids = malloc(trace->count * sizeof(uint32_t));
+    if (ids == NULL) return 0;
+    for (size_t i = 0; i < trace->count; i++) ids[i] = trace->recs[i].client_id;
+    qsort(ids, trace->count, sizeof(uint32_t), cmp_u32);
+    size_t unique = 1;
+    for (size_t i = 1; i < trace->count; i++) unique += ids[i] != ids[i - 1];
+    free(ids);
+    return unique;
+}
+
+static void count_status(StatusCounts *c, uint8_t status) {
+    if (status == RIDE_STATUS_CONFIRMED) c->confirmed++;
+    else if (status == RIDE_STATUS_NO_DRIVER) c->no_driver++;
+    else if (status == RIDE_STATUS_BLOCKED) c->blocked++;
+    else c->failed++;
+}
+
+//  重播
+void *replay_thread_func(void *arg) {
+    ReplayThread *t = (ReplayThread *)arg;
+    const TraceRecord *base = &t->trace->recs[0];
+    char msg_buffer[1024];
+
+    srand(time(NULL) ^ (t->id * 7919)); // RESUME 的 nonce
+
+    for (size_t k = 0; k < t->list_len; k++) {
+        const TraceRecord *rec = &t->trace->recs[t->list[k]];
+
+        double due;
+        if (t->speed > 0) {
+            due = t->start_ms + (double)(rec->t_us - base->t_us) / 1000.0 / t->speed;
+            if (due > now_ms()) sleep_until_ms(due);
+        } else {
+            due = now_ms();
+        }
+        double start = now_ms();
+        hist_record_ms(&t->lag, start - due);
+
+        int sock_fd = connect_to_server(t->ip, t->port);
+        if (sock_fd < 0) {
+            t->counts.failed++;
+            continue;
+        }
+        struct timeval tv = {REQUEST_TIMEOUT_SEC, 0};
+        setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
+
+        RideRequestData req;
+        req.client_id = rec->client_id;
+        req.type = rec->type;
+        req.lat = rec->lat_e7 / LOC_COORD_SCALE;
+        req.lon = rec->lon_e7 / LOC_COORD_SCALE;
+        uint16_t opcode = rec->opcode == OP_REQ_RIDE ? OP_REQ_RIDE : OP_REQ_RIDE_BIN;
+
+        int result = perform_ride_request_as(sock_fd, &req, opcode, msg_buffer, NULL);
+        close(sock_fd);
+        double end = now_ms();
+
+        if (result == 0) {
+            t->counts.confirmed++;
+        } else if (result == -2) {
+            t->counts.blocked++;
+        } else if (result == -3) {
+            t->counts.no_driver++;
+        } else {
+            t->counts.failed++; // 文字回覆的「無車可用」也歸在這裡
+            continue;
+        }
+        hist_record_ms(&t->latency, end - due);
+        hist_record_ms(&t->service, end - start);
+    }
+    return NULL;
+}
+
+//  報表
+static void print_row_counts(const char *label, uint64_t orig, uint64_t orig_total, const uint64_t *replay, uint64_t replay_total) {
+    char a[32], b[32];
+    snprintf(a, sizeof(a), "%lu (%.1f%%)", orig, orig_total ? orig * 100.0 / orig_total : 0);
+    if (replay != NULL) {
+        snprintf(b, sizeof(b), "%lu (%.1f%%)", *replay, replay_total ? *replay * 100.0 / replay_total : 0);
+        printf("| %-24s | %18s | %18s |\n", label, a, b);
+    } else {
+        printf("| %-24s | %18s |\n", label, a);
+    }
+}
+
+static void print_row_value(const char *label, double orig, const double *replay, const char *fmt) {
+    char a[32], b[32];
+    snprintf(a, sizeof(a), fmt, orig);
+    if (replay != NULL) {
+        snprintf(b, sizeof(b), fmt, *replay);
+        printf("| %-24s | %18s | %18s |\n", label, a, b);
+    } else {
+        printf("| %-24s | %18s |\n", label, a);
+    }
+}
+
+static void print_rule(int columns) {
+    printf("+--------------------------+--------------------%s\n", columns == 2 ? "+--------------------+" : "+");
+}
+
+/**
+ * 原本的結果與重播結果並列 (replay_* 為 NULL 時只印原本的欄位)。
+ * 原本的延遲是 Server 端處理時間，重播的延遲是 Client 端從預定送出時間算起 (連線 + 握手 + 請求)。
+ */
+static void print_report(const Trace *trace, const StatusCounts *replay_counts, const LatencyHistogram *replay_latency,
+                         double replay_secs) {
+    StatusCounts orig;
+    LatencyHistogram service;
+    memset(&orig, 0, sizeof(orig));
+    hist_init(&service);
+    for (size_t i = 0; i < trace->count; i++) {
+        count_status(&orig, trace->recs[i].status);
+        hist_record(&service, trace->recs[i].service_us);
+    }
+    uint64_t total = trace->count;
+    double span = trace->count > 1 ? (trace->recs[trace->count - 1].t_us - trace->recs[0].t_us) / 1e6 : 0;
+    int columns = replay_counts != NULL ? 2 : 1;
+
+    uint64_t replay_total = 0, replied = 0;
+    LatencySummary lat_orig, lat_replay;
+    hist_summarize(&service, &lat_orig);
+    memset(&lat_replay, 0, sizeof(lat_replay));
+    if (replay_counts != NULL) {
+        replied = replay_counts->confirmed + replay_counts->no_driver + replay_counts->blocked;
+        replay_total = replied + replay_counts->failed;
+        hist_summarize(replay_latency, &lat_replay);
+    }
+
+    print_rule(columns);
+    if (columns == 2) {
+        printf("| %-24s | %18s | %18s |\n", "", "Original", "Replay");
+    } else {
+        printf("| %-24s | %18s |\n", "", "Original");
+    }
+    print_rule(columns);
+    double v;
+    v = (double)replay_total;
+    print_row_value("Requests", (double)total, columns == 2 ? &v : NULL, "%.0f");
+    print_row_value("Duration (s)", span, columns == 2 ? &replay_secs : NULL, "%.2f");
+    v = replay_secs > 0 ? replay_total / replay_secs : 0;
+    print_row_value("Throughput (req/s)", span > 0 ? total / span : 0, columns == 2 ? &v : NULL, "%.1f");
+    print_row_counts("Confirmed", orig.confirmed, total, columns == 2 ? &replay_counts->confirmed : NULL, replay_total);
+    print_row_counts("No driver", orig.no_driver, total, columns == 2 ? &replay_counts->no_driver : NULL, replay_total);
+    print_row_counts("Blocked", orig.blocked, total, columns == 2 ? &replay_counts->blocked : NULL, replay_total);
+    if (columns == 2) print_row_counts("Errors", orig.failed, total, &replay_counts->failed, replay_total);
+    print_rule(columns);
+    const char *labels[] = { "Latency p50 (ms)", "Latency p99 (ms)", "Latency p99.9 (ms)", "Latency max (ms)" };
+    uint64_t orig_us[] = { lat_orig.p50, lat_orig.p99, lat_orig.p999, lat_orig.max };
+    uint64_t replay_us[] = { lat_replay.p50, lat_replay.p99, lat_replay.p999, lat_replay.max };
+    for (int i = 0; i < 4; i++) {
+        v = replay_us[i] / 1000.0;
+        print_row_value(labels[i], orig_us[i] / 1000.0, columns == 2 ? &v : NULL, "%.3f");
+    }
+    print_rule(columns);
+    printf("Original latency = server-side processing time");
+    if (columns == 2) printf("; replay latency = client-side, from the scheduled send time (connect + handshake + request)");
+    printf(".\n");
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [--speed=N|max] [--threads=N] [--limit=N] <trace file> <server_ip> <port>\n", prog);
+    printf("       %s --info <trace file>\n", prog);
+    printf("  --speed=N    1 = original pace (default), N = N times faster, max = as fast as possible\n");
+    printf("  --threads=N  replay threads (default %d); each client is always replayed by the same thread, in order\n", DEFAULT_THREADS);
+    printf("  --limit=N    replay only the first N requests\n");
+}
+
+int main(int argc, char *argv[]) {
+    double speed = 1.0;
+    int threads = DEFAULT_THREADS;
+    size_t limit = 0;
+    int info = 0;
+
+    static struct option long_options[] = {
+        {"speed",   required_argument, NULL, 's'},
+        {"threads", required_argument, NULL, 't'},
+        {"limit",   required_argument, NULL, 'l'},
+        {"info",    no_argument,       NULL, 'i'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's': speed = strcmp(optarg, "max") == 0 ? 0 : atof(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'l': limit = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'i': info = 1; break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind < (info ? 1 : 3) || speed < 0 || threads < 1 || threads > MAX_THREADS) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Trace trace;
+    if (load_trace(argv[optind], &trace) < 0) return 1;
+    if (limit > 0 && limit < trace.count) trace.count = limit;
+
+    time_t started = (time_t)trace.header.started_at;
+    char when[32];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&started));
+    printf("Trace %s: %zu requests from %zu clients, captured %s\n", argv[optind], trace.count, count_clients(&trace), when);
+
+    if (info || trace.count == 0) {
+        print_report(&trace, NULL, NULL, 0);
+        return 0;
+    }
+
+    const char *ip = argv[optind + 1];
+    int port = atoi(argv[optind + 2]);
+    char speed_text[32];
+    if (speed > 0) snprintf(speed_text, sizeof(speed_text), "%gx", speed);
+    else snprintf(speed_text, sizeof(speed_text), "max");
+    printf("Replaying at %s speed with %d threads against %s:%d ...\n", speed_text, threads, ip, port);
+    fflush(stdout);
+
+    // 依 client_id 分給執行緒 (同一位 Client 的請求由同一個執行緒依序送出)
+    ReplayThread *ts = calloc(threads, sizeof(ReplayThread));
+    size_t *lists = malloc(trace.count * sizeof(size_t));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    if (ts == NULL || lists == NULL || tids == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    for (size_t i = 0; i < trace.count; i++) ts[trace.recs[i].client_id % threads].list_len++;
+    size_t offset = 0;
+    for (int i = 0; i < threads; i++) {
+        ts[i].list = lists + offset;
+        offset += ts[i].list_len;
+        ts[i].list_len = 0;
+    }
+    for (size_t i = 0; i < trace.count; i++) {
+        ReplayThread *t = &ts[trace.recs[i].client_id % threads];
+        t->list[t->list_len++] = i;
+    }
+
+    client_core_set_quiet(1);
+    double start_ms = now_ms() + 50; // 讓所有執行緒都建立好再開始
+    for (int i = 0; i < threads; i++) {
+        ts[i].id = i;
+        ts[i].ip = ip;
+        ts[i].port = port;
+        ts[i].speed = speed;
+        ts[i].start_ms = start_ms;
+        ts[i].trace = &trace;
+        hist_init(&ts[i].latency);
+        hist_init(&ts[i].service);
+        hist_init(&ts[i].lag);
+        if (pthread_create(&tids[i], NULL, replay_thread_func, &ts[i]) != 0) {
+            fprintf(stderr, "Failed to create replay thread %d.\n", i);
+            tids[i] = 0;
+            ts[i].counts.failed += ts[i].list_len;
+        }
+    }
+
+    StatusCounts counts;
+    static LatencyHistogram latency, service, lag;
+    memset(&counts, 0, sizeof(counts));
+    hist_init(&latency);
+    hist_init(&service);
+    hist_init(&lag);
+    for (int i = 0; i < threads; i++) {
+        if (tids[i] != 0) pthread_join(tids[i], NULL);
+        counts.confirmed += ts[i].counts.confirmed;
+        counts.no_driver += ts[i].counts.no_driver;
+        counts.blocked += ts[i].counts.blocked;
+        counts.failed += ts[i].counts.failed;
+        hist_merge(&latency, &ts[i].latency);
+        hist_merge(&service, &ts[i].service);
+        hist_merge(&lag, &ts[i].lag);
+    }
+    double elapsed = (now_ms() - start_ms) / 1000.0;
+
+    print_report(&trace, &counts, &latency, elapsed);
+
+    LatencySummary s_service, s_lag;
+    hist_summarize(&service, &s_service);
+    hist_summarize(&lag, &s_lag);
+    printf("Replay service time (from actual send): p50 %.3f ms, p99 %.3f ms\n", s_service.p50 / 1000.0, s_service.p99 / 1000.0);
+    printf("Send lag behind schedule: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", s_lag.p50 / 1000.0, s_lag.p99 / 1000.0, s_lag.max / 1000.0);
+    if (speed > 0 && s_lag.p99 / 1000.0 > LAG_WARN_MS) {
+        printf("\033[1;33m[WARN] Replay fell behind the original pace; inter-arrival gaps were not preserved. Try more --threads.\033[0m\n");
+    }
+
+    free(ts);
+    free(lists);
+    free(tids);
+    free(trace.recs);
+    return 0;
+}
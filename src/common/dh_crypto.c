@@ -6,15 +6,39 @@
 #include <string.h>
 #include <time.h>
 
-// 使用較小的質數與生成元
-// P = 2147483647 (Mersenne Prime 2^31 - 1)
-// G = 16807 (7^5, Primitive root modulo P)
-#define DH_PRIME 2147483647L
-#define DH_GENERATOR 16807L
+#include "include/dh_crypto.h"
+
+// Mersenne 質數的模乘法: out = (a * b) % (2^31 - 1)
+// 因為 2^31 ≡ 1 (mod P)，x = hi * 2^31 + lo ≡ hi + lo，折疊兩次再減一次 P 即可
+// (寫成巨集：預設 -O0 編譯時 static inline 不會被內聯，函式呼叫成本反而比除法高)
+#define MULMOD_MERSENNE31(out, a, b) do {                  \
+        uint64_t x_ = (uint64_t)(a) * (uint64_t)(b);       \
+        x_ = (x_ & DH_PRIME) + (x_ >> 31);                 \
+        x_ = (x_ & DH_PRIME) + (x_ >> 31);                 \
+        (out) = x_ >= (uint64_t)DH_PRIME ? x_ - DH_PRIME : x_; \
+    } while (0)
+
+long long power_mod_mersenne31(long long base, long long exp) {
+    // base 可能來自網路 (對方公鑰)，先正規化到 [0, P)
+    base %= DH_PRIME;
+    if (base < 0) base += DH_PRIME;
+
+    // a, b < 2^31，乘積 < 2^62 不會溢位
+    uint64_t res = 1;
+    uint64_t b = (uint64_t)base;
+    while (exp > 0) {
+        if (exp & 1) MULMOD_MERSENNE31(res, res, b);
+        exp >>= 1;
+        MULMOD_MERSENNE31(b, b, b);
+    }
+    return (long long)res;
+}
 
 // 模數冪運算: (base^exp) % mod
 // 使用 long long 防止計算過程溢位
 long long power_mod(long long base, long long exp, long long mod) {
+    if (mod == DH_PRIME) return power_mod_mersenne31(base, exp);
+
     long long res = 1;
     base = base % mod;
     while (exp > 0) {
@@ -43,4 +67,48 @@ long long calculate_shared_secret(long long other_public_key, long long my_priva
 // 將共享密鑰整數轉換為 RC4 可用的字串 Key
 void derive_session_key(long long shared_secret, char *output_buffer, size_t len) {
     snprintf(output_buffer, len, "KEY_%lld_SECURE", shared_secret);
-}
\ No newline at end of file
+}
+
+long long derive_resumption_secret(long long shared_secret) {
+    // splitmix64：和 Session Key 使用的 shared_secret 在數值上無關
+    uint64_t z = (uint64_t)shared_secret + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (long long)((z ^ (z >> 31)) & 0x7fffffffffffffffULL);
+}
+
+void derive_resumed_session_key(long long resumption_secret, uint32_t client_nonce, char *output_buffer, size_t len) {
+    snprintf(output_buffer, len, "KEY_%lld_%08x_RESUMED", resumption_secret, client_nonce);
+}
+
+//  密鑰對池 (Keypair Pool)
+void dh_keypool_init(DhKeyPool *pool) {
+    memset(pool, 0, sizeof(DhKeyPool));
+}
+
+int dh_keypool_full(const DhKeyPool *pool) {
+    return pool->count >= DH_KEYPOOL_SIZE;
+}
+
+int dh_keypool_refill(DhKeyPool *pool, int max_new) {
+    int added = 0;
+    while (added < max_new && pool->count < DH_KEYPOOL_SIZE) {
+        DhKeyPair *kp = &pool->keys[pool->count++];
+        kp->private_key = generate_private_key();
+        kp->public_key = calculate_public_key(kp->private_key);
+        added++;
+    }
+    return added;
+}
+
+DhKeyPair dh_keypool_take(DhKeyPool *pool) {
+    if (pool->count > 0) {
+        pool->hits++;
+        return pool->keys[--pool->count];
+    }
+    pool->misses++;
+    DhKeyPair kp;
+    kp.private_key = generate_private_key();
+    kp.public_key = calculate_public_key(kp.private_key);
+    return kp;
+}
@@ -0,0 +1,67 @@
+/* src/common/include/dh_crypto.h */
+#ifndef DH_CRYPTO_H
+#define DH_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 使用較小的質數與生成元
+// P = 2147483647 (Mersenne Prime 2^31 - 1)
+// G = 16807 (7^5, Primitive root modulo P)
+#define DH_PRIME 2147483647L
+#define DH_GENERATOR 16807L
+
+// 每個 Dispatcher 預先計算好的密鑰對數量
+#define DH_KEYPOOL_SIZE 64
+
+// 模數冪運算: (base^exp) % mod (mod == DH_PRIME 時自動走 Mersenne 快速路徑)
+long long power_mod(long long base, long long exp, long long mod);
+
+// 專用於 DH_PRIME 的模數冪運算 (以位移 + 加法取代 64-bit 除法)
+long long power_mod_mersenne31(long long base, long long exp);
+
+// 生成私鑰 (隨機數)
+long long generate_private_key();
+
+// 計算公鑰: G^Private % P
+long long calculate_public_key(long long private_key);
+
+// 計算共享密鑰: OtherPublic^MyPrivate % P
+long long calculate_shared_secret(long long other_public_key, long long my_private_key);
+
+// 將共享密鑰整數轉換為 RC4 可用的字串 Key
+void derive_session_key(long long shared_secret, char *output_buffer, size_t len);
+
+// 從 DH 共享密鑰衍生 Resumption Secret (雙方各自計算，不上線傳送)
+long long derive_resumption_secret(long long shared_secret);
+
+// 以 Resumption Secret + Client Nonce 衍生恢復連線的 Session Key
+void derive_resumed_session_key(long long resumption_secret, uint32_t client_nonce, char *output_buffer, size_t len);
+
+// 預先計算的密鑰對池 (Keypair Pool)
+// 讓握手時只需要計算 Shared Secret，公鑰的模數冪運算在閒置時完成
+typedef struct {
+    long long private_key;
+    long long public_key;
+} DhKeyPair;
+
+typedef struct {
+    DhKeyPair keys[DH_KEYPOOL_SIZE];
+    int count;          // 目前可用的密鑰對數量
+    uint64_t hits;      // 統計：直接從池中取得
+    uint64_t misses;    // 統計：池子空了，只好同步計算
+} DhKeyPool;
+
+// 清空密鑰池
+void dh_keypool_init(DhKeyPool *pool);
+
+// 補充最多 max_new 組密鑰對，回傳實際補充的數量
+int dh_keypool_refill(DhKeyPool *pool, int max_new);
+
+// 是否已經補滿
+int dh_keypool_full(const DhKeyPool *pool);
+
+// 取出一組密鑰對 (池子空了就同步計算一組)
+DhKeyPair dh_keypool_take(DhKeyPool *pool);
+
+#endif // DH_CRYPTO_H
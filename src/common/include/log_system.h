@@ -2,16 +2,147 @@
 #ifndef LOG_SYSTEM_H
 #define LOG_SYSTEM_H
 
-// 初始化日誌系統 
+#include <stddef.h>
+#include <stdint.h>
+
+// 非同步模式 (Server 使用)
+// 每個進程一個共享記憶體環狀緩衝區：log 呼叫只把「呼叫點編號 + 原始參數」複製到緩衝區
+// (用快取的粗略時間戳記，不呼叫 localtime / vfprintf / fflush)，
+// 由 Coordinator 的寫入執行緒批次取出所有緩衝區，格式化成文字或直接寫成二進位記錄，並負責輪替檔案
+#define LOG_RING_COUNT   128    // 緩衝區數 (Coordinator + 每個 Dispatcher 一個；超過時共用，仍然安全)
+#define LOG_RING_SLOTS   512    // 每個緩衝區的行數 (必須是 2 的次方)
+#define LOG_TEXT_MAX     240    // 單行最大長度 / 參數區大小 (超過的截斷)
+#define LOG_DEFAULT_ROTATE_MB 64
+
+// 呼叫點
+#define LOG_MAX_SITES    512    // 呼叫點字典大小 (超過的呼叫點改在呼叫端格式化)
+#define LOG_MAX_ARGS     12     // 單一呼叫點最多的參數數
+#define LOG_FMT_MAX      192    // 字典中格式字串的最大長度
+#define LOG_FILE_MAX     48     // 字典中檔名的最大長度
+#define LOG_SITE_TEXT    0xFFFF // 不能延後格式化的呼叫點 (字典已滿 / 不支援的格式)
+
+// 緩衝區滿時的策略
+#define LOG_OVERFLOW_DROP  0    // 丟棄並計數 (寫入執行緒會補一行 WARN 說明丟了幾行)
+#define LOG_OVERFLOW_BLOCK 1    // 等待寫入執行緒騰出空間
+
+// 輸出格式
+#define LOG_FORMAT_TEXT    0    // 寫入執行緒格式化成文字 (與同步模式的輸出相同)
+#define LOG_FORMAT_BINARY  1    // 寫入二進位記錄，由 log_decode 離線還原成文字
+
+// 等級
+#define LOG_LEVEL_INFO  0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_DEBUG 3
+
+// 二進位 log 檔案格式 (little-endian)：
+//   檔頭 LogBinFileHeader，之後是連續的記錄：LogBinRecord + len bytes 的內容
+//   LOG_BIN_SITE  內容 = uint16 site, uint16 line, 檔名 '\0', 格式字串 '\0' (在第一次使用之前寫入，每個檔案各自完整)
+//   LOG_BIN_EVENT 內容 = uint16 site, 參數 (依格式字串的順序：整數 4/8 bytes、double 8 bytes、字串 uint16 長度 + 內容)
+//   LOG_BIN_TEXT  內容 = 已格式化的文字 (同步寫入、不能延後格式化的呼叫點、寫入執行緒自己的訊息)
+#define LOG_BIN_MAGIC   "RIDEBLOG"
+#define LOG_BIN_VERSION 1
+#define LOG_BIN_SITE    1
+#define LOG_BIN_EVENT   2
+#define LOG_BIN_TEXT    3
+// 寫入端產生的單筆內容上限 (最長的是 SITE：4 bytes 編號 + 檔名 + 格式字串)，超過的記錄必定是損毀的
+#define LOG_BIN_MAX_LEN (4 + LOG_FILE_MAX + LOG_FMT_MAX)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} __attribute__((packed)) LogBinFileHeader;
+
+typedef struct {
+    uint8_t kind;           // LOG_BIN_*
+    uint8_t level;          // LOG_LEVEL_*
+    uint8_t flags;          // LOG_BIN_TRUNCATED
+    uint8_t reserved;
+    uint16_t len;           // 內容長度
+    uint16_t reserved2;
+    uint32_t timestamp;     // 秒 (wall clock)
+} __attribute__((packed)) LogBinRecord;
+
+#define LOG_BIN_TRUNCATED 1 // 參數區放不下，之後的參數被截斷
+
+// 一個 log 呼叫點 (由 log_info 等巨集產生的 static 變數，第一次呼叫時登記)
+typedef struct {
+    const char *fmt;
+    const char *file;
+    uint16_t line;
+    uint8_t level;
+    uint8_t nargs;
+    uint16_t id;                    // 0 = 尚未登記
+    uint8_t types[LOG_MAX_ARGS];    // 每個參數的型別 (由格式字串解析)
+} LogSite;
+
+// 初始化日誌系統
 void log_init(const char *filename);
 
-// 清理日誌資源
+// 清理日誌資源 (非同步模式下由啟動寫入執行緒的進程呼叫：寫完剩餘的行並停止執行緒)
 void log_cleanup();
 
-// 日誌函式
-void log_info(const char *fmt, ...);
-void log_warn(const char *fmt, ...);
-void log_error(const char *fmt, ...);
-void log_debug(const char *fmt, ...);
+/**
+ * 切換為非同步模式 (log_init 開檔之後、fork 之前呼叫)。
+ * overflow_policy LOG_OVERFLOW_*
+ * rotate_bytes 檔案超過這個大小時改名為 <filename>.1 並開新檔；0 = 不輪替
+ * format LOG_FORMAT_*；二進位格式時同步寫入的行也以 LOG_BIN_TEXT 記錄寫入
+ * return 0 = 成功, -1 = 失敗 (維持同步寫入)
+ */
+int log_async_init(int overflow_policy, size_t rotate_bytes, int format);
+
+/**
+ * 指定目前進程使用的緩衝區 (fork 之後在子進程呼叫)。
+ */
+void log_attach(int ring);
+
+/**
+ * 進程異常結束後由 Coordinator 呼叫 (在同一個緩衝區重新 fork 之前)：
+ * 把它取得位置但還沒發布的 slot 標記為空行，寫入執行緒才不會永遠卡在那裡。
+ * 只能用在這個進程獨佔的緩衝區 (共用時無法分辨是誰還在寫)。
+ * return 回收的 slot 數
+ */
+int log_reclaim_ring(int ring);
+
+/**
+ * 啟動寫入執行緒 (fork 之後由 Coordinator 呼叫)。啟動前與停止後的 log 直接同步寫入。
+ * return 0 = 成功, -1 = 失敗
+ */
+int log_async_start(void);
+
+/**
+ * 所有緩衝區累計寫出 / 丟棄的行數。
+ */
+void log_async_stats(uint64_t *written, uint64_t *dropped);
+
+/**
+ * 依格式字串把 LOG_BIN_EVENT 的參數還原成文字 (寫入執行緒與 log_decode 共用)。
+ * truncated 參數區在記錄時被截斷
+ * return 寫入 out 的長度 (不含 '\0')
+ */
+size_t log_render(const char *fmt, const uint8_t *args, size_t len, int truncated, char *out, size_t cap);
+
+// 巨集展開後的實際進入點 (呼叫端請用 log_info 等巨集)
+void log_emit(LogSite *site, ...);
+
+// 只用來讓編譯器檢查格式字串與參數 (永遠不會被呼叫)
+static inline void __attribute__((format(printf, 1, 2))) log_format_check(const char *fmt, ...) { (void)fmt; }
+
+#define LOG_AT_LEVEL(lvl, fmt, ...) do { \
+        static LogSite log_site_ = { fmt, __FILE__, __LINE__, lvl, 0, 0, {0} }; \
+        if (0) log_format_check(fmt, ##__VA_ARGS__); \
+        log_emit(&log_site_, ##__VA_ARGS__); \
+    } while (0)
+
+// 日誌函式 (格式字串必須是字串常值：每個呼叫點只登記一次)
+#define log_info(fmt, ...)  LOG_AT_LEVEL(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define log_warn(fmt, ...)  LOG_AT_LEVEL(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define log_error(fmt, ...) LOG_AT_LEVEL(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#ifdef DEBUG
+#define log_debug(fmt, ...) LOG_AT_LEVEL(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define log_debug(fmt, ...) do { if (0) log_format_check(fmt, ##__VA_ARGS__); } while (0)
+#endif
 
-#endif // LOG_SYSTEM_H
\ No newline at end of file
+#endif // LOG_SYSTEM_H
@@ -3,7 +3,11 @@
 #define NET_WRAPPER_H
 
 #include <stddef.h> 
+#include <stdint.h>
 #include <sys/types.h> // 包含 ssize_t
+#include <sys/uio.h>   // struct iovec
+
+#include "protocol.h"
 
 // Socket 建立與連線
 
@@ -21,6 +25,52 @@ ssize_t send_n(int fd, const void *buf, size_t n);
 // 確保接收 n 個位元組
 ssize_t recv_n(int fd, void *buf, size_t n);
 
+// 分幀 I/O (Framed I/O)
+// recv_n 讀 Header 和 Body 各要一次 read()，兩次 send_n 可能變成兩個 TCP 段 (還會撞上 Nagle)。
+// FrameReader 一次 read() 盡量讀滿緩衝區，已經在緩衝區裡的完整 Frame 直接解析，不再進核心；
+// FrameWriter 把多個 Frame 的 Header/Body 收集起來，用一次 writev() 送出。
+
+#define FRAME_MAX_BODY        1024  // 單一 Frame Body 上限 (與 Dispatcher 的限制一致)
+#define FRAME_READER_BUF_SIZE 4096  // 讀取緩衝區大小 (可容納數個完整 Frame)
+#define FRAME_WRITER_MAX      4     // 一次 writev 最多合併的 Frame 數
+
+// 每條連線一個讀取器 (不可跨連線共用)
+typedef struct {
+    int fd;
+    size_t head;    // 下一個尚未解析的位元組
+    size_t tail;    // 已讀入資料的結尾
+    uint8_t buf[FRAME_READER_BUF_SIZE];
+} FrameReader;
+
+// 每條連線一個寫入器；Body 只保存指標，flush 之前呼叫端必須保持 Body 有效
+typedef struct {
+    int fd;
+    int count;      // 已排入的 Frame 數
+    ProtocolHeader headers[FRAME_WRITER_MAX];
+    struct iovec iov[FRAME_WRITER_MAX * 2];
+} FrameWriter;
+
+// 從一段連續資料的開頭解析一個 Frame Header (不做 I/O，給自行管理緩衝區的呼叫端使用)
+// return 完整 Frame 的長度 (Header + Body), 0 = 資料還不完整, -1 = Body 超過 FRAME_MAX_BODY
+ssize_t frame_parse(const uint8_t *data, size_t avail, ProtocolHeader *header);
+
+void frame_reader_init(FrameReader *reader, int fd);
+
+// 取出下一個完整 Frame。Body 指向讀取器內部緩衝區，下次呼叫前有效 (可就地解密)
+// return 1 = 成功, 0 = 連線關閉, -1 = 錯誤 / 逾時 / Body 超過 FRAME_MAX_BODY
+int frame_reader_next(FrameReader *reader, ProtocolHeader *header, uint8_t **body);
+
+void frame_writer_init(FrameWriter *writer, int fd);
+
+// 排入一個 Frame (Header 會複製，Body 長度取 header->length)；已滿時先自動 flush
+int frame_writer_add(FrameWriter *writer, const ProtocolHeader *header, const void *body);
+
+// 以一次 writev 送出所有排入的 Frame (處理 partial write)。return 0 = 成功, -1 = 錯誤
+int frame_writer_flush(FrameWriter *writer);
+
+// 單一 Frame 直接送出：Header + Body 一次 writev
+int send_frame(int fd, const ProtocolHeader *header, const void *body);
+
 // 加密/解密 (機密性)
 
 // RC4 加密/解密函式 (在 net_wrapper.c 實作)
@@ -10,13 +10,23 @@
 #define MSG_TYPE_RIDE_RESP  2   // 伺服器回應
 #define MSG_TYPE_HANDSHAKE  3   // Client 發送 DH 公鑰
 #define MSG_TYPE_HANDSHAKE_ACK 4 // Server 回覆 DH 公鑰
+#define MSG_TYPE_SESSION_TICKET 5 // Server 發給 Client 的 Resumption Ticket
+#define MSG_TYPE_RESUME     6   // Client 出示 Ticket 恢復 Session (取代 DH 握手)
+#define MSG_TYPE_RESUME_REJECT 7 // Server 拒絕 Ticket，Client 必須重新握手
+#define MSG_TYPE_DRIVER_ATTACH 8 // 司機握手後出示身分證明，連線轉為長連線
+#define MSG_TYPE_RIDE_ASSIGN 9  // Server 主動推播給司機的派單
 
 // 操作碼定義 (Opcodes)
 #define OP_REQ_RIDE     0x0001  // 乘客請求叫車
 #define OP_DRIVER_JOIN  0x0002  // 司機加入網路
-#define OP_UPDATE_LOC   0x0003  // 更新位置
+#define OP_UPDATE_LOC   0x0003  // 更新位置 (UDP 司機定位回報)
 #define OP_RESPONSE     0x8000  // 伺服器回應
 #define OP_HANDSHAKE    0x0004  // 握手操作
+#define OP_HANDSHAKE_RESUMABLE 0x0005 // 握手並要求 Server 簽發 Ticket
+#define OP_RESUME       0x0006  // 以 Ticket 恢復 Session
+#define OP_RIDE_ASSIGN  0x0007  // 派單推播
+#define OP_REQ_RIDE_BIN 0x0008  // 乘客請求叫車，要求二進位回覆 (RideResponseData)
+#define OP_RESPONSE_BIN 0x8001  // 伺服器回應 (二進位 RideResponseData)
 
 // 協定頭部 (Header)
 typedef struct {
@@ -48,9 +58,111 @@ typedef struct {
     // 可以根據需要擴充其他欄位
 } __attribute__((packed)) DriverJoinData;
 
+// 4. Session Resumption Ticket
+// Ticket 對 Client 來說是不透明的資料，只有 Server 的 Ticket Key 能解開
+#define SESSION_TICKET_SEALED_LEN 16
+typedef struct {
+    uint32_t key_generation;    // 用第幾代 Ticket Key 封裝 (明文)
+    uint32_t ticket_nonce;      // 每張 Ticket 唯一 (明文，用於產生加密金鑰流)
+    uint8_t sealed[SESSION_TICKET_SEALED_LEN]; // 加密後的 {resumption secret, 簽發時間}
+    uint64_t tag;               // 完整性標籤
+} __attribute__((packed)) SessionTicket;
+
+// MSG_TYPE_SESSION_TICKET 的 Payload (握手完成後由 Server 發送)
+typedef struct {
+    uint32_t lifetime_secs;     // Ticket 有效秒數
+    SessionTicket ticket;
+} __attribute__((packed)) SessionTicketData;
+
+// MSG_TYPE_RESUME 的 Payload (連線後的第一個封包)
+typedef struct {
+    SessionTicket ticket;
+    uint32_t client_nonce;      // 每次連線隨機，讓每條連線的 Session Key 都不同
+} __attribute__((packed)) ResumeData;
+
+// 5. 司機定位回報 (UDP Datagram，不經過 TCP 握手)
+// 一個 Datagram 一筆回報；以每位司機的金鑰計算標籤驗證來源，序號用來丟棄重送 / 亂序的舊資料
+#define LOC_COORD_SCALE 10000000.0  // 座標以 1e-7 度為單位的定點數 (約 1 公分)
+
+typedef struct {
+    uint16_t opcode;    // OP_UPDATE_LOC
+    uint16_t reserved;
+    uint32_t driver_id;
+    uint32_t seq;       // 每位司機自己遞增 (允許回繞)，Server 只接受比目前更新的序號
+    int32_t lat_e7;     // 緯度 * LOC_COORD_SCALE
+    int32_t lon_e7;     // 經度 * LOC_COORD_SCALE
+    uint64_t tag;       // keyed_digest(司機金鑰, 以上所有欄位)
+} __attribute__((packed)) LocationUpdateDatagram;
+
+// 6. 司機長連線 (MSG_TYPE_DRIVER_ATTACH 的 Payload，以 Session Key 加密)
+// proof 證明司機持有由車隊金鑰衍生的司機金鑰，並綁定這條連線的 Session Key (無法搬到別的連線重放)
+typedef struct {
+    uint32_t driver_id;
+    uint64_t proof;     // driver_attach_proof(司機金鑰, Session Key)
+} __attribute__((packed)) DriverAttachData;
+
+// 7. 派單推播 (MSG_TYPE_RIDE_ASSIGN 的 Payload，以 Session Key 加密)
+typedef struct {
+    uint32_t ride_id;
+    uint32_t client_id;
+    double pickup_lat;
+    double pickup_lon;
+    double dest_lat;
+    double dest_lon;
+    int32_t fare;
+} __attribute__((packed)) RideAssignmentData;
+
+// 8. 叫車結果 (OP_RESPONSE_BIN 的 Payload，以 Session Key 加密)
+// 以 OP_REQ_RIDE_BIN 請求的 Client 收到這個結構；舊 Client 送 OP_REQ_RIDE，仍收到文字回覆。
+// 新版本只會在結尾追加欄位：解碼端接受 version >= 1 且長度至少為 v1 的回覆，忽略不認識的尾端。
+#define RIDE_RESP_VERSION       1
+#define RIDE_STATUS_CONFIRMED   0   // 派車成功
+#define RIDE_STATUS_NO_DRIVER   1   // 無車可用
+#define RIDE_STATUS_BLOCKED     2   // 被限流阻擋
+#define RIDE_FLAG_SURGE         0x01 // 加成計價
+#define RIDE_FLAG_SMART         0x02 // 以 SMART 模式派車 (否則為 BASIC)
+#define RIDE_FLAG_VIP           0x04 // VIP 乘客
+
+typedef struct {
+    uint8_t version;    // RIDE_RESP_VERSION
+    uint8_t status;     // RIDE_STATUS_*
+    uint8_t flags;      // RIDE_FLAG_*
+    uint8_t rating_x10; // 司機評分 * 10
+    uint32_t ride_id;
+    uint32_t driver_id;
+    uint32_t dist_e7;   // 司機與上車點距離 (度 * LOC_COORD_SCALE)
+    uint16_t eta_secs;  // 預估抵達秒數
+    uint16_t reserved;
+    int32_t fare;
+} __attribute__((packed)) RideResponseData;
+
+// 車隊金鑰沒有預設值 (寫在公開原始碼裡的金鑰等於沒有金鑰)：Server 與司機端都必須以 --fleet-key 指定同一把
+// 0 = 未設定，Server 不啟動 UDP 定位回報、也不接受司機長連線
+#define DRIVER_FLEET_KEY_NONE 0ULL
+
 // 安全性與工具函式宣告
 
 // 計算校驗和 (在 protocol.c 實作)
 uint16_t calculate_checksum(const uint8_t *data, size_t len);
 
+// 帶金鑰的 64-bit 摘要 (FNV-1a + 混洗)，用於 Ticket 等標籤 (在 protocol.c 實作)
+// 與本專案的 RC4 / 31-bit DH 同屬教學等級，不具密碼學強度
+uint64_t keyed_digest(uint64_t key, const uint8_t *data, size_t len);
+
+// 由車隊金鑰衍生單一司機的定位金鑰 (在 protocol.c 實作)
+uint64_t driver_location_key(uint64_t fleet_key, uint32_t driver_id);
+
+// 計算 / 驗證定位 Datagram 的標籤 (在 protocol.c 實作)。驗證 return 1 = 通過, 0 = 失敗
+void location_datagram_seal(LocationUpdateDatagram *dgram, uint64_t driver_key);
+int location_datagram_verify(const LocationUpdateDatagram *dgram, uint64_t driver_key);
+
+// 計算司機長連線的身分證明 (在 protocol.c 實作)
+uint64_t driver_attach_proof(uint64_t driver_key, const char *session_key);
+
+// 解碼二進位叫車結果 (在 protocol.c 實作)。return 0 = 成功, -1 = 長度 / 版本不符
+int ride_response_decode(const uint8_t *body, size_t len, RideResponseData *out);
+
+// 把叫車結果格式化成舊版文字回覆 (在 protocol.c 實作，Server 回覆舊 Client 與 Client 顯示共用)
+int ride_response_format_text(const RideResponseData *resp, char *buf, size_t len);
+
 #endif // PROTOCOL_H
\ No newline at end of file
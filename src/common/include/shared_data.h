@@ -3,10 +3,26 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <time.h> 
+#include "protocol.h"
+
+// server_app 建立的具名共享記憶體 (ride_top 以唯讀方式附加)
+#define SHM_NAME "/ride_hailing_shm"
 
 #define MAX_DRIVERS 256
 #define MAX_PENDING_RIDES 128
+#define DRIVER_PUSH_MAX_WORKERS 128 // 派單推播最多支援的 Dispatcher 進程數 (每個進程一組待處理位元)
+
+// 區域定價網格 (把地圖切成 ZONE_COLS x ZONE_ROWS 個區域)
+#define ZONE_COLS 4
+#define ZONE_ROWS 2
+#define ZONE_COUNT (ZONE_COLS * ZONE_ROWS)
+
+// 司機在區域計數器中被計入的狀態
+#define ZONE_STATE_NONE      0  // 未計入 (加油中 / 沒油)
+#define ZONE_STATE_AVAILABLE 1  // 計入 Supply (空車)
+#define ZONE_STATE_BUSY      2  // 計入載客中
 
 // 司機狀態
 typedef struct {
@@ -27,8 +43,193 @@ typedef struct {
     double target_lat;     // 目標緯度
     double target_lon;     // 目標經度
 
+    // 區域計數器登記資訊 (由 pricing_sync_driver 維護)
+    // 記錄這位司機目前被算在哪個區域、哪個狀態，狀態轉換時只需 O(1) 修正計數
+    int8_t zone_id;
+    uint8_t zone_state;
+
+    // UDP 定位回報 (由 location_service 維護)
+    uint32_t loc_seq;      // 最後套用的回報序號
+    double loc_updated;    // 最後套用的時間 (CLOCK_MONOTONIC 秒)；0 = 從未回報，由模擬移動
+
 } Driver;
 
+// 單一區域的供需計數器
+typedef struct {
+    int available_drivers;  // 空車數 (Supply)
+    int busy_drivers;       // 載客中司機數
+    double demand;          // 近期叫車數 (指數衰減)
+    double demand_updated;  // demand 最後更新時間 (CLOCK_MONOTONIC 秒)
+} ZoneStats;
+
+// UDP 司機定位回報統計 (只有 Coordinator 的接收執行緒寫入)
+typedef struct {
+    uint64_t received;      // 收到的 Datagram 數
+    uint64_t applied;       // 寫入司機表的更新數
+    uint64_t stale;         // 序號不比現有的新 (重送 / 亂序) 而丟棄
+    uint64_t rejected;      // 長度 / 標籤錯誤或未知司機
+    uint64_t batches;       // 套用批次數 (每批只上鎖一次)
+} LocationIngestStats;
+
+// 司機派單信箱 (每位司機一格，與 drivers[] 同索引)
+// 寫入端 (派車的 Dispatcher) 持有 mutex；讀取端 (持有司機長連線的 Dispatcher) 以 write_seq 做 seqlock，不需上鎖
+typedef struct {
+    uint32_t write_seq;         // 奇數 = 寫入中；每次投遞 +2
+    uint32_t delivered_seq;     // 已推播給司機的 write_seq (只有擁有者寫入)
+    uint8_t connected;          // 1 = 司機目前有長連線
+    uint16_t owner_worker;      // 持有長連線的 Dispatcher 編號
+    uint32_t generation;        // 每次建立長連線 +1；舊連線發現不一致就自行關閉
+    RideAssignmentData msg;     // 最新一筆派單
+} DriverMailbox;
+
+// 派單推播表
+typedef struct {
+    DriverMailbox mailboxes[MAX_DRIVERS];
+    // 每個 Dispatcher 一組「哪些司機有新派單」的位元，被 eventfd 喚醒後整組取走
+    uint64_t pending[DRIVER_PUSH_MAX_WORKERS][MAX_DRIVERS / 64];
+    uint32_t connected;         // 目前的長連線數
+    uint64_t attaches;          // 統計：建立長連線次數
+    uint64_t posted;            // 統計：投遞派單數
+    uint64_t offline;           // 統計：投遞時司機沒有長連線 (只能從回覆得知)
+    uint64_t delivered;         // 統計：已推播的派單數
+} DriverPushTable;
+
+// 背景 Snapshot 統計 (只有 Coordinator 的 Snapshot 執行緒寫入)
+typedef struct {
+    uint32_t interval_secs;     // 設定的間隔；0 = 只在啟動 / 關機時寫入
+    uint64_t taken;             // 成功寫入的背景 Snapshot 數
+    uint64_t failed;            // 寫入失敗數
+    double last_stall_ms;       // 上一次持有 mutex 轉出映像的時間 (Dispatcher 被擋住的時間)
+    double max_stall_ms;
+    double total_stall_ms;
+    double last_write_ms;       // 上一次在鎖外寫檔 + fsync 的時間
+    uint64_t last_lsn;          // 上一次 Snapshot 包含到的 WAL LSN
+    time_t last_taken_at;       // 上一次完成的時間 (wall clock)
+} SnapshotStats;
+
+// Dispatcher 各階段延遲與計數 (--metrics-port 以 Prometheus 文字格式輸出)
+// 每個 Worker 一格，只有自己寫入 (relaxed store，不需要 atomic 加法或鎖)；讀取端逐格相加。
+// 延遲直方圖以 2 的次方分格：第 i 格 = 小於 2^(i + METRICS_MIN_SHIFT) ns，最後一格是更長的值。
+#define METRICS_MAX_WORKERS 128
+#define METRICS_BUCKETS     24      // 256 ns ~ 2.1 s
+#define METRICS_MIN_SHIFT   8
+
+typedef enum {
+    STAGE_HANDSHAKE,    // DH 握手 (取密鑰對、共享密鑰、回覆 / Ticket)
+    STAGE_RESUME,       // Ticket 驗證與 Session Key 衍生
+    STAGE_DECRYPT,      // 請求解密 + Checksum
+    STAGE_RATE_LIMIT,   // 以 client_id 限流
+    STAGE_LOCK_WAIT,    // 等待 state->mutex
+    STAGE_MATCH,        // 持有鎖：定價、派車、狀態更新
+    STAGE_RESPONSE,     // 回覆編碼 + 加密
+    STAGE_SEND,         // 送出回覆 (阻塞式 send；io_uring 為送出到完成)
+    STAGE_REQUEST,      // 叫車請求從解密後到回覆排入的總時間
+    STAGE_COUNT
+} MetricsStage;
+
+typedef enum {
+    METRIC_CONNECTIONS,     // 開始的連線 (Session)
+    METRIC_HANDSHAKES,
+    METRIC_RESUMES,
+    METRIC_RESUME_REJECTS,
+    METRIC_REQUESTS,
+    METRIC_CONFIRMED,
+    METRIC_NO_DRIVER,
+    METRIC_BLOCKED,
+    METRIC_CHECKSUM_ERRORS,
+    METRIC_NO_HANDSHAKE,    // 沒握手就送請求
+    METRIC_COUNT
+} MetricsCounter;
+
+typedef struct {
+    uint64_t buckets[METRICS_BUCKETS + 1];
+    uint64_t count;
+    uint64_t sum_ns;
+} StageHistogram;
+
+typedef struct {
+    StageHistogram stages[STAGE_COUNT];
+    uint64_t counters[METRIC_COUNT];
+} __attribute__((aligned(64))) WorkerMetrics;  // 每格獨占 cache line，Worker 之間不會 false sharing
+
+typedef struct {
+    WorkerMetrics workers[METRICS_MAX_WORKERS];
+} DispatcherMetrics;
+
+// state->mutex 的競爭分析 (--lock-profile 或對 Coordinator 送 SIGUSR1 開關)
+// 每個取鎖的呼叫點一個編號；每個進程一格 (第 0 格 = Coordinator 的各執行緒，Worker i = 第 i + 1 格)。
+// 關閉時取鎖只多一次 relaxed load；開啟時記錄等待與持有時間。
+#define LOCKPROF_SLOTS      (METRICS_MAX_WORKERS + 1)
+#define LOCKPROF_BUCKETS    20      // 128 ns ~ 134 ms
+#define LOCKPROF_MIN_SHIFT  7
+
+typedef enum {
+    LOCK_SITE_RIDE_MATCH,       // ride_service：定價 + 派車
+    LOCK_SITE_DRIVER_JOIN,      // coordinator：司機加入
+    LOCK_SITE_MAP_TICK,         // map_monitor：每個 tick 移動所有司機
+    LOCK_SITE_LOCATION_BATCH,   // location_service：套用一批 UDP 定位回報
+    LOCK_SITE_DRIVER_ATTACH,    // driver_channel：司機長連線登記
+    LOCK_SITE_DRIVER_DETACH,    // driver_channel：司機長連線斷開
+    LOCK_SITE_TICKET_ROTATE,    // session_ticket：Ticket 金鑰輪替
+    LOCK_SITE_SNAPSHOT,         // snapshot：轉出映像
+    LOCK_SITE_COUNT
+} LockSite;
+
+typedef struct {
+    uint64_t acquisitions;
+    uint64_t contended;         // trylock 失敗、真的需要排隊的次數
+    uint64_t wait_ns;
+    uint64_t hold_ns;
+    uint64_t max_wait_ns;
+    uint64_t max_hold_ns;
+    uint64_t wait_buckets[LOCKPROF_BUCKETS + 1];
+    uint64_t hold_buckets[LOCKPROF_BUCKETS + 1];
+} LockSiteStats;
+
+typedef struct {
+    LockSiteStats sites[LOCK_SITE_COUNT];
+} __attribute__((aligned(64))) LockProfileSlot;
+
+typedef struct {
+    uint32_t enabled;           // 取鎖端只讀這個欄位決定要不要計時
+    uint32_t reserved;
+    uint64_t since_ns;          // 這一輪開始記錄的時間 (CLOCK_MONOTONIC)
+    uint64_t until_ns;          // 這一輪停止的時間 (0 = 仍在記錄)
+    LockProfileSlot slots[LOCKPROF_SLOTS];
+} LockProfile;
+
+// Dispatcher 進程池 (Coordinator 依負載增減 Worker，Worker 結束時補上)
+// 每個格子對應一組固定的 Worker 資源 (log / metrics / 推播信箱 / trace 各自的第 i 格)，
+// 所以上限是格子數；Worker 只寫自己格子的 active / busy 欄位，其餘都由 Coordinator 寫入。
+#define POOL_MAX_WORKERS 100    // 不可超過 METRICS_MAX_WORKERS、DRIVER_PUSH_MAX_WORKERS 與 LOG_RING_COUNT - 1 (每個 Worker 獨佔一個 log 緩衝區)
+
+typedef struct {
+    pid_t pid;                  // 0 = 空格
+    uint32_t retire;            // Coordinator 要求退休：Worker 處理完手上的連線後自行結束
+    uint32_t respawn;           // Worker 異常結束，等下一個 tick 重新 fork
+    uint32_t active;            // 非 0 = 正在處理連線 / 完成事件 (Worker 寫入)
+    uint64_t busy_since_ns;     // active 由 0 變為非 0 的時間 (Worker 寫入)
+    uint64_t busy_ns;           // 累計處理連線的時間 (Worker 寫入)
+    uint64_t idle_since_ns;     // active 回到 0 的時間 (Worker 寫入；fork 時由 Coordinator 設定)
+    uint64_t started_ns;
+} __attribute__((aligned(64))) WorkerSlot;
+
+typedef struct {
+    uint32_t min_workers;
+    uint32_t max_workers;
+    uint32_t idle_secs;         // 池子持續清閒多久才開始回收
+    uint32_t live;              // 執行中 (不含退休中) 的 Worker 數
+    uint32_t busy;              // 上一個 tick 正在處理連線的 Worker 數
+    uint32_t accept_queue;      // 監聽 socket 已完成握手、等待 accept 的連線數
+    uint32_t accept_backlog;    // accept 佇列的上限
+    uint32_t reserved;
+    double utilization;         // 忙碌時間比例 (各 Worker 的 busy_ns 增量 / 經過時間，指數平滑)
+    uint64_t spawned;           // 擴充 fork 的 Worker 數 (不含啟動時與重生)
+    uint64_t respawned;         // 異常結束後補上的 Worker 數
+    uint64_t retired;           // 閒置回收的 Worker 數
+    WorkerSlot slots[POOL_MAX_WORKERS];
+} WorkerPool;
+
 // 訂單/行程狀態
 typedef struct {
     uint32_t ride_id;
@@ -38,6 +239,35 @@ typedef struct {
     uint8_t status;       
 } Ride;
 
+// GCRA 限流表 (固定大小的開放定址雜湊表，不需要全域鎖)
+// 每個 slot 是一個 64-bit word，以 CAS 原子更新：
+//   高 32 bits = key (client_id)，低 32 bits = TAT (Theoretical Arrival Time，微秒刻度，約 71 分鐘回繞一次)
+// word == 0 表示空 slot；TAT 已經過去的 slot 沒有任何額度負債，等同新 client，可直接重用
+#define RATE_LIMIT_SLOTS (1 << 17)  // 必須是 2 的次方 (8 bytes x 131072 = 1 MB)
+#define RATE_LIMIT_PROBE 8          // 線性探測視窗 (剛好一條 64-byte cache line)
+
+typedef struct {
+    uint32_t emission_us;       // 每個請求消耗的時間 (1000000 / rate)；0 = 停用
+    uint32_t tolerance_us;      // 可預支的時間 (決定 burst 大小)
+    uint64_t epoch_ns;          // tick 0 對應的 CLOCK_MONOTONIC 時間
+    uint32_t sweep_hand;        // Clock sweep 指針 (逐步清除過期 slot)
+    uint64_t blocked_count;     // 統計：被阻擋的請求數
+    uint64_t table_full_count;  // 統計：探測視窗內都是活躍 client，只能放行的次數
+    uint64_t slots[RATE_LIMIT_SLOTS];
+} RateLimitTable;
+
+// Session Ticket 金鑰環 (所有 Dispatcher 共用，才能驗證彼此簽發的 Ticket)
+// keys[generation & 1] 是目前這一代，另一格保留上一代，輪替期間簽發的 Ticket 仍然有效
+typedef struct {
+    uint32_t generation;        // 目前的金鑰代數 (從 1 開始)
+    time_t rotated_at;          // 上次輪替時間
+    uint64_t keys[2];
+    uint32_t next_nonce;        // 下一張 Ticket 的編號 (原子遞增)
+    uint64_t issued_count;      // 統計：簽發張數
+    uint64_t resumed_count;     // 統計：成功恢復次數
+    uint64_t rejected_count;    // 統計：拒絕次數 (過期 / 偽造 / 金鑰已輪替)
+} TicketKeyring;
+
 // 主共享記憶體結構
 typedef struct {
     // 1. Process-Shared Mutex (互斥鎖)
@@ -52,20 +282,52 @@ typedef struct {
     // 3. 訂單佇列 (結構保留)
     Ride pending_rides[MAX_PENDING_RIDES];
     int ride_count;
+    uint32_t next_ride_id;  // 派單編號 (推播給司機)
 
     // 所有 Dispatcher 處理完訂單後，都會更新這裡的數字
+    uint64_t total_connections_accepted; // 通過 Admission Control 的連線數 (原子遞增)
     uint64_t total_requests_handled;
     uint64_t total_success_requests;
     long total_revenue; // 總營收 (用於計算 Surge Pricing 門檻)
+    uint64_t journal_lsn;   // Snapshot 已包含的最後一筆 WAL 記錄 (重播時只套用更新的記錄)
+
+    // 4. 區域供需計數器 (Zone-based Surge Pricing)
+    // 在每次司機狀態轉換時增量更新，定價只需查表
+    ZoneStats zones[ZONE_COUNT];
 
     // 5. 資安防護資料 (Security / DoS Protection)
-    // 記錄每個 Client IP 最後連線時間與請求次數，用於 Rate Limiting
-    time_t client_last_seen[2000]; 
-    int client_req_count[2000];    
+    // 以 client_id 為 key 的 GCRA 限流表，用於 Rate Limiting
+    RateLimitTable rate_limit;
+    // 以來源 IPv4 位址為 key 的 GCRA 限流表，在 accept 之後、握手之前就擋掉過量連線
+    RateLimitTable peer_admission;
+
+    // 6. Session Resumption Ticket 金鑰環
+    TicketKeyring tickets;
+
+    // 7. UDP 司機定位回報統計
+    LocationIngestStats location;
+
+    // 8. 司機長連線的派單信箱
+    DriverPushTable driver_push;
+
+    // 9. 背景 Snapshot 統計
+    SnapshotStats snapshot;
+
+    // 10. Dispatcher 各階段延遲與計數
+    DispatcherMetrics metrics;
+
+    // 11. state->mutex 各呼叫點的等待 / 持有時間
+    LockProfile lock_profile;
+
+    // 12. Dispatcher 進程池
+    WorkerPool pool;
 
     // 派車演算法模式 (0=Basic, 1=Smart)
     int dispatch_mode;
 
+    // Coordinator 的 PID (ride_top 用來判斷 Server 是否還在執行)
+    pid_t server_pid;
+
 } SharedState;
 
 extern SharedState *g_shared_state;
@@ -0,0 +1,213 @@
+/* src/common/include/snapshot_format.h */
+#ifndef SNAPSHOT_FORMAT_H
+#define SNAPSHOT_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "shared_data.h"
+
+// Snapshot 檔案格式 (server.dat)
+// 版本 1 是第一版程式 (x86-64 / glibc) 直接 write() 出來的 SharedState，版面凍結在下面的 SnapshotV1State。
+// 版本 2 起改成自我描述的格式，所有欄位固定寬度、little-endian、無 padding：
+//
+//   offset 0      SnapshotFileHeader (64 bytes)
+//   offset 64     SnapshotSection[section_count] (區段表，每筆 40 bytes)
+//   offset 4096*k 各區段內容 (起點對齊分頁，可以直接 mmap 當陣列使用)
+//
+// 檔頭的 header_crc 涵蓋檔頭 (crc 欄位視為 0) 與區段表；每個區段有自己的 crc。
+// 讀取端略過不認得的區段；record_size 比自己知道的大時只讀前面認得的欄位，
+// 所以新增區段或在記錄尾端加欄位只需要提高 version，舊版 dump_dat 仍然讀得懂。
+// 不相容的變更必須換 magic。
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "snapshot format is little-endian; big-endian hosts need byte swapping in snapshot_format.c"
+#endif
+
+#define SNAPSHOT_MAGIC        "RIDESNAP"    // 8 bytes，不含結尾 NUL
+#define SNAPSHOT_VERSION      2             // 目前寫入的版本
+#define SNAPSHOT_VERSION_RAW  1             // 舊格式：沒有檔頭的第一版 SharedState 原始傾印 (SnapshotV1State)
+#define SNAPSHOT_PAGE         4096          // 區段起點對齊
+#define SNAPSHOT_MAX_SECTIONS 16
+
+// 區段編號
+#define SNAPSHOT_SEC_COUNTERS 1     // SnapshotCounters x 1 (必要)
+#define SNAPSHOT_SEC_DRIVERS  2     // SnapshotDriver x driver_count (必要，熱資料)
+#define SNAPSHOT_SEC_ZONES    3     // SnapshotZone x ZONE_COUNT (只供檢視，載入時依司機重建)
+#define SNAPSHOT_SEC_STATS    4     // SnapshotStatsRecord x 1 (只供檢視，統計只算單次執行)
+
+typedef struct {
+    char magic[8];              // SNAPSHOT_MAGIC
+    uint32_t version;           // SNAPSHOT_VERSION
+    uint32_t header_size;       // sizeof(SnapshotFileHeader)，區段表緊接在後
+    uint32_t section_count;
+    uint32_t section_entry_size;// sizeof(SnapshotSection)
+    uint64_t journal_lsn;       // Snapshot 已包含的最後一筆 WAL 記錄
+    int64_t created_at;         // 寫入時間 (wall clock)
+    uint32_t reserved[5];
+    uint32_t header_crc;        // CRC-32 (檔頭 + 區段表)
+} __attribute__((packed)) SnapshotFileHeader;
+
+typedef struct {
+    uint32_t id;                // SNAPSHOT_SEC_*
+    uint32_t record_size;       // 每筆記錄的長度
+    uint64_t record_count;
+    uint64_t offset;            // 從檔案開頭算起，對齊 SNAPSHOT_PAGE
+    uint64_t length;            // record_size * record_count
+    uint32_t crc;               // CRC-32 (區段內容)
+    uint32_t reserved;
+} __attribute__((packed)) SnapshotSection;
+
+// 全域計數器
+typedef struct {
+    uint32_t driver_count;
+    int32_t dispatch_mode;
+    uint32_t next_ride_id;
+    uint32_t reserved;
+    uint64_t total_connections_accepted;
+    uint64_t total_requests_handled;
+    uint64_t total_success_requests;
+    int64_t total_revenue;
+} __attribute__((packed)) SnapshotCounters;
+
+// 司機記錄 (64 bytes；double 欄位位於 8 的倍數，mmap 之後可以直接讀)
+typedef struct {
+    uint32_t driver_id;
+    uint8_t is_available;
+    uint8_t is_refueling;
+    uint8_t has_target;
+    uint8_t reserved0;
+    int32_t rides_count;
+    int32_t fuel;
+    uint32_t loc_seq;
+    uint32_t reserved1;
+    double lat;
+    double lon;
+    double rating;
+    double target_lat;
+    double target_lon;
+} __attribute__((packed)) SnapshotDriver;
+
+// 版本 1 的版面：照抄第一版的 SharedState / Driver / Ride (自然對齊，不是 packed)。
+// 之後 SharedState 怎麼改都不影響讀取；長度必須剛好是 SNAPSHOT_V1_SIZE。
+#define SNAPSHOT_V1_MAX_DRIVERS 256
+#define SNAPSHOT_V1_MAX_RIDES   128
+#define SNAPSHOT_V1_CLIENTS     2000
+#define SNAPSHOT_V1_SIZE        46616
+
+typedef struct {
+    uint32_t driver_id;
+    double lat;
+    double lon;
+    uint8_t is_available;
+    int32_t rides_count;
+    int32_t fuel;
+    uint8_t is_refueling;
+    double rating;
+    uint8_t has_target;
+    double target_lat;
+    double target_lon;
+} SnapshotV1Driver;
+
+typedef struct {
+    uint32_t ride_id;
+    uint32_t client_id;
+    double start_lat;
+    double start_lon;
+    uint8_t status;
+} SnapshotV1Ride;
+
+typedef struct {
+    uint8_t mutex[40];                  // pthread_mutex_t (glibc x86-64)，讀取時忽略
+    SnapshotV1Driver drivers[SNAPSHOT_V1_MAX_DRIVERS];
+    int32_t driver_count;
+    SnapshotV1Ride pending_rides[SNAPSHOT_V1_MAX_RIDES];
+    int32_t ride_count;
+    uint64_t total_requests_handled;
+    uint64_t total_success_requests;
+    int64_t total_revenue;
+    int64_t client_last_seen[SNAPSHOT_V1_CLIENTS];
+    int32_t client_req_count[SNAPSHOT_V1_CLIENTS];
+    int32_t dispatch_mode;
+} SnapshotV1State;
+
+_Static_assert(sizeof(SnapshotV1State) == SNAPSHOT_V1_SIZE, "SnapshotV1State must match the v1 file layout");
+
+typedef struct {
+    int32_t available_drivers;
+    int32_t busy_drivers;
+    double demand;
+} __attribute__((packed)) SnapshotZone;
+
+// 寫入當下的執行統計 (dump_dat 顯示用)
+typedef struct {
+    uint64_t peer_blocked;          // peer_admission.blocked_count
+    uint64_t rate_limit_blocked;    // rate_limit.blocked_count
+    uint64_t loc_received;
+    uint64_t loc_applied;
+    uint64_t loc_stale;
+    uint64_t loc_rejected;
+    uint64_t loc_batches;
+    uint64_t push_attaches;
+    uint64_t push_posted;
+    uint64_t push_offline;
+    uint64_t push_delivered;
+    uint32_t push_connected;
+    uint32_t snapshot_interval_secs;
+    uint64_t tickets_issued;
+    uint64_t tickets_resumed;
+    uint64_t tickets_rejected;
+    uint64_t snapshots_taken;
+    uint64_t snapshots_failed;
+    double snapshot_last_stall_ms;
+    double snapshot_max_stall_ms;
+    double snapshot_last_write_ms;
+} __attribute__((packed)) SnapshotStatsRecord;
+
+// 寫入端在記憶體中組好的完整映像 (不是檔案格式，各區段的內容直接取自這裡)
+typedef struct {
+    uint64_t journal_lsn;
+    int64_t created_at;
+    SnapshotCounters counters;
+    SnapshotDriver drivers[MAX_DRIVERS];
+    SnapshotZone zones[ZONE_COUNT];
+    SnapshotStatsRecord stats;
+} SnapshotImage;
+
+/**
+ * 累加 CRC-32 (IEEE 802.3)。第一次呼叫傳 crc = 0，可以分段餵入。
+ */
+uint32_t snapshot_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ * 把共享狀態轉成檔案格式的映像 (呼叫端負責鎖)。
+ */
+void snapshot_image_capture(const SharedState *state, SnapshotImage *image);
+
+/**
+ * 把版本 1 的檔案內容轉成映像 (只有計數器與司機表；區域與統計留 0，journal_lsn = 0)。
+ * size 檔案長度
+ * return NULL = 成功，否則為錯誤說明
+ */
+const char *snapshot_v1_decode(const void *data, uint64_t size, SnapshotImage *image);
+
+/**
+ * 由司機記錄還原司機 (區域登記與定位時間由呼叫端重建)。
+ */
+void snapshot_driver_restore(const SnapshotDriver *rec, Driver *driver);
+
+/**
+ * 檢查檔頭與區段表：magic / 版本 / 檔頭 CRC / 每個區段都落在檔案內且對齊。
+ * sections 必須已經讀入 section_count 筆 (呼叫端先確認 section_count <= SNAPSHOT_MAX_SECTIONS)
+ * file_size 檔案長度
+ * return NULL = 通過，否則為錯誤說明
+ */
+const char *snapshot_header_check(const SnapshotFileHeader *hdr, const SnapshotSection *sections, uint64_t file_size);
+
+/**
+ * 在區段表中找指定區段，並確認記錄長度至少是 min_record_size。
+ * return 區段；沒有或太短時回傳 NULL
+ */
+const SnapshotSection *snapshot_find_section(const SnapshotFileHeader *hdr, const SnapshotSection *sections,
+                                             uint32_t id, uint32_t min_record_size);
+
+#endif
@@ -0,0 +1,45 @@
+/* src/common/include/trace_format.h */
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdint.h>
+
+// 請求擷取檔 (server_app --trace=FILE 寫入，trace_replay 讀取)
+// 只記錄解密後的叫車請求中繼資料，不含 Session Key / Ticket 等連線狀態，重播時由重播端重新握手。
+//
+//   offset 0   TraceFileHeader (32 bytes)
+//   offset 32  TraceRecord x N (每筆 record_size bytes)
+//
+// 所有欄位固定寬度、little-endian、無 padding。各 Worker 的記錄依寫入順序排列，
+// 不保證依時間排序 (讀取端依 t_us 排序)。新版本只會在記錄尾端追加欄位：
+// 讀取端接受 record_size >= sizeof(TraceRecord) 的檔案，只讀前面認得的欄位。
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "trace format is little-endian; big-endian hosts need byte swapping"
+#endif
+
+#define TRACE_MAGIC   "RIDETRCE"    // 8 bytes，不含結尾 NUL
+#define TRACE_VERSION 1
+
+typedef struct {
+    char magic[8];              // TRACE_MAGIC
+    uint32_t version;           // TRACE_VERSION
+    uint32_t record_size;       // sizeof(TraceRecord)
+    int64_t started_at;         // 開始擷取的時間 (wall clock 秒)
+    uint64_t reserved;
+} __attribute__((packed)) TraceFileHeader;
+
+typedef struct {
+    uint64_t t_us;              // 請求到達時間 (從開始擷取算起，單調時鐘)
+    uint32_t client_id;
+    uint32_t service_us;        // Server 處理時間 (解密完成 → 回覆排入緩衝區)
+    int32_t lat_e7;             // 上車點 * LOC_COORD_SCALE
+    int32_t lon_e7;
+    uint16_t opcode;            // OP_REQ_RIDE / OP_REQ_RIDE_BIN
+    uint8_t type;               // RideRequestData.type (0=Standard, 1=VIP)
+    uint8_t status;             // 原本的結果 RIDE_STATUS_*
+    uint16_t worker;            // 處理的 Dispatcher 進程 (0 起算)
+    uint16_t reserved;
+} __attribute__((packed)) TraceRecord;
+
+#endif // TRACE_FORMAT_H
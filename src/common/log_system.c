@@ -4,10 +4,85 @@
 #include <stdarg.h>
 #include <time.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "include/log_system.h"
 
 static FILE *log_fp = NULL;
+static char log_path[256] = "";
+
+// 非同步模式
+// 每個緩衝區是多寫入者 / 單讀取者的有界佇列：每個 slot 帶一個序號，
+// 寫入者以 CAS 取得位置、填好內容後把序號設為 pos + 1 (發布)；讀取者看到序號 == pos + 1 才取走，
+// 取走後設為 pos + LOG_RING_SLOTS 讓下一輪的寫入者使用。
+// 同一進程的多個執行緒 (Coordinator 有 Map Monitor / WAL / Snapshot 等) 或共用緩衝區的進程都不需要鎖。
+//
+// 延後格式化：每個 log 巨集的呼叫點是一個 static LogSite，第一次呼叫時解析格式字串得到參數型別，
+// 並登記到共享的呼叫點字典 (取得編號)。之後每次呼叫只把編號與原始參數複製進緩衝區，
+// 格式化留給寫入執行緒 (文字模式) 或 log_decode (二進位模式)。
+#define LOG_WRITER_IDLE_MIN_US 50       // 沒有新行時寫入執行緒的休息時間：從這裡開始每次加倍，
+#define LOG_WRITER_IDLE_MAX_US 5000     // 最多到這裡 (也是時間戳記的更新粒度)；有新行就回到最短
+#define LOG_WRITE_BATCH     (64 * 1024) // 每批 write() 的最大長度
+#define LOG_BLOCK_WAIT_US   100         // LOG_OVERFLOW_BLOCK 等待空間時每次休息的時間 (讓出 CPU 給寫入執行緒)
+#define LOG_SITE_BUSY       0xFFFE      // 另一個執行緒正在登記這個呼叫點
+#define LOG_SITE_SKIP       0xFFFD      // 寫入者死在發布之前，由 log_reclaim_ring 補上的空行 (不輸出)
+#define LOG_LINE_MAX        1024        // 還原後單行的最大長度
+
+static const char *level_names[] = { "INFO", "WARN", "ERROR", "DEBUG" };
+
+// 參數型別 (由格式字串的轉換規格決定)
+enum { ARG_NONE, ARG_I32, ARG_I64, ARG_DBL, ARG_STR, ARG_BAD };
+
+typedef struct {
+    uint64_t seq;               // 見上方說明
+    uint32_t timestamp;         // 粗略時間 (秒)
+    uint16_t site;              // 呼叫點編號；LOG_SITE_TEXT = data 是已格式化的文字
+    uint8_t level;
+    uint8_t truncated;
+    uint16_t len;
+    uint8_t data[LOG_TEXT_MAX];
+} LogRecord;
+
+typedef struct {
+    uint64_t head __attribute__((aligned(64)));    // 下一個寫入位置 (寫入者 CAS)
+    uint64_t tail __attribute__((aligned(64)));    // 下一個讀取位置 (只有寫入執行緒更新)
+    uint64_t written;
+    uint64_t dropped;
+    LogRecord slots[LOG_RING_SLOTS];
+} LogRing;
+
+// 呼叫點字典的一格 (編號 = 索引 + 1)
+typedef struct {
+    const char *fmt_ptr;        // 登記時的格式字串位址 (fork 出來的進程位址相同，用來找重複登記)
+    uint16_t line;
+    uint8_t level;
+    uint8_t ready;              // 內容寫好之後才設為 1
+    char file[LOG_FILE_MAX];
+    char fmt[LOG_FMT_MAX];
+} LogSiteEntry;
+
+typedef struct {
+    int64_t coarse_now;         // 寫入執行緒定期更新的時間 (秒)
+    uint8_t running;            // 寫入執行緒運作中才走非同步路徑
+    uint8_t overflow_policy;
+    uint8_t format;             // LOG_FORMAT_*
+    uint32_t site_count;
+    LogSiteEntry sites[LOG_MAX_SITES];
+    LogRing rings[LOG_RING_COUNT];
+} LogShared;
+
+static LogShared *g_log = NULL;
+static int g_ring_index = 0;            // 本進程使用的緩衝區
+static int g_format = LOG_FORMAT_TEXT;  // 同步寫入時也要依照檔案格式
+static size_t g_rotate_bytes = 0;
+static pthread_t g_writer_tid;
+static int g_writer_owner = 0;          // 本進程是否啟動了寫入執行緒
 
 /**
  * 初始化日誌系統。
@@ -19,16 +94,24 @@ void log_init(const char *filename) {
         if (!log_fp) {
             fprintf(stderr, "Failed to open log file %s, using stderr.\n", filename);
             log_fp = stderr;
+        } else {
+            snprintf(log_path, sizeof(log_path), "%s", filename);
         }
     } else {
         log_fp = stderr;
     }
 }
 
+/**
+ * 停止寫入執行緒並寫完剩餘的行。
+ */
+static void log_async_stop(void);
+
 /**
  * 清理日誌資源，關閉檔案。
  */
 void log_cleanup() {
+    if (g_writer_owner) log_async_stop();
     if (log_fp && log_fp != stderr) {
         fclose(log_fp);
         log_fp = NULL;
@@ -36,11 +119,613 @@ void log_cleanup() {
 }
 
 /**
- * 內部輔助：實際列印函式。
+ * 二進位檔案是空的時候寫入檔頭。
+ */
+static void write_bin_header(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size != 0) return;
+    LogBinFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LOG_BIN_MAGIC, sizeof(hdr.magic));
+    hdr.version = LOG_BIN_VERSION;
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) return;
+}
+
+int log_async_init(int overflow_policy, size_t rotate_bytes, int format) {
+    if (log_fp == NULL || log_fp == stderr) return -1; // 只有寫檔需要
+    g_format = format; // 即使非同步模式失敗，同步寫入也要符合檔案格式
+    if (format == LOG_FORMAT_BINARY) write_bin_header(fileno(log_fp));
+    LogShared *shared = mmap(NULL, sizeof(LogShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) return -1;
+
+    // 匿名映射已經是 0，只需要設定每個 slot 的初始序號
+    for (int r = 0; r < LOG_RING_COUNT; r++) {
+        for (int i = 0; i < LOG_RING_SLOTS; i++) shared->rings[r].slots[i].seq = (uint64_t)i;
+    }
+    shared->overflow_policy = (uint8_t)overflow_policy;
+    shared->format = (uint8_t)format;
+    shared->coarse_now = (int64_t)time(NULL);
+    g_rotate_bytes = rotate_bytes;
+    g_log = shared;
+    return 0;
+}
+
+void log_attach(int ring) {
+    g_ring_index = ring >= 0 ? ring % LOG_RING_COUNT : 0;
+}
+
+int log_reclaim_ring(int ring) {
+    if (g_log == NULL || ring < 0) return 0;
+    LogRing *r = &g_log->rings[ring % LOG_RING_COUNT];
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    int reclaimed = 0;
+    // slot i 的序號 == pos (pos % SLOTS == i) 且 pos < head：位置已被取得、內容還沒發布
+    for (uint64_t i = 0; i < LOG_RING_SLOTS; i++) {
+        LogRecord *rec = &r->slots[i];
+        uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if ((seq & (LOG_RING_SLOTS - 1)) != i || seq >= head) continue;
+        rec->site = LOG_SITE_SKIP;
+        rec->len = 0;
+        __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+        reclaimed++;
+    }
+    return reclaimed;
+}
+
+void log_async_stats(uint64_t *written, uint64_t *dropped) {
+    *written = 0;
+    *dropped = 0;
+    if (g_log == NULL) return;
+    for (int r = 0; r < LOG_RING_COUNT; r++) {
+        *written += __atomic_load_n(&g_log->rings[r].written, __ATOMIC_RELAXED);
+        *dropped += __atomic_load_n(&g_log->rings[r].dropped, __ATOMIC_RELAXED);
+    }
+}
+
+//  格式字串解析
+/**
+ * 解析一個轉換規格。
+ * p 指向 '%'
+ * spec 複製出來的規格 (例如 "%.4f")，給 snprintf 使用
+ * type 參數型別 ARG_*
+ * return 規格之後的位置
+ */
+static const char *parse_spec(const char *p, char *spec, size_t cap, int *type) {
+    const char *start = p++;
+    int longs = 0, wide = 0;
+    *type = ARG_BAD;
+
+    while (*p && strchr("-+ #0", *p)) p++;                  // flags
+    while (*p >= '0' && *p <= '9') p++;                     // width
+    if (*p == '.') {                                        // precision
+        p++;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    while (*p && strchr("hlLzjt", *p)) {                    // length
+        if (*p == 'l') longs++;
+        if (*p == 'z' || *p == 'j' || *p == 't') wide = 1;
+        if (*p == 'L') longs = 3;                           // long double：不支援
+        p++;
+    }
+    switch (*p) {
+        case '%': *type = ARG_NONE; break;
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            *type = (longs == 3) ? ARG_BAD : (longs || wide) ? ARG_I64 : ARG_I32;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            *type = (longs == 3) ? ARG_BAD : ARG_DBL;
+            break;
+        case 's': *type = longs ? ARG_BAD : ARG_STR; break;
+        case 'p': *type = ARG_I64; break;
+        default: break;                                     // %n、'*' 寬度等不支援
+    }
+    if (*p) p++;
+
+    size_t n = (size_t)(p - start);
+    if (n >= cap) {
+        n = cap - 1;
+        *type = ARG_BAD;
+    }
+    memcpy(spec, start, n);
+    spec[n] = '\0';
+    return p;
+}
+
+size_t log_render(const char *fmt, const uint8_t *args, size_t len, int truncated, char *out, size_t cap) {
+    const uint8_t *arg = args, *end = args + len;
+    size_t n = 0;
+    char spec[32];
+
+    if (cap < 4) return 0;
+    for (const char *p = fmt; *p && n + 1 < cap; ) {
+        if (*p != '%') {
+            out[n++] = *p++;
+            continue;
+        }
+        int type;
+        p = parse_spec(p, spec, sizeof(spec), &type);
+        if (type == ARG_NONE) {
+            out[n++] = '%';
+            continue;
+        }
+
+        size_t need = (type == ARG_I32) ? 4 : (type == ARG_STR) ? 2 : 8;
+        if (type == ARG_BAD || (size_t)(end - arg) < need) {
+            truncated = 1; // 參數被截斷 (或記錄時就不支援)，停止還原
+            break;
+        }
+        int w = 0;
+        if (type == ARG_I32) {
+            int32_t v;
+            memcpy(&v, arg, 4);
+            w = snprintf(out + n, cap - n, spec, v);
+        } else if (type == ARG_I64) {
+            int64_t v;
+            memcpy(&v, arg, 8);
+            if (spec[strlen(spec) - 1] == 'p') {
+                w = snprintf(out + n, cap - n, spec, (void *)(uintptr_t)v);
+            } else if (strstr(spec, "ll")) {
+                w = snprintf(out + n, cap - n, spec, (long long)v);
+            } else if (strchr(spec, 'z')) {
+                w = snprintf(out + n, cap - n, spec, (size_t)v);
+            } else {
+                w = snprintf(out + n, cap - n, spec, (long)v);
+            }
+        } else if (type == ARG_DBL) {
+            double v;
+            memcpy(&v, arg, 8);
+            w = snprintf(out + n, cap - n, spec, v);
+        } else {
+            uint16_t slen;
+            memcpy(&slen, arg, 2);
+            if ((size_t)(end - arg) < 2u + slen) slen = (uint16_t)(end - arg - 2);
+            need = 2u + slen;
+            // 記錄來自檔案 (log_decode) 時長度不可信：超過寫入端的上限就截斷
+            char str[LOG_TEXT_MAX + 1];
+            if (slen > LOG_TEXT_MAX) {
+                slen = LOG_TEXT_MAX;
+                truncated = 1;
+            }
+            memcpy(str, arg + 2, slen);
+            str[slen] = '\0';
+            w = snprintf(out + n, cap - n, spec, str);
+        }
+        if (w > 0) n += ((size_t)w < cap - n) ? (size_t)w : cap - n - 1;
+        arg += need;
+    }
+
+    if (truncated && n + 4 < cap) {
+        memcpy(out + n, "...", 3);
+        n += 3;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+//  呼叫點登記
+/**
+ * 第一次非同步呼叫時：解析參數型別，並在共享字典取得編號 (同一個呼叫點在其他進程已登記過就共用)。
+ * return 1 = site 可以使用, 0 = 另一個執行緒正在登記 (這一次改在呼叫端格式化)
+ */
+static int site_prepare(LogSite *site) {
+    uint16_t expected = 0;
+    if (!__atomic_compare_exchange_n(&site->id, &expected, LOG_SITE_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        return expected != LOG_SITE_BUSY;
+    }
+
+    uint16_t id = LOG_SITE_TEXT;
+    int nargs = 0, ok = strlen(site->fmt) < LOG_FMT_MAX;
+    char spec[32];
+    for (const char *p = site->fmt; ok && *p; ) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        int type;
+        p = parse_spec(p, spec, sizeof(spec), &type);
+        if (type == ARG_NONE) continue;
+        if (type == ARG_BAD || nargs == LOG_MAX_ARGS) ok = 0;
+        else site->types[nargs++] = (uint8_t)type;
+    }
+    site->nargs = (uint8_t)nargs;
+
+    if (ok) {
+        uint32_t count = __atomic_load_n(&g_log->site_count, __ATOMIC_ACQUIRE);
+        for (uint32_t i = 0; i < count && i < LOG_MAX_SITES; i++) {
+            LogSiteEntry *e = &g_log->sites[i];
+            if (__atomic_load_n(&e->ready, __ATOMIC_ACQUIRE) && e->fmt_ptr == site->fmt && e->line == site->line) {
+                id = (uint16_t)(i + 1);
+                break;
+            }
+        }
+        if (id == LOG_SITE_TEXT) {
+            uint32_t idx = __atomic_fetch_add(&g_log->site_count, 1, __ATOMIC_ACQ_REL);
+            if (idx < LOG_MAX_SITES) {
+                LogSiteEntry *e = &g_log->sites[idx];
+                e->fmt_ptr = site->fmt;
+                e->line = site->line;
+                e->level = site->level;
+                const char *base = strrchr(site->file, '/');
+                snprintf(e->file, sizeof(e->file), "%s", base ? base + 1 : site->file);
+                snprintf(e->fmt, sizeof(e->fmt), "%s", site->fmt);
+                __atomic_store_n(&e->ready, 1, __ATOMIC_RELEASE);
+                id = (uint16_t)(idx + 1);
+            }
+        }
+    }
+    __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+    return 1;
+}
+
+//  寫入端 (呼叫 log 的執行緒)
+/**
+ * 在本進程的緩衝區取得一個 slot。
+ * return slot；NULL 時 *handled = 1 表示依策略丟棄，0 表示寫入執行緒未運作 (呼叫端改為同步寫入)
+ */
+static LogRecord *ring_claim(uint64_t *pos_out, int *handled) {
+    LogRing *ring = &g_log->rings[g_ring_index];
+    uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    while (1) {
+        LogRecord *rec = &ring->slots[pos & (LOG_RING_SLOTS - 1)];
+        uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pos_out = pos;
+                return rec;
+            }
+        } else if (diff < 0) {
+            // 緩衝區滿
+            if (g_log->overflow_policy == LOG_OVERFLOW_DROP) {
+                __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+                *handled = 1;
+                return NULL;
+            }
+            if (!__atomic_load_n(&g_log->running, __ATOMIC_ACQUIRE)) { // 寫入執行緒已停止，不能再等
+                *handled = 0;
+                return NULL;
+            }
+            usleep(LOG_BLOCK_WAIT_US);
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * 依呼叫點的參數型別，把原始參數複製到 data (字串以 uint16 長度 + 內容存放)。
+ * return 使用的長度；放不下時設定 *truncated 並停止
+ */
+static size_t capture_args(const LogSite *site, va_list args, uint8_t *data, uint8_t *truncated) {
+    uint8_t *p = data, *end = data + LOG_TEXT_MAX;
+    for (int i = 0; i < site->nargs && !*truncated; i++) {
+        uint8_t type = site->types[i];
+        if (type == ARG_STR) {
+            const char *s = va_arg(args, const char *);
+            if (s == NULL) s = "(null)";
+            size_t n = strlen(s);
+            if (end - p < 2) {
+                *truncated = 1;
+            } else {
+                size_t room = (size_t)(end - p) - 2;
+                if (n > room) {
+                    n = room;
+                    *truncated = 1;
+                }
+                uint16_t len = (uint16_t)n;
+                memcpy(p, &len, 2);
+                memcpy(p + 2, s, n);
+                p += 2 + n;
+            }
+        } else {
+            union { int32_t i32; int64_t i64; double d; } v;
+            size_t size = 8;
+            if (type == ARG_I32) {
+                v.i32 = va_arg(args, int);
+                size = 4;
+            } else if (type == ARG_I64) {
+                v.i64 = va_arg(args, long);
+            } else {
+                v.d = va_arg(args, double);
+            }
+            if ((size_t)(end - p) < size) {
+                *truncated = 1;
+            } else {
+                memcpy(p, &v, size);
+                p += size;
+            }
+        }
+    }
+    return (size_t)(p - data);
+}
+
+/**
+ * 寫入本進程的緩衝區。
+ * return 1 = 已處理 (放入緩衝區或依策略丟棄), 0 = 寫入執行緒未運作，呼叫端改為同步寫入
+ */
+static int log_enqueue(LogSite *site, va_list args) {
+    if (g_log == NULL || !__atomic_load_n(&g_log->running, __ATOMIC_ACQUIRE)) return 0;
+    uint16_t id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+    if (id == 0 || id == LOG_SITE_BUSY) {
+        id = site_prepare(site) ? __atomic_load_n(&site->id, __ATOMIC_ACQUIRE) : LOG_SITE_TEXT;
+    }
+
+    uint64_t pos;
+    int handled = 1;
+    LogRecord *rec = ring_claim(&pos, &handled);
+    if (rec == NULL) return handled;
+
+    rec->truncated = 0;
+    if (id == LOG_SITE_TEXT) {
+        // 不能延後格式化的呼叫點：照舊在這裡格式化
+        int n = vsnprintf((char *)rec->data, sizeof(rec->data), site->fmt, args);
+        if (n < 0) n = 0;
+        rec->truncated = n >= (int)sizeof(rec->data);
+        rec->len = (uint16_t)(rec->truncated ? sizeof(rec->data) - 1 : (size_t)n);
+    } else {
+        rec->len = (uint16_t)capture_args(site, args, rec->data, &rec->truncated);
+    }
+    rec->site = id;
+    rec->level = site->level;
+    rec->timestamp = (uint32_t)__atomic_load_n(&g_log->coarse_now, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+//  寫入執行緒
+// 輸出緩衝區、時間字串快取、本檔案已寫過定義的呼叫點 (二進位模式每個檔案各自完整)
+static char g_out[LOG_WRITE_BATCH];
+static size_t g_out_len = 0;
+static size_t g_file_bytes = 0;
+static int64_t g_cached_sec = -1;
+static char g_cached_time[20];
+static uint8_t g_site_emitted[LOG_MAX_SITES + 1];
+static uint64_t g_reported_drops[LOG_RING_COUNT];  // 已寫過 WARN 的丟棄行數
+
+static void flush_out(void) {
+    size_t off = 0;
+    while (off < g_out_len) {
+        ssize_t n = write(fileno(log_fp), g_out + off, g_out_len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break; // 磁碟錯誤：丟掉這批，不能讓 log 卡住服務
+        off += (size_t)n;
+    }
+    g_file_bytes += g_out_len;
+    g_out_len = 0;
+}
+
+/**
+ * 檔案超過大小時輪替：<path> 改名為 <path>.1 (覆蓋上一次輪替的檔案)，開新檔接在同一個 fd 上。
+ */
+static void maybe_rotate(void) {
+    if (g_rotate_bytes == 0 || g_file_bytes < g_rotate_bytes || log_path[0] == '\0') return;
+    char rotated[sizeof(log_path) + 2];
+    snprintf(rotated, sizeof(rotated), "%s.1", log_path);
+    if (rename(log_path, rotated) != 0) return;
+    int fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        rename(rotated, log_path);
+        return;
+    }
+    dup2(fd, fileno(log_fp));
+    close(fd);
+    g_file_bytes = 0;
+    if (g_format == LOG_FORMAT_BINARY) {
+        write_bin_header(fileno(log_fp));
+        memset(g_site_emitted, 0, sizeof(g_site_emitted));
+    }
+}
+
+/**
+ * 確保輸出緩衝區還有 len bytes 的空間 (不夠就先寫出)。
+ */
+static void reserve_out(size_t len) {
+    if (g_out_len + len > sizeof(g_out)) {
+        flush_out();
+        maybe_rotate();
+    }
+}
+
+static void append_line(int64_t timestamp, int level, const char *text, size_t len, int truncated) {
+    reserve_out(len + 64);
+    if (timestamp != g_cached_sec) {
+        time_t t = (time_t)timestamp;
+        struct tm local;
+        localtime_r(&t, &local);
+        strftime(g_cached_time, sizeof(g_cached_time), "%Y-%m-%d %H:%M:%S", &local);
+        g_cached_sec = timestamp;
+    }
+    g_out_len += (size_t)snprintf(g_out + g_out_len, sizeof(g_out) - g_out_len, "[%s] [%s] ", g_cached_time, level_names[level]);
+    memcpy(g_out + g_out_len, text, len);
+    g_out_len += len;
+    if (truncated) {
+        memcpy(g_out + g_out_len, "...", 3);
+        g_out_len += 3;
+    }
+    g_out[g_out_len++] = '\n';
+}
+
+/**
+ * 附加一筆二進位記錄 (prefix 可為 NULL，用來放 EVENT / SITE 開頭的呼叫點編號等欄位)。
+ */
+static void append_bin(int kind, int level, int flags, uint32_t timestamp,
+                       const void *prefix, size_t prefix_len, const void *body, size_t body_len) {
+    LogBinRecord hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.kind = (uint8_t)kind;
+    hdr.level = (uint8_t)level;
+    hdr.flags = (uint8_t)flags;
+    hdr.len = (uint16_t)(prefix_len + body_len);
+    hdr.timestamp = timestamp;
+    reserve_out(sizeof(hdr) + prefix_len + body_len);
+    memcpy(g_out + g_out_len, &hdr, sizeof(hdr));
+    g_out_len += sizeof(hdr);
+    if (prefix_len > 0) memcpy(g_out + g_out_len, prefix, prefix_len);
+    g_out_len += prefix_len;
+    memcpy(g_out + g_out_len, body, body_len);
+    g_out_len += body_len;
+}
+
+/**
+ * 二進位模式：第一次在這個檔案用到某個呼叫點時先寫它的定義。
+ */
+static void emit_site(uint16_t id, uint32_t timestamp) {
+    if (g_site_emitted[id]) return;
+    const LogSiteEntry *e = &g_log->sites[id - 1];
+    char body[sizeof(e->file) + sizeof(e->fmt) + 2];
+    size_t file_len = strlen(e->file) + 1, fmt_len = strlen(e->fmt) + 1;
+    memcpy(body, e->file, file_len);
+    memcpy(body + file_len, e->fmt, fmt_len);
+    uint16_t prefix[2] = { id, e->line };
+    append_bin(LOG_BIN_SITE, e->level, 0, timestamp, prefix, sizeof(prefix), body, file_len + fmt_len);
+    g_site_emitted[id] = 1;
+}
+
+static void write_record(const LogRecord *rec) {
+    uint8_t level = rec->level < 4 ? rec->level : LOG_LEVEL_INFO;
+    if (g_format == LOG_FORMAT_BINARY) {
+        if (rec->site == LOG_SITE_TEXT) {
+            append_bin(LOG_BIN_TEXT, level, rec->truncated ? LOG_BIN_TRUNCATED : 0, rec->timestamp, NULL, 0, rec->data, rec->len);
+        } else {
+            emit_site(rec->site, rec->timestamp);
+            append_bin(LOG_BIN_EVENT, level, rec->truncated ? LOG_BIN_TRUNCATED : 0, rec->timestamp,
+                       &rec->site, sizeof(rec->site), rec->data, rec->len);
+        }
+    } else if (rec->site == LOG_SITE_TEXT) {
+        append_line(rec->timestamp, level, (const char *)rec->data, rec->len, rec->truncated);
+    } else {
+        char line[LOG_LINE_MAX];
+        size_t len = log_render(g_log->sites[rec->site - 1].fmt, rec->data, rec->len, rec->truncated, line, sizeof(line));
+        append_line(rec->timestamp, level, line, len, 0);
+    }
+}
+
+/**
+ * 寫入執行緒自己的訊息 (丟棄統計等)。
+ */
+static void write_notice(int level, const char *text, size_t len) {
+    uint32_t now = (uint32_t)g_log->coarse_now;
+    if (g_format == LOG_FORMAT_BINARY) {
+        append_bin(LOG_BIN_TEXT, level, 0, now, NULL, 0, text, len);
+    } else {
+        append_line(now, level, text, len, 0);
+    }
+}
+
+/**
+ * 取出所有緩衝區中已發布的行。
+ * return 取出的行數
  */
-static void log_base(const char *level, const char *fmt, va_list args) {
+static int drain_rings(void) {
+    int total = 0;
+
+    for (int r = 0; r < LOG_RING_COUNT; r++) {
+        LogRing *ring = &g_log->rings[r];
+        uint64_t tail = ring->tail;
+        uint64_t start = tail;
+        while (1) {
+            LogRecord *rec = &ring->slots[tail & (LOG_RING_SLOTS - 1)];
+            if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + 1) break; // 空的或還在寫
+            if (rec->site != LOG_SITE_SKIP) write_record(rec);
+            __atomic_store_n(&rec->seq, tail + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+            tail++;
+        }
+        if (tail != start) {
+            ring->tail = tail;
+            __atomic_fetch_add(&ring->written, tail - start, __ATOMIC_RELAXED);
+            total += (int)(tail - start);
+        }
+
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != g_reported_drops[r]) {
+            char msg[96];
+            int len = snprintf(msg, sizeof(msg), "Log ring %d full: dropped %lu lines.", r, dropped - g_reported_drops[r]);
+            write_notice(LOG_LEVEL_WARN, msg, (size_t)len);
+            g_reported_drops[r] = dropped;
+        }
+    }
+    return total;
+}
+
+static void *log_writer_thread(void *arg) {
+    (void)arg;
+    // SIGINT 交給其他執行緒處理 (關機流程最後會呼叫 log_cleanup 收尾)
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    useconds_t idle_us = LOG_WRITER_IDLE_MIN_US;
+    while (__atomic_load_n(&g_log->running, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&g_log->coarse_now, (int64_t)time(NULL), __ATOMIC_RELAXED);
+        int n = drain_rings();
+        if (g_out_len > 0) {
+            flush_out();
+            maybe_rotate();
+        }
+        if (n > 0) {
+            idle_us = LOG_WRITER_IDLE_MIN_US;
+        } else {
+            usleep(idle_us);
+            if (idle_us < LOG_WRITER_IDLE_MAX_US) idle_us *= 2;
+        }
+    }
+    return NULL;
+}
+
+int log_async_start(void) {
+    if (g_log == NULL) return -1;
+    struct stat st;
+    g_file_bytes = fstat(fileno(log_fp), &st) == 0 ? (size_t)st.st_size : 0;
+
+    memset(g_reported_drops, 0, sizeof(g_reported_drops));
+    memset(g_site_emitted, 0, sizeof(g_site_emitted));
+    __atomic_store_n(&g_log->running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&g_writer_tid, NULL, log_writer_thread, NULL) != 0) {
+        __atomic_store_n(&g_log->running, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    g_writer_owner = 1;
+    return 0;
+}
+
+static void log_async_stop(void) {
+    __atomic_store_n(&g_log->running, 0, __ATOMIC_RELEASE);
+    pthread_join(g_writer_tid, NULL);
+    g_writer_owner = 0;
+
+    // 停止後新的 log 直接同步寫入；這裡寫完已發布的行
+    // (被終止的進程可能留下寫到一半的 slot，該緩衝區之後的行無法取出，直接略過)
+    drain_rings();
+    flush_out();
+}
+
+/**
+ * 同步寫入 (寫入執行緒未運作、用戶端程式、stderr)。
+ */
+static void log_sync(int level, const char *fmt, va_list args) {
     if (!log_fp) log_fp = stderr;
 
+    if (g_format == LOG_FORMAT_BINARY && log_fp != stderr) {
+        // 二進位檔案：整筆 LOG_BIN_TEXT 記錄一次 write()，不會與寫入執行緒的批次交錯
+        struct {
+            LogBinRecord hdr;
+            char text[LOG_TEXT_MAX];
+        } __attribute__((packed)) rec;
+        int n = vsnprintf(rec.text, sizeof(rec.text), fmt, args);
+        if (n < 0) n = 0;
+        memset(&rec.hdr, 0, sizeof(rec.hdr));
+        rec.hdr.kind = LOG_BIN_TEXT;
+        rec.hdr.level = (uint8_t)level;
+        rec.hdr.flags = n >= (int)sizeof(rec.text) ? LOG_BIN_TRUNCATED : 0;
+        rec.hdr.len = (uint16_t)(n >= (int)sizeof(rec.text) ? sizeof(rec.text) - 1 : (size_t)n);
+        rec.hdr.timestamp = (uint32_t)time(NULL);
+        if (write(fileno(log_fp), &rec, sizeof(rec.hdr) + rec.hdr.len) < 0) return;
+        return;
+    }
+
     // 1. 獲取時間
     time_t now;
     time(&now);
@@ -49,7 +734,7 @@ static void log_base(const char *level, const char *fmt, va_list args) {
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", local);
 
     // 2. 格式化輸出
-    fprintf(log_fp, "[%s] [%s] ", time_str, level);
+    fprintf(log_fp, "[%s] [%s] ", time_str, level_names[level]);
     vfprintf(log_fp, fmt, args);
     fprintf(log_fp, "\n");
 
@@ -57,35 +742,13 @@ static void log_base(const char *level, const char *fmt, va_list args) {
     fflush(log_fp);
 }
 
-//  日誌輸出介面
-void log_info(const char *fmt, ...) {
+//  日誌輸出介面 (log_info 等巨集展開後呼叫這裡)
+void log_emit(LogSite *site, ...) {
     va_list args;
-    va_start(args, fmt);
-    log_base("INFO", fmt, args);
-    va_end(args);
-}
-
-void log_warn(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    log_base("WARN", fmt, args);
-    va_end(args);
-}
-
-void log_error(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    log_base("ERROR", fmt, args);
+    va_start(args, site);
+    if (!log_enqueue(site, args)) {
+        // log_enqueue 回傳 0 時還沒有讀取任何參數
+        log_sync(site->level, site->fmt, args);
+    }
     va_end(args);
 }
-
-void log_debug(const char *fmt, ...) {
-    #ifdef DEBUG 
-    va_list args;
-    va_start(args, fmt);
-    log_base("DEBUG", fmt, args);
-    va_end(args);
-    #else
-    (void)fmt; 
-    #endif
-}
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -147,6 +148,149 @@ ssize_t recv_n(int fd, void *buf, size_t n) {
     return (n - nleft); // 回傳實際讀到的位元組數
 }
 
+//  分幀 I/O (緩衝讀取 + writev 合併寫出)
+/**
+ * 從一段連續資料的開頭解析一個 Frame Header。
+ * data 資料開頭
+ * avail 可用位元組數
+ * header 輸出 Header (只要資料足夠就會填入)
+ * return 完整 Frame 長度、0 (不完整) 或 -1 (Frame 過大)
+ */
+ssize_t frame_parse(const uint8_t *data, size_t avail, ProtocolHeader *header) {
+    if (avail < sizeof(ProtocolHeader)) return 0;
+
+    memcpy(header, data, sizeof(ProtocolHeader));
+    if (header->length > FRAME_MAX_BODY) return -1; // 防止 Buffer Overflow
+
+    size_t frame_len = sizeof(ProtocolHeader) + header->length;
+    return (avail >= frame_len) ? (ssize_t)frame_len : 0;
+}
+
+/**
+ * 初始化分幀讀取器。
+ * reader 讀取器
+ * fd socket file descriptor
+ */
+void frame_reader_init(FrameReader *reader, int fd) {
+    reader->fd = fd;
+    reader->head = 0;
+    reader->tail = 0;
+}
+
+/**
+ * 取出下一個完整 Frame：緩衝區已有完整 Frame 就直接解析，不足時才 read()。
+ * 每次 read() 都盡量讀滿剩餘空間，對方連續送出的 Frame 通常一次就全部讀進來。
+ * reader 讀取器
+ * header 輸出 Header
+ * body 輸出 Body 指標 (指向內部緩衝區，下次呼叫前有效)
+ * return 1 (成功)、0 (連線關閉) 或 -1 (錯誤 / Frame 過大)
+ */
+int frame_reader_next(FrameReader *reader, ProtocolHeader *header, uint8_t **body) {
+    while (1) {
+        size_t avail = reader->tail - reader->head;
+
+        ssize_t frame_len = frame_parse(reader->buf + reader->head, avail, header);
+        if (frame_len < 0) return -1;
+        if (frame_len > 0) {
+            *body = reader->buf + reader->head + sizeof(ProtocolHeader);
+            reader->head += frame_len;
+            if (reader->head == reader->tail) {
+                reader->head = 0; // 全部消化完，下次從頭開始填
+                reader->tail = 0;
+            }
+            return 1;
+        }
+
+        // 不完整：把殘餘資料搬回開頭，騰出空間再讀
+        if (reader->head > 0) {
+            memmove(reader->buf, reader->buf + reader->head, avail);
+            reader->head = 0;
+            reader->tail = avail;
+        }
+
+        ssize_t nread = read(reader->fd, reader->buf + reader->tail, sizeof(reader->buf) - reader->tail);
+        if (nread < 0) {
+            if (errno == EINTR) continue; // 被訊號中斷，重試
+            return -1;
+        }
+        if (nread == 0) return 0;         // EOF (對方關閉連線)
+        reader->tail += nread;
+    }
+}
+
+/**
+ * 初始化分幀寫入器。
+ * writer 寫入器
+ * fd socket file descriptor
+ */
+void frame_writer_init(FrameWriter *writer, int fd) {
+    writer->fd = fd;
+    writer->count = 0;
+}
+
+/**
+ * 排入一個 Frame，等待 frame_writer_flush 一起送出。
+ * writer 寫入器
+ * header Frame Header (複製一份保存)
+ * body Frame Body (只保存指標，長度為 header->length)
+ * return 0 (成功) 或 -1 (自動 flush 失敗)
+ */
+int frame_writer_add(FrameWriter *writer, const ProtocolHeader *header, const void *body) {
+    if (writer->count == FRAME_WRITER_MAX && frame_writer_flush(writer) < 0) return -1;
+
+    int i = writer->count++;
+    writer->headers[i] = *header;
+    writer->iov[i * 2].iov_base = &writer->headers[i];
+    writer->iov[i * 2].iov_len = sizeof(ProtocolHeader);
+    writer->iov[i * 2 + 1].iov_base = (void *)body;
+    writer->iov[i * 2 + 1].iov_len = header->length;
+    return 0;
+}
+
+/**
+ * 以一次 writev 送出所有排入的 Frame (處理 partial write)。
+ * writer 寫入器
+ * return 0 (成功) 或 -1 (錯誤)
+ */
+int frame_writer_flush(FrameWriter *writer) {
+    struct iovec *iov = writer->iov;
+    int iovcnt = writer->count * 2;
+
+    writer->count = 0;
+    while (iovcnt > 0) {
+        ssize_t nwritten = writev(writer->fd, iov, iovcnt);
+        if (nwritten < 0) {
+            if (errno == EINTR) continue; // 被訊號中斷，重試
+            return -1;
+        }
+        // 跳過已完整送出的片段，調整送到一半的片段
+        while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+            nwritten -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + nwritten;
+            iov->iov_len -= nwritten;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 單一 Frame 直接送出 (Header + Body 一次 writev)。
+ * fd socket file descriptor
+ * header Frame Header
+ * body Frame Body (長度為 header->length，可為 NULL 若長度為 0)
+ * return 0 (成功) 或 -1 (錯誤)
+ */
+int send_frame(int fd, const ProtocolHeader *header, const void *body) {
+    FrameWriter writer;
+    frame_writer_init(&writer, fd);
+    frame_writer_add(&writer, header, body);
+    return frame_writer_flush(&writer);
+}
+
 //  RC4 Stream Cipher 實作 (機密性)
 /**
  * RC4 加密/解密函式。
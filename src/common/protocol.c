@@ -1,4 +1,5 @@
 /* src/common/protocol.c */
+#include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
@@ -27,4 +28,106 @@ uint16_t calculate_checksum(const uint8_t *data, size_t len) {
     }
 
     return (uint16_t)~sum; // 取反
-}
\ No newline at end of file
+}
+
+//  帶金鑰的摘要 (Ticket 完整性)
+/**
+ * 計算帶金鑰的 64-bit 摘要：以 key 作為 FNV-1a 初始值，最後做 splitmix64 混洗。
+ * key 金鑰
+ * data 待計算的數據
+ * len 數據長度
+ * return 64-bit 摘要
+ */
+uint64_t keyed_digest(uint64_t key, const uint8_t *data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ key;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    // splitmix64 finalizer：讓每個 bit 都影響整個輸出
+    h ^= key;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+//  司機定位回報 (UDP Datagram 驗證)
+/**
+ * 由車隊金鑰衍生單一司機的定位金鑰。
+ * 每位司機的金鑰不同，洩漏一位司機的金鑰不能偽造其他司機的位置。
+ * fleet_key 車隊金鑰
+ * driver_id 司機 ID
+ * return 64-bit 司機金鑰
+ */
+uint64_t driver_location_key(uint64_t fleet_key, uint32_t driver_id) {
+    return keyed_digest(fleet_key, (const uint8_t *)&driver_id, sizeof(driver_id));
+}
+
+/**
+ * 計算並填入定位 Datagram 的標籤 (涵蓋 tag 之前的所有欄位)。
+ * dgram 待送出的 Datagram
+ * driver_key 司機金鑰
+ */
+void location_datagram_seal(LocationUpdateDatagram *dgram, uint64_t driver_key) {
+    dgram->tag = keyed_digest(driver_key, (const uint8_t *)dgram, offsetof(LocationUpdateDatagram, tag));
+}
+
+/**
+ * 驗證定位 Datagram 的標籤。
+ * dgram 收到的 Datagram
+ * driver_key 司機金鑰
+ * return 1 = 通過, 0 = 失敗
+ */
+int location_datagram_verify(const LocationUpdateDatagram *dgram, uint64_t driver_key) {
+    return keyed_digest(driver_key, (const uint8_t *)dgram, offsetof(LocationUpdateDatagram, tag)) == dgram->tag;
+}
+
+//  司機長連線 (身分證明)
+/**
+ * 計算司機長連線的身分證明：以司機金鑰對這條連線的 Session Key 做摘要。
+ * driver_key 司機金鑰 (driver_location_key)
+ * session_key 握手後衍生的 Session Key (字串)
+ * return 64-bit 證明
+ */
+uint64_t driver_attach_proof(uint64_t driver_key, const char *session_key) {
+    return keyed_digest(driver_key, (const uint8_t *)session_key, strlen(session_key));
+}
+
+//  叫車結果 (二進位回覆)
+/**
+ * 解碼二進位叫車結果。body 已解密並通過 Checksum。
+ * 較新版本追加在尾端的欄位直接忽略。
+ * body 回覆 Payload
+ * len Payload 長度
+ * out 解碼結果
+ * return 0 = 成功, -1 = 長度不足或版本不符
+ */
+int ride_response_decode(const uint8_t *body, size_t len, RideResponseData *out) {
+    if (len < sizeof(RideResponseData)) return -1;
+    memcpy(out, body, sizeof(RideResponseData));
+    return (out->version >= 1) ? 0 : -1;
+}
+
+/**
+ * 把叫車結果格式化成舊版文字回覆 (內容與改版前的 snprintf 完全相同，舊 Client 的 sscanf 照常運作)。
+ * resp 叫車結果
+ * buf 輸出緩衝區
+ * len 緩衝區長度
+ * return 寫入的字元數 (同 snprintf)
+ */
+int ride_response_format_text(const RideResponseData *resp, char *buf, size_t len) {
+    switch (resp->status) {
+        case RIDE_STATUS_CONFIRMED:
+            return snprintf(buf, len,
+                "Ride Confirmed! Driver ID: %u (Rating: %.1f, Dist: %.4f) [Mode: %s] Fare: $%d%s",
+                resp->driver_id, resp->rating_x10 / 10.0, resp->dist_e7 / LOC_COORD_SCALE,
+                (resp->flags & RIDE_FLAG_SMART) ? "SMART" : "BASIC",
+                resp->fare, (resp->flags & RIDE_FLAG_SURGE) ? " (Surge)" : "");
+        case RIDE_STATUS_BLOCKED:
+            return snprintf(buf, len, "Error: Blocked.");
+        default:
+            return snprintf(buf, len, "Error: No drivers available.");
+    }
+}
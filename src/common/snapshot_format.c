@@ -0,0 +1,173 @@
+/* src/common/snapshot_format.c */
+// Snapshot 檔案格式的共用部分 (Server 寫入 / 載入與 dump_dat 共用)
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "include/snapshot_format.h"
+
+// CRC-32 (反射多項式 0xEDB88320)，每次處理 4 bits：16 格的表不需要初始化，
+// Snapshot 只有幾十 KB，速度足夠
+static const uint32_t crc_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t snapshot_crc32(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ crc_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_nibble_table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+void snapshot_image_capture(const SharedState *state, SnapshotImage *image) {
+    memset(image, 0, sizeof(*image));
+    image->journal_lsn = state->journal_lsn;
+    image->created_at = (int64_t)time(NULL);
+
+    SnapshotCounters *c = &image->counters;
+    int count = state->driver_count;
+    if (count < 0) count = 0;
+    if (count > MAX_DRIVERS) count = MAX_DRIVERS;
+    c->driver_count = (uint32_t)count;
+    c->dispatch_mode = state->dispatch_mode;
+    c->next_ride_id = state->next_ride_id;
+    c->total_connections_accepted = state->total_connections_accepted;
+    c->total_requests_handled = state->total_requests_handled;
+    c->total_success_requests = state->total_success_requests;
+    c->total_revenue = state->total_revenue;
+
+    for (int i = 0; i < count; i++) {
+        const Driver *d = &state->drivers[i];
+        SnapshotDriver *r = &image->drivers[i];
+        r->driver_id = d->driver_id;
+        r->is_available = d->is_available;
+        r->is_refueling = d->is_refueling;
+        r->has_target = d->has_target;
+        r->rides_count = d->rides_count;
+        r->fuel = d->fuel;
+        r->loc_seq = d->loc_seq;
+        r->lat = d->lat;
+        r->lon = d->lon;
+        r->rating = d->rating;
+        r->target_lat = d->target_lat;
+        r->target_lon = d->target_lon;
+    }
+
+    for (int z = 0; z < ZONE_COUNT; z++) {
+        image->zones[z].available_drivers = state->zones[z].available_drivers;
+        image->zones[z].busy_drivers = state->zones[z].busy_drivers;
+        image->zones[z].demand = state->zones[z].demand;
+    }
+
+    SnapshotStatsRecord *s = &image->stats;
+    s->peer_blocked = state->peer_admission.blocked_count;
+    s->rate_limit_blocked = state->rate_limit.blocked_count;
+    s->loc_received = state->location.received;
+    s->loc_applied = state->location.applied;
+    s->loc_stale = state->location.stale;
+    s->loc_rejected = state->location.rejected;
+    s->loc_batches = state->location.batches;
+    s->push_attaches = state->driver_push.attaches;
+    s->push_posted = state->driver_push.posted;
+    s->push_offline = state->driver_push.offline;
+    s->push_delivered = state->driver_push.delivered;
+    s->push_connected = state->driver_push.connected;
+    s->snapshot_interval_secs = state->snapshot.interval_secs;
+    s->tickets_issued = state->tickets.issued_count;
+    s->tickets_resumed = state->tickets.resumed_count;
+    s->tickets_rejected = state->tickets.rejected_count;
+    s->snapshots_taken = state->snapshot.taken;
+    s->snapshots_failed = state->snapshot.failed;
+    s->snapshot_last_stall_ms = state->snapshot.last_stall_ms;
+    s->snapshot_max_stall_ms = state->snapshot.max_stall_ms;
+    s->snapshot_last_write_ms = state->snapshot.last_write_ms;
+}
+
+const char *snapshot_v1_decode(const void *data, uint64_t size, SnapshotImage *image) {
+    if (size != SNAPSHOT_V1_SIZE) return "unknown format (not a snapshot or v1 dump)";
+    const SnapshotV1State *v1 = data;
+    if (v1->driver_count < 0 || v1->driver_count > SNAPSHOT_V1_MAX_DRIVERS || v1->driver_count > MAX_DRIVERS) {
+        return "bad driver count";
+    }
+
+    memset(image, 0, sizeof(*image));
+    SnapshotCounters *c = &image->counters;
+    c->driver_count = (uint32_t)v1->driver_count;
+    c->dispatch_mode = v1->dispatch_mode;
+    c->total_requests_handled = v1->total_requests_handled;
+    c->total_success_requests = v1->total_success_requests;
+    c->total_revenue = v1->total_revenue;
+
+    for (int i = 0; i < v1->driver_count; i++) {
+        const SnapshotV1Driver *d = &v1->drivers[i];
+        SnapshotDriver *r = &image->drivers[i];
+        r->driver_id = d->driver_id;
+        r->is_available = d->is_available;
+        r->is_refueling = d->is_refueling;
+        r->has_target = d->has_target;
+        r->rides_count = d->rides_count;
+        r->fuel = d->fuel;
+        r->lat = d->lat;
+        r->lon = d->lon;
+        r->rating = d->rating;
+        r->target_lat = d->target_lat;
+        r->target_lon = d->target_lon;
+    }
+    return NULL;
+}
+
+void snapshot_driver_restore(const SnapshotDriver *rec, Driver *driver) {
+    memset(driver, 0, sizeof(*driver));
+    driver->driver_id = rec->driver_id;
+    driver->is_available = rec->is_available;
+    driver->is_refueling = rec->is_refueling;
+    driver->has_target = rec->has_target;
+    driver->rides_count = rec->rides_count;
+    driver->fuel = rec->fuel;
+    driver->loc_seq = rec->loc_seq;
+    driver->lat = rec->lat;
+    driver->lon = rec->lon;
+    driver->rating = rec->rating;
+    driver->target_lat = rec->target_lat;
+    driver->target_lon = rec->target_lon;
+}
+
+const char *snapshot_header_check(const SnapshotFileHeader *hdr, const SnapshotSection *sections, uint64_t file_size) {
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0) return "bad magic";
+    if (hdr->version < 2) return "unsupported version";
+    if (hdr->header_size != sizeof(SnapshotFileHeader) || hdr->section_entry_size != sizeof(SnapshotSection)) {
+        return "unknown header layout";
+    }
+    if (hdr->section_count > SNAPSHOT_MAX_SECTIONS) return "too many sections";
+    if (file_size < sizeof(SnapshotFileHeader) + hdr->section_count * sizeof(SnapshotSection)) return "truncated section table";
+
+    uint32_t crc = snapshot_crc32(0, hdr, offsetof(SnapshotFileHeader, header_crc));
+    crc = snapshot_crc32(crc, sections, hdr->section_count * sizeof(SnapshotSection));
+    if (crc != hdr->header_crc) return "header checksum mismatch";
+
+    for (uint32_t i = 0; i < hdr->section_count; i++) {
+        const SnapshotSection *s = &sections[i];
+        if (s->offset % SNAPSHOT_PAGE != 0) return "misaligned section";
+        if (s->record_size == 0 || s->record_count > s->length / s->record_size ||
+            s->length != (uint64_t)s->record_size * s->record_count) {
+            return "bad section length";
+        }
+        if (s->offset > file_size || s->length > file_size - s->offset) return "section past end of file (truncated?)";
+    }
+    return NULL;
+}
+
+const SnapshotSection *snapshot_find_section(const SnapshotFileHeader *hdr, const SnapshotSection *sections,
+                                             uint32_t id, uint32_t min_record_size) {
+    for (uint32_t i = 0; i < hdr->section_count; i++) {
+        if (sections[i].id == id) {
+            return sections[i].record_size >= min_record_size ? &sections[i] : NULL;
+        }
+    }
+    return NULL;
+}
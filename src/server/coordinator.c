@@ -18,9 +18,20 @@
 #include "../../common/include/shared_data.h"
 #include "../../common/include/log_system.h"
 #include "../include/map_monitor.h" 
+#include "../include/pricing_service.h"
+#include "../include/resource_service.h"
+#include "../include/location_service.h"
+#include "../include/driver_channel.h"
+#include "../include/journal.h"
+#include "../include/snapshot.h"
+#include "../include/request_trace.h"
+#include "../include/metrics.h"
+#include "../include/lock_profile.h"
+#include "../include/span_trace.h"
+#include "../include/worker_pool.h"
+#include "../include/coordinator.h"
 
-#define DATA_FILE "server.dat"
-#define WORKER_COUNT 100 
+#define WORKER_COUNT 100 // 漏洞版的固定 Worker 數 (安全版見 worker_pool.h)
 #define BASE_LAT 25.0330
 #define BASE_LON 121.5654
 
@@ -36,38 +47,27 @@ extern void dispatcher_loop(int server_fd);
 extern void dispatcher_loop_insecure(int server_fd);
 
 // 前向宣告
-void save_state();
-int load_state();
 void ipc_cleanup();
 void handle_sigint(int sig);
 
 // A. 資料持久化
+// 直接寫共享記憶體 (只在啟動 / 關機時呼叫，沒有其他寫入者；執行中的 Snapshot 見 snapshot.c)
+// 新 Snapshot 就位之後，它已包含的 WAL 記錄才能清掉
 void save_state() {
-    int fd = open(DATA_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
-        log_error("Failed to save state to %s: %s", DATA_FILE, strerror(errno));
-        return;
-    }
-    if (write(fd, g_shared_state, sizeof(SharedState)) != sizeof(SharedState)) {
-        log_error("Error writing state to file: %s", strerror(errno));
-    } else {
-        log_info("✅ System state saved to %s", DATA_FILE);
-    }
-    close(fd);
+    static SnapshotImage image;
+    uint64_t lsn = journal_last_lsn();
+    if (lsn > 0) g_shared_state->journal_lsn = lsn; // WAL 停用時保留載入時的值
+
+    snapshot_image_capture(g_shared_state, &image);
+    if (snapshot_write(&image) < 0) return;
+    journal_truncate(g_shared_state->journal_lsn);
+    log_info("✅ System state saved to %s (journal LSN %lu)", SNAPSHOT_FILE, g_shared_state->journal_lsn);
 }
 
+// 只還原持久化的欄位 (計數器與司機表)，其餘區塊由呼叫端重新初始化
 int load_state() {
-    int fd = open(DATA_FILE, O_RDONLY);
-    if (fd == -1) return 0;
-    log_info("🔄 Found save file. Loading state...");
-    if (read(fd, g_shared_state, sizeof(SharedState)) != sizeof(SharedState)) {
-        log_warn("Save file corrupted. Re-initializing.");
-        close(fd);
-        return 0;
-    }
-    close(fd);
-    log_info("✅ State loaded!");
-    return 1;
+    log_info("🔄 Loading state from %s...", SNAPSHOT_FILE);
+    return snapshot_load(g_shared_state) > 0;
 }
 
 // B. IPC 初始化
@@ -102,11 +102,18 @@ void ipc_init(int driver_count) {
         for (int i = 0; i < g_shared_state->driver_count; i++) {
             g_shared_state->drivers[i].is_available = 1; 
         }
+        memset(&g_shared_state->driver_push, 0, sizeof(DriverPushTable)); // 長連線不會跨越重啟
     }
 
+    // 區域計數器依照目前司機狀態重建 (存檔中的計數可能已經過期)
+    pricing_rebuild_zones(g_shared_state);
+    rate_limit_table_init(&g_shared_state->rate_limit, RATE_LIMIT_PER_SEC, RATE_LIMIT_BURST);
+    rate_limit_table_init(&g_shared_state->peer_admission, 0, 0); // 漏洞版不做准入控制
+
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED); 
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST); // Worker 持鎖時崩潰，其他進程仍可接手
     pthread_mutex_init(&g_shared_state->mutex, &attr);
     pthread_mutexattr_destroy(&attr);
     log_info("IPC initialized.");
@@ -121,39 +128,88 @@ void ipc_cleanup() {
 }
 
 // C. Coordinator 流程
+// Signal handler 只能清旗標：關機流程 (join 執行緒、寫檔、log) 都不是 async-signal-safe，
+// 由主迴圈結束後的 stop_workers 與呼叫端的清理流程完成
 void handle_sigint(int sig) {
     (void)sig;
-    printf("\n");
-    g_running = 0; 
+    g_running = 0;
+}
+
+// 不設 SA_RESTART：主迴圈的 nanosleep / wait 被打斷後立即檢查 g_running
+static void install_sigint_handler(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+}
+
+// 通知所有 Worker 結束並收屍 (關機流程的第一步，之後 WAL / 擷取記錄才不會再有寫入者)
+static void stop_workers(void) {
     log_info("Received SIGINT. Shutting down...");
     for (int i = 0; i < WORKER_COUNT; i++) {
         if (workers[i] > 0) kill(workers[i], SIGTERM);
     }
-    while (wait(NULL) > 0);
-    if (g_shared_state != NULL) save_state();
-    ipc_cleanup();
-    exit(0);
+    worker_pool_kill_all(SIGTERM);
+    while (wait(NULL) > 0 || errno == EINTR);
+}
+
+/**
+ * fork 一個 Worker 到第 slot 格 (啟動時、擴充與重生都走這裡，之後可能已經有背景執行緒)。
+ * 退休的 Worker 從 dispatcher_loop 返回後以 _exit 結束：不能 flush 從 Coordinator 繼承來的 stdio 緩衝區。
+ */
+static pid_t spawn_worker(int slot) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child Process (Worker/Dispatcher)
+        signal(SIGINT, SIG_DFL); 
+        log_attach(slot + 1); // 緩衝區 0 留給 Coordinator
+        driver_channel_worker_init(slot);
+        trace_attach(slot);
+        metrics_attach(slot);
+        span_attach(slot);
+        lock_profile_attach(slot + 1);  // 第 0 格留給 Coordinator
+        signal(SIGUSR1, SIG_IGN);       // 競爭分析的開關只由 Coordinator 處理
+        worker_pool_attach(slot);
+        dispatcher_loop(g_server_fd);
+        _exit(0);
+    }
+    return pid;
 }
 
 void start_coordinator_process(int server_fd) {
     g_server_fd = server_fd;
-    signal(SIGINT, handle_sigint);
+    install_sigint_handler();
 
-    for (int i = 0; i < WORKER_COUNT; i++) {
-        pid_t pid = fork();
-        if (pid < 0) {
-            log_error("Fork failed"); exit(EXIT_FAILURE);
-        } else if (pid == 0) {
-            // Child Process (Worker/Dispatcher)
-            signal(SIGINT, SIG_DFL); 
-            dispatcher_loop(server_fd); 
-            exit(0);
-        } else {
-            // Parent Process (Master/Coordinator) 記錄 PID
-            workers[i] = pid;
-        }
+    // 派單推播的 eventfd 必須在 fork 之前建立 (之後擴充的 Worker 也用同一組)，任何 Worker 才能喚醒其他 Worker
+    if (driver_channel_init(POOL_MAX_WORKERS) < 0) {
+        log_warn("Driver push channel disabled.");
     }
-    log_info("%d Dispatcher processes started.", WORKER_COUNT);
+
+    // WAL flusher 必須在 fork 之前啟動：flusher 未運作時 journal_append 不等待空的 slot，
+    // Worker 一開始的記錄會蓋掉還沒寫入的 slot (環狀緩衝區在共享記憶體，Worker 看得到 running)
+    journal_start();
+
+    int started = worker_pool_start(server_fd, spawn_worker);
+    if (started == 0) {
+        log_error("Fork failed"); exit(EXIT_FAILURE);
+    }
+    // SIGUSR1 開關 state->mutex 競爭分析：只交給主執行緒 (背景執行緒建立前先擋住，它們繼承這個遮罩)，
+    // 不設 SA_RESTART 讓下面的 wait 返回，在主迴圈切換而不是在 Signal handler 裡
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = lock_profile_request_toggle;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    // Log 寫入執行緒 (之前的 log 都是同步寫入)
+    if (log_async_start() < 0) log_warn("Log writer thread failed to start; logging synchronously.");
+    log_info("%d Dispatcher processes started (pool %u ~ %u, idle reclaim after %u s).", started,
+             g_shared_state->pool.min_workers, g_shared_state->pool.max_workers, g_shared_state->pool.idle_secs);
 
     pthread_t map_tid;
     if (pthread_create(&map_tid, NULL, map_monitor_thread, NULL) == 0) {
@@ -161,15 +217,35 @@ void start_coordinator_process(int server_fd) {
         log_info("Map Monitor thread started.");
     }
 
+    // UDP 司機定位回報 (與 TCP 同一個 Coordinator，司機表寫入共用同一把鎖)
+    location_service_start();
+
+    // 背景 Snapshot
+    snapshot_start();
+    trace_start();
+    span_trace_start();
+    metrics_start();
+    pthread_sigmask(SIG_UNBLOCK, &usr1, NULL);
+
+    // 主迴圈：收屍、處理 SIGUSR1、每個 tick 調整進程池 (SIGUSR1 會打斷 nanosleep，開關不必等滿一個 tick)
+    struct timespec tick = { 0, POOL_TICK_MS * 1000000L };
     while (g_running) {
         int status;
-        if (wait(&status) <= 0 && (errno == ECHILD || !g_running)) break;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) worker_pool_exited(pid, status);
+        lock_profile_poll();
+        rate_limit_maintain();
+        worker_pool_tick();
+        nanosleep(&tick, NULL);
     }
+
+    stop_workers();
+    lock_profile_set(0); // 仍在記錄時把報表寫入 log (其餘清理由 server_main 的 cleanup_resources 完成)
 }
 
 void start_coordinator_process_insecure(int server_fd) {
     g_server_fd = server_fd;
-    signal(SIGINT, handle_sigint);
+    install_sigint_handler();
 
     for (int i = 0; i < WORKER_COUNT; i++) {
         pid_t pid = fork();
@@ -194,20 +270,32 @@ void start_coordinator_process_insecure(int server_fd) {
         int status;
         if (wait(&status) <= 0 && (errno == ECHILD || !g_running)) break;
     }
+    stop_workers();
+}
+
+int register_driver_locked(uint32_t driver_id) {
+    if (g_shared_state->driver_count >= MAX_DRIVERS) return -1;
+    int idx = g_shared_state->driver_count++;
+    g_shared_state->drivers[idx].driver_id = driver_id;
+    g_shared_state->drivers[idx].is_available = 1; 
+    g_shared_state->drivers[idx].fuel = 10;
+    pricing_sync_driver(g_shared_state, idx);
+
+    JournalRecord jrec = { .type = JOURNAL_DRIVER_JOIN, .driver_id = driver_id };
+    journal_append(&jrec);
+    return idx;
+}
+
+void register_driver(uint32_t driver_id) {
+    uint64_t lock_token = state_lock(LOCK_SITE_DRIVER_JOIN);
+    register_driver_locked(driver_id);
+    state_unlock(LOCK_SITE_DRIVER_JOIN, lock_token);
+    journal_commit(journal_last_lsn());
 }
 
 void process_driver_join(int client_fd, ProtocolHeader *in_header, uint8_t *body) {
     (void)in_header;
-    uint32_t driver_id = *((uint32_t*)body);
-
-    pthread_mutex_lock(&g_shared_state->mutex);
-    if (g_shared_state->driver_count < MAX_DRIVERS) {
-        int idx = g_shared_state->driver_count++;
-        g_shared_state->drivers[idx].driver_id = driver_id;
-        g_shared_state->drivers[idx].is_available = 1; 
-        g_shared_state->drivers[idx].fuel = 10;
-    }
-    pthread_mutex_unlock(&g_shared_state->mutex);
+    register_driver(((DriverJoinData *)body)->driver_id); // Body 不保證對齊，透過 packed 結構讀取
 
     // 2：初始化結構
     ProtocolHeader resp_header = {
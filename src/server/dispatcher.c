@@ -12,33 +12,84 @@
 #include <errno.h>
 #include <time.h>       
 #include <pthread.h>    
+#include <poll.h>
+#include <sys/epoll.h>
 
 // 引入共用模組
 #include "../../common/include/protocol.h" 
 #include "../../common/include/shared_data.h"
 #include "../../common/include/log_system.h"
 #include "../../common/include/net_wrapper.h"
+#include "../../common/include/dh_crypto.h"
 // 引入業務服務層
 #include "../include/ride_service.h" 
 #include "../include/resource_service.h" 
+#include "../include/session_ticket.h"
+#include "../include/coordinator.h"
+#include "../include/dispatcher.h"
+#include "../include/uring_dispatcher.h"
+#include "../include/driver_channel.h"
+#include "../include/location_service.h"
+#include "../include/request_trace.h"
+#include "../include/metrics.h"
+#include "../include/span_trace.h"
+#include "../include/worker_pool.h"
 
 extern SharedState *g_shared_state;
 
-// 引入 DH 數學函式 (來自 src/common/dh_crypto.c)
-extern long long generate_private_key();
-extern long long calculate_public_key(long long private_key);
-extern long long calculate_shared_secret(long long other_public, long long my_private);
-extern void derive_session_key(long long secret, char *buf, size_t len);
+// 啟動時選定的 I/O 後端 (fork 之前設定，所有 Worker 繼承)
+static int g_io_backend = IO_BACKEND_CLASSIC;
 
-extern void process_driver_join(int client_fd, ProtocolHeader *header, uint8_t *body);
+// 每個 Dispatcher 進程私有的 DH 密鑰對池 (fork 之後才填，各進程的密鑰互不相同)
+static DhKeyPool g_keypool;
+
+// 閒置時每輪補充的密鑰對數量 (補完一輪就回頭檢查有沒有新連線)
+#define KEYPOOL_REFILL_BATCH 8
+
+// 傳統迴圈的司機長連線交給每個 Worker 的推播執行緒 (第一位司機連上時才建立)
+// 主執行緒維持原本的阻塞式 accept，一般請求的路徑不多任何系統呼叫
+#define PUSH_MAX_EVENTS 64
+#define EV_NOTIFY 0ULL              // epoll data：派單 eventfd (司機長連線的 data.ptr 是連線指標)
+#define DRIVER_SEND_TIMEOUT_SEC 1   // 推播寫不出去 (司機端不讀) 時不能卡住推播執行緒
+
+// 傳統迴圈持有的司機長連線 (只有推播執行緒存取)
+typedef struct ClassicDriverConn {
+    int fd;
+    ClientSession session;
+    ReplyBuffer out;                // 交接時 = 待送出的確認
+    struct ClassicDriverConn *next; // 交接佇列
+} ClassicDriverConn;
+
+static int g_push_epoll_fd = -1;
+static pthread_mutex_t g_handoff_lock = PTHREAD_MUTEX_INITIALIZER;
+static ClassicDriverConn *g_handoff_head = NULL; // 主執行緒驗證完、等推播執行緒接手的長連線
+
+// 傳統迴圈最近一次 accept 返回的時間 (抽樣連線的 accept span 起點；0 = 不是從 dispatcher_loop 呼叫)
+static uint64_t g_accepted_ns = 0;
 
 // 前向宣告
-void handle_client(int client_fd);
+int handle_client(int client_fd);
+
+/**
+ * 將一個 Frame 複製進回覆緩衝區 (由 I/O 後端負責實際送出)。
+ * return 0 = 成功, -1 = 緩衝區不足 (丟棄此 Frame)
+ */
+static int reply_append(ReplyBuffer *out, const ProtocolHeader *header, const void *body) {
+    size_t frame_len = sizeof(ProtocolHeader) + header->length;
+    if (out->len + frame_len > sizeof(out->data)) return -1;
+
+    memcpy(out->data + out->len, header, sizeof(ProtocolHeader));
+    if (header->length > 0) {
+        memcpy(out->data + out->len + sizeof(ProtocolHeader), body, header->length);
+    }
+    out->len += frame_len;
+    return 0;
+}
 
 /**
- * 封裝回覆邏輯：使用動態 Session Key 加密、計算 Checksum 並發送。
+ * 封裝回覆邏輯：使用動態 Session Key 加密、計算 Checksum 並排入回覆緩衝區。
  */
-void send_response_packet(int client_fd, char *resp_msg, size_t len, uint16_t opcode, const char *session_key) {
+static void queue_response_packet(ReplyBuffer *out, char *resp_msg, size_t len, uint16_t opcode, const char *session_key) {
     ProtocolHeader resp_header;
     resp_header.type = MSG_TYPE_RIDE_RESP; // 設定類型
     resp_header.opcode = opcode;
@@ -50,15 +101,202 @@ void send_response_packet(int client_fd, char *resp_msg, size_t len, uint16_t op
         rc4_crypt((uint8_t*)resp_msg, len, session_key);
     }
 
-    send_n(client_fd, &resp_header, sizeof(ProtocolHeader));
-    send_n(client_fd, resp_msg, len);
+    reply_append(out, &resp_header, resp_msg); // Header + Body 連續存放，送出時只需一次系統呼叫
+}
+
+/**
+ * 設定 I/O 後端 (在 fork Worker 之前呼叫)。
+ */
+void dispatcher_set_io_backend(int backend) {
+    g_io_backend = backend;
+}
+
+/**
+ * Worker 進程初始化：重設亂數種子並建立密鑰池。
+ */
+void dispatcher_worker_init(void) {
+    // 所有 Worker 都從同一個 Coordinator fork 出來，必須各自重設亂數種子，
+    // 否則每個進程會產生一模一樣的 DH 私鑰序列
+    srand(time(NULL) ^ getpid());
+    dh_keypool_init(&g_keypool);
+}
+
+/**
+ * 閒置工作：補充一批 DH 密鑰對。
+ * return 1 = 有補充 (呼叫端應回頭檢查 I/O), 0 = 密鑰池已滿
+ */
+int dispatcher_refill_keypool(void) {
+    if (dh_keypool_full(&g_keypool)) return 0;
+    dh_keypool_refill(&g_keypool, KEYPOOL_REFILL_BATCH);
+    return 1;
+}
+
+/**
+ * 關閉司機長連線並解除登記 (推播執行緒)。
+ */
+static void classic_drop_driver(ClassicDriverConn *conn) {
+    epoll_ctl(g_push_epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    driver_channel_detach(&conn->session.driver);
+    free(conn);
+}
+
+/**
+ * 接手主執行緒交過來的長連線：登記、送出確認 (以及斷線期間未送出的派單)。
+ */
+static void classic_adopt_drivers(void) {
+    pthread_mutex_lock(&g_handoff_lock);
+    ClassicDriverConn *list = g_handoff_head;
+    g_handoff_head = NULL;
+    pthread_mutex_unlock(&g_handoff_lock);
+
+    while (list != NULL) {
+        ClassicDriverConn *conn = list;
+        list = conn->next;
+
+        void *replaced;
+        if (driver_channel_attach(&conn->session.driver, conn->session.attach_driver_id, conn, &replaced) < 0) {
+            close(conn->fd);
+            free(conn);
+            continue;
+        }
+        if (replaced != NULL) classic_drop_driver(replaced); // 同一位司機的舊連線 (斷線重連)
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        dispatch_driver_push(&conn->session, &conn->out);
+        if (send_n(conn->fd, conn->out.data, conn->out.len) < 0 ||
+            epoll_ctl(g_push_epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+            close(conn->fd);
+            driver_channel_detach(&conn->session.driver);
+            free(conn);
+        }
+    }
+}
+
+/**
+ * eventfd 喚醒：推播所有本地司機的新派單。
+ */
+static void classic_push_assignments(void) {
+    void *conns[MAX_DRIVERS];
+    int n = driver_channel_drain(conns);
+
+    for (int i = 0; i < n; i++) {
+        ClassicDriverConn *conn = conns[i];
+        conn->out.len = 0;
+        if (dispatch_driver_push(&conn->session, &conn->out) < 0 ||
+            (conn->out.len > 0 && send_n(conn->fd, conn->out.data, conn->out.len) < 0)) {
+            classic_drop_driver(conn);
+        }
+    }
+}
+
+/**
+ * 司機長連線可讀：目前司機不會在長連線上送資料，讀到 EOF 或錯誤就關閉。
+ */
+static void classic_driver_readable(ClassicDriverConn *conn) {
+    uint8_t scratch[256];
+    ssize_t n = read(conn->fd, scratch, sizeof(scratch));
+    if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+        classic_drop_driver(conn);
+    }
+}
+
+static void *classic_push_thread(void *arg) {
+    (void)arg;
+    struct epoll_event events[PUSH_MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(g_push_epoll_fd, events, PUSH_MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u64 == EV_NOTIFY) {
+                // 先清 eventfd 並推播既有連線，再接手新連線 (接手時會順便送出信箱中的派單，不會漏)
+                classic_push_assignments();
+                classic_adopt_drivers();
+            } else {
+                classic_driver_readable(events[i].data.ptr);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 第一位司機連上時建立推播執行緒。
+ * return 0 = 已在執行, -1 = 無法建立 (此 Worker 不接受司機長連線)
+ */
+static int classic_push_thread_start(void) {
+    if (g_push_epoll_fd >= 0) return 0;
+
+    int notify_fd = driver_channel_eventfd();
+    if (notify_fd < 0) return -1;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) return -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = EV_NOTIFY };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, notify_fd, &ev);
+    g_push_epoll_fd = epfd;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, classic_push_thread, NULL) != 0) {
+        close(epfd);
+        g_push_epoll_fd = -1;
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+/**
+ * 連線通過司機驗證：交給推播執行緒 (登記與送出確認都在推播執行緒做)。
+ * return 1 = 連線已轉交 (呼叫端不可關閉), 0 = 無法轉交 (呼叫端關閉)
+ */
+static int classic_hold_driver(int client_fd, ClientSession *session, ReplyBuffer *out) {
+    if (classic_push_thread_start() < 0) return 0;
+
+    ClassicDriverConn *conn = malloc(sizeof(ClassicDriverConn));
+    if (conn == NULL) return 0;
+    conn->fd = client_fd;
+    conn->session = *session;
+    conn->out = *out;
+
+    struct timeval tv = { DRIVER_SEND_TIMEOUT_SEC, 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    pthread_mutex_lock(&g_handoff_lock);
+    conn->next = g_handoff_head;
+    g_handoff_head = conn;
+    pthread_mutex_unlock(&g_handoff_lock);
+
+    uint64_t one = 1;
+    if (write(driver_channel_eventfd(), &one, sizeof(one)) < 0) {
+        log_warn("[Dispatcher %d] Driver handoff wakeup failed: %s", getpid(), strerror(errno));
+    }
+    return 1;
 }
 
 /**
  * Dispatcher 進程的主迴圈：持續接受連線。
+ * 選用 io_uring 後端時交給 uring_dispatcher_loop，建立 Ring 失敗則退回傳統阻塞式迴圈。
  */
 void dispatcher_loop(int server_fd) {
-    while (1) {
+    dispatcher_worker_init();
+
+    if (g_io_backend == IO_BACKEND_URING) {
+        if (uring_dispatcher_loop(server_fd) == 0) return; // 退休
+        log_warn("[Dispatcher %d] io_uring loop unavailable, falling back to blocking I/O.", getpid());
+    }
+
+    // 退休的訊號會讓阻塞中的 accept 返回 EINTR，回到這裡檢查旗標
+    while (!worker_pool_retiring()) {
+        // 閒置時補充密鑰池：沒有等待中的連線才計算，一有連線就先去 accept
+        if (!dh_keypool_full(&g_keypool)) {
+            struct pollfd pfd = { .fd = server_fd, .events = POLLIN };
+            if (poll(&pfd, 1, 0) == 0) {
+                dispatcher_refill_keypool();
+                continue;
+            }
+        }
+
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         
@@ -67,8 +305,17 @@ void dispatcher_loop(int server_fd) {
             if (errno == EINTR) continue; // 忽略被訊號中斷
             continue;
         }
-        handle_client(client_fd); // 處理單一連線
-        close(client_fd);         // 處理完畢後關閉 (短連線模型)
+        g_accepted_ns = metrics_now();
+        // 准入控制：同一來源 IP 連線過量時，在任何加密運算之前直接關閉
+        if (check_peer_admission(&client_addr)) {
+            close(client_fd);
+            continue;
+        }
+        worker_pool_set_active(1);
+        if (!handle_client(client_fd)) { // 處理單一連線
+            close(client_fd);            // 處理完畢後關閉 (短連線模型)；司機長連線已交給推播執行緒
+        }
+        worker_pool_set_active(0);
     }
 }
 
@@ -76,131 +323,304 @@ void dispatcher_loop(int server_fd) {
  * 請求處理Wrapper：處理叫車業務請求
  * 增加 session_key 參數，以便加密回覆
  */
-void process_ride_request_wrapper(int client_fd, ProtocolHeader *in_header, uint8_t *body, const char *session_key) {
-    (void)in_header;
+void process_ride_request_wrapper(ReplyBuffer *out, ProtocolHeader *in_header, uint8_t *body, const char *session_key) {
     RideRequestData *req = (RideRequestData *)body; 
-    char resp_msg[256]; 
+    RideResponseData resp;
+    uint64_t trace_t0 = trace_begin(); // --trace 時記錄到達時間與處理時間
+    uint64_t t0 = metrics_now();
+    uint64_t t = t0;
+    // OP_REQ_RIDE_BIN 的 Client 直接收結構，省掉兩端的 snprintf / sscanf；舊 Client 仍收文字
+    int binary = (in_header->opcode == OP_REQ_RIDE_BIN);
     
     // 1. 安全檢查 (Rate Limit)
-    if (check_and_update_rate_limit(req->client_id)) { 
-        char *err_msg = "Error: Blocked.";
-        printf("\033[1;31m[SECURITY] Blocked DoS attack from Client %d!\033[0m\n", req->client_id);
-        send_response_packet(client_fd, err_msg, strlen(err_msg), OP_RESPONSE, session_key);
-        return; 
+    int blocked = check_and_update_rate_limit(req->client_id);
+    t = metrics_stage(STAGE_RATE_LIMIT, t);
+    metrics_count(METRIC_REQUESTS);
+    if (blocked) { 
+        metrics_count(METRIC_BLOCKED);
+        printf("\033[1;31m[SECURITY] Blocked DoS attack from Client %u!\033[0m\n", req->client_id);
+        memset(&resp, 0, sizeof(resp));
+        resp.version = RIDE_RESP_VERSION;
+        resp.status = RIDE_STATUS_BLOCKED;
+    } else {
+        // 2. 商業處理 (單一呼叫 Service Layer)
+        handle_ride_request_logic(req->client_id, req->lat, req->lon, &resp);
+        metrics_count(resp.status == RIDE_STATUS_CONFIRMED ? METRIC_CONFIRMED : METRIC_NO_DRIVER);
+        t = metrics_now();
     }
+    trace_request(trace_t0, req, in_header->opcode, resp.status);
 
-    // 2. 商業處理 (單一呼叫 Service Layer)
-    // 注意：handle_ride_request_logic 現在需要處理 VIP 邏輯 (req->type)
-    // 為了相容，我們先假設 logic 函式只看 ID，或者可以修改 logic 函式傳入 req->type
-    // 這裡演示直接呼叫:
-    int result = handle_ride_request_logic(req->client_id, resp_msg, sizeof(resp_msg));
-    (void)result; 
-
-    // 3. 網路回覆 (使用 Session Key 加密)
-    send_response_packet(client_fd, resp_msg, strlen(resp_msg), OP_RESPONSE, session_key);
+    // 3. 網路回覆 (使用 Session Key 加密；回覆會被就地加密，所以都放在區域緩衝區)
+    if (binary) {
+        queue_response_packet(out, (char *)&resp, sizeof(resp), OP_RESPONSE_BIN, session_key);
+    } else {
+        char resp_msg[256];
+        ride_response_format_text(&resp, resp_msg, sizeof(resp_msg));
+        queue_response_packet(out, resp_msg, strlen(resp_msg), OP_RESPONSE, session_key);
+    }
+    metrics_stage(STAGE_RESPONSE, t);
+    metrics_stage(STAGE_REQUEST, t0);
 }
 
 /**
- * 處理單一客戶端連線，負責 DH 握手、I/O 和安全過濾。
+ * 處理單一客戶端連線 (阻塞式 I/O)：逐一讀出 Frame 交給 dispatch_frame，回覆一次送出。
+ * return 1 = 連線已轉為司機長連線 (呼叫端不可關閉), 0 = 處理完畢
  */
-void handle_client(int client_fd) {
+int handle_client(int client_fd) {
     ProtocolHeader header;
-    uint8_t body[1024];
-    char session_key[64] = {0}; // 存放這個連線專屬的 Key
-    int is_key_established = 0; // 標記握手是否完成
+    uint8_t *body;
+    FrameReader reader;         // 連線專屬的讀取緩衝區：連續到達的 Frame 一次 read() 讀完
+    ClientSession session;
+    ReplyBuffer out;
+    int held = 0;
+
+    frame_reader_init(&reader, client_fd);
+    client_session_init(&session); // 決定這條連線是否被抽樣 (trace ID)
+
+    // 被抽中的連線：之後每個 metrics_stage 都會記成 span
+    uint64_t accepted_ns = 0;
+    span_set_current(session.trace_id);
+    if (session.trace_id != 0) {
+        uint64_t now = metrics_now();
+        accepted_ns = g_accepted_ns != 0 ? g_accepted_ns : now;
+        span_record(session.trace_id, SPAN_ACCEPT, accepted_ns, now);
+    }
 
     // 迴圈接收：因為可能會先收到握手包，再收到資料包
     while (1) {
-        ssize_t bytes_read = recv_n(client_fd, &header, sizeof(ProtocolHeader));
-        if (bytes_read <= 0) break; // 連線斷開
-
-        if (header.length > 1024) break; // 防止 Buffer Overflow
-
-        // 讀取 Body
-        if (header.length > 0) {
-            bytes_read = recv_n(client_fd, body, header.length);
-            if (bytes_read != header.length) break;
-        }
-
-        // 處理握手請求 (MSG_TYPE_HANDSHAKE)
-        if (header.type == MSG_TYPE_HANDSHAKE) {
-            HandshakeData *client_dh = (HandshakeData *)body;
-            
-            // 1. Server 生成密鑰對
-            long long srv_priv = generate_private_key();
-            long long srv_pub  = calculate_public_key(srv_priv);
-            
-            // 2. 計算 Shared Secret (利用 Client 公鑰 + Server 私鑰)
-            long long shared = calculate_shared_secret((long long)client_dh->public_key, srv_priv);
-            
-            // 3. 衍生 Session Key
-            derive_session_key(shared, session_key, 64);
-            is_key_established = 1;
-            
-            log_info("[Security] DH Handshake Success. Session Key Established.");
-
-            // 4. 回覆 Server 公鑰給 Client
-            ProtocolHeader resp_h;
-            HandshakeData resp_body;
-            
-            resp_body.public_key = (int64_t)srv_pub;
-
-            resp_h.type = MSG_TYPE_HANDSHAKE_ACK;
-            resp_h.opcode = OP_HANDSHAKE;
-            resp_h.length = sizeof(HandshakeData);
-            resp_h.checksum = 0; // 握手不校驗
-
-            send_n(client_fd, &resp_h, sizeof(ProtocolHeader));
-            send_n(client_fd, &resp_body, sizeof(HandshakeData));
-            
-            continue; // 握手完成，繼續等待下一個封包 (業務請求)
+        // 連線斷開或 Body 過大 (防止 Buffer Overflow) 都直接結束
+        if (frame_reader_next(&reader, &header, &body) <= 0) break;
+
+        out.len = 0;
+        int keep_open = dispatch_frame(&session, &header, body, &out);
+        if (keep_open == DISPATCH_HOLD_DRIVER) {
+            held = classic_hold_driver(client_fd, &session, &out);
+            break;
         }
+        if (out.len > 0) {
+            uint64_t send_t0 = metrics_now();
+            send_n(client_fd, out.data, out.len);
+            metrics_stage(STAGE_SEND, send_t0);
+        }
+        if (!keep_open) break;
+    }
+
+    if (session.trace_id != 0) span_record(session.trace_id, SPAN_CONNECTION, accepted_ns, metrics_now());
+    span_set_current(0);
+    return held;
+}
+
+void client_session_init(ClientSession *session) {
+    memset(session->session_key, 0, sizeof(session->session_key));
+    session->is_key_established = 0;
+    session->resume_rejected = 0;
+    session->attach_driver_id = 0;
+    driver_link_init(&session->driver);
+    session->trace_id = span_sample();
+    metrics_count(METRIC_CONNECTIONS);
+}
+
+/**
+ * 處理單一 Frame，負責 DH 握手、Ticket 恢復、解密與安全過濾，回覆排入 out。
+ * 不碰 socket，阻塞式與 io_uring 兩種 I/O 後端共用。
+ * return 1 = 繼續等待下一個 Frame, 0 = 送出回覆後關閉連線
+ */
+int dispatch_frame(ClientSession *session, ProtocolHeader *in_header, uint8_t *body, ReplyBuffer *out) {
+    ProtocolHeader header = *in_header;
+    char *session_key = session->session_key; // 存放這個連線專屬的 Key
+
+    // 處理握手請求 (MSG_TYPE_HANDSHAKE)
+    if (header.type == MSG_TYPE_HANDSHAKE) {
+        HandshakeData *client_dh = (HandshakeData *)body;
+        uint64_t t0 = metrics_now();
         
-        // 處理叫車請求 (MSG_TYPE_RIDE_REQ) ---
-        if (header.type == MSG_TYPE_RIDE_REQ) {
-            
-            // 安全強制：如果沒握手就傳資料，直接踢掉
-            if (!is_key_established) {
-                printf("\033[1;31m[SECURITY] Rejected: Request without Handshake!\033[0m\n");
-                break;
-            }
+        // 1. 從密鑰池取出預先算好的 Server 密鑰對 (池空了才同步計算)
+        DhKeyPair kp = dh_keypool_take(&g_keypool);
+        long long srv_priv = kp.private_key;
+        long long srv_pub  = kp.public_key;
+        
+        // 2. 計算 Shared Secret (利用 Client 公鑰 + Server 私鑰)
+        long long shared = calculate_shared_secret((long long)client_dh->public_key, srv_priv);
+        
+        // 3. 衍生 Session Key
+        derive_session_key(shared, session_key, 64);
+        session->is_key_established = 1;
+        
+        log_info("[Security] DH Handshake Success. Session Key Established.");
 
-            // 展示解密前的 亂碼 (Ciphertext)
-        //printf("\033[1;33m[SECURITY] [Proof] Encrypted Data (Ciphertext): ");
-            // 只印前 16 個 Byte 示意即可，避免洗版
-            //for (int i = 0; i < (int)header.length && i < 16; i++) {
-                //printf("%02X ", body[i]);
-            //}
-            //printf("... (RC4 Encrypted)\033[0m\n");
-
-            // 網路層職責：使用 Session Key 解密 (機密性)
-            rc4_crypt(body, header.length, session_key);
-
-            // 將 binary 轉型回結構，證明解密成功
-            //RideRequestData *req_debug = (RideRequestData *)body;
-            //printf("\033[1;36m[SECURITY] [Proof] Decrypted Data (Plaintext) : ClientID=%d, Type=%d\033[0m\n", 
-                   //req_debug->client_id, req_debug->type);
-            
-            // 網路層職責：Checksum 驗證 (完整性)
-            uint16_t checksum = calculate_checksum(body, header.length);
-            if (checksum != header.checksum) {
-                printf("\033[1;31m[SECURITY] Checksum mismatch! Session Key might be wrong.\033[0m\n");
-                return; 
-            }
+        // 4. 回覆 Server 公鑰給 Client
+        ProtocolHeader resp_h;
+        HandshakeData resp_body;
+        
+        resp_body.public_key = (int64_t)srv_pub;
+
+        resp_h.type = MSG_TYPE_HANDSHAKE_ACK;
+        resp_h.opcode = OP_HANDSHAKE;
+        resp_h.length = sizeof(HandshakeData);
+        resp_h.checksum = 0; // 握手不校驗
+
+        reply_append(out, &resp_h, &resp_body);
 
-            // 分發商業邏輯
-            if (header.opcode == OP_REQ_RIDE) {
-                process_ride_request_wrapper(client_fd, &header, body, session_key);
-                break; // 處理完一個請求後結束 
+        // 5. Client 要求可恢復的握手：緊接著送出 Resumption Ticket (同一批送出，不多花 RTT)
+        SessionTicketData ticket_body;
+        if (header.opcode == OP_HANDSHAKE_RESUMABLE) {
+            ticket_issue(derive_resumption_secret(shared), &ticket_body);
+
+            ProtocolHeader ticket_h;
+            ticket_h.type = MSG_TYPE_SESSION_TICKET;
+            ticket_h.opcode = OP_HANDSHAKE_RESUMABLE;
+            ticket_h.length = sizeof(SessionTicketData);
+            ticket_h.checksum = calculate_checksum((uint8_t*)&ticket_body, sizeof(SessionTicketData));
+
+            reply_append(out, &ticket_h, &ticket_body);
+        }
+        metrics_stage(STAGE_HANDSHAKE, t0);
+        metrics_count(METRIC_HANDSHAKES);
+        
+        return 1; // 握手完成，繼續等待下一個封包 (業務請求)
+    }
+
+    // 處理 Ticket 恢復 (MSG_TYPE_RESUME)：省掉 DH 來回，直接衍生這條連線的 Session Key
+    if (header.type == MSG_TYPE_RESUME) {
+        ResumeData *resume = (ResumeData *)body;
+        long long resumption_secret;
+        uint64_t t0 = metrics_now();
+
+        if (header.length != sizeof(ResumeData) || ticket_redeem(&resume->ticket, &resumption_secret) < 0) {
+            // Ticket 無效：通知 Client 重新握手 (Client 會在同一條連線上改走完整 DH)
+            printf("\033[1;33m[SECURITY] Session ticket rejected. Falling back to full handshake.\033[0m\n");
+            ProtocolHeader reject_h = {
+                .length = 0,
+                .type = MSG_TYPE_RESUME_REJECT,
+                .opcode = OP_RESUME,
+                .checksum = 0
+            };
+            reply_append(out, &reject_h, NULL);
+            session->resume_rejected = 1;
+            metrics_count(METRIC_RESUME_REJECTS);
+            return 1;
+        }
+
+        derive_resumed_session_key(resumption_secret, resume->client_nonce, session_key, 64);
+        session->is_key_established = 1;
+        metrics_stage(STAGE_RESUME, t0);
+        metrics_count(METRIC_RESUMES);
+        log_info("[Security] Session Resumed from Ticket. Session Key Established.");
+        return 1; // 不回覆，Client 已經緊接著送出業務請求
+    }
+    
+    // 處理叫車請求 (MSG_TYPE_RIDE_REQ) ---
+    if (header.type == MSG_TYPE_RIDE_REQ) {
+        
+        // 安全強制：如果沒握手就傳資料，直接踢掉
+        if (!session->is_key_established) {
+            if (session->resume_rejected) {
+                // Ticket 被拒前 Client 已用錯誤的 Key 送出的請求，丟棄並等待重新握手
+                session->resume_rejected = 0;
+                return 1;
             }
+            printf("\033[1;31m[SECURITY] Rejected: Request without Handshake!\033[0m\n");
+            metrics_count(METRIC_NO_HANDSHAKE);
+            return 0;
+        }
+
+        // 展示解密前的 亂碼 (Ciphertext)
+    //printf("\033[1;33m[SECURITY] [Proof] Encrypted Data (Ciphertext): ");
+        // 只印前 16 個 Byte 示意即可，避免洗版
+        //for (int i = 0; i < (int)header.length && i < 16; i++) {
+            //printf("%02X ", body[i]);
+        //}
+        //printf("... (RC4 Encrypted)\033[0m\n");
+
+        // 網路層職責：使用 Session Key 解密 (機密性)
+        uint64_t t0 = metrics_now();
+        rc4_crypt(body, header.length, session_key);
+
+        // 將 binary 轉型回結構，證明解密成功
+        //RideRequestData *req_debug = (RideRequestData *)body;
+        //printf("\033[1;36m[SECURITY] [Proof] Decrypted Data (Plaintext) : ClientID=%d, Type=%d\033[0m\n", 
+               //req_debug->client_id, req_debug->type);
+        
+        // 網路層職責：Checksum 驗證 (完整性)
+        uint16_t checksum = calculate_checksum(body, header.length);
+        metrics_stage(STAGE_DECRYPT, t0);
+        if (checksum != header.checksum) {
+            printf("\033[1;31m[SECURITY] Checksum mismatch! Session Key might be wrong.\033[0m\n");
+            metrics_count(METRIC_CHECKSUM_ERRORS);
+            return 0; 
+        }
+
+        // 分發商業邏輯
+        if (header.opcode == OP_REQ_RIDE || header.opcode == OP_REQ_RIDE_BIN) {
+            process_ride_request_wrapper(out, &header, body, session_key);
+            return 0; // 處理完一個請求後結束 
         }
+    }
 
-        // 處理司機加入 (OP_DRIVER_JOIN)
-        // 注意：如果要讓司機也支援加密，司機端程式也要加 DH 邏輯
-        // 這裡暫時保持原樣 (不加密或假設司機走內部網路)
-        if (header.opcode == OP_DRIVER_JOIN) {
-             process_driver_join(client_fd, &header, body);
-             break;
+    // 處理司機長連線 (MSG_TYPE_DRIVER_ATTACH)：握手後出示司機金鑰的證明，連線轉為派單推播通道
+    if (header.type == MSG_TYPE_DRIVER_ATTACH) {
+        if (!session->is_key_established || header.length != sizeof(DriverAttachData)) {
+            printf("\033[1;31m[SECURITY] Rejected: Driver attach without handshake!\033[0m\n");
+            return 0;
         }
+
+        rc4_crypt(body, header.length, session_key);
+        if (calculate_checksum(body, header.length) != header.checksum) {
+            printf("\033[1;31m[SECURITY] Checksum mismatch! Session Key might be wrong.\033[0m\n");
+            return 0;
+        }
+
+        DriverAttachData *attach = (DriverAttachData *)body;
+        uint32_t driver_id = attach->driver_id;
+        if (!location_driver_auth_enabled()) {
+            printf("\033[1;31m[SECURITY] Driver %u attach rejected: server started without --fleet-key.\033[0m\n", driver_id);
+            return 0;
+        }
+        if (attach->proof != driver_attach_proof(location_driver_key(driver_id), session_key)) {
+            printf("\033[1;31m[SECURITY] Driver %u attach proof mismatch!\033[0m\n", driver_id);
+            return 0;
+        }
+
+        session->attach_driver_id = driver_id;
+        ProtocolHeader ack = {
+            .length = 0,
+            .type = MSG_TYPE_RIDE_RESP,
+            .opcode = OP_DRIVER_JOIN,
+            .checksum = 0
+        };
+        reply_append(out, &ack, NULL);
+        return DISPATCH_HOLD_DRIVER;
+    }
+
+    // 處理司機加入 (OP_DRIVER_JOIN)
+    // 未加密的舊流程：只登記不建立長連線 (需要派單推播的司機改用 MSG_TYPE_DRIVER_ATTACH)
+    if (header.opcode == OP_DRIVER_JOIN) {
+        register_driver(((DriverJoinData *)body)->driver_id); // Body 不保證對齊，透過 packed 結構讀取
+
+        ProtocolHeader ack = {
+            .length = 0,
+            .type = MSG_TYPE_RIDE_RESP,
+            .opcode = OP_RESPONSE,
+            .checksum = 0
+        };
+        reply_append(out, &ack, NULL);
+        return 0;
     }
-}
\ No newline at end of file
+
+    return 1; // 其他類型的封包：忽略，繼續等待
+}
+
+int dispatch_driver_push(ClientSession *session, ReplyBuffer *out) {
+    RideAssignmentData assign;
+    int state = driver_channel_fetch(&session->driver, &assign);
+    if (state <= 0) return state;
+
+    ProtocolHeader header;
+    header.type = MSG_TYPE_RIDE_ASSIGN;
+    header.opcode = OP_RIDE_ASSIGN;
+    header.length = sizeof(RideAssignmentData);
+    header.checksum = calculate_checksum((uint8_t *)&assign, sizeof(assign));
+    rc4_crypt((uint8_t *)&assign, sizeof(assign), session->session_key);
+
+    return reply_append(out, &header, &assign) == 0 ? 1 : 0;
+}
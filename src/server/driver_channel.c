@@ -0,0 +1,240 @@
+/* src/server/driver_channel.c */
+// 司機長連線與派單推播
+// 司機握手後出示身分證明，連線就留在接受它的 Dispatcher 上。派車的 Dispatcher 不一定是同一個進程：
+//   1. 派車端 (持有 mutex) 把派單寫進共享記憶體中該司機的信箱，並在擁有者的待處理位元上標記
+//   2. 解鎖後寫入擁有者的 eventfd
+//   3. 擁有者被喚醒，一次取走所有標記的司機，從信箱讀出派單 (seqlock，不需上鎖) 並推播
+// 閒置的長連線只佔一個 fd，不需要輪詢。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "../../common/include/shared_data.h"
+#include "../../common/include/log_system.h"
+#include "../include/coordinator.h"
+#include "../include/driver_channel.h"
+#include "../include/journal.h"
+#include "../include/lock_profile.h"
+
+extern SharedState *g_shared_state;
+
+static int g_worker_count = 0;
+static int g_worker_eventfds[DRIVER_PUSH_MAX_WORKERS];
+static int g_worker_index = -1; // 只有 Dispatcher 進程才有編號
+
+// 本進程持有的長連線 (以 drivers[] 索引查 I/O 後端的連線物件)
+typedef struct {
+    void *conn;
+    uint32_t generation;
+} LocalDriverConn;
+
+static LocalDriverConn g_local_conns[MAX_DRIVERS];
+
+int driver_channel_init(int worker_count) {
+    if (worker_count > DRIVER_PUSH_MAX_WORKERS) {
+        log_error("Driver push supports at most %d dispatchers (requested %d).", DRIVER_PUSH_MAX_WORKERS, worker_count);
+        return -1;
+    }
+    for (int i = 0; i < worker_count; i++) {
+        g_worker_eventfds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (g_worker_eventfds[i] < 0) {
+            log_error("eventfd failed: %s", strerror(errno));
+            while (--i >= 0) close(g_worker_eventfds[i]);
+            return -1;
+        }
+    }
+    g_worker_count = worker_count;
+    return 0;
+}
+
+void driver_channel_worker_init(int worker_index) {
+    g_worker_index = worker_index;
+    memset(g_local_conns, 0, sizeof(g_local_conns));
+}
+
+int driver_channel_eventfd(void) {
+    return (g_worker_index >= 0 && g_worker_index < g_worker_count) ? g_worker_eventfds[g_worker_index] : -1;
+}
+
+void driver_link_init(DriverLink *link) {
+    link->driver_index = -1;
+    link->generation = 0;
+}
+
+/**
+ * 在擁有者的待處理位元上標記司機。
+ */
+static void mark_pending(DriverPushTable *table, int worker, int driver_index) {
+    __atomic_fetch_or(&table->pending[worker][driver_index / 64], 1ULL << (driver_index % 64), __ATOMIC_RELEASE);
+}
+
+int driver_channel_attach(DriverLink *link, uint32_t driver_id, void *conn, void **replaced) {
+    *replaced = NULL;
+    if (driver_channel_eventfd() < 0) return -1;
+
+    DriverPushTable *table = &g_shared_state->driver_push;
+    int takeover_worker = -1;
+    int idx = -1;
+
+    uint64_t lock_token = state_lock(LOCK_SITE_DRIVER_ATTACH);
+    for (int i = 0; i < g_shared_state->driver_count; i++) {
+        if (g_shared_state->drivers[i].driver_id == driver_id) {
+            idx = i;
+            break;
+        }
+    }
+    if (idx < 0) idx = register_driver_locked(driver_id);
+
+    if (idx >= 0) {
+        DriverMailbox *mb = &table->mailboxes[idx];
+        if (mb->connected) {
+            // 司機換了一條連線 (例如斷線重連)：喚醒舊的擁有者，讓它發現 generation 變了並關閉舊連線
+            takeover_worker = mb->owner_worker;
+        } else {
+            table->connected++;
+        }
+        mb->connected = 1;
+        mb->owner_worker = (uint16_t)g_worker_index;
+        __atomic_store_n(&mb->generation, mb->generation + 1, __ATOMIC_RELEASE);
+        table->attaches++;
+
+        link->driver_index = idx;
+        link->generation = mb->generation;
+        if (takeover_worker >= 0 && takeover_worker != g_worker_index) mark_pending(table, takeover_worker, idx);
+    }
+    state_unlock(LOCK_SITE_DRIVER_ATTACH, lock_token);
+
+    if (idx < 0) return -1;
+    journal_commit(journal_last_lsn()); // 新司機的 DRIVER_JOIN
+    if (takeover_worker >= 0 && takeover_worker != g_worker_index) driver_channel_notify(takeover_worker);
+
+    *replaced = g_local_conns[idx].conn;
+    g_local_conns[idx].conn = conn;
+    g_local_conns[idx].generation = link->generation;
+    log_info("[Dispatcher %d] Driver %u attached (push channel).", getpid(), driver_id);
+    return 0;
+}
+
+void driver_channel_detach(DriverLink *link) {
+    int idx = link->driver_index;
+    if (idx < 0) return;
+
+    DriverPushTable *table = &g_shared_state->driver_push;
+    uint64_t lock_token = state_lock(LOCK_SITE_DRIVER_DETACH);
+    DriverMailbox *mb = &table->mailboxes[idx];
+    if (mb->connected && mb->generation == link->generation) {
+        mb->connected = 0;
+        table->connected--;
+    }
+    state_unlock(LOCK_SITE_DRIVER_DETACH, lock_token);
+
+    if (g_local_conns[idx].generation == link->generation) {
+        g_local_conns[idx].conn = NULL;
+    }
+    link->driver_index = -1;
+}
+
+int driver_channel_post(SharedState *state, int driver_index, const RideAssignmentData *msg) {
+    DriverPushTable *table = &state->driver_push;
+    DriverMailbox *mb = &table->mailboxes[driver_index];
+
+    // seqlock 寫入：write_seq 為奇數期間讀取端會重試
+    __atomic_store_n(&mb->write_seq, mb->write_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    mb->msg = *msg;
+    __atomic_store_n(&mb->write_seq, mb->write_seq + 1, __ATOMIC_RELEASE);
+    table->posted++;
+
+    if (!mb->connected) {
+        table->offline++;
+        return -1;
+    }
+    mark_pending(table, mb->owner_worker, driver_index);
+    return mb->owner_worker;
+}
+
+void driver_channel_notify(int worker) {
+    if (worker < 0 || worker >= g_worker_count) return;
+    uint64_t one = 1;
+    if (write(g_worker_eventfds[worker], &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_warn("Driver push notify failed: %s", strerror(errno));
+    }
+}
+
+int driver_channel_drain(void *conns[MAX_DRIVERS]) {
+    int efd = driver_channel_eventfd();
+    if (efd < 0) return 0;
+
+    uint64_t counter;
+    if (read(efd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) return 0;
+
+    int count = 0;
+    uint64_t *pending = g_shared_state->driver_push.pending[g_worker_index];
+    for (int w = 0; w < MAX_DRIVERS / 64; w++) {
+        uint64_t bits = __atomic_exchange_n(&pending[w], 0, __ATOMIC_ACQUIRE);
+        while (bits) {
+            int idx = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (g_local_conns[idx].conn != NULL) conns[count++] = g_local_conns[idx].conn;
+        }
+    }
+    return count;
+}
+
+void driver_channel_release_worker(int worker) {
+    if (worker < 0 || worker >= DRIVER_PUSH_MAX_WORKERS) return;
+    DriverPushTable *table = &g_shared_state->driver_push;
+    int released = 0;
+
+    uint64_t lock_token = state_lock(LOCK_SITE_DRIVER_DETACH);
+    for (int i = 0; i < MAX_DRIVERS; i++) {
+        DriverMailbox *mb = &table->mailboxes[i];
+        if (mb->connected && mb->owner_worker == worker) {
+            mb->connected = 0;
+            table->connected--;
+            released++;
+        }
+    }
+    for (int w = 0; w < MAX_DRIVERS / 64; w++) __atomic_store_n(&table->pending[worker][w], 0, __ATOMIC_RELAXED);
+    state_unlock(LOCK_SITE_DRIVER_DETACH, lock_token);
+
+    if (released > 0) log_info("Released %d driver connections of dispatcher slot %d.", released, worker);
+}
+
+int driver_channel_owned(int worker) {
+    DriverPushTable *table = &g_shared_state->driver_push;
+    int owned = 0;
+    for (int i = 0; i < MAX_DRIVERS; i++) {
+        const DriverMailbox *mb = &table->mailboxes[i];
+        if (__atomic_load_n(&mb->connected, __ATOMIC_RELAXED) && mb->owner_worker == worker) owned++;
+    }
+    return owned;
+}
+
+int driver_channel_fetch(DriverLink *link, RideAssignmentData *out) {
+    if (link->driver_index < 0) return 0;
+
+    DriverPushTable *table = &g_shared_state->driver_push;
+    DriverMailbox *mb = &table->mailboxes[link->driver_index];
+    if (__atomic_load_n(&mb->generation, __ATOMIC_ACQUIRE) != link->generation) return -1;
+
+    uint32_t seq;
+    while (1) {
+        seq = __atomic_load_n(&mb->write_seq, __ATOMIC_ACQUIRE);
+        if (seq == mb->delivered_seq) return 0;
+        if (seq & 1) continue; // 寫入中
+
+        *out = mb->msg;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&mb->write_seq, __ATOMIC_RELAXED) == seq) break;
+    }
+
+    // 送出前就標記 (至多送一次)：寫入 socket 失敗的派單不會重送
+    mb->delivered_seq = seq;
+    __atomic_fetch_add(&table->delivered, 1, __ATOMIC_RELAXED);
+    return 1;
+}
@@ -1,13 +1,28 @@
 #ifndef COORDINATOR_H
 #define COORDINATOR_H
 
+#include <stdint.h>
+#include "../../common/include/protocol.h"
+
 // 啟動 Coordinator 主流程 (安全版)
 void start_coordinator_process(int server_fd);
 
 // 啟動 Coordinator 主流程 (漏洞版)
 void start_coordinator_process_insecure(int server_fd);
 
-// 處理司機加入
-void process_driver_join(int client_fd, void *header, void *body);
+// 司機加入：登記到共享狀態 (不做任何 I/O)
+void register_driver(uint32_t driver_id);
+
+// 同上，但呼叫端已持有 mutex。return 新司機的索引，司機表已滿回傳 -1
+int register_driver_locked(uint32_t driver_id);
+
+// 寫入 Snapshot (server.dat) 並清掉已包含在內的 WAL 記錄
+void save_state(void);
+
+// 載入 Snapshot (目前格式或第一版的原始傾印)。return 1 = 成功, 0 = 沒有存檔或檔案損毀
+int load_state(void);
+
+// 處理司機加入 (登記後直接回覆空的 RIDE_RESP)
+void process_driver_join(int client_fd, ProtocolHeader *header, uint8_t *body);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+/* src/server/include/dispatcher.h */
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../../common/include/protocol.h"
+#include "driver_channel.h"
+
+// Dispatcher 的 I/O 後端 (啟動時選定)
+#define IO_BACKEND_CLASSIC 0    // 每個 Worker 一次處理一條連線 (阻塞式 accept/read/write)
+#define IO_BACKEND_URING   1    // 每個 Worker 一個 io_uring，同時處理多條連線
+
+// 單一連線的回覆緩衝區：Frame 處理器只負責填資料，由 I/O 後端一次送出
+#define REPLY_BUFFER_SIZE 2048
+
+typedef struct {
+    size_t len;
+    uint8_t data[REPLY_BUFFER_SIZE];
+} ReplyBuffer;
+
+// 單一連線的安全狀態 (握手 / Ticket 恢復的結果)
+typedef struct {
+    char session_key[64];       // 這條連線專屬的 Key
+    int is_key_established;     // 握手或 Ticket 恢復是否完成
+    int resume_rejected;        // Ticket 被拒絕：Client 已經送出的下一個請求要丟棄
+    uint32_t attach_driver_id;  // 已通過驗證、要求建立長連線的司機 ID
+    DriverLink driver;          // 司機長連線 (由 I/O 後端在 DISPATCH_HOLD_DRIVER 後登記)
+    uint64_t trace_id;          // --span-trace 抽中的連線 (0 = 不記錄 span)
+} ClientSession;
+
+// dispatch_frame 的回傳值 (1 / 0 之外)：送出回覆後連線轉為司機長連線，不要關閉
+#define DISPATCH_HOLD_DRIVER 2
+
+/**
+ * 設定 I/O 後端 (在 fork Worker 之前呼叫，所有 Worker 繼承)。
+ */
+void dispatcher_set_io_backend(int backend);
+
+/**
+ * Worker 進程初始化 (亂數種子、DH 密鑰池)。由 dispatcher_loop 呼叫。
+ */
+void dispatcher_worker_init(void);
+
+/**
+ * 閒置工作：補充一批 DH 密鑰對。
+ * return 1 = 有補充 (呼叫端應回頭檢查 I/O), 0 = 密鑰池已滿
+ */
+int dispatcher_refill_keypool(void);
+
+/**
+ * Dispatcher 進程的主迴圈。只有 Coordinator 要求退休 (worker_pool.h) 時才返回。
+ */
+void dispatcher_loop(int server_fd);
+
+void client_session_init(ClientSession *session);
+
+/**
+ * 處理單一完整 Frame，回覆排入 out (不做任何 socket I/O)。
+ * body 會被就地解密。
+ * return 1 = 繼續等待下一個 Frame, 0 = 送出回覆後關閉連線,
+ *        DISPATCH_HOLD_DRIVER = 呼叫端以 session->attach_driver_id 登記長連線後再送出回覆
+ */
+int dispatch_frame(ClientSession *session, ProtocolHeader *header, uint8_t *body, ReplyBuffer *out);
+
+/**
+ * 把司機信箱中尚未推播的派單加密後排入 out (不做任何 socket I/O)。
+ * return 1 = 有排入, 0 = 沒有新派單, -1 = 司機已在別處重新連線 (呼叫端應關閉)
+ */
+int dispatch_driver_push(ClientSession *session, ReplyBuffer *out);
+
+#endif
@@ -0,0 +1,81 @@
+/* src/server/include/driver_channel.h */
+#ifndef DRIVER_CHANNEL_H
+#define DRIVER_CHANNEL_H
+
+#include <stdint.h>
+#include "../../common/include/protocol.h"
+#include "../../common/include/shared_data.h"
+
+// 一條司機長連線與共享信箱的對應 (存在 ClientSession 裡，兩種 I/O 後端共用)
+typedef struct {
+    int driver_index;       // drivers[] 索引；-1 = 不是司機長連線
+    uint32_t generation;    // 建立長連線時信箱的 generation
+} DriverLink;
+
+/**
+ * 為每個 Dispatcher 建立 eventfd (Coordinator 在 fork 之前呼叫，所有 Worker 繼承)。
+ * return 0 = 成功, -1 = 失敗
+ */
+int driver_channel_init(int worker_count);
+
+/**
+ * 記錄目前進程的 Dispatcher 編號 (fork 之後在子進程呼叫)。
+ */
+void driver_channel_worker_init(int worker_index);
+
+/**
+ * 目前 Dispatcher 的 eventfd (有新派單時變為可讀)。
+ */
+int driver_channel_eventfd(void);
+
+void driver_link_init(DriverLink *link);
+
+/**
+ * 把一條已驗證的連線登記為司機長連線 (未知的司機會先加入司機表)。
+ * conn 是 I/O 後端自己的連線物件，之後由 driver_channel_drain 取回。
+ * 同一位司機在本進程還有舊連線時，*replaced 設為舊連線 (呼叫端負責關閉)，否則為 NULL。
+ * 舊連線在其他進程時由該進程自行發現並關閉。
+ * return 0 = 成功, -1 = 司機表已滿或不在 Dispatcher 進程
+ */
+int driver_channel_attach(DriverLink *link, uint32_t driver_id, void *conn, void **replaced);
+
+/**
+ * 長連線關閉時呼叫 (司機已在別處重新連線時不影響新連線)。
+ */
+void driver_channel_detach(DriverLink *link);
+
+/**
+ * 投遞一筆派單到司機信箱。呼叫端必須持有 state->mutex。
+ * return 需要喚醒的 Dispatcher 編號 (解鎖後交給 driver_channel_notify)；-1 = 司機沒有長連線
+ */
+int driver_channel_post(SharedState *state, int driver_index, const RideAssignmentData *msg);
+
+/**
+ * 喚醒持有長連線的 Dispatcher (寫入它的 eventfd)。
+ */
+void driver_channel_notify(int worker);
+
+/**
+ * eventfd 可讀時呼叫：清除計數並取走所有有新派單的本地連線。
+ * return conns 中的連線數
+ */
+int driver_channel_drain(void *conns[MAX_DRIVERS]);
+
+/**
+ * Dispatcher 進程結束後由 Coordinator 呼叫：它持有的長連線都已斷開，信箱改為離線並清掉待處理位元
+ * (同一格之後 fork 的新 Worker 不會收到不屬於它的派單)。
+ */
+void driver_channel_release_worker(int worker);
+
+/**
+ * 某個 Dispatcher 目前持有的長連線數 (不上鎖的近似值，回收閒置 Worker 時參考)。
+ */
+int driver_channel_owned(int worker);
+
+/**
+ * 取出尚未推播的派單 (不需上鎖)。
+ * return 1 = 有新派單 (已標記為送出), 0 = 沒有, -1 = 司機已在別處重新連線 (呼叫端應關閉這條連線)
+ */
+int driver_channel_fetch(DriverLink *link, RideAssignmentData *out);
+
+#endif
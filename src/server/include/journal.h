@@ -0,0 +1,139 @@
+/* src/server/include/journal.h */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "../../common/include/shared_data.h"
+
+#define JOURNAL_FILE        "server.wal"
+#define JOURNAL_RING_SLOTS  4096    // 共享記憶體環狀緩衝區的記錄數 (必須是 2 的次方)
+
+// 落盤策略
+#define JOURNAL_FSYNC_ALWAYS   0    // 每批寫入後 fdatasync，回覆前等待落盤 (group commit)
+#define JOURNAL_FSYNC_INTERVAL 1    // 每隔固定時間 fdatasync，回覆不等待 (最多遺失一個間隔)
+#define JOURNAL_FSYNC_NONE     2    // 只 write()，由作業系統決定何時落盤
+
+#define JOURNAL_DEFAULT_INTERVAL_MS 100
+
+// 記錄類型
+#define JOURNAL_DRIVER_JOIN 1   // 司機加入 (driver_id)
+#define JOURNAL_DISPATCH    2   // 派車成功 (driver_id, client_id, ride_id, fare, 目的地)
+#define JOURNAL_COMPLETE    3   // 行程結束 (driver_id, 司機最後位置)
+
+// 一筆變更記錄 (檔案格式與環狀緩衝區共用，固定長度)
+typedef struct {
+    uint64_t lsn;           // 記錄序號 (從 1 開始連續遞增)
+    uint8_t type;           // JOURNAL_*
+    uint8_t reserved[3];
+    uint32_t driver_id;
+    uint32_t client_id;
+    uint32_t ride_id;
+    int32_t fare;
+    int32_t lat_e7;         // 座標 * LOC_COORD_SCALE
+    int32_t lon_e7;
+    uint32_t crc;           // keyed_digest(以上所有欄位) 的低 32 bits，用來辨識寫到一半的尾端
+} __attribute__((packed)) JournalRecord;
+
+// 所有 Worker 共用的環狀緩衝區 (fork 之前建立的匿名共享映射，不屬於 SharedState，也不進 Snapshot)
+// Worker 在持有 state->mutex 時附加記錄，所以 LSN 順序與狀態變更順序一致；
+// Coordinator 的 flusher 執行緒只拿 lock，一次把所有待寫記錄寫入檔案 (group commit)
+typedef struct {
+    pthread_mutex_t lock;       // Process-Shared、Robust，保護以下欄位
+    pthread_cond_t not_empty;   // flusher 等待新記錄
+    pthread_cond_t progress;    // Worker 等待空間 / 落盤
+    uint64_t next_lsn;          // 下一筆記錄的 LSN
+    uint64_t written_lsn;       // 已完整 write() 到檔案的最後 LSN
+    uint64_t durable_lsn;       // 已 fdatasync 的最後 LSN (always / interval 策略下之前的 slot 才可重用)
+    uint8_t fsync_policy;       // JOURNAL_FSYNC_*
+    uint8_t running;            // flusher 是否運作中
+    uint8_t io_error;           // 上一批寫入或落盤失敗 (檔案已截回失敗前的位置，記錄留在環中重試)
+    uint32_t interval_ms;       // JOURNAL_FSYNC_INTERVAL 的間隔
+    uint8_t rotate_requested;   // Snapshot 要求在 rotate_lsn 之後換檔
+    uint64_t rotate_lsn;
+    uint64_t rotated_lsn;       // 最近一次完成的輪替點
+
+    // 統計
+    uint64_t appended;          // 附加的記錄數
+    uint64_t batches;           // write() 批次數
+    uint64_t fsyncs;            // fdatasync 次數
+    uint64_t max_batch;         // 單批最多記錄數
+    uint64_t full_waits;        // 緩衝區滿而等待的次數
+    uint64_t commit_waits;      // 回覆前等待落盤的次數
+    uint64_t io_errors;         // 寫入 / 落盤失敗的批次數
+
+    JournalRecord slots[JOURNAL_RING_SLOTS];
+} JournalRing;
+
+/**
+ * 建立環狀緩衝區並開啟 WAL 檔 (在 fork Worker 之前呼叫)。
+ * last_lsn 目前狀態已包含的最後 LSN (Snapshot 的 journal_lsn)
+ * return 0 = 成功, -1 = 失敗 (不啟用 WAL)
+ */
+int journal_init(const char *path, int fsync_policy, int interval_ms, uint64_t last_lsn);
+
+/**
+ * 啟動 flusher 執行緒 (由 Coordinator 在 fork 之後呼叫)。
+ */
+int journal_start(void);
+
+/**
+ * 附加一筆記錄 (填好 type 與內容即可，lsn / crc 由這裡填寫)。
+ * 呼叫端必須持有 g_shared_state->mutex。緩衝區滿時等待 flusher 騰出空間。
+ * return 記錄的 LSN；WAL 未啟用時回傳 0
+ */
+uint64_t journal_append(JournalRecord *rec);
+
+/**
+ * 解鎖之後、回覆 Client 之前呼叫：JOURNAL_FSYNC_ALWAYS 時等待 lsn 落盤，其他策略立即返回。
+ * 寫入或落盤失敗時 flusher 會一直重試，這段期間回覆也跟著等待 (不會回覆沒有落盤的變更)。
+ */
+void journal_commit(uint64_t lsn);
+
+/**
+ * 停止 flusher 並把剩餘記錄寫入、落盤 (關機時呼叫，Worker 必須已經停止)。
+ * return 已寫入的最後 LSN
+ */
+uint64_t journal_shutdown(void);
+
+/**
+ * Snapshot 已安全寫入 (包含到 lsn 為止的所有變更) 之後呼叫：清空 WAL 檔 (flusher 必須未運作)。
+ */
+void journal_truncate(uint64_t lsn);
+
+/**
+ * 要求 flusher 在目前最後一筆記錄之後換新檔 (背景 Snapshot 呼叫，呼叫端持有 state->mutex)。
+ * return 輪替點的 LSN (Snapshot 會包含到這裡為止的變更)
+ */
+uint64_t journal_rotate(void);
+
+/**
+ * 輪替點之前的 Snapshot 已安全寫入：等 flusher 完成輪替後刪除舊檔。
+ */
+void journal_drop_rotated(uint64_t lsn);
+
+/**
+ * fsync path 所在的目錄，讓 rename / 建立 / 刪除檔案本身落盤 (檔案內容另外要 fsync)。
+ * return 0 = 成功, -1 = 失敗 (errno 保留)
+ */
+int journal_sync_dir(const char *path);
+
+/**
+ * WAL 檔 (含輪替出去的 <path>.1) 中是否有至少一筆完整記錄。
+ * 不用 --recover 重新開始前檢查：啟動時的 Snapshot 會清空 WAL。
+ */
+int journal_has_records(const char *path);
+
+/**
+ * 目前已附加的最後 LSN。
+ */
+uint64_t journal_last_lsn(void);
+
+/**
+ * 在 Snapshot 之上重播 WAL (先 <path>.1 再 <path>；journal_init 之前呼叫，呼叫端負責鎖)。
+ * 遇到寫到一半 / 校驗錯誤 / 不連續的記錄就停止。
+ * return 重播後的最後 LSN
+ */
+uint64_t journal_replay(const char *path, SharedState *state);
+
+#endif
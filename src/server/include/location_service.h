@@ -0,0 +1,45 @@
+/* src/server/include/location_service.h */
+#ifndef LOCATION_SERVICE_H
+#define LOCATION_SERVICE_H
+
+#include <stdint.h>
+#include "../../common/include/shared_data.h"
+
+#define LOCATION_BATCH_SIZE 64      // 每次 recvmmsg 最多讀取的 Datagram 數 (也是每次上鎖套用的上限)
+#define LOCATION_LIVE_SECS  10.0    // 這段時間內有回報的司機視為「即時定位」，不再由 map_monitor 模擬移動
+
+/**
+ * 設定 UDP 接收埠與車隊金鑰 (在 start_coordinator_process 之前呼叫)。
+ * udp_port 0 = 停用 UDP 定位回報
+ * fleet_key DRIVER_FLEET_KEY_NONE = 未設定 (UDP 定位回報與司機長連線都停用)
+ */
+void location_service_configure(int udp_port, uint64_t fleet_key);
+
+/**
+ * 建立 UDP Socket 並啟動接收執行緒 (由 Coordinator 呼叫)。
+ * return 0 = 成功或已停用, -1 = Socket 建立失敗
+ */
+int location_service_start(void);
+
+/**
+ * 是否設定了車隊金鑰 (未設定時拒絕司機長連線)。
+ */
+int location_driver_auth_enabled(void);
+
+/**
+ * 由車隊金鑰衍生的司機金鑰 (UDP 定位回報與 TCP 司機長連線共用)。
+ */
+uint64_t location_driver_key(uint32_t driver_id);
+
+/**
+ * 目前的 CLOCK_MONOTONIC 秒數 (與 Driver.loc_updated 同一時間軸)。
+ */
+double location_now(void);
+
+/**
+ * 司機最近是否有 UDP 定位回報。
+ * 呼叫端必須持有 g_shared_state->mutex。
+ */
+int location_is_live(const Driver *driver, double now);
+
+#endif
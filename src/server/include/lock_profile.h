@@ -0,0 +1,80 @@
+/* src/server/include/lock_profile.h */
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include "../../common/include/shared_data.h"
+
+// state->mutex 的取鎖包裝：所有呼叫點都改用 state_lock / state_unlock 並標上 LockSite。
+// 關閉時 (預設) 只多一次 relaxed load 與分支；開啟時走 lock_profile.c 的計時路徑。
+// state->mutex 是 Robust mutex：持有者 (例如崩潰的 Worker) 死掉時下一個取鎖者拿到 EOWNERDEAD，
+// 由 state_lock_recover 標記為一致後繼續，不會讓整個 Server 卡死。
+
+#define LOCKPROF_REPORT_MAX (8 * 1024)  // 報表文字的上限
+
+/**
+ * 計時路徑 (不要直接呼叫)。
+ * return 取得鎖的時間 (ns)
+ */
+uint64_t lock_profile_acquire(LockSite site);
+void lock_profile_release(LockSite site, uint64_t acquired_ns);
+
+/**
+ * 前一個持有者死掉 (EOWNERDEAD)：把鎖標記為可繼續使用並記錄 (不要直接呼叫)。
+ */
+void state_lock_recover(LockSite site);
+
+/**
+ * 取得 state->mutex。
+ * return 交給 state_unlock 的記號 (0 = 這次沒有計時)
+ */
+static inline uint64_t state_lock(LockSite site) {
+    if (__builtin_expect(__atomic_load_n(&g_shared_state->lock_profile.enabled, __ATOMIC_RELAXED) == 0, 1)) {
+        if (__builtin_expect(pthread_mutex_lock(&g_shared_state->mutex) == EOWNERDEAD, 0)) state_lock_recover(site);
+        return 0;
+    }
+    return lock_profile_acquire(site);
+}
+
+static inline void state_unlock(LockSite site, uint64_t token) {
+    if (token == 0) {
+        pthread_mutex_unlock(&g_shared_state->mutex);
+        return;
+    }
+    lock_profile_release(site, token);
+}
+
+/**
+ * 指定目前進程寫入的格子 (0 = Coordinator；Worker i 在 fork 之後以 i + 1 呼叫)。
+ */
+void lock_profile_attach(int slot);
+
+/**
+ * 開始或停止記錄。開始時清空上一輪的數據；停止時把報表寫入 log。
+ * 只由 Coordinator 呼叫 (啟動時、收到 SIGUSR1 時、關機時)。
+ */
+void lock_profile_set(int enabled);
+
+/**
+ * SIGUSR1 的處理：只設旗標，實際切換由 Coordinator 主迴圈呼叫 lock_profile_poll 完成。
+ */
+void lock_profile_request_toggle(int sig);
+void lock_profile_poll(void);
+
+/**
+ * 依總等待時間排序各呼叫點，輸出文字報表 (不拿 state->mutex)。
+ * return 寫入的長度
+ */
+size_t lock_profile_render(const SharedState *state, char *out, size_t cap);
+
+/**
+ * 把報表逐行寫入 log (從未開啟過時不輸出)。
+ */
+void lock_profile_report(void);
+
+const char *lock_site_name(LockSite site);
+
+#endif // LOCK_PROFILE_H
@@ -0,0 +1,54 @@
+/* src/server/include/metrics.h */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "../../common/include/shared_data.h"
+
+// Dispatcher 各階段的延遲直方圖與計數器 (存放在 SharedState.metrics)
+// 記錄一個階段 = 一次 clock_gettime (vDSO) + 幾個 relaxed store，預設一直開著；
+// --metrics-port 只決定 Coordinator 要不要開一個本機 HTTP 端點輸出 Prometheus 文字格式。
+
+#define METRICS_RENDER_MAX (64 * 1024)  // 一次輸出的上限
+
+static inline uint64_t metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * 指定目前進程寫入的格子 (fork 之後在 Worker 呼叫；未呼叫時寫入第 0 格)。
+ */
+void metrics_attach(int worker);
+
+/**
+ * 記錄一個階段：從 start_ns 到現在。
+ * return 現在的時間 (下一個階段可以直接當作起點，省一次讀時鐘)
+ */
+uint64_t metrics_stage(MetricsStage stage, uint64_t start_ns);
+
+void metrics_count(MetricsCounter counter);
+
+const char *metrics_stage_name(MetricsStage stage);
+
+/**
+ * 把所有 Worker 的數據相加，以 Prometheus 文字格式 (0.0.4) 寫入 out。不拿 state->mutex。
+ * return 寫入的長度
+ */
+size_t metrics_render(const SharedState *state, char *out, size_t cap);
+
+/**
+ * 設定輸出埠 (0 = 不輸出)。在 start_coordinator_process 之前呼叫。
+ */
+void metrics_configure(int port);
+
+/**
+ * 有設定輸出埠時，在 127.0.0.1:port 啟動 HTTP 輸出執行緒 (Coordinator 在 fork 之後呼叫)。
+ * return 0 = 成功或未啟用, -1 = 失敗
+ */
+int metrics_start(void);
+
+#endif // METRICS_H
@@ -5,12 +5,38 @@
 #include <stdint.h>
 #include "../../common/include/shared_data.h"
 
+// 以下函式都會讀寫共享記憶體，呼叫者必須持有 state->mutex
+
+/**
+ * 將座標換算成定價區域編號 (超出地圖範圍的座標會被夾到邊界區域)。
+ * return 0 ~ ZONE_COUNT-1
+ */
+int pricing_zone_of(double lat, double lon);
+
+/**
+ * 司機狀態或位置改變後呼叫：比對登記資訊，O(1) 修正區域計數器。
+ * state 共享記憶體指標
+ * driver_index 司機在陣列中的索引
+ */
+void pricing_sync_driver(SharedState *state, int driver_index);
+
+/**
+ * 清空並重建所有區域計數器 (只在初始化或載入存檔後使用，O(N))。
+ */
+void pricing_rebuild_zones(SharedState *state);
+
+/**
+ * 記錄一筆叫車需求到指定區域 (先衰減舊需求再 +1)。
+ */
+void pricing_record_demand(SharedState *state, int zone);
+
 /**
- * 計算動態定價和是否啟動溢價。
- * state 共享記憶體指標 (讀取忙碌狀態)
+ * 計算指定上車地點的動態定價和是否啟動溢價 (查表，O(1))。
+ * state 共享記憶體指標 (讀取區域計數器)
+ * lat, lon 上車地點
  * is_surge 輸出參數：1 表示啟動溢價，0 表示沒有
  * return 最終價格
  */
-int calculate_surge_price(SharedState *state, int *is_surge);
+int calculate_surge_price(SharedState *state, double lat, double lon, int *is_surge);
 
-#endif // PRICING_SERVICE_H
\ No newline at end of file
+#endif // PRICING_SERVICE_H
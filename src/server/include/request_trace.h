@@ -0,0 +1,61 @@
+/* src/server/include/request_trace.h */
+#ifndef REQUEST_TRACE_H
+#define REQUEST_TRACE_H
+
+#include <stdint.h>
+#include "../../common/include/protocol.h"
+#include "../../common/include/trace_format.h"
+#include "../../common/include/shared_data.h"
+
+// 請求擷取 (--trace=FILE)：把每個叫車請求的中繼資料寫成 trace_replay 可以重播的二進位檔
+// Worker 只把一筆 32 bytes 的記錄放進自己的單一生產者環狀緩衝區 (不上鎖，與 span_trace 相同)，
+// 由 Coordinator 的寫入執行緒定期取走所有環並批次寫檔 (檔案中的順序不保證依時間，trace_replay 會排序)。
+// 擷取不能拖慢服務：緩衝區滿時直接丟棄並計數 (關機時回報)。
+#define TRACE_RING_SLOTS   2048     // 每個 Worker 的記錄數，必須是 2 的次方
+#define TRACE_FLUSH_MS     100      // 寫入執行緒的輪詢間隔
+
+// 單一生產者 (Worker) / 單一消費者 (寫入執行緒)
+typedef struct {
+    uint64_t head;              // Worker 寫入 (release)
+    uint64_t tail;              // 寫入執行緒取走 (release)
+    uint64_t dropped;           // 緩衝區滿而丟棄的記錄
+    TraceRecord slots[TRACE_RING_SLOTS];
+} __attribute__((aligned(64))) TraceRing;
+
+typedef struct {
+    uint64_t start_ns;          // 擷取起點 (CLOCK_MONOTONIC，所有進程共用)
+    TraceRing rings[METRICS_MAX_WORKERS];
+} TraceBuffers;
+
+/**
+ * 開檔並建立環狀緩衝區 (在 fork Worker 之前呼叫)。
+ * return 0 = 成功, -1 = 失敗 (不擷取)
+ */
+int trace_init(const char *path);
+
+/**
+ * 指定目前進程的 Worker 編號 (fork 之後在子進程呼叫)。
+ */
+void trace_attach(int worker);
+
+/**
+ * 啟動寫入執行緒 (由 Coordinator 在 fork 之後呼叫)。未啟用擷取時不做任何事。
+ */
+int trace_start(void);
+
+/**
+ * 請求開始處理時呼叫。未啟用擷取時回傳 0 (不讀時鐘)。
+ */
+uint64_t trace_begin(void);
+
+/**
+ * 記錄一個已處理的請求 (begin = trace_begin 的回傳值，0 時不記錄)。
+ */
+void trace_request(uint64_t begin, const RideRequestData *req, uint16_t opcode, uint8_t status);
+
+/**
+ * 停止寫入執行緒並寫完剩餘記錄 (關機時呼叫，Worker 必須已經停止)。
+ */
+void trace_shutdown(void);
+
+#endif // REQUEST_TRACE_H
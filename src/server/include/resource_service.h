@@ -4,14 +4,73 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <netinet/in.h>
 #include "../../common/include/shared_data.h"
 
+// 閾值：每個 client 平均每秒 3 次，最多連續 3 次突發
+#define RATE_LIMIT_PER_SEC 3
+#define RATE_LIMIT_BURST 3
+
+// 預設每個來源 IP 每秒最多 1000 條新連線 (突發 2000)，只擋明顯的洪水攻擊
+#define ADMIT_DEFAULT_PER_SEC 1000
+#define ADMIT_DEFAULT_BURST 2000
+
+// 參數範圍 (刻度是微秒：1000/s 以內 emission 的量化誤差 < 0.1%)
+// 可預支的時間另外限制在 10 分鐘內，遠小於 32-bit 微秒刻度回繞的一半
+#define RATE_LIMIT_MAX_PER_SEC 1000
+#define RATE_LIMIT_MAX_BURST 100000
+#define RATE_LIMIT_MAX_TOLERANCE_US 600000000U
+
+/**
+ * 初始化 GCRA 限流表 (清空所有 slot 並設定速率)。
+ * table 限流表 (位於共享記憶體)
+ * rate_per_sec 每秒允許的平均請求數 (0 = 停用，上限 RATE_LIMIT_MAX_PER_SEC)
+ * burst 允許的瞬間突發請求數 (1 ~ RATE_LIMIT_MAX_BURST，可預支的時間不超過 RATE_LIMIT_MAX_TOLERANCE_US)
+ */
+void rate_limit_table_init(RateLimitTable *table, uint32_t rate_per_sec, uint32_t burst);
+
+/**
+ * 取得限流表使用的時間刻度 (自 epoch 起的微秒數)。
+ */
+uint32_t rate_limit_now(const RateLimitTable *table);
+
+/**
+ * 對 key 執行一次 GCRA 檢查，全程只用原子操作，不需要持有 mutex。
+ * now 由呼叫者提供 (方便 Benchmark 模擬時間)
+ * return 1 = 阻擋 (Blocked), 0 = 通行 (Allowed)
+ */
+int rate_limit_table_check(RateLimitTable *table, uint32_t key, uint32_t now);
+
+/**
+ * 推進一段 clock sweep (不論有沒有請求都要定期呼叫，見 rate_limit_maintain)。
+ */
+void rate_limit_table_maintain(RateLimitTable *table, uint32_t now);
+
+/**
+ * 維護所有限流表 (Coordinator 主迴圈每個 tick 呼叫)：保證閒置的 slot 在 32-bit 刻度回繞前就被清掉。
+ */
+void rate_limit_maintain(void);
+
 /**
  * 檢查並更新客戶端的請求頻率 (Rate Limiting)。
- * client_id 客戶 ID
+ * client_id 客戶 ID (任意 32-bit 值)
+ * return 1 = 阻擋 (Blocked), 0 = 通行 (Allowed)
+ */
+int check_and_update_rate_limit(uint32_t client_id);
+
+/**
+ * 連線准入控制 (Admission Control)：accept 之後立刻依來源 IP 限流。
+ * 在任何 DH / RC4 運算之前呼叫，被擋的連線直接關閉。
+ * peer accept() 取得的對端位址
+ * return 1 = 阻擋 (Blocked), 0 = 通行 (Allowed)
+ */
+int check_peer_admission(const struct sockaddr_in *peer);
+
+/**
+ * 同上，但只拿得到 fd (io_uring multishot accept)：需要時才以 getpeername 取得對端位址。
  * return 1 = 阻擋 (Blocked), 0 = 通行 (Allowed)
  */
-int check_and_update_rate_limit(int client_id);
+int check_peer_admission_fd(int fd);
 
 /**
  * 檢查司機是否可以接單 (Fuel / Refueling 檢查)。
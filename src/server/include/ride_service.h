@@ -5,15 +5,19 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include "../../common/include/protocol.h"
+
+#define RIDE_KM_PER_DEGREE  111.0   // 緯度 1 度約 111 公里 (ETA 估算用)
+#define RIDE_ETA_SPEED_KMH  30.0    // 市區平均車速 (ETA 估算用)
 
 /**
  * 處理叫車請求的核心業務邏輯 (協調者)。
  * 由 dispatcher.c 呼叫。
  * client_id 客戶 ID
- * response_msg 回覆訊息緩衝區
- * msg_len 緩衝區長度
+ * pickup_lat, pickup_lon 上車地點 (決定計價區域)
+ * resp 叫車結果 (Dispatcher 依 Client 要求送出二進位結構或 ride_response_format_text 的文字)
  * return 0 = 成功, -1 = 失敗 (無車)
  */
-int handle_ride_request_logic(int client_id, char *response_msg, size_t msg_len);
+int handle_ride_request_logic(int client_id, double pickup_lat, double pickup_lon, RideResponseData *resp);
 
 #endif // RIDE_SERVICE_H
\ No newline at end of file
@@ -0,0 +1,35 @@
+/* src/server/include/session_ticket.h */
+#ifndef SESSION_TICKET_H
+#define SESSION_TICKET_H
+
+#include <stdint.h>
+#include "../../common/include/protocol.h"
+#include "../../common/include/shared_data.h"
+
+// Ticket 有效期與金鑰輪替週期 (秒)
+// 保留上一代金鑰，所以輪替週期不能短於有效期
+#define TICKET_LIFETIME_SECS 600
+#define TICKET_KEY_ROTATE_SECS 600
+
+/**
+ * 初始化金鑰環：產生第一代隨機 Ticket Key。
+ * 在 fork Dispatcher 之前呼叫。
+ */
+void ticket_keyring_init(TicketKeyring *ring);
+
+/**
+ * 以目前這一代 Ticket Key 封裝 Resumption Secret，填入要回給 Client 的 Payload。
+ * resumption_secret 由 DH 共享密鑰衍生 (derive_resumption_secret)
+ * out 輸出的 Ticket Payload
+ */
+void ticket_issue(long long resumption_secret, SessionTicketData *out);
+
+/**
+ * 驗證並解開 Client 出示的 Ticket。
+ * ticket Client 傳來的 Ticket
+ * resumption_secret_out 成功時輸出 Resumption Secret
+ * return 0 = 有效, -1 = 無效 (偽造 / 過期 / 金鑰已輪替)
+ */
+int ticket_redeem(const SessionTicket *ticket, long long *resumption_secret_out);
+
+#endif // SESSION_TICKET_H
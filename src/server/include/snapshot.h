@@ -0,0 +1,43 @@
+/* src/server/include/snapshot.h */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "../../common/include/shared_data.h"
+#include "../../common/include/snapshot_format.h"
+
+#define SNAPSHOT_FILE             "server.dat"
+#define SNAPSHOT_DEFAULT_INTERVAL 60    // 背景 Snapshot 預設間隔 (秒)
+
+/**
+ * 設定背景 Snapshot 間隔 (在 start_coordinator_process 之前呼叫)。
+ * interval_secs 0 = 停用 (只在啟動 / 關機時寫入)
+ */
+void snapshot_configure(int interval_secs);
+
+/**
+ * 啟動背景 Snapshot 執行緒 (由 Coordinator 在 fork 之後呼叫)。
+ * return 0 = 成功或已停用, -1 = 執行緒建立失敗
+ */
+int snapshot_start(void);
+
+/**
+ * 把一份映像以目前版本的格式寫入 SNAPSHOT_FILE (格式見 snapshot_format.h)：
+ * 先寫暫存檔並 fsync，再 rename 取代舊檔。任何時間點當機都還有一份完整的 Snapshot。與背景 Snapshot 互斥。
+ * return 0 = 成功, -1 = 失敗 (舊檔保持不變)
+ */
+int snapshot_write(const SnapshotImage *image);
+
+/**
+ * 載入 SNAPSHOT_FILE 到 state (呼叫端負責鎖；mutex 與不持久化的區塊由呼叫端重新初始化)。
+ * 目前的格式直接 mmap 檔案、驗證 CRC 後套用；也接受第一版的原始傾印 (依凍結的 SnapshotV1State 解碼)。
+ * return 載入的格式版本；0 = 沒有檔案或檔案無效 (state 內容未定義，呼叫端應重新初始化)
+ */
+int snapshot_load(SharedState *state);
+
+/**
+ * 立即做一次背景 Snapshot：持有 mutex 轉出映像並輪替 WAL，在鎖外寫檔，成功後刪除舊的 WAL 檔。
+ * return 0 = 成功, -1 = 失敗
+ */
+int snapshot_take(void);
+
+#endif
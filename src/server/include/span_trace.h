@@ -0,0 +1,93 @@
+/* src/server/include/span_trace.h */
+#ifndef SPAN_TRACE_H
+#define SPAN_TRACE_H
+
+#include <stdint.h>
+#include "../../common/include/shared_data.h"
+
+// 抽樣的單一請求時間軸 (--span-trace=FILE)：輸出 Chrome trace-event JSON，可直接用 Perfetto / chrome://tracing 開啟。
+// 每 N 條連線抽一條，給它一個 trace ID；之後這條連線經過的每個 metrics_stage 都記成一個 span
+// (另外加上 accept 與整條連線)。Worker 只寫自己的單一生產者環狀緩衝區 (不上鎖)，
+// Coordinator 的寫入執行緒定期取走並轉成 JSON；緩衝區滿時丟棄並計數。
+#define SPAN_RING_SLOTS     1024    // 每個 Worker 的 span 數，必須是 2 的次方
+#define SPAN_FLUSH_MS       100     // 寫入執行緒的輪詢間隔
+#define SPAN_DEFAULT_SAMPLE 100     // 預設每 100 條連線抽一條
+
+// span 名稱：MetricsStage 之外的兩種
+#define SPAN_ACCEPT     (STAGE_COUNT)       // accept 返回到開始讀取 (准入控制、連線初始化)
+#define SPAN_CONNECTION (STAGE_COUNT + 1)   // 整條連線 (accept 到關閉)
+
+typedef struct {
+    uint64_t trace_id;
+    uint64_t start_ns;          // CLOCK_MONOTONIC
+    uint64_t end_ns;
+    uint32_t name;              // MetricsStage / SPAN_ACCEPT / SPAN_CONNECTION
+    uint32_t reserved;
+} SpanEvent;
+
+// 單一生產者 (Worker) / 單一消費者 (寫入執行緒)
+typedef struct {
+    uint64_t head;              // Worker 寫入 (release)
+    uint64_t tail;              // 寫入執行緒取走 (release)
+    uint64_t dropped;
+    int32_t pid;                // Worker 的 OS PID (JSON 的 process_name 用)
+    uint32_t named;             // 寫入執行緒已輸出目前 pid 的 process_name (Worker 重生時清除)
+    uint32_t trace_seq;         // 這一格發出的 trace 數 (放在共享記憶體：重生的 Worker 接著編號，trace ID 不重複)
+    uint32_t reserved;
+    SpanEvent events[SPAN_RING_SLOTS];
+} __attribute__((aligned(64))) SpanRing;
+
+typedef struct {
+    uint32_t sample_every;      // 每 N 條連線抽一條 (0 = 暫停)；執行中可調整
+    uint32_t reserved;
+    uint64_t start_ns;          // JSON 時間軸的 0 點
+    SpanRing rings[METRICS_MAX_WORKERS];
+} SpanBuffers;
+
+// 目前處理中的連線的 trace ID (0 = 沒有被抽中)。由 I/O 後端在處理每條連線之前設定
+extern uint64_t g_span_current;
+
+/**
+ * 開檔並建立共享緩衝區 (在 fork Worker 之前呼叫)。
+ * return 0 = 成功, -1 = 失敗 (不記錄)
+ */
+int span_trace_init(const char *path, uint32_t sample_every);
+
+/**
+ * 指定目前進程的 Worker 編號 (fork 之後在子進程呼叫)。
+ */
+void span_attach(int worker);
+
+/**
+ * 新連線是否被抽中。
+ * return trace ID (0 = 不記錄)
+ */
+uint64_t span_sample(void);
+
+static inline void span_set_current(uint64_t trace_id) {
+    g_span_current = trace_id;
+}
+
+/**
+ * 記錄一個 span (trace_id 為 0 時不做任何事)。
+ */
+void span_record(uint64_t trace_id, uint32_t name, uint64_t start_ns, uint64_t end_ns);
+
+/**
+ * 執行中調整抽樣率 (0 = 暫停)。
+ * return 0 = 成功, -1 = 未啟用 --span-trace
+ */
+int span_set_sample(uint32_t every);
+uint32_t span_get_sample(void);
+
+/**
+ * 啟動寫入執行緒 (Coordinator 在 fork 之後呼叫)。未啟用時不做任何事。
+ */
+int span_trace_start(void);
+
+/**
+ * 停止寫入執行緒、寫完剩餘 span 並結束 JSON 陣列 (關機時呼叫，Worker 必須已經停止)。
+ */
+void span_trace_shutdown(void);
+
+#endif // SPAN_TRACE_H
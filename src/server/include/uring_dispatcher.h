@@ -0,0 +1,20 @@
+/* src/server/include/uring_dispatcher.h */
+#ifndef URING_DISPATCHER_H
+#define URING_DISPATCHER_H
+
+/**
+ * 檢查核心是否支援 io_uring 後端需要的功能
+ * (multishot accept、provided buffer ring、RECV/SEND/CLOSE)。
+ * 在 Coordinator fork 之前呼叫一次，決定要不要啟用。
+ * return 1 = 支援, 0 = 不支援 (使用傳統阻塞式迴圈)
+ */
+int uring_dispatcher_supported(void);
+
+/**
+ * 以 io_uring 執行 Dispatcher 主迴圈：每個 Worker 一個 Ring，同時處理多條連線。
+ * Coordinator 要求退休時停止 accept，等連線都結束後回傳 0；
+ * 建立 Ring 失敗或 Ring 發生致命錯誤時清理並回傳 -1，呼叫端 (dispatcher_loop) 退回傳統迴圈。
+ */
+int uring_dispatcher_loop(int server_fd);
+
+#endif
@@ -0,0 +1,86 @@
+/* src/server/include/worker_pool.h */
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include "../../common/include/shared_data.h"
+#include "metrics.h"
+
+// Dispatcher 進程池：Coordinator 每個 tick 收屍、補上異常結束的 Worker，並依負載在 min ~ max 之間增減。
+//   擴充：忙碌比例 >= POOL_BUSY_HIGH_PCT 或 accept 佇列有連線在排隊
+//   回收：忙碌比例持續 < POOL_BUSY_LOW_PCT 達 idle 秒數，每個 tick 讓一個閒置的 Worker 退休
+// 退休由 Worker 自己完成 (處理完手上的連線才結束)，Coordinator 只設旗標並以 SIGUSR2 打斷阻塞的 accept。
+#define POOL_TICK_MS            100
+#define POOL_DEFAULT_MIN        8
+#define POOL_DEFAULT_IDLE_SECS  30
+#define POOL_BUSY_HIGH_PCT      75
+#define POOL_BUSY_LOW_PCT       40
+#define POOL_RETIRE_SIGNAL      SIGUSR2
+
+// fork 一個 Worker 到指定的格子。return 子進程 PID，失敗回傳 -1
+typedef pid_t (*WorkerSpawnFn)(int slot);
+
+// 目前進程的格子 (只有 Worker 有；Coordinator、bench 為 NULL)
+extern WorkerSlot *g_pool_self;
+
+/**
+ * 設定池子大小與回收前的清閒時間 (server_main 解析參數後呼叫)。
+ */
+void worker_pool_configure(int min_workers, int max_workers, int idle_secs);
+
+/**
+ * 初始化共享記憶體中的池子並 fork 最少數量的 Worker (Coordinator 呼叫)。
+ * return 啟動的 Worker 數
+ */
+int worker_pool_start(int server_fd, WorkerSpawnFn spawn);
+
+/**
+ * 子進程收屍後呼叫：退休的 Worker 釋放格子，其他原因結束的標記為待重生。
+ */
+void worker_pool_exited(pid_t pid, int status);
+
+/**
+ * 每 POOL_TICK_MS 呼叫一次：重生、更新負載數據、擴充或回收。
+ */
+void worker_pool_tick(void);
+
+/**
+ * 對所有 Worker 送出訊號 (關機時)。
+ */
+void worker_pool_kill_all(int sig);
+
+/**
+ * fork 之後在子進程呼叫：綁定自己的格子並安裝退休訊號的處理 (不設 SA_RESTART，阻塞的 accept 會返回 EINTR)。
+ */
+void worker_pool_attach(int slot);
+
+/**
+ * Worker 回報是否正在工作 (傳統迴圈：處理一條連線的期間為 1；io_uring：處理一批完成事件的期間為 1)。
+ * 只在 0 與非 0 之間轉換時讀時鐘。
+ */
+static inline void worker_pool_set_active(uint32_t active) {
+    WorkerSlot *self = g_pool_self;
+    if (self == NULL) return;
+    uint32_t prev = self->active;
+    __atomic_store_n(&self->active, active, __ATOMIC_RELAXED);
+    if ((prev == 0) == (active == 0)) return;
+
+    uint64_t now = metrics_now();
+    if (active != 0) {
+        __atomic_store_n(&self->busy_since_ns, now, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(&self->busy_ns, self->busy_ns + (now - self->busy_since_ns), __ATOMIC_RELAXED);
+        __atomic_store_n(&self->idle_since_ns, now, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Coordinator 是否要求這個 Worker 退休。
+ */
+static inline int worker_pool_retiring(void) {
+    return g_pool_self != NULL && __atomic_load_n(&g_pool_self->retire, __ATOMIC_RELAXED) != 0;
+}
+
+#endif // WORKER_POOL_H
@@ -76,8 +76,9 @@ void process_ride_request_insecure_wrapper(int client_fd, ProtocolHeader *in_hea
     // if (check_and_update_rate_limit(req->client_id)) { ... return; }
 
     // 業務處理 (單一呼叫 Service Layer)
-    int result = handle_ride_request_logic(req->client_id, resp_msg, sizeof(resp_msg));
-    (void)result;
+    RideResponseData resp;
+    handle_ride_request_logic(req->client_id, req->lat, req->lon, &resp);
+    ride_response_format_text(&resp, resp_msg, sizeof(resp_msg));
 
     // 網路回覆 (使用漏洞版的發送函式)
     send_response_packet_insecure(client_fd, resp_msg, strlen(resp_msg), OP_RESPONSE);
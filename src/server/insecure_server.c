@@ -14,6 +14,7 @@
 // 宣告 coordinator.c 中的函式
 extern void ipc_init(int driver_count);
 extern void ipc_cleanup();
+extern void save_state(void);
 extern void start_coordinator_process_insecure(int server_fd); 
 
 // 在這裡「定義」變數 (移除 extern)，給予實體空間
@@ -52,10 +53,12 @@ int main(int argc, char *argv[]) {
     // 5. 啟動 Coordinator-Dispatcher 機制
     start_coordinator_process_insecure(server_fd); 
 
-    // 6. 清理
+    // 6. 清理 (Worker 都已停止)
+    save_state();
     ipc_cleanup(); 
     close(server_fd);
     log_warn("Insecure Server shutdown completed.");
+    log_cleanup();
 
     return 0;
 }
\ No newline at end of file
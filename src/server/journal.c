@@ -0,0 +1,617 @@
+/* src/server/journal.c */
+// 預寫日誌 (Write-Ahead Log)
+// Snapshot (server.dat) 只在關機時寫入，當機就會遺失全部狀態。這裡把每次變更寫成一筆固定長度的記錄：
+//   1. Worker 在持有 state->mutex 時把記錄放進共享記憶體的環狀緩衝區 (只花一次 memcpy)
+//   2. Coordinator 的 flusher 執行緒一次取走所有待寫記錄，合併成一次 write() (group commit)
+//   3. 依落盤策略 fdatasync；JOURNAL_FSYNC_ALWAYS 時 Worker 等到自己的記錄落盤才回覆 Client
+// 重新啟動時 (--recover) 先載入 Snapshot，再重播 LSN 比 Snapshot 新的記錄。
+// 位置 / 油量等模擬狀態變化太頻繁，不寫日誌，以 Snapshot 為準。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../common/include/protocol.h"
+#include "../../common/include/shared_data.h"
+#include "../../common/include/log_system.h"
+#include "../include/coordinator.h"
+#include "../include/pricing_service.h"
+#include "../include/journal.h"
+
+extern volatile sig_atomic_t g_running;
+
+#define JOURNAL_IDLE_WAIT_MS 200    // 沒有新記錄時定期醒來檢查 g_running
+#define JOURNAL_CRC_KEY      0x57414c31ULL
+
+static JournalRing *g_journal = NULL;
+static int g_journal_fd = -1;
+static char g_journal_path[256];
+static char g_rotated_path[272];    // 輪替出去、等待 Snapshot 完成後刪除的舊檔 (<path>.1)
+static pthread_t g_flusher_tid;
+
+// 目前 WAL 檔的長度 (只算完整的批次) 與上一次 fdatasync 成功時的長度 (flusher 私有)
+// 寫入失敗截回 g_file_size，落盤失敗截回 g_synced_size：檔案中間不會留下寫到一半的記錄
+static off_t g_file_size = 0;
+static off_t g_synced_size = 0;
+
+// flusher 私有的寫入緩衝區 (一批最多整個環)
+static JournalRecord g_batch[JOURNAL_RING_SLOTS];
+
+static uint32_t record_crc(const JournalRecord *rec) {
+    return (uint32_t)keyed_digest(JOURNAL_CRC_KEY, (const uint8_t *)rec, offsetof(JournalRecord, crc));
+}
+
+/**
+ * 已經可以重用的 slot 到哪一筆：會落盤的策略要等 fdatasync 成功，落盤失敗時才能從環中重寫。
+ */
+static uint64_t reusable_lsn(const JournalRing *ring) {
+    return ring->fsync_policy == JOURNAL_FSYNC_NONE ? ring->written_lsn : ring->durable_lsn;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void deadline_after_ms(struct timespec *ts, int ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * ring->lock 是 robust 鎖：持鎖的 Worker 崩潰時由下一個取得鎖的人標記為一致並繼續
+ * (持鎖區段很短，最壞只是一筆寫到一半的記錄，重播時會被 CRC 擋下)。
+ */
+static void ring_recover(JournalRing *ring) {
+    pthread_mutex_consistent(&ring->lock);
+    log_warn("Journal lock owner died while holding it; recovered.");
+}
+
+static void ring_lock(JournalRing *ring) {
+    if (pthread_mutex_lock(&ring->lock) == EOWNERDEAD) ring_recover(ring);
+}
+
+/**
+ * 等待條件變數 (deadline 為 NULL 時不限時)；醒來重新取得鎖時同樣要處理 EOWNERDEAD。
+ */
+static void ring_wait(pthread_cond_t *cond, JournalRing *ring, const struct timespec *deadline) {
+    int rc = deadline != NULL ? pthread_cond_timedwait(cond, &ring->lock, deadline)
+                              : pthread_cond_wait(cond, &ring->lock);
+    if (rc == EOWNERDEAD) ring_recover(ring);
+}
+
+//  A. 初始化
+int journal_init(const char *path, int fsync_policy, int interval_ms, uint64_t last_lsn) {
+    snprintf(g_journal_path, sizeof(g_journal_path), "%s", path);
+    snprintf(g_rotated_path, sizeof(g_rotated_path), "%s.1", path);
+    g_journal_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (g_journal_fd < 0) {
+        log_error("Failed to open journal %s: %s", path, strerror(errno));
+        return -1;
+    }
+    // 上次當機留下的半筆記錄：截掉，否則之後附加的記錄全部錯位
+    off_t size = lseek(g_journal_fd, 0, SEEK_END);
+    if (size < 0) size = 0;
+    off_t whole = size - size % (off_t)sizeof(JournalRecord);
+    if (whole != size && ftruncate(g_journal_fd, whole) != 0) {
+        log_warn("Journal %s: cannot trim partial record: %s", path, strerror(errno));
+    }
+    g_file_size = whole;
+    g_synced_size = whole;
+
+    JournalRing *ring = mmap(NULL, sizeof(JournalRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        log_error("Journal mmap failed: %s", strerror(errno));
+        close(g_journal_fd);
+        g_journal_fd = -1;
+        return -1;
+    }
+    memset(ring, 0, sizeof(JournalRing));
+
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST); // Worker 在 journal_append 中崩潰，其他進程仍可接手
+    pthread_mutex_init(&ring->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ring->not_empty, &cattr);
+    pthread_cond_init(&ring->progress, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    ring->next_lsn = last_lsn + 1;
+    ring->written_lsn = last_lsn;
+    ring->durable_lsn = last_lsn;
+    ring->fsync_policy = (uint8_t)fsync_policy;
+    ring->interval_ms = interval_ms > 0 ? (uint32_t)interval_ms : JOURNAL_DEFAULT_INTERVAL_MS;
+
+    g_journal = ring;
+    return 0;
+}
+
+//  B. Worker 端
+uint64_t journal_append(JournalRecord *rec) {
+    JournalRing *ring = g_journal;
+    if (ring == NULL) return 0;
+
+    ring_lock(ring);
+    // 環滿了：等 flusher 寫出一批 (呼叫端持有 state->mutex，flusher 不碰那把鎖，不會死結)
+    if (ring->next_lsn - reusable_lsn(ring) > JOURNAL_RING_SLOTS) ring->full_waits++;
+    while (ring->next_lsn - reusable_lsn(ring) > JOURNAL_RING_SLOTS && ring->running) {
+        ring_wait(&ring->progress, ring, NULL);
+    }
+
+    uint64_t lsn = ring->next_lsn++;
+    rec->lsn = lsn;
+    memset(rec->reserved, 0, sizeof(rec->reserved));
+    rec->crc = record_crc(rec);
+    ring->slots[lsn & (JOURNAL_RING_SLOTS - 1)] = *rec;
+    ring->appended++;
+    pthread_cond_signal(&ring->not_empty);
+    pthread_mutex_unlock(&ring->lock);
+    return lsn;
+}
+
+void journal_commit(uint64_t lsn) {
+    JournalRing *ring = g_journal;
+    if (ring == NULL || lsn == 0 || ring->fsync_policy != JOURNAL_FSYNC_ALWAYS) return;
+
+    ring_lock(ring);
+    if (ring->durable_lsn < lsn) ring->commit_waits++;
+    while (ring->durable_lsn < lsn && ring->running) {
+        ring_wait(&ring->progress, ring, NULL);
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
+
+uint64_t journal_last_lsn(void) {
+    JournalRing *ring = g_journal;
+    if (ring == NULL) return 0;
+    ring_lock(ring);
+    uint64_t lsn = ring->next_lsn - 1;
+    pthread_mutex_unlock(&ring->lock);
+    return lsn;
+}
+
+//  C. Flusher
+/**
+ * 把 count 筆記錄寫入目前的 WAL 檔。
+ * return 0 = 成功, -1 = 寫入失敗
+ */
+static int write_records(const JournalRecord *recs, int count) {
+    size_t total = (size_t)count * sizeof(JournalRecord);
+    size_t done = 0;
+    while (done < total) {
+        ssize_t n = write(g_journal_fd, (const char *)recs + done, total - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("Journal write failed: %s", strerror(errno));
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * 附加一批記錄；失敗時把檔案截回這批之前的長度。
+ * return 0 = 成功, -1 = 失敗
+ */
+static int append_records(const JournalRecord *recs, int count) {
+    if (count <= 0) return 0;
+    if (write_records(recs, count) == 0) {
+        g_file_size += (off_t)count * (off_t)sizeof(JournalRecord);
+        return 0;
+    }
+    if (ftruncate(g_journal_fd, g_file_size) != 0) {
+        log_error("Journal truncate after failed write failed: %s", strerror(errno));
+    }
+    return -1;
+}
+
+/**
+ * fdatasync 目前的檔案；失敗時截回上一次成功落盤的長度 (之後的記錄由呼叫端從環中重寫)。
+ * return 0 = 成功, -1 = 失敗
+ */
+static int sync_file(void) {
+    if (fdatasync(g_journal_fd) == 0) {
+        g_synced_size = g_file_size;
+        return 0;
+    }
+    log_error("Journal fdatasync failed: %s", strerror(errno));
+    if (ftruncate(g_journal_fd, g_synced_size) != 0) {
+        log_error("Journal truncate after failed fdatasync failed: %s", strerror(errno));
+    }
+    g_file_size = g_synced_size;
+    return -1;
+}
+
+/**
+ * 輪替 WAL 檔：目前的檔案 (只含 Snapshot 會包含的記錄) 落盤後改名為 .1，之後的記錄寫進新檔。
+ * 上一次輪替的 .1 還在 (那次 Snapshot 失敗) 時不輪替，繼續寫在同一個檔案，重播時兩個檔案仍然連續。
+ * return 0 = 輪替點之前的記錄都已落盤, -1 = 落盤失敗 (沒有輪替)
+ */
+static int rotate_file(void) {
+    if (sync_file() < 0) return -1;
+    if (access(g_rotated_path, F_OK) == 0) return 0;
+
+    if (rename(g_journal_path, g_rotated_path) != 0) {
+        log_warn("Journal rotate failed: %s", strerror(errno));
+        return 0;
+    }
+    int fd = open(g_journal_path, O_WRONLY | O_CREAT | O_APPEND | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        // 開不了新檔就改回原名繼續寫，避免新記錄跟著 .1 一起被刪掉
+        log_warn("Journal rotate failed: %s", strerror(errno));
+        rename(g_rotated_path, g_journal_path);
+        return 0;
+    }
+    // 改名與新檔要落盤，否則當機後 .1 可能不存在；失敗時 drop_rotated 會再試一次，不會先刪除
+    if (journal_sync_dir(g_journal_path) != 0) {
+        log_warn("Journal rotate directory fsync failed: %s", strerror(errno));
+    }
+    close(g_journal_fd);
+    g_journal_fd = fd;
+    g_file_size = 0;
+    g_synced_size = 0;
+    return 0;
+}
+
+static void *journal_flusher_thread(void *arg) {
+    (void)arg;
+    JournalRing *ring = g_journal;
+    double last_sync_ms = now_ms();
+
+    // SIGINT 必須由其他執行緒處理：關機流程會 join 這個執行緒
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    ring_lock(ring);
+    while (1) {
+        // 等待新記錄或輪替要求；間隔落盤策略下，閒置時也要把已寫入但未落盤的部分補上 fdatasync
+        while (ring->next_lsn - 1 == ring->written_lsn && ring->running && !ring->rotate_requested) {
+            if (ring->fsync_policy == JOURNAL_FSYNC_INTERVAL && ring->durable_lsn < ring->written_lsn &&
+                now_ms() - last_sync_ms >= ring->interval_ms) {
+                break;
+            }
+            struct timespec deadline;
+            deadline_after_ms(&deadline, ring->fsync_policy == JOURNAL_FSYNC_INTERVAL ? (int)ring->interval_ms : JOURNAL_IDLE_WAIT_MS);
+            ring_wait(&ring->not_empty, ring, &deadline);
+        }
+
+        uint64_t first = ring->written_lsn + 1;
+        uint64_t last = ring->next_lsn - 1;
+        int rotate = ring->rotate_requested;
+        uint64_t rotate_lsn = ring->rotate_lsn;
+        ring->rotate_requested = 0;
+        if (last < first && !ring->running && !rotate) break;
+
+        int count = (int)(last + 1 - first);
+        for (int i = 0; i < count; i++) {
+            g_batch[i] = ring->slots[(first + i) & (JOURNAL_RING_SLOTS - 1)];
+        }
+        int policy = ring->fsync_policy;
+        int need_sync = (policy == JOURNAL_FSYNC_ALWAYS && count > 0) ||
+                        (policy == JOURNAL_FSYNC_INTERVAL && now_ms() - last_sync_ms >= ring->interval_ms &&
+                         (count > 0 || ring->durable_lsn < ring->written_lsn)) ||
+                        (policy == JOURNAL_FSYNC_INTERVAL && ring->next_lsn - ring->durable_lsn > JOURNAL_RING_SLOTS / 2);
+        pthread_mutex_unlock(&ring->lock);
+
+        // 鎖外寫檔：寫入期間 Worker 可以繼續附加 (下一批)
+        // 輪替點之前的記錄留在舊檔 (要求輪替時已全部附加，所以一定在這一批或更早)
+        int split = rotate ? (int)(rotate_lsn + 1 - first) : count;
+        uint64_t done = first - 1;  // 已完整寫入的最後 LSN
+        int rotated = 0;
+        int sync_failed = 0;
+        int ok = (append_records(g_batch, split) == 0);
+        if (ok) done += (uint64_t)split;
+        if (ok && rotate) {
+            ok = (rotate_file() == 0);
+            rotated = ok;
+            sync_failed = !ok;
+        }
+        if (ok && split < count) {
+            ok = (append_records(g_batch + split, count - split) == 0);
+            if (ok) done = last;
+        }
+        int synced = 0;
+        if (ok && need_sync) {
+            ok = (sync_file() == 0);
+            synced = ok;
+            sync_failed = !ok;
+            last_sync_ms = now_ms();
+        }
+
+        ring_lock(ring);
+        // 失敗 (例如磁碟已滿) 時不前進：檔案已截回失敗前的位置，記錄還在環中，稍後整批重寫。
+        // 這段期間 always 策略的回覆會一直等待，環滿時附加也會等待，不會回報沒有落盤的變更
+        if (rotated && ring->durable_lsn < rotate_lsn) ring->durable_lsn = rotate_lsn;
+        ring->written_lsn = sync_failed ? ring->durable_lsn : done;
+        if (synced) ring->durable_lsn = done;
+        if (synced) ring->fsyncs++;
+        if (count > 0) ring->batches++;
+        if ((uint64_t)count > ring->max_batch) ring->max_batch = count;
+        if (rotated) ring->rotated_lsn = rotate_lsn;
+        if (rotate && !rotated) {
+            ring->rotate_requested = 1; // 輪替點不變，下一輪再試
+            ring->rotate_lsn = rotate_lsn;
+        }
+        if (!ok) {
+            ring->io_errors++;
+            if (!ring->io_error) log_error("Journal I/O failed; holding records in memory and retrying.");
+            ring->io_error = 1;
+        } else if (ring->io_error) {
+            ring->io_error = 0;
+            log_info("Journal I/O recovered after %lu failed batches.", ring->io_errors);
+        }
+        pthread_cond_broadcast(&ring->progress);
+
+        if (!ok && ring->running) {
+            // 稍後重試 (不要在磁碟滿的時候空轉)
+            struct timespec deadline;
+            deadline_after_ms(&deadline, JOURNAL_IDLE_WAIT_MS);
+            ring_wait(&ring->progress, ring, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return NULL;
+}
+
+int journal_start(void) {
+    if (g_journal == NULL) return 0;
+    g_journal->running = 1;
+    if (pthread_create(&g_flusher_tid, NULL, journal_flusher_thread, NULL) != 0) {
+        g_journal->running = 0;
+        log_error("Failed to start journal flusher.");
+        return -1;
+    }
+    static const char *policy_names[] = {"always", "interval", "none"};
+    log_info("Journal flusher started (fsync=%s, interval %u ms).",
+             policy_names[g_journal->fsync_policy], g_journal->interval_ms);
+    return 0;
+}
+
+uint64_t journal_shutdown(void) {
+    JournalRing *ring = g_journal;
+    if (ring == NULL) return 0;
+
+    ring_lock(ring);
+    int was_running = ring->running;
+    ring->running = 0;
+    pthread_cond_broadcast(&ring->not_empty);
+    pthread_cond_broadcast(&ring->progress);
+    pthread_mutex_unlock(&ring->lock);
+    if (was_running) pthread_join(g_flusher_tid, NULL);
+
+    // flusher 沒啟動過 (或已停止) 時自己把剩餘記錄寫完
+    uint64_t first = ring->written_lsn + 1;
+    uint64_t last = ring->next_lsn - 1;
+    if (last >= first) {
+        int count = (int)(last + 1 - first);
+        for (int i = 0; i < count; i++) g_batch[i] = ring->slots[(first + i) & (JOURNAL_RING_SLOTS - 1)];
+        if (append_records(g_batch, count) == 0) ring->written_lsn = last;
+    }
+    if (sync_file() == 0) {
+        ring->durable_lsn = ring->written_lsn;
+    } else {
+        ring->written_lsn = ring->durable_lsn;
+    }
+    if (ring->written_lsn < last) {
+        log_error("Journal: records after LSN %lu could not be written.", ring->written_lsn);
+    }
+
+    log_info("Journal: %lu records, %lu batches (max %lu), %lu fsyncs, %lu full waits, %lu commit waits, %lu I/O errors.",
+             ring->appended, ring->batches, ring->max_batch, ring->fsyncs, ring->full_waits, ring->commit_waits,
+             ring->io_errors);
+    return ring->written_lsn;
+}
+
+void journal_truncate(uint64_t lsn) {
+    JournalRing *ring = g_journal;
+    if (ring == NULL) return;
+
+    ring_lock(ring);
+    // 只有檔案中的記錄都已包含在 Snapshot 裡才能清空
+    if (ring->written_lsn <= lsn) {
+        if (ftruncate(g_journal_fd, 0) == 0) {
+            g_file_size = 0;
+            g_synced_size = 0;
+            if (fdatasync(g_journal_fd) != 0) log_warn("Journal truncate fdatasync failed: %s", strerror(errno));
+        } else {
+            log_warn("Journal truncate failed: %s", strerror(errno));
+        }
+        // 呼叫端已確認 Snapshot 的 rename 落盤 (snapshot_write 會 fsync 目錄)
+        unlink(g_rotated_path);
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
+
+uint64_t journal_rotate(void) {
+    JournalRing *ring = g_journal;
+    if (ring == NULL) return 0;
+
+    ring_lock(ring);
+    uint64_t lsn = ring->next_lsn - 1;
+    if (ring->running) {
+        ring->rotate_lsn = lsn;
+        ring->rotate_requested = 1;
+        pthread_cond_signal(&ring->not_empty);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return lsn;
+}
+
+void journal_drop_rotated(uint64_t lsn) {
+    JournalRing *ring = g_journal;
+    if (ring == NULL) return;
+
+    ring_lock(ring);
+    while (ring->rotated_lsn < lsn && ring->running) {
+        ring_wait(&ring->progress, ring, NULL);
+    }
+    int rotated = (ring->rotated_lsn >= lsn);
+    pthread_mutex_unlock(&ring->lock);
+    if (!rotated) return;
+
+    // 刪除前目錄必須已落盤 (Snapshot 的 rename 與輪替)：否則當機後可能只剩舊 Snapshot 而 .1 已經不見
+    if (journal_sync_dir(g_rotated_path) != 0) {
+        log_warn("Journal directory fsync failed, keeping %s: %s", g_rotated_path, strerror(errno));
+        return;
+    }
+    unlink(g_rotated_path);
+}
+
+int journal_sync_dir(const char *path) {
+    char dir[256];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) {
+        snprintf(dir, sizeof(dir), ".");
+    } else if (slash == path) {
+        snprintf(dir, sizeof(dir), "/");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int result = fsync(fd);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return result;
+}
+
+int journal_has_records(const char *path) {
+    char rotated[272];
+    snprintf(rotated, sizeof(rotated), "%s.1", path);
+    struct stat st;
+    if (stat(path, &st) == 0 && st.st_size >= (off_t)sizeof(JournalRecord)) return 1;
+    if (stat(rotated, &st) == 0 && st.st_size >= (off_t)sizeof(JournalRecord)) return 1;
+    return 0;
+}
+
+//  D. 重播
+static int find_driver_index(SharedState *state, uint32_t driver_id) {
+    for (int i = 0; i < state->driver_count; i++) {
+        if (state->drivers[i].driver_id == driver_id) return i;
+    }
+    return -1;
+}
+
+/**
+ * 把一筆記錄套用到狀態上 (與產生記錄時的變更相同)。
+ */
+static void apply_record(SharedState *state, const JournalRecord *rec) {
+    int idx = find_driver_index(state, rec->driver_id);
+
+    switch (rec->type) {
+        case JOURNAL_DRIVER_JOIN:
+            if (idx < 0) register_driver_locked(rec->driver_id);
+            break;
+
+        case JOURNAL_DISPATCH: {
+            state->total_requests_handled++;
+            state->total_success_requests++;
+            state->total_revenue += rec->fare;
+            if (rec->ride_id > state->next_ride_id) state->next_ride_id = rec->ride_id;
+            if (idx < 0) break;
+            Driver *d = &state->drivers[idx];
+            d->is_available = 0;
+            d->rides_count++;
+            d->fuel--;
+            d->has_target = 1;
+            d->target_lat = rec->lat_e7 / LOC_COORD_SCALE;
+            d->target_lon = rec->lon_e7 / LOC_COORD_SCALE;
+            break;
+        }
+
+        case JOURNAL_COMPLETE: {
+            if (idx < 0) break;
+            Driver *d = &state->drivers[idx];
+            d->has_target = 0;
+            d->is_available = 1;
+            d->is_refueling = 0;
+            d->lat = rec->lat_e7 / LOC_COORD_SCALE;
+            d->lon = rec->lon_e7 / LOC_COORD_SCALE;
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+/**
+ * 重播一個 WAL 檔。
+ * return 0 = 讀到檔尾, -1 = 遇到損毀 / 不連續的記錄 (之後的檔案也不能再套用)
+ */
+static int replay_file(const char *path, SharedState *state, uint64_t *last_lsn, uint64_t *applied, uint64_t *skipped) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    JournalRecord rec;
+    int result = 0;
+    ssize_t n;
+    while ((n = read(fd, &rec, sizeof(rec))) == (ssize_t)sizeof(rec)) {
+        if (rec.crc != record_crc(&rec)) {
+            log_warn("Journal record after LSN %lu in %s is corrupted. Stopping replay.", *last_lsn, path);
+            result = -1;
+            break;
+        }
+        if (rec.lsn <= *last_lsn) {
+            (*skipped)++; // 已包含在 Snapshot 中
+            continue;
+        }
+        if (rec.lsn != *last_lsn + 1) {
+            log_warn("Journal gap in %s: expected LSN %lu, found %lu. Stopping replay.", path, *last_lsn + 1, rec.lsn);
+            result = -1;
+            break;
+        }
+        apply_record(state, &rec);
+        *last_lsn = rec.lsn;
+        (*applied)++;
+    }
+    if (n > 0 && n < (ssize_t)sizeof(rec)) {
+        log_warn("Journal %s ends with a partial record (torn write). Ignored.", path);
+    }
+    close(fd);
+    return result;
+}
+
+uint64_t journal_replay(const char *path, SharedState *state) {
+    uint64_t last_lsn = state->journal_lsn;
+    uint64_t applied = 0, skipped = 0;
+    char rotated[272];
+
+    // 先重播輪替出去的舊檔 (上次 Snapshot 還沒完成就當機時才會存在)，再重播目前的檔案
+    snprintf(rotated, sizeof(rotated), "%s.1", path);
+    if (replay_file(rotated, state, &last_lsn, &applied, &skipped) == 0) {
+        replay_file(path, state, &last_lsn, &applied, &skipped);
+    }
+
+    pricing_rebuild_zones(state);
+    state->journal_lsn = last_lsn;
+    log_info("Journal replay: %lu records applied, %lu already in snapshot, last LSN %lu.", applied, skipped, last_lsn);
+    return last_lsn;
+}
@@ -0,0 +1,238 @@
+/* src/server/location_service.c */
+// UDP 司機定位回報 (OP_UPDATE_LOC)
+// 司機每幾秒回報一次 GPS，若每次都開一條 TCP 連線 + 握手，連線數會比叫車請求多好幾個數量級。
+// 這裡改用無連線的 UDP：
+//   1. recvmmsg 一次讀進一整批 Datagram
+//   2. 在鎖外驗證長度與標籤 (每位司機一把由車隊金鑰衍生的金鑰)
+//   3. 整批只上鎖一次寫入司機表，序號比現有的新才套用 (last-writer-wins)，同時同步區域計數器
+#define _GNU_SOURCE // recvmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "../../common/include/protocol.h"
+#include "../../common/include/shared_data.h"
+#include "../../common/include/log_system.h"
+#include "../include/location_service.h"
+#include "../include/pricing_service.h"
+#include "../include/lock_profile.h"
+
+extern SharedState *g_shared_state;
+extern volatile sig_atomic_t g_running;
+
+#define LOCATION_RCVBUF_BYTES (4 * 1024 * 1024) // 回報尖峰時吸收突發流量
+#define DRIVER_INDEX_SLOTS    (MAX_DRIVERS * 2) // driver_id → 陣列索引 的開放定址表 (2 的冪次)
+
+static int g_udp_port = 0;
+static uint64_t g_fleet_key = DRIVER_FLEET_KEY_NONE;
+static int g_udp_fd = -1;
+
+// 接收執行緒私有的司機索引：司機只會附加到陣列尾端，所以只需補上新增的部分
+static int16_t g_driver_index[DRIVER_INDEX_SLOTS];
+static int g_indexed_count = 0;
+
+void location_service_configure(int udp_port, uint64_t fleet_key) {
+    g_udp_port = udp_port;
+    g_fleet_key = fleet_key;
+}
+
+int location_driver_auth_enabled(void) {
+    return g_fleet_key != DRIVER_FLEET_KEY_NONE;
+}
+
+uint64_t location_driver_key(uint32_t driver_id) {
+    return driver_location_key(g_fleet_key, driver_id);
+}
+
+double location_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int location_is_live(const Driver *driver, double now) {
+    return driver->loc_updated > 0 && now - driver->loc_updated < LOCATION_LIVE_SECS;
+}
+
+//  A. 司機索引 (呼叫端持有 mutex)
+static unsigned index_slot(uint32_t driver_id) {
+    return (driver_id * 2654435761u) & (DRIVER_INDEX_SLOTS - 1);
+}
+
+/**
+ * 把上次之後新加入的司機補進索引。
+ */
+static void refresh_driver_index(SharedState *state) {
+    if (g_indexed_count == 0) {
+        memset(g_driver_index, 0xff, sizeof(g_driver_index)); // 全部設為 -1 (空)
+    }
+    while (g_indexed_count < state->driver_count) {
+        int idx = g_indexed_count++;
+        unsigned slot = index_slot(state->drivers[idx].driver_id);
+        while (g_driver_index[slot] >= 0) slot = (slot + 1) & (DRIVER_INDEX_SLOTS - 1);
+        g_driver_index[slot] = (int16_t)idx;
+    }
+}
+
+/**
+ * return 司機在陣列中的索引，找不到回傳 -1。
+ */
+static int find_driver(SharedState *state, uint32_t driver_id) {
+    unsigned slot = index_slot(driver_id);
+    while (g_driver_index[slot] >= 0) {
+        int idx = g_driver_index[slot];
+        if (state->drivers[idx].driver_id == driver_id) return idx;
+        slot = (slot + 1) & (DRIVER_INDEX_SLOTS - 1);
+    }
+    return -1;
+}
+
+//  B. 批次套用
+/**
+ * 在鎖外驗證一個 Datagram。
+ * return 1 = 可套用, 0 = 長度 / Opcode / 標籤錯誤
+ */
+static int validate_datagram(const LocationUpdateDatagram *dgram, const struct mmsghdr *msg) {
+    if (msg->msg_len != sizeof(LocationUpdateDatagram) || (msg->msg_hdr.msg_flags & MSG_TRUNC)) return 0;
+    if (dgram->opcode != OP_UPDATE_LOC) return 0;
+    return location_datagram_verify(dgram, location_driver_key(dgram->driver_id));
+}
+
+/**
+ * 整批只上鎖一次：依序號套用 (同一批內同一司機的多筆回報也依序號取最新)。
+ */
+static void apply_batch(const LocationUpdateDatagram *dgrams, const int *valid, int count) {
+    double now = location_now();
+    uint64_t applied = 0, stale = 0, rejected = 0;
+
+    uint64_t lock_token = state_lock(LOCK_SITE_LOCATION_BATCH);
+    refresh_driver_index(g_shared_state);
+
+    for (int i = 0; i < count; i++) {
+        if (!valid[i]) {
+            rejected++;
+            continue;
+        }
+        int idx = find_driver(g_shared_state, dgrams[i].driver_id);
+        if (idx < 0) {
+            rejected++;
+            continue;
+        }
+
+        Driver *d = &g_shared_state->drivers[idx];
+        // 序號比較採用回繞安全的差值判斷 (RFC 1982 serial number arithmetic)
+        if (d->loc_updated > 0 && (int32_t)(dgrams[i].seq - d->loc_seq) <= 0) {
+            stale++;
+            continue;
+        }
+
+        d->loc_seq = dgrams[i].seq;
+        d->loc_updated = now;
+        d->lat = dgrams[i].lat_e7 / LOC_COORD_SCALE;
+        d->lon = dgrams[i].lon_e7 / LOC_COORD_SCALE;
+        pricing_sync_driver(g_shared_state, idx); // 位置改變可能跨區，O(1) 修正區域計數
+        applied++;
+    }
+
+    LocationIngestStats *stats = &g_shared_state->location;
+    stats->received += count;
+    stats->applied += applied;
+    stats->stale += stale;
+    stats->rejected += rejected;
+    stats->batches++;
+    state_unlock(LOCK_SITE_LOCATION_BATCH, lock_token);
+}
+
+//  C. 接收執行緒
+static void *location_listener_thread(void *arg) {
+    (void)arg;
+    LocationUpdateDatagram dgrams[LOCATION_BATCH_SIZE];
+    struct iovec iovs[LOCATION_BATCH_SIZE];
+    struct mmsghdr msgs[LOCATION_BATCH_SIZE];
+    int valid[LOCATION_BATCH_SIZE];
+
+    // SIGINT 必須由主執行緒處理：它的等待被打斷後才會開始關機流程
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    for (int i = 0; i < LOCATION_BATCH_SIZE; i++) {
+        iovs[i].iov_base = &dgrams[i];
+        iovs[i].iov_len = sizeof(LocationUpdateDatagram);
+    }
+
+    while (g_running) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < LOCATION_BATCH_SIZE; i++) {
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // MSG_WAITFORONE：等到第一個 Datagram 後，把已經到達的全部帶走就返回
+        int n = recvmmsg(g_udp_fd, msgs, LOCATION_BATCH_SIZE, MSG_WAITFORONE, NULL);
+        if (n <= 0) continue; // 逾時 (回頭檢查 g_running) 或被訊號中斷
+
+        for (int i = 0; i < n; i++) {
+            valid[i] = validate_datagram(&dgrams[i], &msgs[i]);
+        }
+        if (g_shared_state) apply_batch(dgrams, valid, n);
+    }
+
+    close(g_udp_fd);
+    g_udp_fd = -1;
+    return NULL;
+}
+
+int location_service_start(void) {
+    if (g_udp_port <= 0) {
+        log_info("UDP location ingestion disabled.");
+        return 0;
+    }
+    if (!location_driver_auth_enabled()) {
+        log_info("UDP location ingestion disabled (no --fleet-key).");
+        return 0;
+    }
+
+    g_udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (g_udp_fd < 0) {
+        log_error("UDP location socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    int rcvbuf = LOCATION_RCVBUF_BYTES;
+    setsockopt(g_udp_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    // 定期逾時，讓執行緒能看到 g_running 變化
+    struct timeval tv = {0, 200 * 1000};
+    setsockopt(g_udp_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(g_udp_port);
+    if (bind(g_udp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        log_error("UDP location bind on port %d failed: %s", g_udp_port, strerror(errno));
+        close(g_udp_fd);
+        g_udp_fd = -1;
+        return -1;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, location_listener_thread, NULL) != 0) {
+        close(g_udp_fd);
+        g_udp_fd = -1;
+        return -1;
+    }
+    pthread_detach(tid);
+    log_info("UDP location listener started on port %d.", g_udp_port);
+    return 0;
+}
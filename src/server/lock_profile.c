@@ -0,0 +1,232 @@
+/* src/server/lock_profile.c */
+// state->mutex 的競爭分析：計時路徑與報表 (關閉時的快速路徑在 lock_profile.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <time.h>
+
+#include "../../common/include/shared_data.h"
+#include "../../common/include/log_system.h"
+#include "../include/lock_profile.h"
+
+static const char *const g_site_names[LOCK_SITE_COUNT] = {
+    "ride_match", "driver_join", "map_tick", "location_batch",
+    "driver_attach", "driver_detach", "ticket_rotate", "snapshot"
+};
+
+static int g_lockprof_slot = 0;
+static volatile sig_atomic_t g_toggle_requested = 0;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+const char *lock_site_name(LockSite site) {
+    return (site >= 0 && site < LOCK_SITE_COUNT) ? g_site_names[site] : "unknown";
+}
+
+void lock_profile_attach(int slot) {
+    g_lockprof_slot = (slot >= 0 && slot < LOCKPROF_SLOTS) ? slot : 0;
+}
+
+//  A. 計時路徑
+static int bucket_of(uint64_t ns) {
+    int b = 64 - __builtin_clzll(ns | 1) - LOCKPROF_MIN_SHIFT;
+    if (b < 0) b = 0;
+    if (b > LOCKPROF_BUCKETS) b = LOCKPROF_BUCKETS;
+    return b;
+}
+
+static void store_max(uint64_t *field, uint64_t v) {
+    uint64_t cur = __atomic_load_n(field, __ATOMIC_RELAXED);
+    while (v > cur && !__atomic_compare_exchange_n(field, &cur, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Coordinator 那一格有多個執行緒 (地圖、UDP、Snapshot) 同時寫入，所以一律用 atomic 加法
+static LockSiteStats *site_stats(LockSite site) {
+    return &g_shared_state->lock_profile.slots[g_lockprof_slot].sites[site];
+}
+
+void state_lock_recover(LockSite site) {
+    pthread_mutex_consistent(&g_shared_state->mutex);
+    log_warn("State mutex owner died while holding it; recovered at %s (state may be partially updated).",
+             lock_site_name(site));
+}
+
+uint64_t lock_profile_acquire(LockSite site) {
+    LockSiteStats *st = site_stats(site);
+    uint64_t t0 = mono_ns();
+    int rc = pthread_mutex_trylock(&g_shared_state->mutex);
+    if (rc == EBUSY) {
+        rc = pthread_mutex_lock(&g_shared_state->mutex);
+        __atomic_fetch_add(&st->contended, 1, __ATOMIC_RELAXED);
+    }
+    if (rc == EOWNERDEAD) state_lock_recover(site);
+    uint64_t t1 = mono_ns();
+    uint64_t wait = t1 - t0;
+
+    __atomic_fetch_add(&st->acquisitions, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->wait_ns, wait, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->wait_buckets[bucket_of(wait)], 1, __ATOMIC_RELAXED);
+    store_max(&st->max_wait_ns, wait);
+    return t1 != 0 ? t1 : 1; // 0 代表沒有計時
+}
+
+void lock_profile_release(LockSite site, uint64_t acquired_ns) {
+    uint64_t hold = mono_ns() - acquired_ns;
+    pthread_mutex_unlock(&g_shared_state->mutex);
+
+    LockSiteStats *st = site_stats(site);
+    __atomic_fetch_add(&st->hold_ns, hold, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->hold_buckets[bucket_of(hold)], 1, __ATOMIC_RELAXED);
+    store_max(&st->max_hold_ns, hold);
+}
+
+//  B. 開關 (Coordinator)
+void lock_profile_set(int enabled) {
+    LockProfile *prof = &g_shared_state->lock_profile;
+    int running = __atomic_load_n(&prof->enabled, __ATOMIC_RELAXED) != 0;
+
+    if (enabled && !running) {
+        // 先清空再開啟：取鎖端看到 enabled 時上一輪的數據已經歸零
+        memset(prof->slots, 0, sizeof(prof->slots));
+        prof->since_ns = mono_ns();
+        prof->until_ns = 0;
+        __atomic_store_n(&prof->enabled, 1, __ATOMIC_RELEASE);
+        log_info("Lock profiling enabled (send SIGUSR1 again to stop and report).");
+    } else if (!enabled && running) {
+        __atomic_store_n(&prof->enabled, 0, __ATOMIC_RELEASE);
+        prof->until_ns = mono_ns();
+        lock_profile_report();
+    }
+}
+
+void lock_profile_request_toggle(int sig) {
+    (void)sig;
+    g_toggle_requested = 1;
+}
+
+void lock_profile_poll(void) {
+    if (!g_toggle_requested) return;
+    g_toggle_requested = 0;
+    lock_profile_set(!__atomic_load_n(&g_shared_state->lock_profile.enabled, __ATOMIC_RELAXED));
+}
+
+//  C. 報表
+typedef struct {
+    int site;
+    LockSiteStats total;
+} SiteTotal;
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+} Writer;
+
+static void __attribute__((format(printf, 2, 3))) emit(Writer *w, const char *fmt, ...) {
+    if (w->len + 1 >= w->cap) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, w->cap - w->len, fmt, args);
+    va_end(args);
+    if (n > 0) w->len += (size_t)n < w->cap - w->len ? (size_t)n : w->cap - w->len - 1;
+}
+
+static void sum_site(const LockProfile *prof, int site, LockSiteStats *out) {
+    memset(out, 0, sizeof(*out));
+    for (int s = 0; s < LOCKPROF_SLOTS; s++) {
+        const LockSiteStats *st = &prof->slots[s].sites[site];
+        if (__atomic_load_n(&st->acquisitions, __ATOMIC_RELAXED) == 0) continue;
+        out->acquisitions += __atomic_load_n(&st->acquisitions, __ATOMIC_RELAXED);
+        out->contended += __atomic_load_n(&st->contended, __ATOMIC_RELAXED);
+        out->wait_ns += __atomic_load_n(&st->wait_ns, __ATOMIC_RELAXED);
+        out->hold_ns += __atomic_load_n(&st->hold_ns, __ATOMIC_RELAXED);
+        uint64_t mw = __atomic_load_n(&st->max_wait_ns, __ATOMIC_RELAXED);
+        uint64_t mh = __atomic_load_n(&st->max_hold_ns, __ATOMIC_RELAXED);
+        if (mw > out->max_wait_ns) out->max_wait_ns = mw;
+        if (mh > out->max_hold_ns) out->max_hold_ns = mh;
+        for (int b = 0; b <= LOCKPROF_BUCKETS; b++) {
+            out->wait_buckets[b] += __atomic_load_n(&st->wait_buckets[b], __ATOMIC_RELAXED);
+            out->hold_buckets[b] += __atomic_load_n(&st->hold_buckets[b], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * 由直方圖估計 p99：回傳落點那一格的上界 (最後一格回傳觀察到的最大值)。
+ */
+static double p99_us(const uint64_t *buckets, uint64_t max_ns) {
+    uint64_t count = 0;
+    for (int b = 0; b <= LOCKPROF_BUCKETS; b++) count += buckets[b];
+    if (count == 0) return 0.0;
+    uint64_t target = count - count / 100, seen = 0;
+    for (int b = 0; b < LOCKPROF_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= target) {
+            double bound = (double)(1ULL << (b + LOCKPROF_MIN_SHIFT));
+            return (bound < (double)max_ns ? bound : (double)max_ns) / 1e3;
+        }
+    }
+    return max_ns / 1e3;
+}
+
+static int by_wait_desc(const void *a, const void *b) {
+    const SiteTotal *x = a, *y = b;
+    if (x->total.wait_ns != y->total.wait_ns) return x->total.wait_ns < y->total.wait_ns ? 1 : -1;
+    return x->site - y->site;
+}
+
+size_t lock_profile_render(const SharedState *state, char *out, size_t cap) {
+    Writer w = { out, cap, 0 };
+    if (cap == 0) return 0;
+    out[0] = '\0';
+    const LockProfile *prof = &state->lock_profile;
+
+    SiteTotal totals[LOCK_SITE_COUNT];
+    uint64_t acquisitions = 0, contended = 0, hold_ns = 0;
+    for (int i = 0; i < LOCK_SITE_COUNT; i++) {
+        totals[i].site = i;
+        sum_site(prof, i, &totals[i].total);
+        acquisitions += totals[i].total.acquisitions;
+        contended += totals[i].total.contended;
+        hold_ns += totals[i].total.hold_ns;
+    }
+    qsort(totals, LOCK_SITE_COUNT, sizeof(SiteTotal), by_wait_desc);
+
+    uint64_t until = prof->until_ns != 0 ? prof->until_ns : mono_ns();
+    double elapsed = prof->since_ns != 0 && until > prof->since_ns ? (until - prof->since_ns) / 1e9 : 0.0;
+    emit(&w, "state->mutex over %.1f s: held %.1f%% of the time, %lu acquisitions, %.1f%% contended\n",
+         elapsed, elapsed > 0 ? hold_ns / 1e9 / elapsed * 100.0 : 0.0, acquisitions,
+         acquisitions > 0 ? contended * 100.0 / acquisitions : 0.0);
+    emit(&w, "%-15s %10s %7s | %10s %9s %9s %9s | %10s %9s %9s %9s\n",
+         "site", "acquires", "contend", "wait ms", "avg us", "p99 us", "max us",
+         "hold ms", "avg us", "p99 us", "max us");
+    for (int i = 0; i < LOCK_SITE_COUNT; i++) {
+        const LockSiteStats *t = &totals[i].total;
+        if (t->acquisitions == 0) continue;
+        emit(&w, "%-15s %10lu %6.1f%% | %10.2f %9.2f %9.2f %9.2f | %10.2f %9.2f %9.2f %9.2f\n",
+             lock_site_name(totals[i].site), t->acquisitions, t->contended * 100.0 / t->acquisitions,
+             t->wait_ns / 1e6, t->wait_ns / 1e3 / t->acquisitions,
+             p99_us(t->wait_buckets, t->max_wait_ns), t->max_wait_ns / 1e3,
+             t->hold_ns / 1e6, t->hold_ns / 1e3 / t->acquisitions,
+             p99_us(t->hold_buckets, t->max_hold_ns), t->max_hold_ns / 1e3);
+    }
+    return w.len;
+}
+
+void lock_profile_report(void) {
+    if (g_shared_state == NULL || g_shared_state->lock_profile.since_ns == 0) return;
+
+    char report[LOCKPROF_REPORT_MAX];
+    lock_profile_render(g_shared_state, report, sizeof(report));
+    char *save = NULL;
+    for (char *line = strtok_r(report, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+        log_info("[LockProfile] %s", line);
+    }
+}
@@ -11,6 +11,10 @@
 #include "../../common/include/shared_data.h"
 #include "../include/map_monitor.h"
 #include "../include/pathfinding.h" 
+#include "../include/pricing_service.h"
+#include "../include/location_service.h"
+#include "../include/journal.h"
+#include "../include/lock_profile.h"
 
 extern SharedState *g_shared_state;
 extern volatile sig_atomic_t g_running; 
@@ -24,6 +28,13 @@ extern volatile sig_atomic_t g_running;
 void *map_monitor_thread(void *arg) {
     (void)arg;
     char map[MAP_HEIGHT][MAP_WIDTH];
+
+    // SIGINT 必須由主執行緒處理：它的等待被打斷後才會開始關機流程
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
     srand(time(NULL) + getpid());
     setvbuf(stdout, NULL, _IONBF, 0);
 
@@ -31,16 +42,20 @@ void *map_monitor_thread(void *arg) {
 
     while (g_running) {
         if (g_shared_state) {
-            pthread_mutex_lock(&g_shared_state->mutex);
+            uint64_t lock_token = state_lock(LOCK_SITE_MAP_TICK);
+            double now = location_now();
             
             for (int i = 0; i < g_shared_state->driver_count; i++) {
                 Driver *d = &g_shared_state->drivers[i];
+                // 有即時 GPS 回報的司機：位置以回報為準，不做重生與模擬移動
+                int gps_live = location_is_live(d, now);
+                int had_target = d->has_target;
 
                 int gy = (int)((d->lat - BASE_LAT) * SCALE_FACTOR);
                 int gx = (int)((d->lon - BASE_LON) * SCALE_FACTOR);
                 
                 // 1. 防卡牆 (重生機制)
-                if (is_obstacle(gx, gy) || gx < 0 || gx >= MAP_WIDTH || gy < 0 || gy >= MAP_HEIGHT) {
+                if (!gps_live && (is_obstacle(gx, gy) || gx < 0 || gx >= MAP_WIDTH || gy < 0 || gy >= MAP_HEIGHT)) {
                     d->lat = BASE_LAT; d->lon = BASE_LON;
                     d->has_target = 0; d->is_available = 1; d->is_refueling = 0;
                 }
@@ -95,7 +110,10 @@ void *map_monitor_thread(void *arg) {
                 }
 
                 // 5. 移動核心
-                if (d->has_target && !d->is_refueling) {
+                if (gps_live) {
+                    // 位置由 UDP 回報更新
+                }
+                else if (d->has_target && !d->is_refueling) {
                     Point next = get_next_step_astar(d->lat, d->lon, d->target_lat, d->target_lon);
                     
                     // 原地踏步偵測 (Stuck) -> 直接算抵達
@@ -118,8 +136,22 @@ void *map_monitor_thread(void *arg) {
                         d->lat = old_lat; d->lon = old_lon;
                     }
                 }
+
+                // 6. 抵達 / 加油 / 移動都可能改變區域計數，O(1) 同步
+                pricing_sync_driver(g_shared_state, i);
+
+                // 7. 行程結束寫入 WAL (重播時司機回到空車，位置為抵達點)
+                if (had_target && !d->has_target) {
+                    JournalRecord jrec = {
+                        .type = JOURNAL_COMPLETE,
+                        .driver_id = d->driver_id,
+                        .lat_e7 = (int32_t)lround(d->lat * LOC_COORD_SCALE),
+                        .lon_e7 = (int32_t)lround(d->lon * LOC_COORD_SCALE)
+                    };
+                    journal_append(&jrec);
+                }
             }
-            pthread_mutex_unlock(&g_shared_state->mutex);
+            state_unlock(LOCK_SITE_MAP_TICK, lock_token);
 
             // --- 繪圖邏輯 ---
             for (int y = 0; y < MAP_HEIGHT; y++) {
@@ -0,0 +1,310 @@
+/* src/server/metrics.c */
+// Dispatcher 各階段的延遲與計數：Worker 只寫自己的格子，Coordinator 的輸出執行緒讀取時逐格相加
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../../common/include/shared_data.h"
+#include "../../common/include/log_system.h"
+#include "../include/metrics.h"
+#include "../include/lock_profile.h"
+#include "../include/span_trace.h"
+
+extern SharedState *g_shared_state;
+
+#define METRICS_REQUEST_MAX     1024    // 只需要讀到請求行，內容不解析
+#define METRICS_IO_TIMEOUT_SEC  1       // 抓取端不讀 / 不送時不能卡住輸出執行緒
+
+// 單一寫入者：讀出、加一、relaxed store 寫回 (讀取端不會看到撕裂的值)
+#define METRIC_ADD(field, v) __atomic_store_n(&(field), (field) + (v), __ATOMIC_RELAXED)
+
+static const char *const g_stage_names[STAGE_COUNT] = {
+    "handshake", "resume", "decrypt", "rate_limit", "lock_wait", "match", "response", "send", "request"
+};
+
+static const char *const g_counter_names[METRIC_COUNT] = {
+    "connections", "handshakes", "resumes", "resume_rejects", "requests",
+    "confirmed", "no_driver", "blocked", "checksum_errors", "no_handshake"
+};
+
+static int g_metrics_worker = 0;
+static int g_exporter_port = 0;
+static int g_exporter_fd = -1;
+
+const char *metrics_stage_name(MetricsStage stage) {
+    return (stage >= 0 && stage < STAGE_COUNT) ? g_stage_names[stage] : "unknown";
+}
+
+void metrics_attach(int worker) {
+    g_metrics_worker = (worker >= 0 && worker < METRICS_MAX_WORKERS) ? worker : 0;
+}
+
+//  A. Worker 端
+uint64_t metrics_stage(MetricsStage stage, uint64_t start_ns) {
+    uint64_t now = metrics_now();
+    if (g_span_current != 0) span_record(g_span_current, stage, start_ns, now); // 被抽樣的連線另外記成 span
+    if (g_shared_state == NULL) return now;
+
+    uint64_t ns = now - start_ns;
+    int bucket = 64 - __builtin_clzll(ns | 1) - METRICS_MIN_SHIFT;
+    if (bucket < 0) bucket = 0;
+    if (bucket > METRICS_BUCKETS) bucket = METRICS_BUCKETS;
+
+    StageHistogram *h = &g_shared_state->metrics.workers[g_metrics_worker].stages[stage];
+    METRIC_ADD(h->buckets[bucket], 1);
+    METRIC_ADD(h->count, 1);
+    METRIC_ADD(h->sum_ns, ns);
+    return now;
+}
+
+void metrics_count(MetricsCounter counter) {
+    if (g_shared_state == NULL) return;
+    METRIC_ADD(g_shared_state->metrics.workers[g_metrics_worker].counters[counter], 1);
+}
+
+//  B. Prometheus 文字格式
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+} Writer;
+
+static void __attribute__((format(printf, 2, 3))) emit(Writer *w, const char *fmt, ...) {
+    if (w->len >= w->cap) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, w->cap - w->len, fmt, args);
+    va_end(args);
+    if (n > 0) w->len += (size_t)n < w->cap - w->len ? (size_t)n : w->cap - w->len - 1;
+}
+
+static uint64_t load_u64(const uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+size_t metrics_render(const SharedState *state, char *out, size_t cap) {
+    Writer w = { out, cap, 0 };
+    if (cap == 0) return 0;
+    out[0] = '\0';
+    const DispatcherMetrics *m = &state->metrics;
+
+    // 1. 各階段直方圖 (所有 Worker 相加，bucket 轉成 Prometheus 的累積值)
+    emit(&w, "# HELP ride_stage_seconds Time spent in each dispatcher stage.\n");
+    emit(&w, "# TYPE ride_stage_seconds histogram\n");
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        uint64_t buckets[METRICS_BUCKETS + 1] = {0};
+        uint64_t count = 0, sum_ns = 0;
+        for (int wk = 0; wk < METRICS_MAX_WORKERS; wk++) {
+            const StageHistogram *h = &m->workers[wk].stages[s];
+            if (load_u64(&h->count) == 0) continue;
+            for (int b = 0; b <= METRICS_BUCKETS; b++) buckets[b] += load_u64(&h->buckets[b]);
+            sum_ns += load_u64(&h->sum_ns);
+        }
+        // count 由 bucket 加總 (讀取期間 Worker 仍在寫，這樣 +Inf 與 count 一定一致)
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            cumulative += buckets[b];
+            emit(&w, "ride_stage_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %lu\n", g_stage_names[s],
+                 (double)(1ULL << (b + METRICS_MIN_SHIFT)) / 1e9, cumulative);
+        }
+        count = cumulative + buckets[METRICS_BUCKETS];
+        emit(&w, "ride_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n", g_stage_names[s], count);
+        emit(&w, "ride_stage_seconds_sum{stage=\"%s\"} %.9f\n", g_stage_names[s], sum_ns / 1e9);
+        emit(&w, "ride_stage_seconds_count{stage=\"%s\"} %lu\n", g_stage_names[s], count);
+    }
+
+    // 2. 事件計數
+    emit(&w, "# HELP ride_dispatcher_events_total Dispatcher events summed over all workers.\n");
+    emit(&w, "# TYPE ride_dispatcher_events_total counter\n");
+    for (int c = 0; c < METRIC_COUNT; c++) {
+        uint64_t total = 0;
+        for (int wk = 0; wk < METRICS_MAX_WORKERS; wk++) total += load_u64(&m->workers[wk].counters[c]);
+        emit(&w, "ride_dispatcher_events_total{event=\"%s\"} %lu\n", g_counter_names[c], total);
+    }
+
+    // 3. 每個 Worker 的請求數 (看負載是否平均；沒處理過請求的 Worker 不輸出)
+    emit(&w, "# HELP ride_worker_requests_total Ride requests handled by each dispatcher worker.\n");
+    emit(&w, "# TYPE ride_worker_requests_total counter\n");
+    for (int wk = 0; wk < METRICS_MAX_WORKERS; wk++) {
+        uint64_t n = load_u64(&m->workers[wk].counters[METRIC_REQUESTS]);
+        if (n > 0) emit(&w, "ride_worker_requests_total{worker=\"%d\"} %lu\n", wk, n);
+    }
+
+    // 4. state->mutex 各呼叫點 (--lock-profile / SIGUSR1 開啟時才有數據)
+    emit(&w, "# HELP ride_lock_profiling Whether state mutex profiling is recording.\n");
+    emit(&w, "# TYPE ride_lock_profiling gauge\n");
+    emit(&w, "ride_lock_profiling %u\n", __atomic_load_n(&state->lock_profile.enabled, __ATOMIC_RELAXED));
+    static const char *const lock_fields[] = { "acquisitions", "contended", "wait_seconds", "hold_seconds" };
+    for (int f = 0; f < 4; f++) {
+        emit(&w, "# TYPE ride_lock_%s_total counter\n", lock_fields[f]);
+        for (int site = 0; site < LOCK_SITE_COUNT; site++) {
+            uint64_t total = 0;
+            for (int slot = 0; slot < LOCKPROF_SLOTS; slot++) {
+                const LockSiteStats *st = &state->lock_profile.slots[slot].sites[site];
+                const uint64_t *v = f == 0 ? &st->acquisitions : f == 1 ? &st->contended : f == 2 ? &st->wait_ns : &st->hold_ns;
+                total += load_u64(v);
+            }
+            if (f < 2) emit(&w, "ride_lock_%s_total{site=\"%s\"} %lu\n", lock_fields[f], lock_site_name(site), total);
+            else emit(&w, "ride_lock_%s_total{site=\"%s\"} %.9f\n", lock_fields[f], lock_site_name(site), total / 1e9);
+        }
+    }
+
+    // 5. 共享狀態 (不拿鎖直接讀：只供觀察，偶爾讀到更新到一半的司機表無妨)
+    int available = 0, busy = 0, refueling = 0;
+    int count = state->driver_count < MAX_DRIVERS ? state->driver_count : MAX_DRIVERS;
+    for (int i = 0; i < count; i++) {
+        const Driver *d = &state->drivers[i];
+        if (d->is_refueling) refueling++;
+        else if (d->is_available) available++;
+        else busy++;
+    }
+    emit(&w, "# HELP ride_drivers Drivers by state.\n");
+    emit(&w, "# TYPE ride_drivers gauge\n");
+    emit(&w, "ride_drivers{state=\"available\"} %d\n", available);
+    emit(&w, "ride_drivers{state=\"busy\"} %d\n", busy);
+    emit(&w, "ride_drivers{state=\"refueling\"} %d\n", refueling);
+    emit(&w, "# HELP ride_revenue_total Total fare revenue.\n");
+    emit(&w, "# TYPE ride_revenue_total counter\n");
+    emit(&w, "ride_revenue_total %ld\n", state->total_revenue);
+    emit(&w, "# HELP ride_rate_limit_blocked_total Requests blocked by the per-client rate limit.\n");
+    emit(&w, "# TYPE ride_rate_limit_blocked_total counter\n");
+    emit(&w, "ride_rate_limit_blocked_total %lu\n", load_u64(&state->rate_limit.blocked_count));
+
+    const WorkerPool *pool = &state->pool;
+    emit(&w, "# HELP ride_pool_workers Dispatcher processes (live excludes retiring ones).\n");
+    emit(&w, "# TYPE ride_pool_workers gauge\n");
+    emit(&w, "ride_pool_workers{state=\"live\"} %u\n", pool->live);
+    emit(&w, "ride_pool_workers{state=\"busy\"} %u\n", pool->busy);
+    emit(&w, "ride_pool_workers{state=\"min\"} %u\n", pool->min_workers);
+    emit(&w, "ride_pool_workers{state=\"max\"} %u\n", pool->max_workers);
+    emit(&w, "# HELP ride_pool_utilization Smoothed fraction of time dispatchers spend on connections.\n");
+    emit(&w, "# TYPE ride_pool_utilization gauge\n");
+    emit(&w, "ride_pool_utilization %.4f\n", pool->utilization);
+    emit(&w, "# HELP ride_pool_accept_queue Connections waiting in the listen socket's accept queue.\n");
+    emit(&w, "# TYPE ride_pool_accept_queue gauge\n");
+    emit(&w, "ride_pool_accept_queue %u\n", pool->accept_queue);
+    emit(&w, "# HELP ride_pool_events_total Dispatcher pool changes.\n");
+    emit(&w, "# TYPE ride_pool_events_total counter\n");
+    emit(&w, "ride_pool_events_total{event=\"spawned\"} %lu\n", pool->spawned);
+    emit(&w, "ride_pool_events_total{event=\"respawned\"} %lu\n", pool->respawned);
+    emit(&w, "ride_pool_events_total{event=\"retired\"} %lu\n", pool->retired);
+    return w.len;
+}
+
+//  C. HTTP 輸出 (Coordinator 的執行緒)
+/**
+ * GET /span-sample[?every=N]：查詢或調整 --span-trace 的抽樣率。
+ * return 回覆內容的長度
+ */
+static size_t span_control(const char *request, char *out, size_t cap) {
+    const char *arg = strstr(request, "every=");
+    const char *line_end = strchr(request, '\n');
+    if (arg != NULL && (line_end == NULL || arg < line_end)) {
+        if (span_set_sample((uint32_t)strtoul(arg + 6, NULL, 10)) < 0) {
+            return (size_t)snprintf(out, cap, "span tracing is off (start server_app with --span-trace=FILE)\n");
+        }
+    }
+    uint32_t every = span_get_sample();
+    if (every == 0) return (size_t)snprintf(out, cap, "span sampling: paused\n");
+    return (size_t)snprintf(out, cap, "span sampling: 1 in %u connections\n", every);
+}
+
+static void write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static void *metrics_exporter_thread(void *arg) {
+    (void)arg;
+    char request[METRICS_REQUEST_MAX];
+    char *body = malloc(METRICS_RENDER_MAX);
+    if (body == NULL) return NULL;
+
+    // SIGINT 由主執行緒處理
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    while (1) {
+        int fd = accept(g_exporter_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            log_warn("Metrics exporter accept failed: %s", strerror(errno));
+            break;
+        }
+        struct timeval tv = { METRICS_IO_TIMEOUT_SEC, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        // 只監聽本機；讀一次請求就好。/span-sample?every=N 調整抽樣率，其他路徑都回覆 metrics
+        ssize_t n = recv(fd, request, sizeof(request) - 1, 0);
+        if (n > 0) {
+            request[n] = '\0';
+            size_t len;
+            if (strncmp(request, "GET /span-sample", 16) == 0) {
+                len = span_control(request, body, METRICS_RENDER_MAX);
+            } else {
+                len = metrics_render(g_shared_state, body, METRICS_RENDER_MAX);
+            }
+            char header[128];
+            int hlen = snprintf(header, sizeof(header),
+                                "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", len);
+            write_all(fd, header, (size_t)hlen);
+            write_all(fd, body, len);
+        }
+        close(fd);
+    }
+    free(body);
+    return NULL;
+}
+
+void metrics_configure(int port) {
+    g_exporter_port = port;
+}
+
+int metrics_start(void) {
+    int port = g_exporter_port;
+    if (port <= 0) return 0;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        log_error("Metrics exporter cannot listen on 127.0.0.1:%d: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    g_exporter_fd = fd;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, metrics_exporter_thread, NULL) != 0) {
+        close(fd);
+        g_exporter_fd = -1;
+        return -1;
+    }
+    pthread_detach(tid);
+    log_info("Metrics exporter listening on http://127.0.0.1:%d/metrics", port);
+    return 0;
+}
@@ -2,47 +2,119 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
 #include "pricing_service.h"
+#include "pathfinding.h"
 #include "../../common/include/log_system.h"
 
+#define BASE_FARE 100
+
+// 忙碌比例門檻：區域內超過 70% 的司機在載客即啟動溢價
+#define SURGE_BUSY_RATIO 0.7
+// 需求壓力門檻：近期叫車數超過 (空車數 + 1) 的 2 倍即啟動溢價
+#define SURGE_DEMAND_RATIO 2.0
+// 需求衰減時間常數 (秒)：約 30 秒前的叫車只剩 1/e 的權重
+#define DEMAND_DECAY_SECS 30.0
+
+static double monotonic_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 取得衰減到 now 時刻的需求量 (不修改共享記憶體)
+static double decayed_demand(const ZoneStats *z, double now) {
+    if (z->demand <= 0.0) return 0.0;
+    double elapsed = now - z->demand_updated;
+    if (elapsed <= 0.0) return z->demand;
+    return z->demand * exp(-elapsed / DEMAND_DECAY_SECS);
+}
+
+// 依照司機目前狀態決定他應該被算在哪一類 (與 check_if_driver_available 一致)
+static uint8_t driver_zone_state(const Driver *d) {
+    if (d->is_refueling) return ZONE_STATE_NONE;
+    if (d->is_available) return d->fuel > 0 ? ZONE_STATE_AVAILABLE : ZONE_STATE_NONE;
+    return ZONE_STATE_BUSY;
+}
+
+static void zone_adjust(ZoneStats *z, uint8_t zone_state, int delta) {
+    if (zone_state == ZONE_STATE_AVAILABLE) z->available_drivers += delta;
+    else if (zone_state == ZONE_STATE_BUSY) z->busy_drivers += delta;
+}
+
+int pricing_zone_of(double lat, double lon) {
+    double gy = (lat - BASE_LAT) * SCALE_FACTOR;
+    double gx = (lon - BASE_LON) * SCALE_FACTOR;
+
+    // 夾到地圖範圍內 (寫成 !(x >= 0) 讓 NaN 也落在 0)
+    if (!(gx >= 0)) gx = 0;
+    if (gx > MAP_WIDTH - 1) gx = MAP_WIDTH - 1;
+    if (!(gy >= 0)) gy = 0;
+    if (gy > MAP_HEIGHT - 1) gy = MAP_HEIGHT - 1;
+
+    int zx = (int)gx * ZONE_COLS / MAP_WIDTH;
+    int zy = (int)gy * ZONE_ROWS / MAP_HEIGHT;
+    return zy * ZONE_COLS + zx;
+}
+
+void pricing_sync_driver(SharedState *state, int driver_index) {
+    Driver *d = &state->drivers[driver_index];
+    uint8_t new_state = driver_zone_state(d);
+    int new_zone = pricing_zone_of(d->lat, d->lon);
+
+    if (new_state == d->zone_state && (new_state == ZONE_STATE_NONE || new_zone == d->zone_id)) {
+        return; // 沒有變化
+    }
+
+    if (d->zone_state != ZONE_STATE_NONE) {
+        zone_adjust(&state->zones[d->zone_id], d->zone_state, -1);
+    }
+    zone_adjust(&state->zones[new_zone], new_state, +1);
+
+    d->zone_id = (int8_t)new_zone;
+    d->zone_state = new_state;
+}
+
+void pricing_rebuild_zones(SharedState *state) {
+    memset(state->zones, 0, sizeof(state->zones));
+    for (int i = 0; i < state->driver_count; i++) {
+        state->drivers[i].zone_id = 0;
+        state->drivers[i].zone_state = ZONE_STATE_NONE;
+        pricing_sync_driver(state, i);
+    }
+}
+
+void pricing_record_demand(SharedState *state, int zone) {
+    ZoneStats *z = &state->zones[zone];
+    double now = monotonic_now();
+    z->demand = decayed_demand(z, now) + 1.0;
+    z->demand_updated = now;
+}
+
 // 實作動態定價邏輯
 /**
- * 計算當前的動態定價 (Surge Price)。
- * state 共享記憶體指標
- * is_surge 輸出參數：1 表示啟動溢價，0 表示沒有
+ * 計算上車區域當前的動態定價 (Surge Price)。
+ * 只讀取該區域的計數器，不再掃描整個車隊。
  * return 最終價格 (例如：100 或 200)
  */
-int calculate_surge_price(SharedState *state, int *is_surge) {
+int calculate_surge_price(SharedState *state, double lat, double lon, int *is_surge) {
     *is_surge = 0; // 預設沒有溢價
-    int base_fare = 100;
-    
-    // 檢查是否有司機
-    if (state->driver_count == 0) {
-        return base_fare; 
-    }
+    const ZoneStats *z = &state->zones[pricing_zone_of(lat, lon)];
 
-    // 1. 計算忙碌司機數量
-    int busy_drivers = 0;
-    for (int i = 0; i < state->driver_count; i++) {
-        // 忙碌的定義：不空閒 (is_available == 0) 且不在加油中 (is_refueling == 0)
-        // 這裡只需要計算載客中的車，因為加油中的車不影響「供需緊張」的定義
-        if (!state->drivers[i].is_available && !state->drivers[i].is_refueling) {
-            busy_drivers++;
-        }
-    }
+    int active = z->available_drivers + z->busy_drivers;
+    double busy_ratio = active > 0 ? (double)z->busy_drivers / active : 0.0;
+    double demand = decayed_demand(z, monotonic_now());
 
-    // 2. 計算忙碌比例
-    double total_drivers = (double)state->driver_count;
-    double busy_ratio = busy_drivers / total_drivers;
-    
-    int final_fare = base_fare;
+    int final_fare = BASE_FARE;
 
-    // 3. 判斷是否啟動溢價 (閾值：70%)
-    if (busy_ratio > 0.7) {
-        final_fare = base_fare * 2; // 價格翻倍
+    // 判斷是否啟動溢價：區域內車子太忙，或近期需求遠大於空車數
+    if (busy_ratio > SURGE_BUSY_RATIO || demand > SURGE_DEMAND_RATIO * (z->available_drivers + 1)) {
+        final_fare = BASE_FARE * 2; // 價格翻倍
         *is_surge = 1;
-        // log_debug("Surge Price Activated! Busy Ratio: %.2f", busy_ratio);
-    } 
+        // log_debug("Surge Price Activated! Busy Ratio: %.2f, Demand: %.1f", busy_ratio, demand);
+    }
 
     return final_fare;
-}
\ No newline at end of file
+}
@@ -0,0 +1,185 @@
+/* src/server/request_trace.c */
+// 請求擷取：Worker 端只寫自己的單一生產者環 (一次 memcpy、不上鎖)，寫檔由 Coordinator 的寫入執行緒負責
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "../../common/include/protocol.h"
+#include "../../common/include/log_system.h"
+#include "../include/request_trace.h"
+
+static TraceBuffers *g_trace = NULL;
+static int g_trace_fd = -1;
+static int g_trace_worker = 0;
+static pthread_t g_trace_tid;
+static volatile int g_trace_running = 0;
+static uint64_t g_trace_written = 0;
+
+// 寫入執行緒私有的批次緩衝區 (一批最多一個環)
+static TraceRecord g_trace_batch[TRACE_RING_SLOTS];
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int write_all(const void *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(g_trace_fd, (const char *)data + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            log_error("Trace write failed: %s", strerror(errno));
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+//  A. 初始化
+int trace_init(const char *path) {
+    g_trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (g_trace_fd < 0) {
+        log_error("Failed to open trace %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    TraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.started_at = (int64_t)time(NULL);
+    if (write_all(&header, sizeof(header)) < 0) {
+        close(g_trace_fd);
+        g_trace_fd = -1;
+        return -1;
+    }
+
+    // 匿名映射本來就是零，不 memset：沒有用到的 Worker 環不會佔用實體記憶體
+    TraceBuffers *bufs = mmap(NULL, sizeof(TraceBuffers), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (bufs == MAP_FAILED) {
+        log_error("Trace mmap failed: %s", strerror(errno));
+        close(g_trace_fd);
+        g_trace_fd = -1;
+        return -1;
+    }
+    bufs->start_ns = mono_ns();
+    g_trace = bufs;
+    log_info("Capturing ride requests to %s.", path);
+    return 0;
+}
+
+void trace_attach(int worker) {
+    g_trace_worker = (worker >= 0 && worker < METRICS_MAX_WORKERS) ? worker : 0;
+}
+
+//  B. Worker 端
+uint64_t trace_begin(void) {
+    return g_trace != NULL ? mono_ns() : 0;
+}
+
+void trace_request(uint64_t begin, const RideRequestData *req, uint16_t opcode, uint8_t status) {
+    TraceBuffers *bufs = g_trace;
+    if (bufs == NULL || begin == 0) return;
+    TraceRing *ring = &bufs->rings[g_trace_worker];
+
+    uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SLOTS) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    TraceRecord *rec = &ring->slots[head & (TRACE_RING_SLOTS - 1)];
+    uint64_t service_ns = mono_ns() - begin;
+    rec->t_us = (begin - bufs->start_ns) / 1000;
+    rec->client_id = req->client_id;
+    rec->service_us = service_ns / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)(service_ns / 1000);
+    rec->lat_e7 = (int32_t)(req->lat * LOC_COORD_SCALE);
+    rec->lon_e7 = (int32_t)(req->lon * LOC_COORD_SCALE);
+    rec->opcode = opcode;
+    rec->type = (uint8_t)req->type;
+    rec->status = status;
+    rec->worker = (uint16_t)g_trace_worker;
+    rec->reserved = 0;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+//  C. 寫入執行緒
+/**
+ * 取走一個 Worker 環中的所有記錄並寫檔。
+ * return 筆數
+ */
+static int drain_ring(TraceRing *ring) {
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    int count = (int)(head - tail);
+    if (count == 0) return 0;
+    for (int i = 0; i < count; i++) g_trace_batch[i] = ring->slots[(tail + i) & (TRACE_RING_SLOTS - 1)];
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+
+    // 寫入失敗 (例如磁碟已滿) 時照樣前進，擷取不影響服務
+    write_all(g_trace_batch, (size_t)count * sizeof(TraceRecord));
+    return count;
+}
+
+static void drain_all(void) {
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) g_trace_written += drain_ring(&g_trace->rings[w]);
+}
+
+static void *trace_writer_thread(void *arg) {
+    (void)arg;
+    // SIGINT 必須由其他執行緒處理：關機流程會 join 這個執行緒
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    struct timespec pause = { 0, TRACE_FLUSH_MS * 1000000L };
+    while (g_trace_running) {
+        nanosleep(&pause, NULL);
+        drain_all();
+    }
+    return NULL;
+}
+
+int trace_start(void) {
+    if (g_trace == NULL) return 0;
+    g_trace_running = 1;
+    if (pthread_create(&g_trace_tid, NULL, trace_writer_thread, NULL) != 0) {
+        g_trace_running = 0;
+        log_error("Failed to start trace writer.");
+        return -1;
+    }
+    return 0;
+}
+
+void trace_shutdown(void) {
+    if (g_trace == NULL) return;
+    if (g_trace_running) {
+        g_trace_running = 0;
+        pthread_join(g_trace_tid, NULL);
+    }
+
+    // 寫入執行緒沒啟動過 (或已停止) 時自己把剩餘記錄寫完
+    drain_all();
+    fdatasync(g_trace_fd);
+    close(g_trace_fd);
+    g_trace_fd = -1;
+
+    uint64_t dropped = 0;
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) dropped += g_trace->rings[w].dropped;
+    log_info("Trace: %lu requests captured, %lu dropped (buffer full).", g_trace_written, dropped);
+    g_trace = NULL;
+}
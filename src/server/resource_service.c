@@ -5,8 +5,10 @@
 #include <time.h>
 #include <pthread.h>
 #include <string.h>
+#include <sys/socket.h>
 
 #include "resource_service.h"
+#include "pricing_service.h"
 #include "../../common/include/shared_data.h"
 #include "../../common/include/log_system.h"
 
@@ -47,41 +49,215 @@ void complete_ride_and_update_resources(SharedState *state, int driver_index, in
     if (state->drivers[driver_index].fuel > 0) {
         state->drivers[driver_index].fuel -= 1; 
     }
+
+    // 司機釋放回空閒，同步區域計數器
+    pricing_sync_driver(state, driver_index);
 }
 
 //  B. DoS 頻率限制邏輯 (Availability Security)
+// GCRA (Generic Cell Rate Algorithm)：每個 key 只存一個 TAT。
+// 請求到達時 TAT 落後現在太多 (超過 tolerance) 就阻擋，否則 TAT 往後推 emission。
+// 等價於 token bucket，但狀態只有 32 bits，可以和 key 一起塞進一個 64-bit CAS。
+
+// 過期超過這個時間的 slot 會被 clock sweep 清空
+#define RATE_LIMIT_STALE_US 10000000
+// 每次檢查順便推進的 sweep 步數
+#define RATE_LIMIT_SWEEP_STEP 2
+// Coordinator 每次維護推進的步數：每 POOL_TICK_MS (100 ms) 一次，約 26 秒繞完整張表。
+// 請求量少時檢查順便做的 sweep 走不完一圈，靠這裡保證任何 slot 在 TAT 過期後 STALE + 一圈之內被清掉，
+// 遠早於 32-bit 微秒刻度回繞的一半 (約 35 分鐘)，舊 TAT 不會在回繞後被誤認為未來的時間
+#define RATE_LIMIT_MAINTAIN_STEP 512
+
+#define SLOT_KEY(w) ((uint32_t)((w) >> 32))
+#define SLOT_TAT(w) ((uint32_t)(w))
+#define MAKE_SLOT(key, tat) (((uint64_t)(key) << 32) | (tat))
+
+// 32-bit 刻度會回繞 (約 71 分鐘)，比較一律用有號差值
+#define TICK_DIFF(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)))
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// MurmurHash3 fmix32：讓連號的 client_id 均勻分散到整張表
+static uint32_t hash_key(uint32_t k) {
+    k ^= k >> 16;
+    k *= 0x85ebca6b;
+    k ^= k >> 13;
+    k *= 0xc2b2ae35;
+    k ^= k >> 16;
+    return k;
+}
+
+void rate_limit_table_init(RateLimitTable *table, uint32_t rate_per_sec, uint32_t burst) {
+    if (rate_per_sec > RATE_LIMIT_MAX_PER_SEC) rate_per_sec = RATE_LIMIT_MAX_PER_SEC;
+    if (burst == 0) burst = 1;
+    if (burst > RATE_LIMIT_MAX_BURST) burst = RATE_LIMIT_MAX_BURST;
+    memset(table->slots, 0, sizeof(table->slots));
+    table->emission_us = rate_per_sec ? 1000000 / rate_per_sec : 0;
+    uint64_t tolerance = (uint64_t)table->emission_us * (burst - 1);
+    table->tolerance_us = tolerance > RATE_LIMIT_MAX_TOLERANCE_US ? RATE_LIMIT_MAX_TOLERANCE_US : (uint32_t)tolerance;
+    // epoch 往前推 1 秒，確保 TAT 不會是 0 (0 代表空 slot)
+    table->epoch_ns = monotonic_ns() - 1000000000ULL;
+    table->sweep_hand = 0;
+    table->blocked_count = 0;
+    table->table_full_count = 0;
+}
+
+uint32_t rate_limit_now(const RateLimitTable *table) {
+    return (uint32_t)((monotonic_ns() - table->epoch_ns) / 1000ULL);
+}
+
+// TAT 超前現在超過 tolerance + emission 是不可能的狀態 (只有 Coordinator 停止維護、刻度回繞時才會出現)，視同過期
+static int tat_wrapped(const RateLimitTable *table, uint32_t tat, uint32_t now) {
+    return TICK_DIFF(tat, now) > (int32_t)(table->tolerance_us + table->emission_us);
+}
+
+// Clock sweep：指針繞著整張表走，把很久沒出現的 key 清掉，讓探測視窗保持乾淨
+static void rate_limit_sweep(RateLimitTable *table, uint32_t now, int steps) {
+    uint32_t pos = __atomic_fetch_add(&table->sweep_hand, (uint32_t)steps, __ATOMIC_RELAXED);
+    for (int i = 0; i < steps; i++) {
+        uint64_t *slot = &table->slots[(pos + i) & (RATE_LIMIT_SLOTS - 1)];
+        uint64_t w = __atomic_load_n(slot, __ATOMIC_RELAXED);
+        if (w != 0 && (TICK_DIFF(now, SLOT_TAT(w)) > RATE_LIMIT_STALE_US || tat_wrapped(table, SLOT_TAT(w), now))) {
+            // CAS 失敗代表剛好有人在用，直接略過
+            __atomic_compare_exchange_n(slot, &w, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// 在 slot 上套用 GCRA。回傳 1/0 = 阻擋/通行，-1 = slot 已被別的 key 搶走 (需重新查找)
+static int gcra_update(RateLimitTable *table, uint64_t *slot, uint64_t w, uint32_t key, uint32_t now) {
+    for (;;) {
+        if (w != 0 && SLOT_KEY(w) != key) return -1;
+
+        uint32_t tat = SLOT_TAT(w);
+        if (w == 0 || TICK_DIFF(tat, now) < 0 || tat_wrapped(table, tat, now)) tat = now; // 額度已滿，從現在開始算
+        if ((uint32_t)TICK_DIFF(tat, now) > table->tolerance_us) return 1;
+
+        uint32_t new_tat = tat + table->emission_us;
+        if (new_tat == 0) new_tat = 1;
+        if (__atomic_compare_exchange_n(slot, &w, MAKE_SLOT(key, new_tat), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        // CAS 失敗：w 已更新成最新值，重試
+    }
+}
+
+int rate_limit_table_check(RateLimitTable *table, uint32_t key, uint32_t now) {
+    if (table->emission_us == 0) return 0; // 停用
+    uint32_t base = hash_key(key);
+
+    rate_limit_sweep(table, now, RATE_LIMIT_SWEEP_STEP);
+
+    // 最多重試幾次 (只有在和其他進程搶同一個 slot 時才會重試)
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint64_t *reuse = NULL;
+        uint64_t reuse_word = 0;
+
+        // 1. 掃完整個探測視窗找自己的 key；同時記下第一個可重用的 slot
+        for (int i = 0; i < RATE_LIMIT_PROBE; i++) {
+            uint64_t *slot = &table->slots[(base + i) & (RATE_LIMIT_SLOTS - 1)];
+            uint64_t w = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+            if (w != 0 && SLOT_KEY(w) == key) {
+                int r = gcra_update(table, slot, w, key, now);
+                if (r < 0) break; // 剛好被重用，重新查找
+                if (r) __atomic_fetch_add(&table->blocked_count, 1, __ATOMIC_RELAXED);
+                return r;
+            }
+            if (reuse == NULL && (w == 0 || TICK_DIFF(now, SLOT_TAT(w)) >= 0 || tat_wrapped(table, SLOT_TAT(w), now))) {
+                reuse = slot;
+                reuse_word = w;
+            }
+        }
+
+        // 2. 沒找到：佔用空 slot 或過期 slot (新 client 第一次請求一定放行)
+        //    兩個進程同時為同一個新 key 佔用不同 slot 的機率很低，代價只是該 client 多一次額度
+        if (reuse != NULL) {
+            uint32_t new_tat = now + table->emission_us;
+            if (new_tat == 0) new_tat = 1;
+            if (__atomic_compare_exchange_n(reuse, &reuse_word, MAKE_SLOT(key, new_tat), 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                return 0;
+            }
+            continue; // 被搶先，重新查找
+        }
+
+        // 3. 視窗內全是活躍 client：固定記憶體的代價，選擇放行 (fail-open) 並記錄
+        __atomic_fetch_add(&table->table_full_count, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return 0;
+}
+
 /**
  * 檢查並更新客戶端的請求頻率 (Rate Limiting)。
  * 這是 Dispatcher.c 在接受 Payload 後第一個調用的安全函式。
+ * 限流表以原子操作更新，多個 Dispatcher 進程同時呼叫也不需要鎖。
  * client_id 客戶 ID
  * return 1 = 阻擋 (Blocked), 0 = 通行 (Allowed)
  */
-int check_and_update_rate_limit(int client_id) {
-    if (client_id <= 0 || client_id >= 2000 || g_shared_state == NULL) {
-        return 0; // 不處理無效 ID
+void rate_limit_table_maintain(RateLimitTable *table, uint32_t now) {
+    if (table->emission_us == 0) return;
+    rate_limit_sweep(table, now, RATE_LIMIT_MAINTAIN_STEP);
+}
+
+void rate_limit_maintain(void) {
+    if (g_shared_state == NULL) return;
+    rate_limit_table_maintain(&g_shared_state->rate_limit, rate_limit_now(&g_shared_state->rate_limit));
+    rate_limit_table_maintain(&g_shared_state->peer_admission, rate_limit_now(&g_shared_state->peer_admission));
+}
+
+int check_and_update_rate_limit(uint32_t client_id) {
+    if (g_shared_state == NULL) {
+        return 0;
     }
+    RateLimitTable *table = &g_shared_state->rate_limit;
+    return rate_limit_table_check(table, client_id, rate_limit_now(table));
+}
 
-    int is_spam = 0;
-    time_t now = time(NULL);
-    
-    // 必須鎖定，因為多個 Dispatcher 進程會同時寫入這個陣列
-    pthread_mutex_lock(&g_shared_state->mutex);
-    
-    if (g_shared_state->client_last_seen[client_id] == now) {
-        // 同一秒內，增加計數
-        g_shared_state->client_req_count[client_id]++;
-    } else {
-        // 新的一秒，重置時間和計數
-        g_shared_state->client_last_seen[client_id] = now;
-        g_shared_state->client_req_count[client_id] = 1;
+/**
+ * 連線准入控制：以來源 IPv4 位址為 key 做 GCRA 檢查。
+ * 這是 Dispatcher.c 在 accept() 之後、握手之前調用的安全函式，
+ * 被擋的連線不會花到任何一次模數冪運算或 RC4。
+ * peer 對端位址
+ * return 1 = 阻擋 (Blocked), 0 = 通行 (Allowed)
+ */
+int check_peer_admission(const struct sockaddr_in *peer) {
+    if (g_shared_state == NULL) {
+        return 0;
+    }
+    RateLimitTable *table = &g_shared_state->peer_admission;
+    if (rate_limit_table_check(table, peer->sin_addr.s_addr, rate_limit_now(table))) {
+        return 1;
     }
+    __atomic_fetch_add(&g_shared_state->total_connections_accepted, 1, __ATOMIC_RELAXED);
+    return 0;
+}
 
-    // 閾值：每秒超過 3 次即視為 DoS 攻擊
-    if (g_shared_state->client_req_count[client_id] > 3) {
-        is_spam = 1; 
+/**
+ * 連線准入控制 (只有 fd 的版本)：給 multishot accept 這類拿不到對端位址的路徑使用。
+ * 准入控制停用時不呼叫 getpeername，省下一次系統呼叫。
+ * fd 已接受的連線
+ * return 1 = 阻擋 (Blocked), 0 = 通行 (Allowed)
+ */
+int check_peer_admission_fd(int fd) {
+    if (g_shared_state == NULL) {
+        return 0;
     }
-    
-    pthread_mutex_unlock(&g_shared_state->mutex);
-    
-    return is_spam;
-}
\ No newline at end of file
+    if (g_shared_state->peer_admission.emission_us == 0) {
+        __atomic_fetch_add(&g_shared_state->total_connections_accepted, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr *)&peer, &len) < 0 || peer.sin_family != AF_INET) {
+        __atomic_fetch_add(&g_shared_state->total_connections_accepted, 1, __ATOMIC_RELAXED);
+        return 0; // 非 IPv4 (或已斷線)：不限流，交給後續讀取處理
+    }
+    return check_peer_admission(&peer);
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "../../common/include/shared_data.h"
 #include "../../common/include/log_system.h"
@@ -9,16 +10,41 @@
 
 // 引入演算法模組
 #include "../include/dispatch_algorithms.h"
+#include "../include/pricing_service.h"
+#include "../include/driver_channel.h"
+#include "../include/journal.h"
+#include "../include/metrics.h"
+#include "../include/lock_profile.h"
 
-int handle_ride_request_logic(int client_id, char *resp_buffer, size_t buffer_len) {
+/**
+ * 由直線距離 (度) 估算司機抵達秒數。
+ */
+static uint16_t estimate_eta_secs(double dist_deg) {
+    double secs = dist_deg * RIDE_KM_PER_DEGREE / RIDE_ETA_SPEED_KMH * 3600.0;
+    return (secs > UINT16_MAX) ? UINT16_MAX : (uint16_t)lround(secs);
+}
+
+int handle_ride_request_logic(int client_id, double pickup_lat, double pickup_lon, RideResponseData *resp) {
     SharedState *state = g_shared_state;
+
+    memset(resp, 0, sizeof(*resp));
+    resp->version = RIDE_RESP_VERSION;
     
-    // 進入臨界區 (Critical Section)
-    pthread_mutex_lock(&state->mutex);
+    // 進入臨界區 (Critical Section)；等鎖與持鎖時間分開記錄
+    uint64_t wait_t0 = metrics_now();
+    uint64_t lock_token = state_lock(LOCK_SITE_RIDE_MATCH);
+    uint64_t hold_t0 = metrics_stage(STAGE_LOCK_WAIT, wait_t0);
 
     int is_vip = (client_id <= 10);
     int best_driver_index = -1;
 
+    // 無論是否派車成功，都算一筆該區域的需求 (沒車時需求壓力更應反映在價格上)
+    pricing_record_demand(state, pricing_zone_of(pickup_lat, pickup_lon));
+
+    // 依上車區域查表報價 (在派車之前，避免把這筆行程自己算進忙碌比例)
+    int is_surge = 0;
+    int fare = calculate_surge_price(state, pickup_lat, pickup_lon, &is_surge) + (is_vip ? 50 : 0);
+
     // 根據模式選擇派車演算法
     if (state->dispatch_mode == 0) {
         best_driver_index = find_driver_basic(state);
@@ -45,30 +71,65 @@ int handle_ride_request_logic(int client_id, char *resp_buffer, size_t buffer_le
         d->target_lat = 25.0330 + (rand() % 90) * 0.0001; 
         d->target_lon = 121.5654 + (rand() % 180) * 0.0001;
 
+        // 司機由空車轉為載客，O(1) 更新區域計數器
+        pricing_sync_driver(state, best_driver_index);
+
         // 2. 更新全域統計
         state->total_requests_handled++;
         state->total_success_requests++;
         
-        // 計算顯示用的距離與車資
+        // 計算顯示用的距離，並記入車資
         double dist = calculate_distance(25.0330, 121.5654, d->lat, d->lon);
-        double fare = 100.0 + (is_vip ? 50.0 : 0.0);
-        state->total_revenue += (long)fare;
+        state->total_revenue += fare;
+
+        // 推播給司機 (司機有長連線時，解鎖後喚醒持有連線的 Dispatcher)
+        RideAssignmentData assign = {
+            .ride_id = ++state->next_ride_id,
+            .client_id = (uint32_t)client_id,
+            .pickup_lat = pickup_lat,
+            .pickup_lon = pickup_lon,
+            .dest_lat = d->target_lat,
+            .dest_lon = d->target_lon,
+            .fare = fare
+        };
+        int push_worker = driver_channel_post(state, best_driver_index, &assign);
+
+        // 寫入 WAL (與狀態變更在同一個臨界區，LSN 順序就是變更順序)
+        JournalRecord jrec = {
+            .type = JOURNAL_DISPATCH,
+            .driver_id = d->driver_id,
+            .client_id = (uint32_t)client_id,
+            .ride_id = assign.ride_id,
+            .fare = fare,
+            .lat_e7 = (int32_t)lround(d->target_lat * LOC_COORD_SCALE),
+            .lon_e7 = (int32_t)lround(d->target_lon * LOC_COORD_SCALE)
+        };
+        uint64_t lsn = journal_append(&jrec);
+
+        // 3. 填寫回覆 (在鎖內讀取司機資料；文字格式由 Dispatcher 視 Client 版本決定)
+        resp->status = RIDE_STATUS_CONFIRMED;
+        resp->flags = (is_surge ? RIDE_FLAG_SURGE : 0) | (state->dispatch_mode == 1 ? RIDE_FLAG_SMART : 0) | (is_vip ? RIDE_FLAG_VIP : 0);
+        resp->rating_x10 = (uint8_t)lround(d->rating * 10.0);
+        resp->ride_id = assign.ride_id;
+        resp->driver_id = d->driver_id;
+        resp->dist_e7 = (uint32_t)lround(dist * LOC_COORD_SCALE);
+        resp->eta_secs = estimate_eta_secs(dist);
+        resp->fare = fare;
 
-        pthread_mutex_unlock(&state->mutex);
+        state_unlock(LOCK_SITE_RIDE_MATCH, lock_token);
+        metrics_stage(STAGE_MATCH, hold_t0);
+        journal_commit(lsn); // 落盤後才讓司機與乘客看到這筆派單
+        driver_channel_notify(push_worker);
 
-        // 3. 準備回傳訊息
-        snprintf(resp_buffer, buffer_len, 
-            "Ride Confirmed! Driver ID: %d (Rating: %.1f, Dist: %.4f) [Mode: %s]", 
-            d->driver_id, d->rating, dist, 
-            state->dispatch_mode == 1 ? "SMART" : "BASIC");
-            
         log_info("Dispatched Driver %d (Rate %.1f) to Client %d. Heading to (%.4f, %.4f)", 
                  d->driver_id, d->rating, client_id, d->target_lat, d->target_lon);
         return 0; // 成功
     } else {
         // 無車可用
-        pthread_mutex_unlock(&state->mutex);
-        snprintf(resp_buffer, buffer_len, "Error: No drivers available.");
+        state_unlock(LOCK_SITE_RIDE_MATCH, lock_token);
+        metrics_stage(STAGE_MATCH, hold_t0);
+        resp->status = RIDE_STATUS_NO_DRIVER;
+        resp->flags = is_vip ? RIDE_FLAG_VIP : 0;
         return -1; // 失敗
     }
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <getopt.h>
 
 #include "../../common/include/shared_data.h"
 #include "../../common/include/log_system.h"
@@ -16,48 +17,39 @@
 
 // 引用 Coordinator 模組
 #include "coordinator.h"
-
-// 定義共享記憶體名稱
-#define SHM_NAME "/ride_hailing_shm"
+#include "pricing_service.h"
+#include "resource_service.h"
+#include "session_ticket.h"
+#include "dispatcher.h"
+#include "uring_dispatcher.h"
+#include "location_service.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "request_trace.h"
+#include "metrics.h"
+#include "lock_profile.h"
+#include "span_trace.h"
+#include "worker_pool.h"
 
 // 全域變數
 SharedState *g_shared_state = NULL;
 int g_shm_fd = -1;
 volatile sig_atomic_t g_running = 1;
 
+// 啟動期間的 SIGINT (Coordinator 啟動後改用 handle_sigint)：只能用 async-signal-safe 的 write
 void handle_signal(int sig) {
     if (sig == SIGINT) {
-        printf("\n[INFO] SIGINT received. Shutting down...\n");
+        static const char msg[] = "\n[INFO] SIGINT received. Shutting down...\n";
+        if (write(STDOUT_FILENO, msg, sizeof(msg) - 1) < 0) { /* 無法回報 */ }
         g_running = 0;
     }
 }
 
-// 寫入數據到檔案
-void save_data_to_file() {
-    FILE *fp = fopen("server.dat", "wb");
-    if (fp) {
-        fwrite(g_shared_state, sizeof(SharedState), 1, fp);
-        fclose(fp);
-        log_info("Data saved to server.dat");
-    } else {
-        log_error("Failed to save data to server.dat");
-    }
-}
-
-// 從檔案載入數據
-void load_data_from_file() {
-    FILE *fp = fopen("server.dat", "rb");
-    if (fp) {
-        fread(g_shared_state, sizeof(SharedState), 1, fp);
-        fclose(fp);
-        log_info("Data loaded from server.dat");
-    } else {
-        log_info("No existing data found. Starting fresh.");
-    }
-}
-
 void cleanup_resources() {
-    save_data_to_file();
+    trace_shutdown();
+    span_trace_shutdown();
+    journal_shutdown();
+    save_state(); // Snapshot + 清空 WAL (存檔格式見 coordinator.c)
     if (g_shared_state != MAP_FAILED) {
         pthread_mutex_destroy(&g_shared_state->mutex);
         munmap(g_shared_state, sizeof(SharedState));
@@ -69,18 +61,163 @@ void cleanup_resources() {
     log_info("Resources cleaned up.");
 }
 
+void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <port> <driver_count> [mode: 0=Basic, 1=Smart]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --admit-rate=N   每個來源 IP 每秒允許的新連線數 (0=停用, 上限 %d, 預設 %d)\n", RATE_LIMIT_MAX_PER_SEC, ADMIT_DEFAULT_PER_SEC);
+    fprintf(stderr, "  --admit-burst=N  每個來源 IP 允許的連線突發量 (1 ~ %d, 預設 %d)\n", RATE_LIMIT_MAX_BURST, ADMIT_DEFAULT_BURST);
+    fprintf(stderr, "  --udp-port=N     UDP 司機定位回報埠 (0=停用, 預設與 TCP 埠相同；需要 --fleet-key)\n");
+    fprintf(stderr, "  --fleet-key=K    驗證定位回報與司機長連線的車隊金鑰 (64-bit, 可用 0x 前綴；未指定時兩者都停用)\n");
+    fprintf(stderr, "  --workers-min=N  Dispatcher 進程數下限 (啟動時的數量，預設 %d)\n", POOL_DEFAULT_MIN);
+    fprintf(stderr, "  --workers-max=N  忙碌或 accept 佇列排隊時擴充到的上限 (最多 %d, 預設 %d)\n", POOL_MAX_WORKERS, POOL_MAX_WORKERS);
+    fprintf(stderr, "  --worker-idle-sec=N  池子持續清閒 N 秒後開始回收閒置的 Worker (預設 %d)\n", POOL_DEFAULT_IDLE_SECS);
+    fprintf(stderr, "  --io-backend=B   Dispatcher I/O 後端：classic (阻塞式, 預設) 或 uring (io_uring，不支援時自動退回)\n");
+    fprintf(stderr, "  --recover        從 server.dat + server.wal 恢復上次的狀態 (預設重新開始)\n");
+    fprintf(stderr, "  --discard-wal    server.wal 還有上次未存進 Snapshot 的記錄時，仍然重新開始 (丟棄那些記錄)\n");
+    fprintf(stderr, "  --wal-fsync=P    WAL 落盤策略：always (回覆前落盤), interval (預設), none\n");
+    fprintf(stderr, "  --wal-interval-ms=N  interval 策略的落盤間隔 (預設 %d ms)\n", JOURNAL_DEFAULT_INTERVAL_MS);
+    fprintf(stderr, "  --snapshot-interval=N  背景 Snapshot 間隔秒數 (0=只在啟動 / 關機時寫入, 預設 %d)\n", SNAPSHOT_DEFAULT_INTERVAL);
+    fprintf(stderr, "  --log-overflow=P Log 緩衝區滿時：drop (丟棄並計數, 預設) 或 block (等待寫入)\n");
+    fprintf(stderr, "  --log-rotate-mb=N  server.log 超過 N MB 時輪替為 server.log.1 (0=不輪替, 預設 %d)\n", LOG_DEFAULT_ROTATE_MB);
+    fprintf(stderr, "  --log-format=F   text (server.log, 預設) 或 binary (server.blog，只記錄呼叫點編號與原始參數，用 log_decode 還原)\n");
+    fprintf(stderr, "  --trace=FILE     把每個叫車請求的中繼資料擷取到 FILE (用 trace_replay 重播)\n");
+    fprintf(stderr, "  --lock-profile   啟動時就記錄 state->mutex 各呼叫點的等待 / 持有時間 (執行中可用 SIGUSR1 開關，停止時報表寫入 log)\n");
+    fprintf(stderr, "  --metrics-port=N 在 127.0.0.1:N 以 Prometheus 文字格式輸出各階段延遲與計數 (0=停用, 預設)\n");
+    fprintf(stderr, "  --span-trace=FILE 抽樣記錄單一請求的各階段時間軸，寫成 Chrome trace-event JSON (Perfetto 可開啟)\n");
+    fprintf(stderr, "  --span-sample=N  每 N 條連線抽一條 (預設 %d；執行中可用 GET /span-sample?every=N 調整，需 --metrics-port)\n", SPAN_DEFAULT_SAMPLE);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <port> <driver_count> [mode: 0=Basic, 1=Smart]\n", argv[0]);
+    int admit_rate = ADMIT_DEFAULT_PER_SEC;
+    int admit_burst = ADMIT_DEFAULT_BURST;
+    int io_backend = IO_BACKEND_CLASSIC;
+    int udp_port = -1; // -1 = 與 TCP 埠相同
+    uint64_t fleet_key = DRIVER_FLEET_KEY_NONE;
+    int recover = 0;
+    int discard_wal = 0;
+    int wal_fsync = JOURNAL_FSYNC_INTERVAL;
+    int wal_interval_ms = JOURNAL_DEFAULT_INTERVAL_MS;
+    int snapshot_interval = SNAPSHOT_DEFAULT_INTERVAL;
+    int log_overflow = LOG_OVERFLOW_DROP;
+    int log_rotate_mb = LOG_DEFAULT_ROTATE_MB;
+    int log_format = LOG_FORMAT_TEXT;
+    const char *trace_path = NULL;
+    int metrics_port = 0;
+    int lock_profile = 0;
+    const char *span_path = NULL;
+    int span_sample_every = SPAN_DEFAULT_SAMPLE;
+    int workers_min = POOL_DEFAULT_MIN;
+    int workers_max = POOL_MAX_WORKERS;
+    int worker_idle_secs = POOL_DEFAULT_IDLE_SECS;
+
+    // 解析選項 (getopt_long 會把位置參數排到最後，選項可放在任何位置)
+    static struct option long_options[] = {
+        {"admit-rate",  required_argument, NULL, 'a'},
+        {"admit-burst", required_argument, NULL, 'b'},
+        {"io-backend",  required_argument, NULL, 'i'},
+        {"udp-port",    required_argument, NULL, 'u'},
+        {"fleet-key",   required_argument, NULL, 'k'},
+        {"recover",     no_argument,       NULL, 'r'},
+        {"discard-wal", no_argument,       NULL, 'D'},
+        {"wal-fsync",   required_argument, NULL, 'w'},
+        {"wal-interval-ms", required_argument, NULL, 'W'},
+        {"snapshot-interval", required_argument, NULL, 's'},
+        {"log-overflow", required_argument, NULL, 'o'},
+        {"log-rotate-mb", required_argument, NULL, 'R'},
+        {"log-format",  required_argument, NULL, 'f'},
+        {"trace",       required_argument, NULL, 't'},
+        {"metrics-port", required_argument, NULL, 'M'},
+        {"lock-profile", no_argument,      NULL, 'L'},
+        {"span-trace",  required_argument, NULL, 'T'},
+        {"span-sample", required_argument, NULL, 'N'},
+        {"workers-min", required_argument, NULL, 'm'},
+        {"workers-max", required_argument, NULL, 'x'},
+        {"worker-idle-sec", required_argument, NULL, 'I'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'a': admit_rate = atoi(optarg); break;
+            case 'b': admit_burst = atoi(optarg); break;
+            case 'u': udp_port = atoi(optarg); break;
+            case 'k': fleet_key = strtoull(optarg, NULL, 0); break;
+            case 'r': recover = 1; break;
+            case 'D': discard_wal = 1; break;
+            case 'W': wal_interval_ms = atoi(optarg); break;
+            case 's': snapshot_interval = atoi(optarg); break;
+            case 'R': log_rotate_mb = atoi(optarg); break;
+            case 't': trace_path = optarg; break;
+            case 'M': metrics_port = atoi(optarg); break;
+            case 'L': lock_profile = 1; break;
+            case 'T': span_path = optarg; break;
+            case 'N': span_sample_every = atoi(optarg); break;
+            case 'm': workers_min = atoi(optarg); break;
+            case 'x': workers_max = atoi(optarg); break;
+            case 'I': worker_idle_secs = atoi(optarg); break;
+            case 'o':
+                if (strcmp(optarg, "drop") == 0) {
+                    log_overflow = LOG_OVERFLOW_DROP;
+                } else if (strcmp(optarg, "block") == 0) {
+                    log_overflow = LOG_OVERFLOW_BLOCK;
+                } else {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    log_format = LOG_FORMAT_TEXT;
+                } else if (strcmp(optarg, "binary") == 0) {
+                    log_format = LOG_FORMAT_BINARY;
+                } else {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                if (strcmp(optarg, "always") == 0) {
+                    wal_fsync = JOURNAL_FSYNC_ALWAYS;
+                } else if (strcmp(optarg, "interval") == 0) {
+                    wal_fsync = JOURNAL_FSYNC_INTERVAL;
+                } else if (strcmp(optarg, "none") == 0) {
+                    wal_fsync = JOURNAL_FSYNC_NONE;
+                } else {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'i':
+                if (strcmp(optarg, "uring") == 0) {
+                    io_backend = IO_BACKEND_URING;
+                } else if (strcmp(optarg, "classic") == 0) {
+                    io_backend = IO_BACKEND_CLASSIC;
+                } else {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind < 2 || workers_min < 1 || workers_max > POOL_MAX_WORKERS || workers_min > workers_max ||
+        (udp_port > 0 && fleet_key == DRIVER_FLEET_KEY_NONE) || admit_rate < 0 || admit_rate > RATE_LIMIT_MAX_PER_SEC || admit_burst < 1 || admit_burst > RATE_LIMIT_MAX_BURST) {
+        print_usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    int port = atoi(argv[1]);
-    int driver_count = atoi(argv[2]);
-    int mode = (argc >= 4) ? atoi(argv[3]) : 1; 
+    int port = atoi(argv[optind]);
+    int driver_count = atoi(argv[optind + 1]);
+    int mode = (argc - optind >= 3) ? atoi(argv[optind + 2]) : 1; 
 
-    // 初始化 Log 系統
-    log_init("server.log");
+    // 初始化 Log 系統 (共享緩衝區必須在 fork 之前建立，寫入執行緒由 Coordinator 啟動)
+    log_init(log_format == LOG_FORMAT_BINARY ? "server.blog" : "server.log");
+    if (log_async_init(log_overflow, log_rotate_mb > 0 ? (size_t)log_rotate_mb * 1024 * 1024 : 0, log_format) < 0) {
+        log_warn("Async logging disabled; writing log lines synchronously.");
+    }
     log_info("Server starting on port %d with %d drivers...", port, driver_count);
     log_info("Dispatch Logic Mode: %s", mode == 1 ? "SMART (VIP Priority)" : "BASIC (Distance Only)");
 
@@ -107,13 +244,35 @@ int main(int argc, char *argv[]) {
 
     // 1：調整初始化順序 (先 memset 再 mutex_init)
     
-    // 強制設定 fp 為 NULL，永遠不讀取舊檔，確保每次都是乾淨啟動
-    FILE *fp = NULL; 
-    
-    if (fp) {
-        // 如果要讀檔，先讀進來
-        load_data_from_file();
-        // 讀檔後，因為 Mutex 狀態可能不對，建議還是要重新初始化 Mutex
+    // 預設每次都是乾淨啟動；--recover 時載入 Snapshot 並重播 WAL
+    int loaded = recover && load_state();
+
+    // 重新開始時的第一個 Snapshot 會清空 WAL：上次當機留下的記錄只存在那裡，不能默默丟掉
+    if (!loaded && !discard_wal && journal_has_records(JOURNAL_FILE)) {
+        log_error("%s holds changes that are not in a loaded %s. Restart with --recover, or pass --discard-wal to start fresh anyway.",
+                  JOURNAL_FILE, SNAPSHOT_FILE);
+        fprintf(stderr, "%s holds changes that are not in a loaded %s. Restart with --recover, or pass --discard-wal to start fresh anyway.\n",
+                JOURNAL_FILE, SNAPSHOT_FILE);
+        munmap(g_shared_state, sizeof(SharedState));
+        close(g_shm_fd);
+        shm_unlink(SHM_NAME);
+        log_cleanup();
+        exit(EXIT_FAILURE);
+    }
+
+    if (loaded) {
+        // 此時還沒有其他進程，重播不需要上鎖 (Mutex 稍後重新初始化)
+        journal_replay(JOURNAL_FILE, g_shared_state);
+        g_shared_state->dispatch_mode = mode;
+        memset(&g_shared_state->driver_push, 0, sizeof(DriverPushTable)); // 長連線不會跨越重啟
+        memset(&g_shared_state->snapshot, 0, sizeof(SnapshotStats));       // 統計只算這次執行
+        memset(&g_shared_state->metrics, 0, sizeof(DispatcherMetrics));   // 同上
+        memset(&g_shared_state->lock_profile, 0, sizeof(LockProfile));    // 同上
+        for (int i = 0; i < g_shared_state->driver_count; i++) {
+            g_shared_state->drivers[i].loc_updated = 0; // 單調時鐘不跨越重啟，改回模擬移動直到下一次回報
+        }
+        log_info("Recovered state: %d drivers, %lu rides, revenue $%ld.", g_shared_state->driver_count,
+                 g_shared_state->total_success_requests, g_shared_state->total_revenue);
     } else {
         log_info("Starting fresh (Ignoring old save file)...");
         
@@ -151,14 +310,61 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // 依照初始司機分佈建立區域供需計數器
+    pricing_rebuild_zones(g_shared_state);
+    g_shared_state->server_pid = getpid(); // Coordinator 就是這個進程
+
+    // 限流表每次啟動都重新開始 (時間刻度與舊存檔無關)
+    rate_limit_table_init(&g_shared_state->rate_limit, RATE_LIMIT_PER_SEC, RATE_LIMIT_BURST);
+    rate_limit_table_init(&g_shared_state->peer_admission, (uint32_t)admit_rate, (uint32_t)admit_burst);
+    if (admit_rate > 0) {
+        log_info("Admission control: %d new connections/s per IP (burst %d)", admit_rate, admit_burst);
+    } else {
+        log_info("Admission control disabled.");
+    }
+
+    // Ticket Key 每次啟動都重新產生，舊 Ticket 一律失效
+    ticket_keyring_init(&g_shared_state->tickets);
+
+    // Dispatcher I/O 後端：核心不支援 io_uring 需要的功能時退回阻塞式迴圈
+    if (io_backend == IO_BACKEND_URING && !uring_dispatcher_supported()) {
+        log_warn("io_uring backend not supported by this kernel. Falling back to classic I/O.");
+        io_backend = IO_BACKEND_CLASSIC;
+    }
+    dispatcher_set_io_backend(io_backend);
+    log_info("Dispatcher I/O backend: %s", io_backend == IO_BACKEND_URING ? "io_uring" : "classic");
+
+    // UDP 定位回報 (接收執行緒由 Coordinator 啟動)
+    location_service_configure(udp_port < 0 ? port : udp_port, fleet_key);
+
     // 2. 現在才初始化互斥鎖 (確保不會被 memset 清掉)
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST); // Worker 持鎖時崩潰，其他進程仍可接手
     
     // 無論是讀檔還是全新，都重新初始化鎖，確保當前 Process 可用
     pthread_mutex_init(&g_shared_state->mutex, &attr);
 
+    // WAL：環狀緩衝區必須在 fork 之前建立。先寫一次 Snapshot 作為檢查點，
+    // 之後的 WAL 只需要記錄這個時間點之後的變更
+    if (journal_init(JOURNAL_FILE, wal_fsync, wal_interval_ms, g_shared_state->journal_lsn) < 0) {
+        log_warn("Write-ahead journal disabled.");
+    }
+    save_state();
+    snapshot_configure(snapshot_interval);
+
+    // 請求擷取 (環狀緩衝區同樣必須在 fork 之前建立)
+    if (trace_path != NULL && trace_init(trace_path) < 0) {
+        log_warn("Request capture disabled.");
+    }
+    if (span_path != NULL && span_trace_init(span_path, span_sample_every < 0 ? 0 : (uint32_t)span_sample_every) < 0) {
+        log_warn("Span trace disabled.");
+    }
+    metrics_configure(metrics_port);
+    worker_pool_configure(workers_min, workers_max, worker_idle_secs);
+    if (lock_profile) lock_profile_set(1);
+
     // 3. 建立 Server Socket
     int server_fd = create_server_socket(port);
     if (server_fd < 0) {
@@ -173,6 +379,7 @@ int main(int argc, char *argv[]) {
     cleanup_resources();
     close(server_fd);
     log_info("Server stopped.");
+    log_cleanup();
 
     return 0;
 }
\ No newline at end of file
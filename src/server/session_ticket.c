@@ -0,0 +1,130 @@
+/* src/server/session_ticket.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include "session_ticket.h"
+#include "../../common/include/log_system.h"
+#include "lock_profile.h"
+
+extern SharedState *g_shared_state;
+
+// Ticket 內被加密的明文內容 (剛好 SESSION_TICKET_SEALED_LEN bytes)
+typedef struct {
+    int64_t resumption_secret;
+    uint32_t issued_at;         // 簽發時間 (Unix time)
+    uint32_t magic;             // 解密後的快速檢查
+} __attribute__((packed)) TicketPlain;
+
+#define TICKET_MAGIC 0x544b5431 // "TKT1"
+
+_Static_assert(sizeof(TicketPlain) == SESSION_TICKET_SEALED_LEN, "TicketPlain must fill the sealed area");
+
+static uint64_t random_key() {
+    uint64_t key = 0;
+    if (getrandom(&key, sizeof(key), 0) != sizeof(key)) {
+        // 極少見：退回時間與 PID 混合
+        key = ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid() ^ (uint64_t)rand();
+    }
+    return key;
+}
+
+// 以 (key, nonce) 產生金鑰流並 XOR (加密與解密是同一個動作)
+static void ticket_xor_stream(uint64_t key, uint32_t nonce, uint8_t *data, size_t len) {
+    for (size_t off = 0; off < len; off += 8) {
+        uint64_t block_id = ((uint64_t)nonce << 32) | (off / 8);
+        uint64_t ks = keyed_digest(key, (const uint8_t *)&block_id, sizeof(block_id));
+        for (size_t i = 0; i < 8 && off + i < len; i++) {
+            data[off + i] ^= (uint8_t)(ks >> (8 * i));
+        }
+    }
+}
+
+// 標籤涵蓋 Ticket 中除了 tag 以外的所有欄位
+static uint64_t ticket_tag(uint64_t key, const SessionTicket *t) {
+    return keyed_digest(~key, (const uint8_t *)t, offsetof(SessionTicket, tag));
+}
+
+// 金鑰過期就輪替 (由最先發現的 Dispatcher 負責，持鎖避免重複輪替)
+static void ticket_maybe_rotate(TicketKeyring *ring) {
+    time_t now = time(NULL);
+    if (now - ring->rotated_at < TICKET_KEY_ROTATE_SECS) return;
+
+    uint64_t lock_token = state_lock(LOCK_SITE_TICKET_ROTATE);
+    if (now - ring->rotated_at >= TICKET_KEY_ROTATE_SECS) {
+        uint32_t next = ring->generation + 1;
+        ring->keys[next & 1] = random_key(); // 覆蓋上上一代
+        ring->rotated_at = now;
+        __atomic_store_n(&ring->generation, next, __ATOMIC_RELEASE);
+        log_info("[Security] Session ticket key rotated (generation %u).", next);
+    }
+    state_unlock(LOCK_SITE_TICKET_ROTATE, lock_token);
+}
+
+void ticket_keyring_init(TicketKeyring *ring) {
+    memset(ring, 0, sizeof(TicketKeyring));
+    ring->generation = 1;
+    ring->rotated_at = time(NULL);
+    ring->keys[0] = random_key();
+    ring->keys[1] = random_key();
+}
+
+void ticket_issue(long long resumption_secret, SessionTicketData *out) {
+    TicketKeyring *ring = &g_shared_state->tickets;
+    ticket_maybe_rotate(ring);
+
+    uint32_t gen = __atomic_load_n(&ring->generation, __ATOMIC_ACQUIRE);
+    uint64_t key = ring->keys[gen & 1];
+
+    TicketPlain plain;
+    plain.resumption_secret = resumption_secret;
+    plain.issued_at = (uint32_t)time(NULL);
+    plain.magic = TICKET_MAGIC;
+
+    SessionTicket *t = &out->ticket;
+    t->key_generation = gen;
+    t->ticket_nonce = __atomic_fetch_add(&ring->next_nonce, 1, __ATOMIC_RELAXED);
+    memcpy(t->sealed, &plain, sizeof(plain));
+    ticket_xor_stream(key, t->ticket_nonce, t->sealed, sizeof(t->sealed));
+    t->tag = ticket_tag(key, t);
+
+    out->lifetime_secs = TICKET_LIFETIME_SECS;
+    __atomic_fetch_add(&ring->issued_count, 1, __ATOMIC_RELAXED);
+}
+
+// 驗證標籤、解密並檢查有效期；任何一步失敗就回傳 -1
+static int ticket_open(TicketKeyring *ring, const SessionTicket *ticket, long long *resumption_secret_out) {
+    uint32_t gen = __atomic_load_n(&ring->generation, __ATOMIC_ACQUIRE);
+
+    // 只接受目前這一代與上一代的金鑰
+    if (ticket->key_generation != gen && ticket->key_generation + 1 != gen) return -1;
+
+    uint64_t key = ring->keys[ticket->key_generation & 1];
+    if (ticket_tag(key, ticket) != ticket->tag) return -1;
+
+    TicketPlain plain;
+    memcpy(&plain, ticket->sealed, sizeof(plain));
+    ticket_xor_stream(key, ticket->ticket_nonce, (uint8_t *)&plain, sizeof(plain));
+    if (plain.magic != TICKET_MAGIC) return -1;
+
+    uint32_t now = (uint32_t)time(NULL);
+    if (now - plain.issued_at > TICKET_LIFETIME_SECS) return -1;
+
+    *resumption_secret_out = plain.resumption_secret;
+    return 0;
+}
+
+int ticket_redeem(const SessionTicket *ticket, long long *resumption_secret_out) {
+    TicketKeyring *ring = &g_shared_state->tickets;
+    if (ticket_open(ring, ticket, resumption_secret_out) < 0) {
+        __atomic_fetch_add(&ring->rejected_count, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    __atomic_fetch_add(&ring->resumed_count, 1, __ATOMIC_RELAXED);
+    return 0;
+}
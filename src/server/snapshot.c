@@ -0,0 +1,315 @@
+/* src/server/snapshot.c */
+// 背景 Snapshot 與 Snapshot 檔的讀寫 (檔案格式見 snapshot_format.h)
+// 關機時的 Snapshot 可以直接讀共享記憶體 (Worker 都已停止)；執行中要寫就必須讓狀態在寫檔期間不變。
+// 對 MAP_SHARED 的共享記憶體 fork 不會有 copy-on-write (子進程看到的是同一組實體頁面)，
+// 所以改成：持有 mutex 只把需要持久化的欄位轉成檔案格式的映像 (同時記下 WAL 的輪替點)，
+// 解鎖後再由這個執行緒慢慢寫檔 + fsync + rename + fsync 目錄。Dispatcher 被擋住的時間只有那次轉換。
+// Snapshot 就位之後，輪替點之前的 WAL 舊檔 (server.wal.1) 就可以刪除，WAL 不會無限增長。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "../../common/include/shared_data.h"
+#include "../../common/include/log_system.h"
+#include "../../common/include/snapshot_format.h"
+#include "../include/journal.h"
+#include "../include/snapshot.h"
+#include "../include/lock_profile.h"
+
+extern SharedState *g_shared_state;
+extern volatile sig_atomic_t g_running;
+
+static int g_interval_secs = 0;
+static SnapshotImage g_image;           // 背景 Snapshot 私有的映像 (只有 Snapshot 執行緒使用)
+static pthread_mutex_t g_write_lock = PTHREAD_MUTEX_INITIALIZER; // 背景與關機 Snapshot 共用同一個暫存檔
+static uint64_t g_saved_lsn = 0;        // 已寫入的 Snapshot 包含到的 LSN (g_write_lock 保護)
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void snapshot_configure(int interval_secs) {
+    g_interval_secs = interval_secs > 0 ? interval_secs : 0;
+}
+
+/**
+ * 在 offset 寫入完整的 len bytes。
+ */
+static int write_at(int fd, const void *buf, size_t len, off_t offset) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+ * 依照目前版本的格式寫出整個檔案：各區段從分頁邊界開始，最後才寫檔頭與區段表。
+ */
+static int write_image(int fd, const SnapshotImage *image) {
+    struct {
+        uint32_t id;
+        uint32_t record_size;
+        uint64_t record_count;
+        const void *data;
+    } parts[] = {
+        { SNAPSHOT_SEC_COUNTERS, sizeof(SnapshotCounters), 1, &image->counters },
+        { SNAPSHOT_SEC_DRIVERS, sizeof(SnapshotDriver), image->counters.driver_count, image->drivers },
+        { SNAPSHOT_SEC_ZONES, sizeof(SnapshotZone), ZONE_COUNT, image->zones },
+        { SNAPSHOT_SEC_STATS, sizeof(SnapshotStatsRecord), 1, &image->stats },
+    };
+    const uint32_t count = sizeof(parts) / sizeof(parts[0]);
+    SnapshotSection table[sizeof(parts) / sizeof(parts[0])];
+    uint64_t offset = SNAPSHOT_PAGE; // 第一頁放檔頭與區段表
+
+    memset(table, 0, sizeof(table));
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t length = (uint64_t)parts[i].record_size * parts[i].record_count;
+        table[i].id = parts[i].id;
+        table[i].record_size = parts[i].record_size;
+        table[i].record_count = parts[i].record_count;
+        table[i].offset = offset;
+        table[i].length = length;
+        table[i].crc = snapshot_crc32(0, parts[i].data, length);
+        if (write_at(fd, parts[i].data, length, (off_t)offset) < 0) return -1;
+        offset += (length + SNAPSHOT_PAGE - 1) / SNAPSHOT_PAGE * SNAPSHOT_PAGE;
+    }
+
+    SnapshotFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.header_size = sizeof(SnapshotFileHeader);
+    hdr.section_count = count;
+    hdr.section_entry_size = sizeof(SnapshotSection);
+    hdr.journal_lsn = image->journal_lsn;
+    hdr.created_at = image->created_at;
+    hdr.header_crc = snapshot_crc32(snapshot_crc32(0, &hdr, offsetof(SnapshotFileHeader, header_crc)), table, sizeof(table));
+
+    if (write_at(fd, &hdr, sizeof(hdr), 0) < 0 || write_at(fd, table, sizeof(table), sizeof(hdr)) < 0) return -1;
+    return ftruncate(fd, (off_t)offset); // 補齊最後一頁，整個檔案都可以 mmap
+}
+
+int snapshot_write(const SnapshotImage *image) {
+    pthread_mutex_lock(&g_write_lock);
+    int result = -1;
+    if (image->journal_lsn < g_saved_lsn) {
+        // 關機 Snapshot 已經搶先寫入更新的狀態 (WAL 也已清空)，較舊的映像不能再蓋過去
+        pthread_mutex_unlock(&g_write_lock);
+        return -1;
+    }
+    int fd = open(SNAPSHOT_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        log_error("Failed to save state to %s: %s", SNAPSHOT_FILE, strerror(errno));
+    } else if (write_image(fd, image) != 0 || fsync(fd) != 0) {
+        log_error("Error writing state to file: %s", strerror(errno));
+        close(fd);
+        unlink(SNAPSHOT_FILE ".tmp");
+    } else {
+        close(fd);
+        if (rename(SNAPSHOT_FILE ".tmp", SNAPSHOT_FILE) != 0) {
+            log_error("Failed to replace %s: %s", SNAPSHOT_FILE, strerror(errno));
+        } else if (journal_sync_dir(SNAPSHOT_FILE) != 0) {
+            // rename 還沒落盤：當機後可能仍是舊檔，所以不能回報成功 (呼叫端會保留 WAL)
+            log_error("Failed to sync directory of %s: %s", SNAPSHOT_FILE, strerror(errno));
+        } else {
+            g_saved_lsn = image->journal_lsn;
+            result = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_write_lock);
+    return result;
+}
+
+/**
+ * 套用計數器 (state 的其餘欄位清為 0，司機表由呼叫端填入)。
+ */
+static void restore_counters(const SnapshotCounters *c, uint64_t journal_lsn, SharedState *state) {
+    memset(state, 0, sizeof(SharedState));
+    state->journal_lsn = journal_lsn;
+    state->driver_count = (int)c->driver_count;
+    state->dispatch_mode = c->dispatch_mode;
+    state->next_ride_id = c->next_ride_id;
+    state->total_connections_accepted = c->total_connections_accepted;
+    state->total_requests_handled = c->total_requests_handled;
+    state->total_success_requests = c->total_success_requests;
+    state->total_revenue = (long)c->total_revenue;
+}
+
+/**
+ * 驗證 mmap 進來的目前格式檔案並套用到 state。
+ * return NULL = 成功，否則為錯誤說明
+ */
+static const char *load_sections(const uint8_t *map, uint64_t size, SharedState *state) {
+    const SnapshotFileHeader *hdr = (const SnapshotFileHeader *)map;
+    if (size < sizeof(SnapshotFileHeader)) return "truncated header";
+    if (hdr->section_count > SNAPSHOT_MAX_SECTIONS ||
+        size < sizeof(SnapshotFileHeader) + hdr->section_count * sizeof(SnapshotSection)) {
+        return "truncated section table";
+    }
+    const SnapshotSection *sections = (const SnapshotSection *)(map + sizeof(SnapshotFileHeader));
+    const char *why = snapshot_header_check(hdr, sections, size);
+    if (why != NULL) return why;
+
+    // 每個區段 (包含不認得的) 都要通過校驗才套用，避免半新半舊的狀態
+    for (uint32_t i = 0; i < hdr->section_count; i++) {
+        if (snapshot_crc32(0, map + sections[i].offset, sections[i].length) != sections[i].crc) {
+            return "section checksum mismatch";
+        }
+    }
+
+    const SnapshotSection *sec_counters = snapshot_find_section(hdr, sections, SNAPSHOT_SEC_COUNTERS, sizeof(SnapshotCounters));
+    const SnapshotSection *sec_drivers = snapshot_find_section(hdr, sections, SNAPSHOT_SEC_DRIVERS, sizeof(SnapshotDriver));
+    if (sec_counters == NULL || sec_counters->record_count < 1 || sec_drivers == NULL) return "missing required section";
+
+    const SnapshotCounters *c = (const SnapshotCounters *)(map + sec_counters->offset);
+    if (c->driver_count > MAX_DRIVERS || c->driver_count > sec_drivers->record_count) return "bad driver count";
+
+    restore_counters(c, hdr->journal_lsn, state);
+
+    // 司機表直接在映射上以 record_size 為步長讀取 (較新版本加在記錄尾端的欄位自然略過)
+    const uint8_t *rec = map + sec_drivers->offset;
+    for (uint32_t i = 0; i < c->driver_count; i++, rec += sec_drivers->record_size) {
+        snapshot_driver_restore((const SnapshotDriver *)rec, &state->drivers[i]);
+    }
+    return NULL;
+}
+
+int snapshot_load(SharedState *state) {
+    int fd = open(SNAPSHOT_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        log_warn("%s is empty. Ignoring it.", SNAPSHOT_FILE);
+        return 0;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_error("mmap %s failed: %s", SNAPSHOT_FILE, strerror(errno));
+        return 0;
+    }
+
+    int version = 0;
+    const char *why = NULL;
+    if (size >= sizeof(SnapshotFileHeader) && memcmp(map, SNAPSHOT_MAGIC, 8) == 0) {
+        why = load_sections(map, size, state);
+        if (why == NULL) version = (int)((const SnapshotFileHeader *)map)->version;
+    } else {
+        // 版本 1：依凍結的第一版版面解碼 (mutex 與不持久化的區塊由呼叫端重新初始化)
+        static SnapshotImage v1_image;
+        why = snapshot_v1_decode(map, size, &v1_image);
+        if (why == NULL) {
+            restore_counters(&v1_image.counters, 0, state);
+            for (uint32_t i = 0; i < v1_image.counters.driver_count; i++) {
+                snapshot_driver_restore(&v1_image.drivers[i], &state->drivers[i]);
+            }
+            version = SNAPSHOT_VERSION_RAW;
+        }
+    }
+    munmap(map, size);
+
+    if (version == 0) {
+        // 保留壞掉的檔案供檢查 (接下來的啟動檢查點會寫出新的 server.dat)
+        log_warn("Snapshot %s rejected: %s. Kept as %s.bad", SNAPSHOT_FILE, why, SNAPSHOT_FILE);
+        rename(SNAPSHOT_FILE, SNAPSHOT_FILE ".bad");
+    } else {
+        log_info("Snapshot %s loaded (format v%d, %lu bytes, journal LSN %lu).",
+                 SNAPSHOT_FILE, version, size, state->journal_lsn);
+    }
+    return version;
+}
+
+int snapshot_take(void) {
+    SnapshotStats *stats = &g_shared_state->snapshot;
+
+    // 1. 短暫讓所有寫入者停下：轉出映像，並要求 WAL 在同一點換檔
+    uint64_t lock_token = state_lock(LOCK_SITE_SNAPSHOT);
+    double t0 = now_ms();
+    uint64_t lsn = journal_rotate();
+    if (lsn == 0) lsn = g_shared_state->journal_lsn; // WAL 停用
+    g_shared_state->journal_lsn = lsn;
+    snapshot_image_capture(g_shared_state, &g_image);
+    double stall = now_ms() - t0;
+    state_unlock(LOCK_SITE_SNAPSHOT, lock_token);
+
+    // 2. 鎖外寫檔
+    double t1 = now_ms();
+    int result = snapshot_write(&g_image);
+    double write_ms = now_ms() - t1;
+
+    // 3. Snapshot 已包含輪替點之前的所有變更，舊的 WAL 檔可以刪除
+    if (result == 0) journal_drop_rotated(lsn);
+
+    stats->last_stall_ms = stall;
+    stats->total_stall_ms += stall;
+    if (stall > stats->max_stall_ms) stats->max_stall_ms = stall;
+    stats->last_write_ms = write_ms;
+    if (result == 0) {
+        stats->taken++;
+        stats->last_lsn = lsn;
+        stats->last_taken_at = time(NULL);
+    } else {
+        stats->failed++;
+    }
+    log_info("Background snapshot %s: LSN %lu, stall %.3f ms, write %.1f ms.",
+             result == 0 ? "saved" : "FAILED", lsn, stall, write_ms);
+    return result;
+}
+
+static void *snapshot_thread(void *arg) {
+    (void)arg;
+    // SIGINT 交給其他執行緒處理：關機 Snapshot 與這裡共用 g_write_lock，在持有時被訊號打斷會死結
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    double next = now_ms() + g_interval_secs * 1000.0;
+    while (g_running) {
+        usleep(200 * 1000); // 定期檢查 g_running
+        if (now_ms() < next) continue;
+        snapshot_take();
+        next = now_ms() + g_interval_secs * 1000.0;
+    }
+    return NULL;
+}
+
+int snapshot_start(void) {
+    if (g_shared_state == NULL) return -1;
+    g_shared_state->snapshot.interval_secs = (uint32_t)g_interval_secs;
+    if (g_interval_secs == 0) {
+        log_info("Background snapshots disabled.");
+        return 0;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, snapshot_thread, NULL) != 0) {
+        log_error("Failed to start snapshot thread.");
+        return -1;
+    }
+    pthread_detach(tid);
+    log_info("Background snapshots every %d s.", g_interval_secs);
+    return 0;
+}
@@ -0,0 +1,217 @@
+/* src/server/span_trace.c */
+// 抽樣的單一請求時間軸：Worker 端寫入單一生產者環，Coordinator 的寫入執行緒轉成 Chrome trace-event JSON
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "../../common/include/log_system.h"
+#include "../include/metrics.h"
+#include "../include/span_trace.h"
+
+uint64_t g_span_current = 0;
+
+static SpanBuffers *g_spans = NULL;
+static FILE *g_span_file = NULL;
+static int g_span_worker = 0;
+static uint64_t g_span_conn_seq = 0;    // 這個 Worker 看過的連線數 (決定抽樣)
+static pthread_t g_span_tid;
+static volatile int g_span_running = 0;
+static uint64_t g_span_written = 0;
+static int g_span_first = 1;            // JSON 陣列的第一個元素前面不加逗號
+
+// 寫入執行緒私有的批次緩衝區
+static SpanEvent g_span_batch[SPAN_RING_SLOTS];
+
+static const char *span_name(uint32_t name) {
+    if (name == SPAN_ACCEPT) return "accept";
+    if (name == SPAN_CONNECTION) return "connection";
+    return metrics_stage_name((MetricsStage)name);
+}
+
+//  A. 初始化
+int span_trace_init(const char *path, uint32_t sample_every) {
+    g_span_file = fopen(path, "w");
+    if (g_span_file == NULL) {
+        log_error("Failed to open span trace %s: %s", path, strerror(errno));
+        return -1;
+    }
+    SpanBuffers *spans = mmap(NULL, sizeof(SpanBuffers), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (spans == MAP_FAILED) {
+        log_error("Span trace mmap failed: %s", strerror(errno));
+        fclose(g_span_file);
+        g_span_file = NULL;
+        return -1;
+    }
+    memset(spans, 0, sizeof(SpanBuffers));
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    spans->start_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    spans->sample_every = sample_every;
+    g_spans = spans;
+
+    // JSON Array Format：結尾的 ] 可以省略，Server 異常結束時檔案仍可開啟
+    fputs("[\n", g_span_file);
+    log_info("Tracing 1 in %u connections to %s (Chrome trace-event JSON).", sample_every, path);
+    return 0;
+}
+
+void span_attach(int worker) {
+    g_span_worker = (worker >= 0 && worker < METRICS_MAX_WORKERS) ? worker : 0;
+    if (g_spans == NULL) return;
+    SpanRing *ring = &g_spans->rings[g_span_worker];
+    ring->pid = getpid();
+    __atomic_store_n(&ring->named, 0, __ATOMIC_RELEASE); // 讓寫入執行緒重新輸出 process_name
+}
+
+//  B. Worker 端
+uint64_t span_sample(void) {
+    if (g_spans == NULL) return 0;
+    uint32_t every = __atomic_load_n(&g_spans->sample_every, __ATOMIC_RELAXED);
+    if (every == 0 || ++g_span_conn_seq % every != 0) return 0;
+    // 高 32 bits = Worker 編號 + 1，低 32 bits = 這一格的序號 (同一格重生的 Worker 接著編號)
+    SpanRing *ring = &g_spans->rings[g_span_worker];
+    uint32_t seq = ring->trace_seq + 1;
+    __atomic_store_n(&ring->trace_seq, seq, __ATOMIC_RELAXED);
+    return ((uint64_t)(g_span_worker + 1) << 32) | seq;
+}
+
+void span_record(uint64_t trace_id, uint32_t name, uint64_t start_ns, uint64_t end_ns) {
+    if (trace_id == 0 || g_spans == NULL) return;
+    SpanRing *ring = &g_spans->rings[g_span_worker];
+
+    uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= SPAN_RING_SLOTS) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    SpanEvent *ev = &ring->events[head & (SPAN_RING_SLOTS - 1)];
+    ev->trace_id = trace_id;
+    ev->start_ns = start_ns;
+    ev->end_ns = end_ns;
+    ev->name = name;
+    ev->reserved = 0;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int span_set_sample(uint32_t every) {
+    if (g_spans == NULL) return -1;
+    __atomic_store_n(&g_spans->sample_every, every, __ATOMIC_RELAXED);
+    if (every == 0) log_info("Span trace sampling paused.");
+    else log_info("Span trace sampling set to 1 in %u connections.", every);
+    return 0;
+}
+
+uint32_t span_get_sample(void) {
+    return g_spans != NULL ? __atomic_load_n(&g_spans->sample_every, __ATOMIC_RELAXED) : 0;
+}
+
+//  C. 寫入執行緒
+static void write_event(const char *json) {
+    fputs(g_span_first ? "" : ",\n", g_span_file);
+    fputs(json, g_span_file);
+    g_span_first = 0;
+}
+
+/**
+ * 取走一個 Worker 環中的所有 span 並寫成 JSON。
+ * return 寫出的 span 數
+ */
+static int drain_ring(int worker) {
+    SpanRing *ring = &g_spans->rings[worker];
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    int count = (int)(head - tail);
+    if (count == 0) return 0;
+    for (int i = 0; i < count; i++) g_span_batch[i] = ring->events[(tail + i) & (SPAN_RING_SLOTS - 1)];
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+
+    // pid = Worker 編號 + 1 (0 留給 Coordinator)，tid = trace 序號：每個請求一條軌道
+    char line[320];
+    int pid = worker + 1;
+    if (!__atomic_load_n(&ring->named, __ATOMIC_ACQUIRE)) {
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"dispatcher %d (pid %d)\"}}",
+                 pid, worker, ring->pid);
+        write_event(line);
+        ring->named = 1;
+    }
+    for (int i = 0; i < count; i++) {
+        const SpanEvent *ev = &g_span_batch[i];
+        uint32_t tid = (uint32_t)ev->trace_id;
+        double ts = (ev->start_ns - g_spans->start_ns) / 1e3;
+        double dur = (ev->end_ns - ev->start_ns) / 1e3;
+        if (ev->name == SPAN_CONNECTION) {
+            snprintf(line, sizeof(line),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"trace %016lx\"}}",
+                     pid, tid, ev->trace_id);
+            write_event(line);
+        }
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"%s\",\"cat\":\"ride\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                 "\"args\":{\"trace_id\":\"%016lx\"}}",
+                 span_name(ev->name), ts, dur, pid, tid, ev->trace_id);
+        write_event(line);
+    }
+    return count;
+}
+
+static void drain_all(void) {
+    int total = 0;
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) total += drain_ring(w);
+    if (total > 0) {
+        fflush(g_span_file);
+        g_span_written += total;
+    }
+}
+
+static void *span_writer_thread(void *arg) {
+    (void)arg;
+    // SIGINT 必須由其他執行緒處理：關機流程會 join 這個執行緒
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    struct timespec pause = { 0, SPAN_FLUSH_MS * 1000000L };
+    while (g_span_running) {
+        nanosleep(&pause, NULL);
+        drain_all();
+    }
+    return NULL;
+}
+
+int span_trace_start(void) {
+    if (g_spans == NULL) return 0;
+    g_span_running = 1;
+    if (pthread_create(&g_span_tid, NULL, span_writer_thread, NULL) != 0) {
+        g_span_running = 0;
+        log_error("Failed to start span trace writer.");
+        return -1;
+    }
+    return 0;
+}
+
+void span_trace_shutdown(void) {
+    if (g_spans == NULL) return;
+    if (g_span_running) {
+        g_span_running = 0;
+        pthread_join(g_span_tid, NULL);
+    }
+    drain_all();
+    fputs("\n]\n", g_span_file);
+    fclose(g_span_file);
+    g_span_file = NULL;
+
+    uint64_t dropped = 0;
+    for (int w = 0; w < METRICS_MAX_WORKERS; w++) dropped += g_spans->rings[w].dropped;
+    log_info("Span trace: %lu spans written, %lu dropped (buffer full).", g_span_written, dropped);
+    g_spans = NULL;
+}
@@ -0,0 +1,741 @@
+/* src/server/uring_dispatcher.c */
+// io_uring 版的 Dispatcher I/O 迴圈 (直接使用系統呼叫，不依賴 liburing)
+//
+// 傳統迴圈每個請求都要 accept、數次 read/write、close 各一次系統呼叫，而且一個 Worker 同時只能服務一條連線。
+// 這裡每個 Worker 建一個 Ring：
+//   - multishot accept：一次提交，之後每條新連線各產生一個完成事件
+//   - provided buffer ring：recv 不預先綁定緩衝區，資料到了才由核心挑一塊，閒置連線不佔記憶體
+//   - send 與 close 以 IOSQE_IO_LINK 串接：最後的回覆送完由核心直接關閉連線
+//   - 派單 eventfd 以 poll 監聽；司機長連線一直掛著一個 recv (偵測斷線)，推播時另外送出 send
+// Frame 的解析與處理共用 dispatch_frame (與阻塞式迴圈完全相同)，這裡只負責 I/O。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "../../common/include/protocol.h"
+#include "../../common/include/net_wrapper.h"
+#include "../../common/include/log_system.h"
+#include "../include/dispatcher.h"
+#include "../include/resource_service.h"
+#include "../include/uring_dispatcher.h"
+#include "../include/driver_channel.h"
+#include "../include/metrics.h"
+#include "../include/span_trace.h"
+#include "../include/worker_pool.h"
+
+#define URING_ENTRIES     256   // SQ 大小
+#define URING_MAX_CONNS   128   // 每個 Worker 同時處理的連線上限
+#define URING_BUF_COUNT   64    // Provided buffer 數量 (必須是 2 的冪次)
+#define URING_BUF_SIZE    2048  // 每塊 Provided buffer 大小
+#define URING_BUF_GROUP   0
+#define URING_REARM_US    1000  // SQ 滿到連 accept / 推播通知都掛不上時，重試前的等待
+
+// user_data 低 3 bits 標記操作種類，其餘為連線指標 (連線結構至少 8-byte 對齊)
+#define TAG_ACCEPT  0ULL
+#define TAG_RECV    1ULL
+#define TAG_SEND    2ULL
+#define TAG_CLOSE   3ULL
+#define TAG_NOTIFY  4ULL    // 派單 eventfd 可讀
+#define TAG_CANCEL  5ULL    // 取消 multishot accept (完成事件不需處理)
+#define TAG_MASK    7ULL
+
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned sqe_tail;          // 本地已填寫但尚未發布給核心的 SQ tail
+    unsigned to_submit;         // 尚未提交的 SQE 數
+
+    void *ring_ptr;
+    size_t ring_len;
+    size_t sqes_len;
+
+    struct io_uring_buf_ring *buf_ring;
+    uint8_t *buf_base;
+    unsigned buf_tail;
+} Uring;
+
+typedef struct UringConn {
+    int fd;
+    int closing;                // 回覆送完後關閉 (send 已串接 close)
+    int recv_armed;             // 有未完成的 recv
+    int send_armed;             // 有未完成的 send
+    int is_driver;              // 司機長連線：recv 與推播的 send 可能同時進行
+    int push_pending;           // send 進行中又收到派單通知，送完再推播
+    int dead;                   // 司機長連線已斷開，等未完成的操作結束後關閉
+    size_t in_len;              // in_buf 中殘留的不完整 Frame
+    uint64_t send_t0;           // 回覆送出的時間 (STAGE_SEND 從這裡算到 CQE)
+    uint64_t accepted_ns;       // accept 完成的時間 (抽樣連線的 connection span 起點)
+    ClientSession session;
+    ReplyBuffer out;
+    uint8_t in_buf[FRAME_READER_BUF_SIZE];
+    struct UringConn *next_free;
+} UringConn;
+
+static UringConn *g_conns;
+static UringConn *g_free_conns;
+static int g_accept_paused = 0; // 連線表已滿：暫停 accept，讓核心把新連線交給其他 Worker
+static int g_accept_live = 0;   // multishot accept 仍掛著 (退休時等它確實取消才結束)
+static int g_accept_rearm = 0;  // arm_accept 拿不到 SQE：由主迴圈重新提交
+static int g_notify_rearm = 0;  // arm_notify 拿不到 SQE：由主迴圈重新提交
+static uint32_t g_active_conns = 0;    // 連線表的使用量 (退休時等它歸零才結束)
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+//  A. Ring 建立 / 釋放
+/**
+ * 把一塊 Provided buffer 還給核心。
+ */
+static void uring_buf_recycle(Uring *ring, unsigned short bid) {
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->buf_base + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, (uint16_t)ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_teardown(Uring *ring) {
+    if (ring->fd >= 0) close(ring->fd); // 關閉 Ring 會取消所有未完成的操作 (包含 multishot accept)
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    if (ring->ring_ptr) munmap(ring->ring_ptr, ring->ring_len);
+    if (ring->buf_ring) munmap(ring->buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+    free(ring->buf_base);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/**
+ * 建立 Ring、映射 SQ/CQ，並註冊 Provided buffer ring。
+ * return 0 = 成功, -1 = 失敗 (已清理)
+ */
+static int uring_setup(Uring *ring, unsigned entries) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0) return -1;
+
+    // SQ 與 CQ 共用一次 mmap (5.4+)；更舊的核心也沒有 multishot accept，直接放棄
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        uring_teardown(ring);
+        return -1;
+    }
+
+    size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_len = (sq_len > cq_len) ? sq_len : cq_len;
+    ring->ring_ptr = mmap(NULL, ring->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr == MAP_FAILED) {
+        ring->ring_ptr = NULL;
+        uring_teardown(ring);
+        return -1;
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_teardown(ring);
+        return -1;
+    }
+
+    uint8_t *base = ring->ring_ptr;
+    ring->sq_head = (unsigned *)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(base + params.sq_off.ring_mask);
+    ring->cq_head = (unsigned *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+
+    // SQ index array 固定為 1:1 對應，之後只需要推進 tail
+    unsigned *sq_array = (unsigned *)(base + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) sq_array[i] = i;
+
+    // Provided buffer ring (5.19+)：註冊失敗代表核心太舊
+    ring->buf_ring = mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buf_base = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (ring->buf_ring == MAP_FAILED || ring->buf_base == NULL) {
+        if (ring->buf_ring == MAP_FAILED) ring->buf_ring = NULL;
+        uring_teardown(ring);
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        uring_teardown(ring);
+        return -1;
+    }
+    for (unsigned short bid = 0; bid < URING_BUF_COUNT; bid++) {
+        uring_buf_recycle(ring, bid);
+    }
+    return 0;
+}
+
+//  B. 提交 / 收割
+/**
+ * 取得一個空的 SQE；SQ 剩餘空間不足 need 個時先提交 (確保串接的 SQE 在同一批送出)。
+ */
+static struct io_uring_sqe *uring_get_sqe(Uring *ring, unsigned need) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail + need - head > ring->sq_entries) {
+        __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+        int ret = sys_io_uring_enter(ring->fd, ring->to_submit, 0, 0);
+        if (ret > 0) ring->to_submit -= ret;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sqe_tail + need - head > ring->sq_entries) return NULL;
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqe_tail++;
+    ring->to_submit++;
+    return sqe;
+}
+
+/**
+ * 提交所有待送的 SQE；wait_nr > 0 時阻塞到至少有 wait_nr 個完成事件。
+ * return 0 = 成功, -1 = 致命錯誤
+ */
+static int uring_submit(Uring *ring, unsigned wait_nr) {
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    int ret = sys_io_uring_enter(ring->fd, ring->to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) return 0; // 稍後再試
+        return -1;
+    }
+    ring->to_submit -= ret;
+    return 0;
+}
+
+//  C. 連線狀態機
+static UringConn *conn_alloc(int fd) {
+    UringConn *conn = g_free_conns;
+    if (conn == NULL) return NULL;
+    g_free_conns = conn->next_free;
+
+    conn->fd = fd;
+    conn->closing = 0;
+    conn->recv_armed = 0;
+    conn->send_armed = 0;
+    conn->is_driver = 0;
+    conn->push_pending = 0;
+    conn->dead = 0;
+    conn->in_len = 0;
+    conn->out.len = 0;
+    client_session_init(&conn->session);
+    g_active_conns++;
+    return conn;
+}
+
+static void conn_free(UringConn *conn) {
+    if (conn->session.trace_id != 0) span_record(conn->session.trace_id, SPAN_CONNECTION, conn->accepted_ns, metrics_now());
+    conn->fd = -1;
+    conn->next_free = g_free_conns;
+    g_free_conns = conn;
+    g_active_conns--;
+}
+
+static void arm_accept(Uring *ring, int server_fd) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, 1);
+    if (sqe == NULL) {
+        g_accept_rearm = 1; // SQ 提交後仍然是滿的：不掛 accept 這個 Worker 就再也收不到新連線
+        return;
+    }
+    g_accept_rearm = 0;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = TAG_ACCEPT;
+    g_accept_live = 1;
+}
+
+/**
+ * 取消 multishot accept (主迴圈在 g_accept_paused 清除前不會重新提交)。
+ * return 1 = 已送出取消, 0 = 已經暫停或 SQ 滿了
+ */
+static int cancel_accept(Uring *ring) {
+    if (g_accept_paused) return 0;
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, 1);
+    if (sqe == NULL) return 0;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = TAG_ACCEPT; // 以 user_data 指定要取消的操作
+    sqe->user_data = TAG_CANCEL;
+    g_accept_paused = 1;
+    return 1;
+}
+
+/**
+ * 連線表滿了 (例如被司機長連線佔滿)：取消 multishot accept，空出位置後由主迴圈重新提交。
+ * 不取消的話核心會繼續把新連線交給這個 Worker，只能一條條關掉。
+ */
+static void pause_accept(Uring *ring) {
+    if (cancel_accept(ring)) log_warn("[Dispatcher %d] io_uring connection table full, pausing accept.", getpid());
+}
+
+static void arm_close(Uring *ring, UringConn *conn);
+static void driver_conn_kill(Uring *ring, UringConn *conn);
+
+/**
+ * 掛上 recv。SQ 滿了時關閉連線 (沒有 recv 的連線不會再有任何事件，fd 與連線表位置會一直佔著)。
+ */
+static void arm_recv(Uring *ring, UringConn *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, 1);
+    if (sqe == NULL) {
+        if (conn->is_driver) {
+            driver_channel_detach(&conn->session.driver);
+            driver_conn_kill(ring, conn); // 可能還有 send 在途，等它完成才關閉
+        } else {
+            arm_close(ring, conn);
+        }
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->len = URING_BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | TAG_RECV;
+    conn->recv_armed = 1;
+}
+
+static void arm_notify(Uring *ring) {
+    int efd = driver_channel_eventfd();
+    if (efd < 0) return;
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, 1);
+    if (sqe == NULL) {
+        g_notify_rearm = 1; // 不重掛的話之後的派單推播都收不到
+        return;
+    }
+    g_notify_rearm = 0;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = efd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = TAG_NOTIFY;
+}
+
+static void arm_close(Uring *ring, UringConn *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, 1);
+    if (sqe == NULL) {
+        close(conn->fd); // SQ 滿了：同步關閉
+        conn_free(conn);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = conn->fd;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | TAG_CLOSE;
+}
+
+/**
+ * 送出回覆；close_after 時串接 close (送完由核心關閉，不必再回到使用者空間)。
+ */
+static void arm_send(Uring *ring, UringConn *conn, int close_after) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, close_after ? 2 : 1);
+    if (sqe == NULL) {
+        // SQ 滿了：退回同步送出
+        uint64_t t0 = metrics_now();
+        send_n(conn->fd, conn->out.data, conn->out.len);
+        if (!conn->is_driver) {
+            span_set_current(conn->session.trace_id);
+            metrics_stage(STAGE_SEND, t0);
+            span_set_current(0);
+        }
+        if (close_after) {
+            close(conn->fd);
+            conn_free(conn);
+        } else if (!conn->is_driver) {
+            arm_recv(ring, conn); // 司機長連線的 recv 一直掛著
+        }
+        return;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)conn->out.data;
+    sqe->len = (uint32_t)conn->out.len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL; // WAITALL：短寫由核心自行重試，不會斷開串接
+    sqe->user_data = (uint64_t)(uintptr_t)conn | TAG_SEND;
+    conn->send_t0 = metrics_now();
+    conn->send_armed = 1;
+
+    conn->closing = close_after;
+    if (close_after) {
+        sqe->flags = IOSQE_IO_LINK;
+        arm_close(ring, conn);
+    }
+}
+
+/**
+ * 把收到的資料切成 Frame 交給 dispatch_frame。
+ * 連線緩衝區是空的 (常見情況) 時直接在 Provided buffer 上解析，只有殘餘的不完整 Frame 才複製。
+ * return 1 = 繼續讀取, 0 = 送出回覆後關閉, -1 = 協定錯誤 (直接關閉), DISPATCH_HOLD_DRIVER = 轉為司機長連線
+ */
+static int conn_feed(UringConn *conn, uint8_t *data, size_t len) {
+    uint8_t *src = data;
+    size_t avail = len;
+
+    if (conn->in_len > 0) {
+        if (conn->in_len + len > sizeof(conn->in_buf)) return -1;
+        memcpy(conn->in_buf + conn->in_len, data, len);
+        conn->in_len += len;
+        src = conn->in_buf;
+        avail = conn->in_len;
+    }
+
+    conn->out.len = 0;
+    while (1) {
+        ProtocolHeader header;
+        ssize_t frame_len = frame_parse(src, avail, &header);
+        if (frame_len < 0) return -1;
+        if (frame_len == 0) break;
+
+        // 多條連線交錯處理：每個 Frame 前後切換目前的 trace ID
+        span_set_current(conn->session.trace_id);
+        int keep_open = dispatch_frame(&conn->session, &header, src + sizeof(ProtocolHeader), &conn->out);
+        span_set_current(0);
+        src += frame_len;
+        avail -= frame_len;
+        if (keep_open != 1) return keep_open;
+    }
+
+    if (avail > sizeof(conn->in_buf)) return -1;
+    memmove(conn->in_buf, src, avail);
+    conn->in_len = avail;
+    return 1;
+}
+
+//  D. 司機長連線
+/**
+ * 長連線要關閉：等 recv / send 都結束才真正關閉 (shutdown 讓掛著的 recv 立刻以 EOF 完成)。
+ */
+static void driver_conn_kill(Uring *ring, UringConn *conn) {
+    conn->dead = 1;
+    if (conn->recv_armed) {
+        shutdown(conn->fd, SHUT_RDWR);
+    } else if (!conn->send_armed) {
+        arm_close(ring, conn);
+    }
+}
+
+/**
+ * 推播信箱中的新派單 (同一條連線同時只有一個 send)。
+ */
+static void driver_conn_push(Uring *ring, UringConn *conn) {
+    conn->push_pending = 0;
+    conn->out.len = 0;
+    if (dispatch_driver_push(&conn->session, &conn->out) < 0) {
+        driver_conn_kill(ring, conn); // 司機已在別處重新連線
+        return;
+    }
+    if (conn->out.len > 0) arm_send(ring, conn, 0);
+}
+
+/**
+ * 連線通過司機驗證：登記為長連線，確認 (與斷線期間未送出的派單) 一起送出。
+ */
+static void driver_conn_hold(Uring *ring, UringConn *conn) {
+    void *replaced;
+    if (driver_channel_attach(&conn->session.driver, conn->session.attach_driver_id, conn, &replaced) < 0) {
+        arm_close(ring, conn);
+        return;
+    }
+    if (replaced != NULL) driver_conn_kill(ring, replaced); // 同一位司機的舊連線 (斷線重連)
+    conn->is_driver = 1;
+    dispatch_driver_push(&conn->session, &conn->out);
+    arm_recv(ring, conn); // 長連線期間一直掛著 recv，用來偵測司機斷線
+    if (conn->dead) return; // SQ 滿了，arm_recv 已經關閉連線
+    arm_send(ring, conn, 0);
+}
+
+static void on_driver_recv(Uring *ring, UringConn *conn, struct io_uring_cqe *cqe) {
+    if (cqe->res > 0) {
+        // 目前司機不會在長連線上送資料：丟棄並繼續等待
+        uring_buf_recycle(ring, (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+        if (!conn->dead) {
+            arm_recv(ring, conn);
+            return;
+        }
+    }
+    driver_channel_detach(&conn->session.driver);
+    driver_conn_kill(ring, conn);
+}
+
+static void on_driver_send(Uring *ring, UringConn *conn, struct io_uring_cqe *cqe) {
+    if (conn->dead || cqe->res < (int)conn->out.len) {
+        driver_conn_kill(ring, conn);
+    } else if (conn->push_pending) {
+        driver_conn_push(ring, conn);
+    }
+}
+
+static void on_notify(Uring *ring) {
+    arm_notify(ring); // poll 是一次性的，先重新掛上
+
+    void *conns[MAX_DRIVERS];
+    int n = driver_channel_drain(conns);
+    for (int i = 0; i < n; i++) {
+        UringConn *conn = conns[i];
+        if (conn->dead) continue;
+        if (conn->send_armed) {
+            conn->push_pending = 1;
+        } else {
+            driver_conn_push(ring, conn);
+        }
+    }
+}
+
+//  E. 完成事件處理
+static void on_accept(Uring *ring, int server_fd, struct io_uring_cqe *cqe) {
+    // multishot accept 失效 (錯誤或核心決定停止) 時重新提交；暫停中 (被取消) 則等主迴圈恢復
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        g_accept_live = 0;
+        if (!g_accept_paused) arm_accept(ring, server_fd);
+    }
+    if (cqe->res < 0) return;
+
+    int client_fd = cqe->res;
+    uint64_t accepted_ns = metrics_now();
+    // 准入控制：同一來源 IP 連線過量時，在任何加密運算之前直接關閉
+    if (check_peer_admission_fd(client_fd)) {
+        close(client_fd);
+        return;
+    }
+
+    UringConn *conn = conn_alloc(client_fd);
+    if (conn == NULL) {
+        log_warn("[Dispatcher %d] io_uring connection table full, dropping connection.", getpid());
+        close(client_fd);
+        return;
+    }
+    conn->accepted_ns = accepted_ns;
+    if (conn->session.trace_id != 0) span_record(conn->session.trace_id, SPAN_ACCEPT, accepted_ns, metrics_now());
+    arm_recv(ring, conn);
+    if (g_free_conns == NULL) pause_accept(ring);
+}
+
+static void on_recv(Uring *ring, UringConn *conn, struct io_uring_cqe *cqe) {
+    conn->recv_armed = 0;
+    if (cqe->res == -ENOBUFS) {
+        arm_recv(ring, conn); // 暫時沒有空的 Provided buffer：重新排隊等待
+        return;
+    }
+    if (conn->is_driver) {
+        on_driver_recv(ring, conn, cqe);
+        return;
+    }
+    if (cqe->res <= 0) {
+        arm_close(ring, conn); // 連線斷開或錯誤
+        return;
+    }
+
+    unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    int state = conn_feed(conn, ring->buf_base + (size_t)bid * URING_BUF_SIZE, (size_t)cqe->res);
+    uring_buf_recycle(ring, bid); // 資料已處理或複製完畢，立刻歸還
+
+    if (state < 0) {
+        arm_close(ring, conn);
+    } else if (state == DISPATCH_HOLD_DRIVER) {
+        driver_conn_hold(ring, conn);
+    } else if (conn->out.len > 0) {
+        arm_send(ring, conn, state == 0);
+    } else if (state == 0) {
+        arm_close(ring, conn);
+    } else {
+        arm_recv(ring, conn);
+    }
+}
+
+static void on_send(Uring *ring, UringConn *conn, struct io_uring_cqe *cqe) {
+    conn->send_armed = 0;
+    if (conn->is_driver) {
+        on_driver_send(ring, conn, cqe);
+        return;
+    }
+    span_set_current(conn->session.trace_id);
+    metrics_stage(STAGE_SEND, conn->send_t0);
+    span_set_current(0);
+    if (conn->closing) return; // 串接的 close 會接著完成 (send 失敗時 close 會被取消)
+    if (cqe->res < (int)conn->out.len) {
+        arm_close(ring, conn);
+        return;
+    }
+    arm_recv(ring, conn); // 回覆送完，等待下一個 Frame (例如握手後的業務請求)
+}
+
+static void on_close(UringConn *conn, struct io_uring_cqe *cqe) {
+    if (cqe->res == -ECANCELED) close(conn->fd); // 串接的 send 失敗，close 被取消：自行關閉
+    conn_free(conn);
+}
+
+/**
+ * 處理 CQ 中所有已完成的事件。
+ * return 處理的事件數
+ */
+static unsigned uring_reap(Uring *ring, int server_fd) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned handled = 0;
+    if (head == tail) return 0;
+
+    // 忙碌時間只算處理完成事件的期間：閒置的司機長連線 / keep-alive 連線不算
+    worker_pool_set_active(1);
+    while (head != tail) {
+        struct io_uring_cqe cqe = ring->cqes[head & *ring->cq_mask];
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE); // 先歸還 CQ 位置，處理時可能產生新的完成事件
+        handled++;
+
+        UringConn *conn = (UringConn *)(uintptr_t)(cqe.user_data & ~TAG_MASK);
+        switch (cqe.user_data & TAG_MASK) {
+            case TAG_ACCEPT: on_accept(ring, server_fd, &cqe); break;
+            case TAG_RECV:   on_recv(ring, conn, &cqe); break;
+            case TAG_SEND:   on_send(ring, conn, &cqe); break;
+            case TAG_CLOSE:  on_close(conn, &cqe); break;
+            case TAG_NOTIFY: on_notify(ring); break;
+            case TAG_CANCEL: break;
+        }
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    }
+    worker_pool_set_active(0);
+    return handled;
+}
+
+//  F. 對外介面
+int uring_dispatcher_supported(void) {
+    Uring ring;
+    if (uring_setup(&ring, 4) < 0) return 0; // 包含 Provided buffer ring 註冊 (5.19+，與 multishot accept 同版)
+
+    size_t probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_len);
+    int supported = 0;
+    if (probe != NULL && sys_io_uring_register(ring.fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        static const int needed[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_CLOSE,
+                                      IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL };
+        supported = 1;
+        for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+                supported = 0;
+            }
+        }
+    }
+    free(probe);
+    uring_teardown(&ring);
+    return supported;
+}
+
+int uring_dispatcher_loop(int server_fd) {
+    Uring ring;
+    if (uring_setup(&ring, URING_ENTRIES) < 0) {
+        log_error("[Dispatcher %d] io_uring setup failed: %s", getpid(), strerror(errno));
+        return -1;
+    }
+
+    g_conns = calloc(URING_MAX_CONNS, sizeof(UringConn));
+    if (g_conns == NULL) {
+        uring_teardown(&ring);
+        return -1;
+    }
+    g_free_conns = NULL;
+    for (int i = URING_MAX_CONNS - 1; i >= 0; i--) {
+        g_conns[i].fd = -1;
+        g_conns[i].next_free = g_free_conns;
+        g_free_conns = &g_conns[i];
+    }
+    g_active_conns = 0;
+
+    arm_accept(&ring, server_fd);
+    arm_notify(&ring);
+
+    int retiring = 0;
+    while (1) {
+        // 有事件就先處理；新產生的 SQE 在下一輪一起提交 (一次 io_uring_enter 涵蓋整批)
+        unsigned handled = uring_reap(&ring, server_fd);
+        // 退休：先取消 accept (已經 accept 的連線照常處理)，取消確實完成且沒有連線時才結束
+        if (!retiring && worker_pool_retiring()) {
+            retiring = 1;
+            g_accept_rearm = 0;
+            if (!cancel_accept(&ring) && !g_accept_paused) retiring = 0; // SQ 滿了，下一輪再試
+        }
+        if (retiring && !g_accept_live && g_active_conns == 0) break;
+        if (g_accept_paused && g_free_conns != NULL && !retiring) {
+            g_accept_paused = 0;
+            arm_accept(&ring, server_fd);
+        } else if (g_accept_rearm && !g_accept_paused && !retiring) {
+            arm_accept(&ring, server_fd);
+        }
+        if (g_notify_rearm) arm_notify(&ring);
+        if (g_accept_rearm || g_notify_rearm) {
+            // SQ 仍然滿：先提交，稍等再重試 (不能阻塞等待，可能再也沒有完成事件叫醒這個迴圈)
+            if (uring_submit(&ring, 0) < 0) break;
+            usleep(URING_REARM_US);
+            continue;
+        }
+        if (handled > 0 || ring.to_submit > 0) {
+            if (uring_submit(&ring, 0) < 0) break;
+            continue;
+        }
+
+        // 完全閒置：補充密鑰池，補完一批就回頭檢查完成事件
+        if (dispatcher_refill_keypool()) continue;
+
+        if (uring_submit(&ring, 1) < 0) break;
+    }
+
+    if (retiring) {
+        uring_teardown(&ring);
+        free(g_conns);
+        g_conns = NULL;
+        return 0;
+    }
+
+    // Ring 致命錯誤：關閉所有連線，讓呼叫端退回傳統迴圈
+    log_error("[Dispatcher %d] io_uring_enter failed: %s", getpid(), strerror(errno));
+    uring_teardown(&ring);
+    for (int i = 0; i < URING_MAX_CONNS; i++) {
+        if (g_conns[i].fd >= 0) {
+            driver_channel_detach(&g_conns[i].session.driver);
+            close(g_conns[i].fd);
+        }
+    }
+    free(g_conns);
+    g_conns = NULL;
+    return -1;
+}
@@ -0,0 +1,260 @@
+/* src/server/worker_pool.c */
+// Dispatcher 進程池：格子的狀態放在共享記憶體 (ride_top 看得到)，增減的決策只在 Coordinator 主執行緒
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "../../common/include/log_system.h"
+#include "../include/driver_channel.h"
+#include "../include/worker_pool.h"
+
+extern SharedState *g_shared_state;
+
+WorkerSlot *g_pool_self = NULL;
+
+static int g_pool_min = POOL_DEFAULT_MIN;
+static int g_pool_max = POOL_MAX_WORKERS;
+static int g_pool_idle_secs = POOL_DEFAULT_IDLE_SECS;
+
+// 以下只有 Coordinator 主執行緒使用
+static int g_pool_server_fd = -1;
+static WorkerSpawnFn g_pool_spawn = NULL;
+static uint64_t g_prev_busy[POOL_MAX_WORKERS];  // 上一個 tick 看到的各格累計忙碌時間
+static uint64_t g_prev_tick_ns = 0;
+static uint64_t g_calm_since_ns = 0;            // 忙碌比例開始低於回收門檻的時間 (0 = 目前不清閒)
+
+void worker_pool_configure(int min_workers, int max_workers, int idle_secs) {
+    if (max_workers < 1 || max_workers > POOL_MAX_WORKERS) max_workers = POOL_MAX_WORKERS;
+    if (min_workers < 1) min_workers = 1;
+    if (min_workers > max_workers) min_workers = max_workers;
+    g_pool_min = min_workers;
+    g_pool_max = max_workers;
+    g_pool_idle_secs = idle_secs < 0 ? 0 : idle_secs;
+}
+
+//  A. Coordinator 端
+/**
+ * 清空格子並 fork 一個 Worker (清空必須在 fork 之前，子進程一啟動就可能寫入自己的欄位)。
+ * return 0 = 成功, -1 = fork 失敗 (格子保持原狀，下一個 tick 再試)
+ */
+static int spawn_into(int slot, uint64_t now) {
+    WorkerSlot *ws = &g_shared_state->pool.slots[slot];
+    uint32_t respawn = ws->respawn;
+    memset(ws, 0, sizeof(WorkerSlot));
+    ws->idle_since_ns = now;
+    ws->started_ns = now;
+    g_prev_busy[slot] = 0;
+
+    pid_t pid = g_pool_spawn(slot);
+    if (pid < 0) {
+        ws->respawn = respawn;
+        log_error("Dispatcher pool: fork for slot %d failed: %s", slot, strerror(errno));
+        return -1;
+    }
+    __atomic_store_n(&ws->pid, pid, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int worker_pool_start(int server_fd, WorkerSpawnFn spawn) {
+    WorkerPool *pool = &g_shared_state->pool;
+    memset(pool, 0, sizeof(WorkerPool));
+    pool->min_workers = (uint32_t)g_pool_min;
+    pool->max_workers = (uint32_t)g_pool_max;
+    pool->idle_secs = (uint32_t)g_pool_idle_secs;
+    g_pool_server_fd = server_fd;
+    g_pool_spawn = spawn;
+
+    uint64_t now = metrics_now();
+    int started = 0;
+    for (int i = 0; i < g_pool_min; i++) {
+        if (spawn_into(i, now) == 0) started++;
+    }
+    pool->live = (uint32_t)started;
+    g_prev_tick_ns = now;
+    return started;
+}
+
+void worker_pool_exited(pid_t pid, int status) {
+    WorkerPool *pool = &g_shared_state->pool;
+    int slot = -1;
+    for (int i = 0; i < POOL_MAX_WORKERS; i++) {
+        if (pool->slots[i].pid == pid) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) return;
+    WorkerSlot *ws = &pool->slots[slot];
+
+    // 不論原因，這個進程持有的司機長連線都已經斷了；它在 log 緩衝區寫到一半的行也不會再發布
+    driver_channel_release_worker(slot);
+    int lost = log_reclaim_ring(slot + 1);
+    if (lost > 0) log_warn("Dispatcher pool: reclaimed %d unpublished log lines from worker %d (slot %d).", lost, pid, slot);
+    int clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    if (ws->retire) {
+        if (clean) {
+            log_info("Dispatcher pool: worker %d (slot %d) retired.", pid, slot);
+        } else {
+            log_warn("Dispatcher pool: retiring worker %d (slot %d) ended abnormally (status 0x%x).", pid, slot, status);
+        }
+        pool->retired++;
+        ws->retire = 0;
+        ws->active = 0;
+        __atomic_store_n(&ws->pid, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    if (WIFSIGNALED(status)) {
+        log_warn("Dispatcher pool: worker %d (slot %d) killed by signal %d; respawning.", pid, slot, WTERMSIG(status));
+    } else {
+        log_warn("Dispatcher pool: worker %d (slot %d) exited with status %d; respawning.",
+                 pid, slot, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+    ws->active = 0;
+    ws->respawn = 1; // 下一個 tick 才重新 fork：一啟動就崩潰的 Worker 每格每秒最多重生 1000 / POOL_TICK_MS 次
+    __atomic_store_n(&ws->pid, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * 監聽 socket 的 accept 佇列 (LISTEN 狀態的 TCP_INFO：unacked = 目前長度，sacked = 上限)。
+ */
+static void read_accept_queue(WorkerPool *pool) {
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(g_pool_server_fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) return;
+    pool->accept_queue = info.tcpi_unacked;
+    pool->accept_backlog = info.tcpi_sacked;
+}
+
+/**
+ * 選出閒置最久、沒有司機長連線的 Worker 並要求退休。
+ */
+static void retire_one(WorkerPool *pool, uint64_t now) {
+    int best = -1;
+    for (int i = 0; i < POOL_MAX_WORKERS; i++) {
+        WorkerSlot *ws = &pool->slots[i];
+        if (ws->pid <= 0 || ws->retire) continue;
+        if (__atomic_load_n(&ws->active, __ATOMIC_RELAXED) != 0) continue;
+        if (driver_channel_owned(i) > 0) continue;
+        if (best < 0 || ws->idle_since_ns < pool->slots[best].idle_since_ns) best = i;
+    }
+    if (best < 0) return;
+
+    WorkerSlot *ws = &pool->slots[best];
+    ws->retire = 1;
+    kill(ws->pid, POOL_RETIRE_SIGNAL);
+    log_info("Dispatcher pool: retiring worker %d (slot %d, idle %.1f s, utilization %.0f%%).",
+             ws->pid, best, (now - ws->idle_since_ns) / 1e9, pool->utilization * 100.0);
+}
+
+void worker_pool_tick(void) {
+    if (g_pool_spawn == NULL) return;
+    WorkerPool *pool = &g_shared_state->pool;
+    uint64_t now = metrics_now();
+
+    // 1. 補上異常結束的 Worker
+    for (int i = 0; i < POOL_MAX_WORKERS; i++) {
+        if (pool->slots[i].respawn && spawn_into(i, now) == 0) pool->respawned++;
+    }
+
+    // 2. 負載：忙碌比例 = 各 Worker 忙碌時間的增量 / (Worker 數 x 經過時間)
+    int live = 0;
+    int busy = 0;
+    uint64_t busy_delta = 0;
+    for (int i = 0; i < POOL_MAX_WORKERS; i++) {
+        WorkerSlot *ws = &pool->slots[i];
+        if (ws->pid <= 0) continue;
+        if (ws->retire) {
+            kill(ws->pid, POOL_RETIRE_SIGNAL); // 訊號可能剛好落在檢查旗標與進入 accept 之間，每個 tick 再送一次
+            continue;
+        }
+        live++;
+        uint64_t total = __atomic_load_n(&ws->busy_ns, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&ws->active, __ATOMIC_RELAXED) != 0) {
+            busy++;
+            uint64_t since = __atomic_load_n(&ws->busy_since_ns, __ATOMIC_RELAXED);
+            if (now > since) total += now - since;
+        }
+        if (total > g_prev_busy[i]) busy_delta += total - g_prev_busy[i];
+        g_prev_busy[i] = total;
+    }
+    read_accept_queue(pool);
+
+    uint64_t elapsed = now - g_prev_tick_ns;
+    g_prev_tick_ns = now;
+    if (live > 0 && elapsed > 0) {
+        double sample = (double)busy_delta / ((double)live * (double)elapsed);
+        if (sample > 1.0) sample = 1.0;
+        pool->utilization = pool->utilization * 0.7 + sample * 0.3;
+    }
+    pool->live = (uint32_t)live;
+    pool->busy = (uint32_t)busy;
+
+    // 3. 擴充：低於下限，或忙碌 / 有連線在 accept 佇列排隊時一次加 25% (至少補足排隊的連線數)
+    int queue = (int)pool->accept_queue;
+    int grow = 0;
+    if (live < g_pool_min) {
+        grow = g_pool_min - live;
+    } else if (queue > 0 || pool->utilization * 100.0 >= POOL_BUSY_HIGH_PCT) {
+        grow = live / 4;
+        if (grow < queue) grow = queue;
+        if (grow < 1) grow = 1;
+    }
+    if (grow > g_pool_max - live) grow = g_pool_max - live;
+
+    if (grow > 0) {
+        g_calm_since_ns = 0;
+        int added = 0;
+        for (int i = 0; i < POOL_MAX_WORKERS && added < grow; i++) {
+            if (pool->slots[i].pid != 0 || pool->slots[i].respawn) continue;
+            if (spawn_into(i, now) == 0) added++;
+        }
+        if (added > 0) {
+            pool->spawned += (uint64_t)added;
+            pool->live += (uint32_t)added;
+            log_info("Dispatcher pool: +%d workers (%d live, utilization %.0f%%, accept queue %d).",
+                     added, live + added, pool->utilization * 100.0, queue);
+        }
+        return;
+    }
+
+    // 4. 回收：清閒持續 idle 秒數後，每個 tick 讓一個 Worker 退休，直到回到下限或不再清閒
+    if (queue == 0 && live > g_pool_min && pool->utilization * 100.0 < POOL_BUSY_LOW_PCT) {
+        if (g_calm_since_ns == 0) g_calm_since_ns = now;
+        if (now - g_calm_since_ns >= (uint64_t)g_pool_idle_secs * 1000000000ULL) retire_one(pool, now);
+    } else {
+        g_calm_since_ns = 0;
+    }
+}
+
+void worker_pool_kill_all(int sig) {
+    if (g_shared_state == NULL) return;
+    for (int i = 0; i < POOL_MAX_WORKERS; i++) {
+        pid_t pid = g_shared_state->pool.slots[i].pid;
+        if (pid > 0) kill(pid, sig);
+    }
+}
+
+//  B. Worker 端
+static void on_retire_signal(int sig) {
+    (void)sig; // 只是為了打斷阻塞中的系統呼叫，旗標在共享記憶體裡
+}
+
+void worker_pool_attach(int slot) {
+    g_pool_self = &g_shared_state->pool.slots[slot];
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_retire_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(POOL_RETIRE_SIGNAL, &sa, NULL);
+}